@@ -14,7 +14,8 @@
 #include <lvgl_input_device.h>
 
 #include <stdio.h>
-// #include "bsp.h"
+#include "bsp.h"
+#include "bsp_boot.h"
 
 lv_obj_t *screen;
 static lv_obj_t * label;
@@ -67,10 +68,13 @@ int main(void)
 	lv_obj_t *hello_world_label;
 	char count_str[20] = {0};
 
+	bsp_boot_mark("main");
+
 	Display_dev = DEVICE_DT_GET(DT_CHOSEN(zephyr_display));
 	if (!device_is_ready(Display_dev)) {
 		return 0;
 	}
+	bsp_boot_mark("display ready");
   
 
 	#ifdef CONFIG_GPIO
@@ -125,8 +129,17 @@ int main(void)
 	random_lvgl_stuff_to_play_with();
 	lv_scr_load(lv_scr_act());
 	
+	bsp_boot_mark("first lv_task_handler");
 	lv_task_handler();
+	bsp_boot_mark("first frame rendered");
 	display_blanking_off(Display_dev);
+	bsp_boot_done("display_blanking_off");
+
+	/* Buttons and LEDs come up on the BSP work queue behind the first screen */
+	int err = bsp_init_wait(BSP_INIT_BUTTONS | BSP_INIT_LEDS, K_MSEC(500));
+	if (err) {
+		printf("BSP buttons/LEDs not ready (err %d)\n", err);
+	}
 	
 	while (1) {	
 		sprintf(count_str, "Hello World! %d", count);
@@ -2,6 +2,7 @@
 #include <zephyr/kernel.h>
 
 #include "bsp.h" // Board Support Package
+#include "bsp_boot.h"
 
 #include <zephyr/drivers/gpio.h>
 #include <zephyr/sys/reboot.h>
@@ -15,6 +16,11 @@
 #include <zephyr/logging/log.h>
 
 #include "app/drivers/nafe13388.h"
+
+#ifdef CONFIG_BSP_TELEM
+#include "bsp_telem.h"
+#endif
+
 #ifndef CONFIG_VE_SIM
 LOG_MODULE_REGISTER(bsp, CONFIG_LOG_DEFAULT_LEVEL);
 
@@ -75,6 +81,10 @@ LOG_MODULE_REGISTER(bsp, CONFIG_LOG_DEFAULT_LEVEL);
 #define FUSB_REG_CONTROL1_ENABLE 0x08
 #define FUSB_REG_DEVICE_ID_VAL 0x10
 
+/*****************************************************************************/
+/* Deferred init */
+#define INIT_EVT_FAILED(parts) ((parts) << 16)
+
 /*****************************************************************************/
 /* Private objects */
 static struct gpio_dt_spec const l_led_red = GPIO_DT_SPEC_GET(LED_RED, gpios);
@@ -121,6 +131,15 @@ static const struct device *i2c = DEVICE_DT_GET(I2C_NODE);
 static const struct device *digital_in_port = DEVICE_DT_GET(DIGITAL_IN_PORT);
 static const struct device *drv8844 = DEVICE_DT_GET(DRV8844);
 
+// I2C peripherals are brought up here after bsp_init() returned
+static K_THREAD_STACK_DEFINE(bsp_workq_stack, CONFIG_BSP_INIT_THREAD_STACK_SIZE);
+static struct k_work_q bsp_workq;
+static bool bsp_workq_started;
+static struct k_work buttons_init_job;
+static struct k_work usb_init_job;
+static struct k_work leds_init_job;
+static K_EVENT_DEFINE(init_events);
+
 // Input buttons user callback
 static on_input_button_changed_cb_t on_input_button_changed_cb = NULL;
 
@@ -130,6 +149,10 @@ struct input_button_changed_work_ {
     int state;
 } input_button_changed_work;
 
+// Interrupt times of the last edges
+static bsp_ts_t button_ts[INPUT_BUTTON_MAX];
+static bsp_ts_t din_ts[BOARD_DIGITAL_INPUTS_COUNT];
+
 // Work function to invoke callback on workqueue thread
 static void invoke_user_input_button_cb(struct k_work *item)
 {
@@ -167,6 +190,7 @@ void reset_button_pressed(void)
 // GPIO Interrupt handler
 void button_pressed(const struct device *dev, struct gpio_callback *cb, uint32_t pins)
 {
+    bsp_ts_t ts = bsp_ts_now();
     input_button_t button = INPUT_BUTTON_0;
 
     // Which button has been pressed?
@@ -205,6 +229,7 @@ void button_pressed(const struct device *dev, struct gpio_callback *cb, uint32_t
         state = -1;
     }
 
+    button_ts[button] = ts;
     input_button_changed_work.button = button;
     input_button_changed_work.state = state;
     k_work_submit(&input_button_changed_work.work);
@@ -237,9 +262,17 @@ void usb_id_input_changed(const struct device *dev, struct gpio_callback *cb, ui
 // GPIO Interrupt handler
 void digital_in_changed(const struct device *dev, struct gpio_callback *cb, uint32_t pins)
 {
+    bsp_ts_t ts = bsp_ts_now();
     gpio_port_value_t port_val;
     gpio_port_get_raw(dev, &port_val);
 
+    // Digital in n+1 is on GPIO13 pins 3+2n and 4+2n
+    for (int i = 0; i < BOARD_DIGITAL_INPUTS_COUNT; i++) {
+        if (pins & (0b11 << (3 + 2 * i))) {
+            din_ts[i] = ts;
+        }
+    }
+
     uint8_t digital_in_1 = (port_val >> 3) & 0b11; // Digital in 1: GPIO13 3 and 4
     uint8_t digital_in_2 = (port_val >> 5) & 0b11; // Digital in 2: GPIO13 5 and 6
     uint8_t digital_in_3 = (port_val >> 7) & 0b11; // Digital in 3: GPIO13 7 and 8
@@ -250,12 +283,152 @@ void digital_in_changed(const struct device *dev, struct gpio_callback *cb, uint
     // ob11 - undefined
     LOG_INF("DIN1: 0x%02X, DIN2: 0x%02X, DIN3: 0x%02X, DIN4: 0x%02X", digital_in_1, digital_in_2,
             digital_in_3, digital_in_4);
+
+#ifdef CONFIG_BSP_TELEM
+    const uint8_t lines[BOARD_DIGITAL_INPUTS_COUNT] = {digital_in_1, digital_in_2, digital_in_3,
+                                                       digital_in_4};
+    uint8_t din = 0;
+    uint8_t valid = 0;
+
+    for (int i = 0; i < BOARD_DIGITAL_INPUTS_COUNT; i++) {
+        din |= (lines[i] == 0b10) << i;
+        valid |= (lines[i] == 0b10 || lines[i] == 0b01) << i;
+    }
+
+    bsp_telem_din(ts, din, valid);
+#endif
+}
+
+/*****************************************************************************/
+/* Deferred init */
+static void init_done(uint32_t part, int err, const char *milestone)
+{
+    if (err) {
+        LOG_ERR("BSP init part 0x%x failed (err %d)", part, err);
+        k_event_post(&init_events, part | INIT_EVT_FAILED(part));
+        return;
+    }
+
+    bsp_boot_mark(milestone);
+    k_event_post(&init_events, part);
 }
 
 /*****************************************************************************/
+// A job still queued or running from an earlier bsp_init() is left alone,
+// re-initialising it would corrupt the queue
+static void init_job_submit(struct k_work *work, k_work_handler_t handler, uint32_t part,
+                            const struct device *dev)
+{
+    if (k_work_busy_get(work) != 0) {
+        return;
+    }
+
+    k_work_init(work, handler);
+    k_event_clear(&init_events, part | INIT_EVT_FAILED(part));
+
+    if (!device_is_ready(dev)) {
+        init_done(part, -ENODEV, NULL);
+        return;
+    }
+
+    k_work_submit_to_queue(&bsp_workq, work);
+}
+
+/*****************************************************************************/
+// Runs on the BSP work queue, the expander is behind I2C
+static void buttons_init_work(struct k_work *item)
+{
+    ARG_UNUSED(item);
+
+    struct gpio_dt_spec const button_inputs[BUTTON_INPUTS_COUNT] = {
+        board_button_0, board_button_1, board_button_2, board_button_3, board_button_4};
+    int err = 0;
+
+    for (int i = 0; i < BUTTON_INPUTS_COUNT; i++) {
+        int ret = gpio_pin_configure_dt(&button_inputs[i], GPIO_INPUT);
+        if (!ret) {
+            ret = gpio_pin_interrupt_configure_dt(&button_inputs[i], GPIO_INT_EDGE_FALLING);
+        }
+
+        gpio_init_callback(&button_cb_data[i], button_pressed, BIT(button_inputs[i].pin));
+        if (!ret) {
+            ret = gpio_add_callback(button_inputs[i].port, &button_cb_data[i]);
+        }
+        err = err ? err : ret;
+    }
+
+    init_done(BSP_INIT_BUTTONS, err, "bsp buttons ready");
+}
+
+/*****************************************************************************/
+static void usb_init_work(struct k_work *item)
+{
+    ARG_UNUSED(item);
+
+    /* Read device ID */
+    uint8_t fusb_id = 0x0;
+    int err = i2c_reg_read_byte(i2c, FUSB_I2C_ADDR, FUSB_REG_DEVICE_ID, &fusb_id);
+    if (err) {
+        LOG_ERR("Failed to read FUSB ID (err %i)", err);
+    } else {
+        LOG_DBG("FUSB ID 0x%02X", fusb_id);
+    }
+
+    if (fusb_id != FUSB_REG_DEVICE_ID_VAL) {
+        LOG_ERR("FUSB Device ID not correct, expected 0x%02X", FUSB_REG_DEVICE_ID_VAL);
+    }
+
+    /* Set CONTROL1.ENABLE bit */
+    int ret = i2c_reg_write_byte(i2c, FUSB_I2C_ADDR, FUSB_REG_CONTROL1,
+                                 (FUSB_REG_CONTROL1_DEFAULT | FUSB_REG_CONTROL1_ENABLE));
+    if (ret) {
+        LOG_ERR("Failed to set FUSB303's CONTROL1.ENABLE bit!");
+        err = err ? err : ret;
+    }
+
+    /* Configure USB ID as input */
+    ret = gpio_pin_configure_dt(&usb_id_input, GPIO_INPUT);
+    if (!ret) {
+        ret = gpio_pin_interrupt_configure_dt(&usb_id_input, GPIO_INT_EDGE_BOTH);
+    }
+    gpio_init_callback(&usb_id_input_cb_data, usb_id_input_changed, BIT(usb_id_input.pin));
+    if (!ret) {
+        ret = gpio_add_callback(usb_id_input.port, &usb_id_input_cb_data);
+    }
+
+    init_done(BSP_INIT_USB, err ? err : ret, "bsp usb ready");
+}
+
+/*****************************************************************************/
+// Three I2C transfers per LED
+static void leds_init_work(struct k_work *item)
+{
+    ARG_UNUSED(item);
+
+    uint8_t color[] = {23, 194, 255};
+    int err = 0;
+
+    for (int i = 0; i < 5; i++) {
+        int ret = led_set_color(button_led_driver, i, 3, color);
+        if (!ret) {
+            ret = led_on(button_led_driver, i);
+        }
+        if (!ret) {
+            ret = led_set_brightness(button_led_driver, i, 5);
+        }
+        err = err ? err : ret;
+    }
+
+    init_done(BSP_INIT_LEDS, err, "bsp leds ready");
+}
 
+/*****************************************************************************/
+// Power rails, display reset and SoC pins only. The I2C peripherals are
+// brought up on the BSP work queue, so the display starts meanwhile.
 int bsp_init(void)
 {
+    bsp_boot_mark("bsp_init");
+
     /**************************************************************************/
     /* GPIOs */
     int ret = gpio_pin_configure_dt(&l_led_red, GPIO_OUTPUT_ACTIVE);
@@ -285,28 +458,11 @@ int bsp_init(void)
     ret = gpio_pin_configure_dt(&nafe_pwr_en, GPIO_OUTPUT_INACTIVE);
     //__ASSERT(ret >= 0, "Failed configuring nafe_pwr_en");
 
-    /**************************************************************************/
-    /* Board buttons on GPIO expander */
-    //__ASSERT(device_is_ready(gpio_expander), "GPIO expander not ready");
-
-    struct gpio_dt_spec const button_inputs[BUTTON_INPUTS_COUNT] = {
-        board_button_0, board_button_1, board_button_2, board_button_3, board_button_4};
-
-    for (int i = 0; i < BUTTON_INPUTS_COUNT; i++) {
-        ret = gpio_pin_configure_dt(&button_inputs[i], GPIO_INPUT);
-        //__ASSERT(ret >= 0, "Failed configuring button input %d", i);
-
-        ret = gpio_pin_interrupt_configure_dt(&button_inputs[i], GPIO_INT_EDGE_FALLING);
-        //__ASSERT(ret >= 0, "Failed configuring button input %d ISR", i);
-
-        gpio_init_callback(&button_cb_data[i], button_pressed, BIT(button_inputs[i].pin));
-        ret = gpio_add_callback(button_inputs[i].port, &button_cb_data[i]);
-        //__ASSERT(ret >= 0, "Failed adding callback to button input %d", i);
+    if (k_work_busy_get(&input_button_changed_work.work) == 0) {
+        k_work_init(&input_button_changed_work.work,
+                    invoke_user_input_button_cb); // Work submitted in buttons ISR
     }
 
-    k_work_init(&input_button_changed_work.work,
-                invoke_user_input_button_cb); // Work submitted in buttons ISR
-
     /**************************************************************************/
     /* Tri-state digital inputs in SNVS domain */
 
@@ -325,51 +481,18 @@ int bsp_init(void)
     }
 
     /**************************************************************************/
-    /* FUSB303 */
-    ret = device_is_ready(i2c);
-    //__ASSERT(ret != 0, "I2C not ready");
-
-    #ifndef CONFIG_VE_SIM
-    /* Read device ID */
-    uint8_t fusb_id = 0x0;
-    ret = i2c_reg_read_byte(i2c, FUSB_I2C_ADDR, FUSB_REG_DEVICE_ID, &fusb_id);
-    if (ret) {
-        LOG_ERR("Failed to read FUSB ID (err %i)", ret);
-    } else {
-        LOG_DBG("FUSB ID 0x%02X", fusb_id);
-    }
-
-    if (fusb_id != FUSB_REG_DEVICE_ID_VAL) {
-        LOG_ERR("FUSB Device ID not correct, expected 0x%02X", FUSB_REG_DEVICE_ID_VAL);
-    }
-
-    /* Set CONTROL1.ENABLE bit */
-    ret = i2c_reg_write_byte(i2c, FUSB_I2C_ADDR, FUSB_REG_CONTROL1,
-                             (FUSB_REG_CONTROL1_DEFAULT | FUSB_REG_CONTROL1_ENABLE));
-    if (ret) {
-        LOG_ERR("Failed to set FUSB303's CONTROL1.ENABLE bit!");
+    /* Deferred: board buttons on the GPIO expander, FUSB303, button board LEDs */
+    if (!bsp_workq_started) {
+        k_work_queue_start(&bsp_workq, bsp_workq_stack, K_THREAD_STACK_SIZEOF(bsp_workq_stack),
+                           CONFIG_BSP_INIT_THREAD_PRIORITY, NULL);
+        k_thread_name_set(&bsp_workq.thread, "bsp_workq");
+        bsp_workq_started = true;
     }
 
-    /* Configure USB ID as input */
-    ret = gpio_is_ready_dt(&usb_id_input);
-    //__ASSERT(ret >= 0, "USB ID input not ready");
-    ret = gpio_pin_configure_dt(&usb_id_input, GPIO_INPUT);
-    //__ASSERT(ret >= 0, "Failed configuring USB ID input");
-    ret = gpio_pin_interrupt_configure_dt(&usb_id_input, GPIO_INT_EDGE_BOTH);
-    //__ASSERT(ret >= 0, "Failed configuring USB ID ISR");
-    gpio_init_callback(&usb_id_input_cb_data, usb_id_input_changed, BIT(usb_id_input.pin));
-    ret = gpio_add_callback(usb_id_input.port, &usb_id_input_cb_data);
-    //__ASSERT(ret >= 0, "Failed adding callback to USB ID");
-    #endif
-    /**************************************************************************/
-    /* Button board LED driver */
-    //__ASSERT(device_is_ready(button_led_driver), "LED driver not ready");
-    for (int i = 0; i < 5; i++) {
-        uint8_t color[] = {23, 194, 255};
-        led_set_color(button_led_driver, i, 3, color);
-        led_on(button_led_driver, i);
-        led_set_brightness(button_led_driver, i, 5);
-    }
+    // One queue, the jobs share the I2C bus
+    init_job_submit(&buttons_init_job, buttons_init_work, BSP_INIT_BUTTONS, gpio_expander);
+    init_job_submit(&usb_init_job, usb_init_work, BSP_INIT_USB, i2c);
+    init_job_submit(&leds_init_job, leds_init_work, BSP_INIT_LEDS, button_led_driver);
 
     /**************************************************************************/
     /* CANFD */
@@ -382,9 +505,22 @@ int bsp_init(void)
     /**************************************************************************/
     /* Digital outputs */
     //__ASSERT(device_is_ready(drv8844), "DRV8844 not ready");
+    bsp_boot_mark("bsp_init done");
     return 0;
 }
 
+/*****************************************************************************/
+int bsp_init_wait(uint32_t parts, k_timeout_t timeout)
+{
+    uint32_t events = k_event_wait_all(&init_events, parts, false, timeout);
+
+    if ((events & parts) != parts) {
+        return -EAGAIN;
+    }
+
+    return k_event_test(&init_events, INIT_EVT_FAILED(parts)) ? -EIO : 0;
+}
+
 /*****************************************************************************/
 int bsp_red_led_on(void)
 {
@@ -644,18 +780,48 @@ int bsp_input_button_callback_set(on_input_button_changed_cb_t cb)
     return -1;
 }
 
+/*****************************************************************************/
+bsp_ts_t bsp_input_button_ts_get(input_button_t button)
+{
+    if (button >= INPUT_BUTTON_MAX) {
+        return 0;
+    }
+
+    return button_ts[button];
+}
+
+/*****************************************************************************/
+bsp_ts_t bsp_digital_input_ts_get(digital_input_t input)
+{
+    if (input >= BOARD_DIGITAL_INPUTS_COUNT) {
+        return 0;
+    }
+
+    return din_ts[input];
+}
+
 #ifdef CONFIG_BSP_AUTO_INIT
 SYS_INIT(bsp_init, APPLICATION, 32);
 #endif /* CONFIG_LV_Z_AUTO_INIT */
 
 #else /* CONFIG_VE_SIM */
 
+int bsp_init_wait(uint32_t parts, k_timeout_t timeout)
+{
+    // Nothing to bring up in the simulator
+    ARG_UNUSED(parts);
+    ARG_UNUSED(timeout);
+    return 0;
+}
+
 int bsp_nafe_power_on(void)
 {
     //nuffing
+    return 0;
 }
 int  bsp_nafe_power_off(void){
     //nuffing
+    return 0;
 }
 int  bsp_digital_out_disable(digital_output_t output){
     //nuffing
@@ -669,10 +835,38 @@ int  bsp_digital_out_pwm_set(digital_output_t output, uint32_t pulse_width_ns){
 int  bsp_digital_out_mode_set(digital_output_t output, struct digital_output_pin_mode pin_mode){
     //nuffing
 }
+int bsp_digital_out_set(digital_output_t output)
+{
+    ARG_UNUSED(output);
+    return 0;
+}
+int bsp_digital_out_reset(digital_output_t output)
+{
+    ARG_UNUSED(output);
+    return 0;
+}
+struct digital_inputs bsp_digital_inputs_get(void)
+{
+    // No digital input hardware in the simulator, all inputs read low
+    struct digital_inputs inputs = {DIGITAL_IN_LOGIC_LOW, DIGITAL_IN_LOGIC_LOW,
+                                    DIGITAL_IN_LOGIC_LOW, DIGITAL_IN_LOGIC_LOW, .err = 0};
+    return inputs;
+}
 uint8_t  check_button_pressed(void){
     //nuffing
 }
 void  reset_button_pressed(void){
     //nuffing
 }
+bsp_ts_t bsp_input_button_ts_get(input_button_t button)
+{
+    // No button hardware in the simulator, no edges
+    ARG_UNUSED(button);
+    return 0;
+}
+bsp_ts_t bsp_digital_input_ts_get(digital_input_t input)
+{
+    ARG_UNUSED(input);
+    return 0;
+}
 #endif
\ No newline at end of file
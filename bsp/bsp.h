@@ -4,11 +4,20 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+#include <zephyr/kernel.h>
+
 #include "app/drivers/drv8844.h"
+#include "bsp_ts.h"
 
 #define BOARD_DIGITAL_INPUTS_COUNT 4
 #define BOARD_DIGITAL_OUTPUTS_COUNT 4
 
+/// Parts of bsp_init() finished on the BSP work queue, for bsp_init_wait()
+#define BSP_INIT_BUTTONS BIT(0) // Board buttons on the GPIO expander
+#define BSP_INIT_USB BIT(1)     // FUSB303 enabled, USB ID interrupt
+#define BSP_INIT_LEDS BIT(2)    // Button board LEDs
+#define BSP_INIT_ALL (BSP_INIT_BUTTONS | BSP_INIT_USB | BSP_INIT_LEDS)
+
 typedef enum {
     DIGITAL_IN_1,
     DIGITAL_IN_2,
@@ -72,10 +81,18 @@ typedef enum {
 /*****************************************************************************/
 
 /// @brief Initializes the BSP. Must be called before using any other periperal-
-/// related functions in main
+/// related functions in main. Switches the power rails, resets the display and
+/// configures the SoC pins, then returns while the I2C peripherals are brought
+/// up on the BSP work queue; see bsp_init_wait().
 /// @param
 int bsp_init(void);
 
+/// @brief Blocks until deferred parts of bsp_init() finish
+/// @param parts BSP_INIT_* mask
+/// @param timeout
+/// @return 0 when all finished, -EIO if one of them failed, -EAGAIN on timeout
+int bsp_init_wait(uint32_t parts, k_timeout_t timeout);
+
 /// @brief Turns on red board LED
 /// @param
 /// @return 0 on success
@@ -112,7 +129,8 @@ int bsp_red_led_toggle(void);
 /// @return 0 on success
 int bsp_digital_input_isr_enable(digital_input_t din, bool enable);
 
-/// @brief Enables NAFE power (3.3V and +/- 15V)
+/// @brief Enables NAFE power (3.3V and +/- 15V). Only switches the rails; see
+/// bsp_nafe_start() for the complete asynchronous bring-up sequence
 /// @param
 /// @return 0 on success
 int bsp_nafe_power_on(void);
@@ -184,6 +202,18 @@ typedef int (*on_input_button_changed_cb_t)(input_button_t button, int state);
 /// @return 0 on success
 int bsp_input_button_callback_set(on_input_button_changed_cb_t cb);
 
+/// @brief Returns the time of the last edge of an input button, taken in the
+/// interrupt. Valid inside the button changed callback.
+/// @param button
+/// @return Timestamp, 0 if no edge was seen
+bsp_ts_t bsp_input_button_ts_get(input_button_t button);
+
+/// @brief Returns the time of the last edge of a digital input, taken in the
+/// interrupt
+/// @param input
+/// @return Timestamp, 0 if no edge was seen
+bsp_ts_t bsp_digital_input_ts_get(digital_input_t input);
+
 
 void set_button_pressed(uint8_t index);
 
@@ -0,0 +1,314 @@
+#include <stdio.h>
+#include <string.h>
+
+#include <zephyr/device.h>
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/util.h>
+
+#include "bsp_boot.h"
+#include "bsp_ts.h"
+
+LOG_MODULE_REGISTER(bsp_boot, CONFIG_LOG_DEFAULT_LEVEL);
+
+/*****************************************************************************/
+/* Boot log */
+#define ENTRIES_MAX CONFIG_BSP_BOOT_PROF_ENTRIES
+#define TARGET_MS CONFIG_BSP_BOOT_PROF_TARGET_MS
+#define BOOT_LOG_MAGIC 0x544F4F42 // "BOOT"
+#define LINE_LEN 80
+
+struct boot_log {
+    uint32_t magic;
+    uint32_t count;
+    uint32_t dropped; // Entries past ENTRIES_MAX
+    bool done;
+    bsp_ts_t t0;      // Start of the recording, zero of the timeline
+    struct bsp_boot_entry entries[ENTRIES_MAX];
+};
+
+/*****************************************************************************/
+/* Private objects */
+// Survives a reset, so a boot that never reached the screen (watchdog, fault)
+// can be read back after the next one with "boot prev"
+static struct boot_log boot_log __noinit;
+static struct boot_log prev_log;
+static struct k_spinlock boot_lock;
+static bool started;
+static uint32_t first_screen_us;
+
+#ifdef CONFIG_BSP_BOOT_PROF_INIT_CALLS
+static int pending = -1; // Init call entered and not returned yet
+#endif
+
+static const char *const level_names[] = {
+    "EARLY", "PRE_KERNEL_1", "PRE_KERNEL_2", "POST_KERNEL", "APPLICATION", "SMP",
+};
+
+/*****************************************************************************/
+static void log_start(bsp_ts_t now)
+{
+    if (boot_log.magic == BOOT_LOG_MAGIC && boot_log.count <= ENTRIES_MAX) {
+        prev_log = boot_log;
+    }
+
+    boot_log.magic = BOOT_LOG_MAGIC;
+    boot_log.count = 0;
+    boot_log.dropped = 0;
+    boot_log.done = false;
+    boot_log.t0 = now;
+    started = true;
+}
+
+/*****************************************************************************/
+static struct bsp_boot_entry *entry_add(const char *name, const void *fn, int level,
+                                        bsp_ts_t now)
+{
+    if (!started || boot_log.done) {
+        return NULL;
+    }
+    if (boot_log.count >= ENTRIES_MAX) {
+        boot_log.dropped++;
+        return NULL;
+    }
+
+    struct bsp_boot_entry *entry = &boot_log.entries[boot_log.count++];
+
+    strncpy(entry->name, (name != NULL) ? name : "", sizeof(entry->name) - 1);
+    entry->name[sizeof(entry->name) - 1] = '\0';
+    entry->fn = fn;
+    entry->level = level;
+    entry->start = now;
+    entry->end = now;
+
+    return entry;
+}
+
+/*****************************************************************************/
+// Marks from other threads and ISRs may be stored out of order
+static void log_sort(struct boot_log *log)
+{
+    for (uint32_t i = 1; i < log->count; i++) {
+        struct bsp_boot_entry entry = log->entries[i];
+        uint32_t j = i;
+
+        for (; j > 0 && log->entries[j - 1].start > entry.start; j--) {
+            log->entries[j] = log->entries[j - 1];
+        }
+        log->entries[j] = entry;
+    }
+}
+
+/*****************************************************************************/
+static void entry_format(char *buf, size_t size, const struct boot_log *log, uint32_t i)
+{
+    const struct bsp_boot_entry *entry = &log->entries[i];
+    uint32_t at_us = bsp_ts_to_us(entry->start - log->t0);
+
+    // The previous boot's log may be corrupt, never read past the name
+    int name_len = strnlen(entry->name, sizeof(entry->name));
+
+    if (entry->level == BSP_BOOT_MILESTONE) {
+        snprintf(buf, size, "%5u.%03u ms             %.*s", at_us / 1000, at_us % 1000,
+                 name_len, entry->name);
+        return;
+    }
+
+    uint32_t took_us = bsp_ts_to_us(entry->end - entry->start);
+    const char *level = "?";
+
+    if ((size_t)entry->level < ARRAY_SIZE(level_names)) {
+        level = level_names[entry->level];
+    }
+
+    if (name_len > 0) {
+        snprintf(buf, size, "%5u.%03u ms %4u.%03u ms  %s %.*s", at_us / 1000, at_us % 1000,
+                 took_us / 1000, took_us % 1000, level, name_len, entry->name);
+    } else {
+        snprintf(buf, size, "%5u.%03u ms %4u.%03u ms  %s %p", at_us / 1000, at_us % 1000,
+                 took_us / 1000, took_us % 1000, level, entry->fn);
+    }
+}
+
+/*****************************************************************************/
+void bsp_boot_mark(const char *name)
+{
+    bsp_ts_t now = bsp_ts_now();
+    k_spinlock_key_t key = k_spin_lock(&boot_lock);
+
+    entry_add(name, NULL, BSP_BOOT_MILESTONE, now);
+
+    k_spin_unlock(&boot_lock, key);
+}
+
+/*****************************************************************************/
+void bsp_boot_done(const char *name)
+{
+    bsp_ts_t now = bsp_ts_now();
+    k_spinlock_key_t key = k_spin_lock(&boot_lock);
+
+    if (!started || boot_log.done) {
+        k_spin_unlock(&boot_lock, key);
+        return;
+    }
+
+    entry_add(name, NULL, BSP_BOOT_MILESTONE, now);
+    boot_log.done = true;
+    first_screen_us = bsp_ts_to_us(now - boot_log.t0);
+    log_sort(&boot_log);
+
+    k_spin_unlock(&boot_lock, key);
+
+    if (IS_ENABLED(CONFIG_BSP_BOOT_PROF_PRINT)) {
+        char line[LINE_LEN];
+
+        LOG_INF("Boot timeline, %u entries, %u dropped", boot_log.count, boot_log.dropped);
+        for (uint32_t i = 0; i < boot_log.count; i++) {
+            entry_format(line, sizeof(line), &boot_log, i);
+            LOG_INF("%s", line);
+        }
+    }
+
+    if (first_screen_us > TARGET_MS * USEC_PER_MSEC) {
+        LOG_WRN("First screen after %u ms, target %u ms", first_screen_us / 1000, TARGET_MS);
+    } else {
+        LOG_INF("First screen after %u ms, target %u ms", first_screen_us / 1000, TARGET_MS);
+    }
+}
+
+/*****************************************************************************/
+uint32_t bsp_boot_first_screen_us(void)
+{
+    return first_screen_us;
+}
+
+/*****************************************************************************/
+#ifdef CONFIG_BSP_BOOT_PROF_INIT_CALLS
+// Tracing hooks around every SYS_INIT call and device init, CONFIG_TRACING_USER
+void sys_trace_sys_init_enter_user(const struct init_entry *entry, int level)
+{
+    bsp_ts_t now = bsp_ts_now();
+    k_spinlock_key_t key = k_spin_lock(&boot_lock);
+    const char *name = (entry->dev != NULL) ? entry->dev->name : NULL;
+    struct bsp_boot_entry *added = entry_add(name, (const void *)entry->init_fn.sys, level, now);
+
+    pending = (added != NULL) ? added - boot_log.entries : -1;
+
+    k_spin_unlock(&boot_lock, key);
+}
+
+/*****************************************************************************/
+void sys_trace_sys_init_exit_user(const struct init_entry *entry, int level, int result)
+{
+    ARG_UNUSED(entry);
+    ARG_UNUSED(level);
+    ARG_UNUSED(result);
+
+    bsp_ts_t now = bsp_ts_now();
+    k_spinlock_key_t key = k_spin_lock(&boot_lock);
+
+    if (pending >= 0) {
+        struct bsp_boot_entry *added = &boot_log.entries[pending];
+
+        added->end = now;
+        // Short calls only fill the log, unless a mark came in between
+        if (bsp_ts_to_us(now - added->start) < CONFIG_BSP_BOOT_PROF_MIN_US &&
+            (uint32_t)pending == boot_log.count - 1) {
+            boot_log.count--;
+        }
+    }
+    pending = -1;
+
+    k_spin_unlock(&boot_lock, key);
+}
+#endif
+
+/*****************************************************************************/
+/* Init level marks */
+// PRE_KERNEL_1 starts the recording after bsp_ts_init() started the counter,
+// earlier init calls are not timed
+static int boot_mark_pre_kernel_1(void)
+{
+    bsp_ts_t now = bsp_ts_now();
+    k_spinlock_key_t key = k_spin_lock(&boot_lock);
+
+    log_start(now);
+    entry_add("PRE_KERNEL_1", NULL, BSP_BOOT_MILESTONE, now);
+
+    k_spin_unlock(&boot_lock, key);
+
+    return 0;
+}
+
+SYS_INIT(boot_mark_pre_kernel_1, PRE_KERNEL_1, 1);
+
+#define BOOT_LEVEL_MARK(level)                                                                     \
+    static int boot_mark_##level(void)                                                             \
+    {                                                                                              \
+        bsp_boot_mark(#level);                                                                     \
+        return 0;                                                                                  \
+    }                                                                                              \
+    SYS_INIT(boot_mark_##level, level, 0)
+
+BOOT_LEVEL_MARK(PRE_KERNEL_2);
+BOOT_LEVEL_MARK(POST_KERNEL);
+BOOT_LEVEL_MARK(APPLICATION);
+
+/*****************************************************************************/
+/* Shell */
+#ifdef CONFIG_SHELL
+static void timeline_print(const struct shell *sh, struct boot_log *log)
+{
+    char line[LINE_LEN];
+
+    if (log->magic != BOOT_LOG_MAGIC || log->count > ENTRIES_MAX) {
+        shell_print(sh, "No boot log");
+        return;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&boot_lock);
+    log_sort(log);
+    k_spin_unlock(&boot_lock, key);
+
+    shell_print(sh, "%u entries, %u dropped%s", log->count, log->dropped,
+                log->done ? "" : ", no first screen");
+    for (uint32_t i = 0; i < log->count; i++) {
+        entry_format(line, sizeof(line), log, i);
+        shell_print(sh, "%s", line);
+    }
+}
+
+static int cmd_timeline(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    timeline_print(sh, &boot_log);
+    if (first_screen_us != 0) {
+        shell_print(sh, "First screen after %u.%03u ms, target %u ms", first_screen_us / 1000,
+                    first_screen_us % 1000, TARGET_MS);
+    }
+
+    return 0;
+}
+
+static int cmd_prev(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    timeline_print(sh, &prev_log);
+
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(
+    sub_boot, SHELL_CMD_ARG(timeline, NULL, "Show this boot's timeline", cmd_timeline, 1, 0),
+    SHELL_CMD_ARG(prev, NULL, "Show the timeline of the boot before the last reset", cmd_prev,
+                  1, 0),
+    SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(boot, &sub_boot, "Boot time profile", NULL);
+#endif /* CONFIG_SHELL */
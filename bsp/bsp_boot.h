@@ -0,0 +1,56 @@
+#ifndef BSP_BOOT_H_
+#define BSP_BOOT_H_
+
+#include <stdint.h>
+
+#include "bsp_ts.h"
+
+#define BSP_BOOT_MILESTONE (-1)
+#define BSP_BOOT_NAME_LEN 20
+
+// Stored in a buffer that survives a reset, so the name is a copy: a pointer
+// would refer to the image that ran before the reset
+struct bsp_boot_entry {
+    char name[BSP_BOOT_NAME_LEN]; // Milestone or device name, empty for a SYS_INIT call
+    const void *fn;   // Init function of an init call
+    int8_t level;     // Init level of an init call, BSP_BOOT_MILESTONE otherwise
+    bsp_ts_t start;
+    bsp_ts_t end;     // Equal to start for a milestone
+};
+
+/*****************************************************************************/
+
+#ifdef CONFIG_BSP_BOOT_PROF
+/// @brief Records a boot milestone. ISR safe, ignored once the first screen
+/// was recorded.
+/// @param name Copied, truncated to BSP_BOOT_NAME_LEN - 1 characters
+void bsp_boot_mark(const char *name);
+
+/// @brief Records the first screen milestone and ends the recording. Logs
+/// the sorted timeline and the time to first screen against
+/// CONFIG_BSP_BOOT_PROF_TARGET_MS.
+/// @param name Copied, truncated to BSP_BOOT_NAME_LEN - 1 characters
+void bsp_boot_done(const char *name);
+
+/// @brief Returns the time from the timestamp counter start to the first
+/// screen, reset to first screen less the boot ROM and bootloader
+/// @return Microseconds, 0 before bsp_boot_done()
+uint32_t bsp_boot_first_screen_us(void);
+#else
+static inline void bsp_boot_mark(const char *name)
+{
+    (void)name;
+}
+
+static inline void bsp_boot_done(const char *name)
+{
+    (void)name;
+}
+
+static inline uint32_t bsp_boot_first_screen_us(void)
+{
+    return 0;
+}
+#endif
+
+#endif // BSP_BOOT_H_
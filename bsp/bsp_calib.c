@@ -0,0 +1,305 @@
+#include <errno.h>
+#include <string.h>
+
+#include <zephyr/cache.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/util.h>
+
+#include "bsp_calib.h"
+
+LOG_MODULE_REGISTER(bsp_calib, CONFIG_LOG_DEFAULT_LEVEL);
+
+/*****************************************************************************/
+/* Blob layout */
+#define CALIB_MAGIC 0x424C4143 // "CALB"
+#define CALIB_FORMAT_VERSION 1
+#define CALIB_SLOTS_COUNT 2
+#define CALIB_SLOT_SIZE CONFIG_BSP_CALIB_SLOT_SIZE
+#define CALIB_ALIGN 8
+
+struct calib_header {
+    uint32_t magic;
+    uint16_t format_version;
+    uint16_t header_size;
+    uint32_t seq;
+    uint32_t content_version;
+    uint32_t profiles_len;
+    uint32_t calib_len;
+    uint32_t payload_crc;
+    uint32_t header_crc; // Must be the last member
+};
+
+BUILD_ASSERT(sizeof(struct calib_header) % CALIB_ALIGN == 0);
+BUILD_ASSERT(CALIB_SLOT_SIZE % CALIB_ALIGN == 0);
+
+#define STORAGE_PARTITION storage_partition
+
+#ifdef CONFIG_BSP_CALIB_XIP
+#define FLASH_NODE DT_CHOSEN(zephyr_flash)
+// Second reg entry of the FlexSPI controller is the AHB (XIP) window
+#define CALIB_XIP_BASE                                                                             \
+    (DT_REG_ADDR_BY_IDX(DT_PARENT(FLASH_NODE), 1) + FIXED_PARTITION_OFFSET(STORAGE_PARTITION) +   \
+     CONFIG_BSP_CALIB_OFFSET)
+#else
+static uint8_t slot_mirror[CALIB_SLOT_SIZE] __aligned(CALIB_ALIGN);
+#endif
+
+static K_MUTEX_DEFINE(calib_lock);
+
+/*****************************************************************************/
+static off_t slot_offset(int slot)
+{
+    return CONFIG_BSP_CALIB_OFFSET + (off_t)slot * CALIB_SLOT_SIZE;
+}
+
+/*****************************************************************************/
+static size_t payload_size(const struct calib_header *hdr)
+{
+    return ROUND_UP(hdr->profiles_len, CALIB_ALIGN) + ROUND_UP(hdr->calib_len, CALIB_ALIGN);
+}
+
+/*****************************************************************************/
+static bool header_valid(const struct calib_header *hdr)
+{
+    if (hdr->magic != CALIB_MAGIC || hdr->format_version != CALIB_FORMAT_VERSION ||
+        hdr->header_size != sizeof(struct calib_header)) {
+        return false;
+    }
+
+    if (crc32_ieee(hdr, offsetof(struct calib_header, header_crc)) != hdr->header_crc) {
+        return false;
+    }
+
+    return (sizeof(struct calib_header) + payload_size(hdr)) <= CALIB_SLOT_SIZE;
+}
+
+/*****************************************************************************/
+// Returns the slot contents, either memory-mapped or copied into the RAM mirror
+static const uint8_t *slot_map(const struct flash_area *fa, int slot)
+{
+#ifdef CONFIG_BSP_CALIB_XIP
+    ARG_UNUSED(fa);
+
+    return (const uint8_t *)(CALIB_XIP_BASE + (uintptr_t)slot * CALIB_SLOT_SIZE);
+#else
+    if (flash_area_read(fa, slot_offset(slot), slot_mirror, sizeof(slot_mirror))) {
+        return NULL;
+    }
+
+    return slot_mirror;
+#endif
+}
+
+/*****************************************************************************/
+static bool payload_valid(const uint8_t *slot, const struct calib_header *hdr)
+{
+    const uint8_t *profiles = slot + sizeof(struct calib_header);
+    const uint8_t *calib = profiles + ROUND_UP(hdr->profiles_len, CALIB_ALIGN);
+
+    uint32_t crc = crc32_ieee(profiles, hdr->profiles_len);
+    crc = crc32_ieee_update(crc, calib, hdr->calib_len);
+
+    return crc == hdr->payload_crc;
+}
+
+/*****************************************************************************/
+// Finds the newest slot whose header and payload are both intact
+static int active_slot(const struct flash_area *fa, struct calib_header *active,
+                       const uint8_t **data)
+{
+    struct calib_header hdr[CALIB_SLOTS_COUNT];
+    int order[CALIB_SLOTS_COUNT];
+    int valid = 0;
+
+    for (int slot = 0; slot < CALIB_SLOTS_COUNT; slot++) {
+        if (flash_area_read(fa, slot_offset(slot), &hdr[slot], sizeof(hdr[slot]))) {
+            continue;
+        }
+
+        if (header_valid(&hdr[slot])) {
+            order[valid++] = slot;
+        }
+    }
+
+    // Sequence numbers are compared with wrap-around
+    if (valid == 2 && (int32_t)(hdr[order[1]].seq - hdr[order[0]].seq) > 0) {
+        int tmp = order[0];
+        order[0] = order[1];
+        order[1] = tmp;
+    }
+
+    for (int i = 0; i < valid; i++) {
+        const uint8_t *slot = slot_map(fa, order[i]);
+
+        if (slot == NULL || !payload_valid(slot, &hdr[order[i]])) {
+            LOG_WRN("Calibration slot %d corrupted", order[i]);
+            continue;
+        }
+
+        *active = hdr[order[i]];
+        *data = slot;
+        return order[i];
+    }
+
+    return -ENOENT;
+}
+
+/*****************************************************************************/
+static int write_padded(const struct flash_area *fa, off_t off, const void *data, size_t len)
+{
+    size_t aligned = ROUND_DOWN(len, CALIB_ALIGN);
+    int err = 0;
+
+    if (aligned > 0) {
+        err = flash_area_write(fa, off, data, aligned);
+    }
+
+    if (err == 0 && aligned < len) {
+        uint8_t tail[CALIB_ALIGN];
+
+        memset(tail, 0xFF, sizeof(tail));
+        memcpy(tail, (const uint8_t *)data + aligned, len - aligned);
+        err = flash_area_write(fa, off + aligned, tail, sizeof(tail));
+    }
+
+    return err;
+}
+
+/*****************************************************************************/
+static int calib_area_open(const struct flash_area **fa)
+{
+    int err = flash_area_open(FIXED_PARTITION_ID(STORAGE_PARTITION), fa);
+
+    if (err) {
+        LOG_ERR("Failed to open storage partition (err %d)", err);
+        return err;
+    }
+
+    if (slot_offset(CALIB_SLOTS_COUNT) > (off_t)(*fa)->fa_size) {
+        LOG_ERR("Calibration slots exceed the storage partition");
+        flash_area_close(*fa);
+        return -ENOSPC;
+    }
+
+    return 0;
+}
+
+/*****************************************************************************/
+int bsp_calib_load(uint32_t content_version, struct bsp_calib_view *view)
+{
+    const struct flash_area *fa;
+    struct calib_header hdr;
+    const uint8_t *slot;
+
+    if (view == NULL) {
+        return -EINVAL;
+    }
+
+    int err = calib_area_open(&fa);
+    if (err) {
+        return err;
+    }
+
+    k_mutex_lock(&calib_lock, K_FOREVER);
+
+    int active = active_slot(fa, &hdr, &slot);
+
+    if (active < 0) {
+        err = active;
+    } else if (hdr.content_version != content_version) {
+        LOG_INF("Calibration content version %u, expected %u", hdr.content_version,
+                content_version);
+        err = -ESTALE;
+    } else {
+        view->profiles = slot + sizeof(struct calib_header);
+        view->profiles_len = hdr.profiles_len;
+        view->calib = slot + sizeof(struct calib_header) + ROUND_UP(hdr.profiles_len, CALIB_ALIGN);
+        view->calib_len = hdr.calib_len;
+        view->content_version = hdr.content_version;
+        view->seq = hdr.seq;
+
+        LOG_DBG("Calibration loaded from slot %d, seq %u", active, hdr.seq);
+    }
+
+    k_mutex_unlock(&calib_lock);
+    flash_area_close(fa);
+
+    return err;
+}
+
+/*****************************************************************************/
+int bsp_calib_store(uint32_t content_version, const void *profiles, size_t profiles_len,
+                    const void *calib, size_t calib_len)
+{
+    const struct flash_area *fa;
+    struct calib_header hdr;
+    const uint8_t *slot;
+
+    if ((profiles == NULL && profiles_len > 0) || (calib == NULL && calib_len > 0)) {
+        return -EINVAL;
+    }
+
+    struct calib_header new_hdr = {
+        .magic = CALIB_MAGIC,
+        .format_version = CALIB_FORMAT_VERSION,
+        .header_size = sizeof(struct calib_header),
+        .content_version = content_version,
+        .profiles_len = profiles_len,
+        .calib_len = calib_len,
+    };
+
+    if (sizeof(new_hdr) + payload_size(&new_hdr) > CALIB_SLOT_SIZE) {
+        return -ENOSPC;
+    }
+
+    int err = calib_area_open(&fa);
+    if (err) {
+        return err;
+    }
+
+    k_mutex_lock(&calib_lock, K_FOREVER);
+
+    // Never overwrite the newest intact blob
+    int active = active_slot(fa, &hdr, &slot);
+    int target = (active >= 0) ? (active ^ 1) : 0;
+
+    new_hdr.seq = (active >= 0) ? hdr.seq + 1 : 1;
+    new_hdr.payload_crc = crc32_ieee(profiles, profiles_len);
+    new_hdr.payload_crc = crc32_ieee_update(new_hdr.payload_crc, calib, calib_len);
+    new_hdr.header_crc = crc32_ieee(&new_hdr, offsetof(struct calib_header, header_crc));
+
+    off_t base = slot_offset(target);
+    off_t calib_off = base + sizeof(new_hdr) + ROUND_UP(profiles_len, CALIB_ALIGN);
+
+    err = flash_area_erase(fa, base, CALIB_SLOT_SIZE);
+    if (err == 0 && profiles_len > 0) {
+        err = write_padded(fa, base + sizeof(new_hdr), profiles, profiles_len);
+    }
+    if (err == 0 && calib_len > 0) {
+        err = write_padded(fa, calib_off, calib, calib_len);
+    }
+    if (err == 0) {
+        err = flash_area_write(fa, base, &new_hdr, sizeof(new_hdr));
+    }
+
+#ifdef CONFIG_BSP_CALIB_XIP
+    // The slot was reprogrammed behind the AHB window, drop stale cache lines
+    sys_cache_data_invd_range((void *)(CALIB_XIP_BASE + (uintptr_t)target * CALIB_SLOT_SIZE),
+                              CALIB_SLOT_SIZE);
+#endif
+
+    k_mutex_unlock(&calib_lock);
+    flash_area_close(fa);
+
+    if (err) {
+        LOG_ERR("Failed to store calibration in slot %d (err %d)", target, err);
+    } else {
+        LOG_INF("Calibration stored in slot %d, seq %u", target, new_hdr.seq);
+    }
+
+    return err;
+}
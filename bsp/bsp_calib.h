@@ -0,0 +1,40 @@
+#ifndef BSP_CALIB_H_
+#define BSP_CALIB_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+/// @brief Read-only view of the active calibration blob. With XIP enabled the
+/// pointers reference memory-mapped flash and stay valid until the next
+/// bsp_calib_store(); otherwise they reference a RAM mirror of the slot.
+struct bsp_calib_view {
+    const void *profiles;
+    size_t profiles_len;
+    const void *calib;
+    size_t calib_len;
+    uint32_t content_version;
+    uint32_t seq;
+};
+
+/*****************************************************************************/
+
+/// @brief Locates the newest valid calibration blob in the storage partition
+/// @param content_version Version of the profile/calibration layout expected
+/// by the caller
+/// @param view Filled on success
+/// @return 0 on success, -ENOENT if no valid blob exists, -ESTALE if the newest
+/// valid blob has a different content version
+int bsp_calib_load(uint32_t content_version, struct bsp_calib_view *view);
+
+/// @brief Writes a new blob into the inactive slot. The header is programmed
+/// last, so an interrupted update leaves the previous blob active.
+/// @param content_version
+/// @param profiles Channel profiles, may be NULL if profiles_len is 0
+/// @param profiles_len
+/// @param calib Calibration coefficients, may be NULL if calib_len is 0
+/// @param calib_len
+/// @return 0 on success, -ENOSPC if the blob does not fit into a slot
+int bsp_calib_store(uint32_t content_version, const void *profiles, size_t profiles_len,
+                    const void *calib, size_t calib_len);
+
+#endif // BSP_CALIB_H_
@@ -0,0 +1,417 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/can.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/util.h>
+
+#include "bsp_can.h"
+#include "bsp_can_rec.h"
+
+LOG_MODULE_REGISTER(bsp_can, CONFIG_LOG_DEFAULT_LEVEL);
+
+/*****************************************************************************/
+/* Receive ring */
+#define RING_SIZE CONFIG_BSP_CAN_RX_RING_SIZE
+#define RING_MASK (RING_SIZE - 1)
+#define BUSES_COUNT CONFIG_BSP_CAN_MAX_BUSES
+#define FILTERS_COUNT CONFIG_BSP_CAN_MAX_FILTERS
+#define BATCH_MAX CONFIG_BSP_CAN_BATCH_MAX
+
+BUILD_ASSERT(IS_POWER_OF_TWO(RING_SIZE), "CAN receive ring size must be a power of two");
+
+struct rx_slot {
+    struct can_frame frame;
+    bsp_ts_t ts;
+    uint16_t entry;
+    uint16_t gen; // Generation of the entry when the frame was queued
+};
+
+struct can_bus_ctx;
+
+struct rx_entry_ctx {
+    struct can_bus_ctx *bus;
+    const struct bsp_can_rx_entry *table;
+    const struct bsp_can_rx_entry *entry; // NULL when the slot is free
+    int filter_id;
+    uint16_t gen; // Bumped on removal, frames queued before are dropped
+    struct bsp_can_rx_stats stats;
+};
+
+struct can_bus_ctx {
+    const struct device *dev;
+    // Ring indices are never reset, a bus slot reused for another controller
+    // drains the old frames first, dropped on the generation mismatch
+    atomic_t head; // Written by the controller ISR only
+    atomic_t tail; // Written by the dispatch thread only
+    struct bsp_can_bus_stats stats;
+    size_t entries_count; // Slots in use
+    struct rx_entry_ctx entries[FILTERS_COUNT];
+    struct rx_slot ring[RING_SIZE];
+};
+
+/*****************************************************************************/
+/* Private objects */
+static struct can_bus_ctx buses[BUSES_COUNT];
+static K_MUTEX_DEFINE(buses_lock);
+static K_SEM_DEFINE(dispatch_sem, 0, 1); // Binary: a burst of frames is one wake-up
+static K_MUTEX_DEFINE(dispatch_lock);     // Held by the dispatch thread while draining
+static bsp_ts_t dispatch_ts; // Receive time of the frame in the handler
+
+/*****************************************************************************/
+static struct can_bus_ctx *bus_find(const struct device *dev)
+{
+    for (int i = 0; i < BUSES_COUNT; i++) {
+        if (buses[i].dev == dev) {
+            return &buses[i];
+        }
+    }
+
+    return NULL;
+}
+
+/*****************************************************************************/
+// Filter callback, runs in the controller ISR. Copies the used part of the
+// frame straight into the ring slot and wakes the dispatch thread.
+static void rx_isr(const struct device *dev, struct can_frame *frame, void *user_data)
+{
+    bsp_ts_t ts = bsp_ts_now();
+    struct rx_entry_ctx *ctx = user_data;
+    struct can_bus_ctx *bus = ctx->bus;
+    atomic_val_t head = atomic_get(&bus->head);
+    atomic_val_t tail = atomic_get(&bus->tail);
+    uint32_t used = (uint32_t)(head - tail);
+
+#ifdef CONFIG_BSP_CAN_STATS
+    bsp_can_stats_rx(dev, frame);
+#endif
+#ifdef CONFIG_BSP_CAN_REC
+    bsp_can_rec_rx(dev, frame);
+#endif
+
+    if (used >= RING_SIZE) {
+        ctx->stats.dropped++;
+        bus->stats.overruns++;
+#ifdef CONFIG_BSP_CAN_STATS
+        bsp_can_stats_rx_overrun(dev);
+#endif
+        return;
+    }
+
+    struct rx_slot *slot = &bus->ring[head & RING_MASK];
+
+    memcpy(&slot->frame, frame, offsetof(struct can_frame, data) + can_dlc_to_bytes(frame->dlc));
+    slot->ts = ts;
+    slot->entry = (uint16_t)(ctx - bus->entries);
+    slot->gen = ctx->gen;
+
+    atomic_set(&bus->head, head + 1);
+
+    if (used + 1 > bus->stats.ring_high_water) {
+        bus->stats.ring_high_water = used + 1;
+    }
+
+    k_sem_give(&dispatch_sem);
+}
+
+/*****************************************************************************/
+static size_t bus_drain(struct can_bus_ctx *bus)
+{
+    const struct device *dev = bus->dev;
+    atomic_val_t head = atomic_get(&bus->head);
+    atomic_val_t tail = atomic_get(&bus->tail);
+    size_t count = 0;
+
+    while (tail != head && count < BATCH_MAX) {
+        struct rx_slot *slot = &bus->ring[tail & RING_MASK];
+        struct rx_entry_ctx *ctx = &bus->entries[slot->entry];
+        const struct bsp_can_rx_entry *entry = ctx->entry;
+
+        // Frames of a removed entry are dropped, also when its slot is in use again
+        if (entry != NULL && slot->gen == ctx->gen) {
+            if (entry->handler != NULL) {
+                dispatch_ts = slot->ts;
+                entry->handler(dev, &slot->frame, entry->user_data);
+            }
+
+            uint32_t latency_us = bsp_ts_to_us(bsp_ts_now() - slot->ts);
+
+            ctx->stats.frames++;
+            ctx->stats.sum_latency_us += latency_us;
+            ctx->stats.max_latency_us = MAX(ctx->stats.max_latency_us, latency_us);
+        }
+
+        tail++;
+        atomic_set(&bus->tail, tail);
+        count++;
+    }
+
+    if (count > 0) {
+        bus->stats.frames += count;
+        bus->stats.batches++;
+    }
+
+    return count;
+}
+
+/*****************************************************************************/
+static void dispatch_thread(void *p1, void *p2, void *p3)
+{
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    for (;;) {
+        k_sem_take(&dispatch_sem, K_FOREVER);
+
+        // Round-robin over the buses in batches until all rings are empty.
+        // Rings of detached buses are drained too, their frames are dropped.
+        size_t dispatched;
+        do {
+            dispatched = 0;
+            for (int i = 0; i < BUSES_COUNT; i++) {
+                k_mutex_lock(&dispatch_lock, K_FOREVER);
+                dispatched += bus_drain(&buses[i]);
+                k_mutex_unlock(&dispatch_lock);
+            }
+        } while (dispatched > 0);
+    }
+}
+
+K_THREAD_DEFINE(can_dispatch_thread, CONFIG_BSP_CAN_THREAD_STACK_SIZE, dispatch_thread, NULL, NULL,
+                NULL, CONFIG_BSP_CAN_THREAD_PRIORITY, 0, 0);
+
+/*****************************************************************************/
+// Removes the filters of one table, or of all tables when table is NULL.
+// Slots are not compacted, as frames still in the ring refer to them by index,
+// the generation bump drops those frames even when the slot is taken again.
+static void bus_filters_remove(struct can_bus_ctx *bus, const struct bsp_can_rx_entry *table)
+{
+    for (size_t i = 0; i < FILTERS_COUNT; i++) {
+        struct rx_entry_ctx *ctx = &bus->entries[i];
+
+        if (ctx->entry == NULL || (table != NULL && ctx->table != table)) {
+            continue;
+        }
+
+        if (ctx->filter_id >= 0) {
+            can_remove_rx_filter(bus->dev, ctx->filter_id);
+        }
+        ctx->entry = NULL;
+        ctx->table = NULL;
+        ctx->gen++;
+        bus->entries_count--;
+    }
+}
+
+/*****************************************************************************/
+int bsp_can_attach(const struct device *dev, const struct bsp_can_rx_entry *table, size_t count)
+{
+    if (dev == NULL || table == NULL || count == 0) {
+        return -EINVAL;
+    }
+
+    if (!device_is_ready(dev)) {
+        LOG_ERR("CAN controller %s not ready", dev->name);
+        return -ENODEV;
+    }
+
+    k_mutex_lock(&buses_lock, K_FOREVER);
+
+    struct can_bus_ctx *bus = bus_find(dev);
+    if (bus == NULL) {
+        bus = bus_find(NULL);
+        if (bus == NULL) {
+            k_mutex_unlock(&buses_lock);
+            return -ENOSPC;
+        }
+
+        // Ring indices and entry generations are kept, see can_bus_ctx
+        memset(&bus->stats, 0, sizeof(bus->stats));
+        bus->entries_count = 0;
+        bus->dev = dev;
+    } else {
+        for (size_t i = 0; i < FILTERS_COUNT; i++) {
+            if (bus->entries[i].table == table) {
+                k_mutex_unlock(&buses_lock);
+                return -EALREADY;
+            }
+        }
+    }
+
+    if (bus->entries_count + count > FILTERS_COUNT) {
+        k_mutex_unlock(&buses_lock);
+        return -ENOSPC;
+    }
+
+    int err = 0;
+    size_t slot = 0;
+    for (size_t i = 0; i < count; i++) {
+        while (bus->entries[slot].entry != NULL) {
+            slot++;
+        }
+
+        struct rx_entry_ctx *ctx = &bus->entries[slot];
+
+        memset(&ctx->stats, 0, sizeof(ctx->stats));
+        ctx->bus = bus;
+        ctx->table = table;
+        ctx->entry = &table[i];
+        ctx->filter_id = can_add_rx_filter(dev, rx_isr, ctx, &table[i].filter);
+        bus->entries_count++;
+
+        if (ctx->filter_id < 0) {
+            err = ctx->filter_id;
+            LOG_ERR("%s: no hardware filter for entry %zu (err %d)", dev->name, i, err);
+            break;
+        }
+    }
+
+    if (err) {
+        bus_filters_remove(bus, table);
+    } else {
+        LOG_INF("%s: %zu receive filters attached", dev->name, count);
+    }
+
+    if (bus->entries_count == 0) {
+        bus->dev = NULL;
+    }
+
+    k_mutex_unlock(&buses_lock);
+
+    return err;
+}
+
+/*****************************************************************************/
+int bsp_can_detach(const struct device *dev, const struct bsp_can_rx_entry *table)
+{
+    k_mutex_lock(&buses_lock, K_FOREVER);
+
+    struct can_bus_ctx *bus = bus_find(dev);
+    if (bus == NULL || dev == NULL) {
+        k_mutex_unlock(&buses_lock);
+        return -ENOENT;
+    }
+
+    size_t before = bus->entries_count;
+
+    bus_filters_remove(bus, table);
+    int err = (bus->entries_count < before) ? 0 : -ENOENT;
+
+    if (bus->entries_count == 0) {
+        // Frames still in the ring are dropped by the dispatch thread
+        bus->dev = NULL;
+    }
+
+    k_mutex_unlock(&buses_lock);
+
+    // Wait for a drain in progress, which may still call a removed handler.
+    // The mutex is recursive, a handler detaching its own table does not block.
+    k_mutex_lock(&dispatch_lock, K_FOREVER);
+    k_mutex_unlock(&dispatch_lock);
+
+    return err;
+}
+
+/*****************************************************************************/
+static const struct rx_entry_ctx *entry_find(const struct can_bus_ctx *bus,
+                                             const struct bsp_can_rx_entry *entry)
+{
+    for (size_t i = 0; i < FILTERS_COUNT; i++) {
+        if (bus->entries[i].entry == entry) {
+            return &bus->entries[i];
+        }
+    }
+
+    return NULL;
+}
+
+/*****************************************************************************/
+int bsp_can_rx_stats_get(const struct device *dev, const struct bsp_can_rx_entry *entry,
+                         struct bsp_can_rx_stats *stats)
+{
+    struct can_bus_ctx *bus = bus_find(dev);
+
+    if (bus == NULL || dev == NULL || entry == NULL || stats == NULL) {
+        return -EINVAL;
+    }
+
+    const struct rx_entry_ctx *ctx = entry_find(bus, entry);
+    if (ctx == NULL) {
+        return -ENOENT;
+    }
+
+    *stats = ctx->stats;
+
+    return 0;
+}
+
+/*****************************************************************************/
+int bsp_can_bus_stats_get(const struct device *dev, struct bsp_can_bus_stats *stats)
+{
+    struct can_bus_ctx *bus = bus_find(dev);
+
+    if (bus == NULL || dev == NULL || stats == NULL) {
+        return -EINVAL;
+    }
+
+    *stats = bus->stats;
+
+    return 0;
+}
+
+/*****************************************************************************/
+bsp_ts_t bsp_can_rx_ts(void)
+{
+    return dispatch_ts;
+}
+
+/*****************************************************************************/
+/* Shell */
+#ifdef CONFIG_SHELL
+static int cmd_can_rx_stats(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    for (int i = 0; i < BUSES_COUNT; i++) {
+        struct can_bus_ctx *bus = &buses[i];
+
+        if (bus->dev == NULL) {
+            continue;
+        }
+
+        shell_print(sh, "%s: %u frames, %u batches, %u overruns, ring high water %u/%u",
+                    bus->dev->name, bus->stats.frames, bus->stats.batches, bus->stats.overruns,
+                    bus->stats.ring_high_water, RING_SIZE);
+
+        for (size_t e = 0; e < FILTERS_COUNT; e++) {
+            const struct rx_entry_ctx *ctx = &bus->entries[e];
+
+            if (ctx->entry == NULL) {
+                continue;
+            }
+            uint32_t avg_us =
+                ctx->stats.frames ? (uint32_t)(ctx->stats.sum_latency_us / ctx->stats.frames) : 0;
+
+            shell_print(sh, "  id 0x%08x/0x%08x: %u frames, %u dropped, latency avg %u max %u us",
+                        ctx->entry->filter.id, ctx->entry->filter.mask, ctx->stats.frames,
+                        ctx->stats.dropped, avg_us, ctx->stats.max_latency_us);
+        }
+    }
+
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_can_rx,
+                               SHELL_CMD_ARG(stats, NULL, "Show receive statistics",
+                                             cmd_can_rx_stats, 1, 0),
+                               SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(can_rx, &sub_can_rx, "CAN receive service", NULL);
+#endif /* CONFIG_SHELL */
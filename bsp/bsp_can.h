@@ -0,0 +1,78 @@
+#ifndef BSP_CAN_H_
+#define BSP_CAN_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/can.h>
+
+#include "bsp_can_stats.h"
+#include "bsp_ts.h"
+
+/// @brief Frame handler invoked from the CAN dispatch thread. The frame points
+/// into the receive ring and is only valid for the duration of the call.
+typedef void (*bsp_can_handler_t)(const struct device *dev, const struct can_frame *frame,
+                                  void *user_data);
+
+/// @brief One row of a receive table: a hardware filter and its handler
+struct bsp_can_rx_entry {
+    struct can_filter filter;
+    bsp_can_handler_t handler;
+    void *user_data;
+};
+
+struct bsp_can_rx_stats {
+    uint32_t frames;         // Frames dispatched to the handler
+    uint32_t dropped;        // Frames lost because the receive ring was full
+    uint32_t max_latency_us; // Longest ISR to handler delay
+    uint64_t sum_latency_us;
+};
+
+struct bsp_can_bus_stats {
+    uint32_t frames;
+    uint32_t overruns;
+    uint32_t batches;
+    uint32_t ring_high_water;
+};
+
+/*****************************************************************************/
+
+/// @brief Programs the hardware filters of a receive table on a controller and
+/// routes matching frames through the receive ring to the dispatch thread.
+/// Several tables may share a controller. The table must stay valid while attached.
+/// @param dev CAN controller
+/// @param table
+/// @param count Number of entries
+/// @return 0 on success, -ENOSPC if no free bus slot or fewer than count of the
+/// CONFIG_BSP_CAN_MAX_FILTERS entries per controller are left
+int bsp_can_attach(const struct device *dev, const struct bsp_can_rx_entry *table, size_t count);
+
+/// @brief Removes the filters of a table previously attached. Frames of the
+/// table still in the receive ring are dropped. On return the dispatch thread
+/// no longer calls its handlers, except the call detaching from inside a handler,
+/// so the table and its user data may be freed.
+/// @param dev
+/// @param table Table passed to bsp_can_attach(), NULL removes all tables
+/// @return 0 on success, -ENOENT if the table is not attached
+int bsp_can_detach(const struct device *dev, const struct bsp_can_rx_entry *table);
+
+/// @brief Returns statistics of a receive table entry
+/// @param dev
+/// @param entry Entry of a table passed to bsp_can_attach()
+/// @param stats
+/// @return 0 on success
+int bsp_can_rx_stats_get(const struct device *dev, const struct bsp_can_rx_entry *entry,
+                         struct bsp_can_rx_stats *stats);
+
+/// @brief Returns receive statistics of a controller
+/// @param dev
+/// @param stats
+/// @return 0 on success
+int bsp_can_bus_stats_get(const struct device *dev, struct bsp_can_bus_stats *stats);
+
+/// @brief Returns the receive time of the frame being dispatched, taken in the
+/// controller ISR. Only valid inside a bsp_can_handler_t call.
+bsp_ts_t bsp_can_rx_ts(void);
+
+#endif // BSP_CAN_H_
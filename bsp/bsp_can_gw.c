@@ -0,0 +1,414 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/can.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/util.h>
+
+#include "bsp_can.h"
+#include "bsp_can_gw.h"
+#include "bsp_can_stats.h"
+#include "bsp_ts.h"
+
+LOG_MODULE_REGISTER(bsp_can_gw, CONFIG_LOG_DEFAULT_LEVEL);
+
+/*****************************************************************************/
+#define ROUTES_COUNT CONFIG_BSP_CAN_GW_MAX_ROUTES
+#define QUEUE_SIZE CONFIG_BSP_CAN_GW_QUEUE_SIZE
+#define TX_TIMEOUT K_MSEC(2) // Bounded wait for a free mailbox on the destination
+#define TOKEN_ONE (1U << 16) // Token bucket in 16.16 fixed point
+#define BURST_MAX UINT16_MAX // Keeps the bucket size in 32 bits
+
+BUILD_ASSERT(ROUTES_COUNT <= UINT8_MAX, "Route index must fit in a byte");
+
+// Updated from the dispatch thread, the gateway thread and the transmit done callback
+struct gw_route_stats {
+    atomic_t forwarded;
+    atomic_t rate_limited;
+    atomic_t dropped;
+    atomic_t tx_errors;
+    uint32_t max_latency_us; // Latency under stats_lock
+    uint64_t sum_latency_us;
+};
+
+struct gw_route_ctx {
+    struct bsp_can_gw_route route;
+    bool used;
+    uint8_t gen; // Bumped on removal, frames queued before are dropped
+    struct bsp_can_rx_entry rx; // One-entry receive table attached to src
+    uint32_t tokens;
+    bsp_ts_t last_ts;
+    struct gw_route_stats stats;
+};
+
+struct gw_slot {
+    struct can_frame frame;
+    bsp_ts_t ts;
+    uint8_t route;
+    uint8_t gen;
+};
+
+// In flight between can_send() and the transmit done callback
+struct gw_tx {
+    bsp_ts_t ts;
+    uint8_t route;
+    uint8_t gen;
+};
+
+/*****************************************************************************/
+/* Private objects */
+static struct gw_route_ctx routes[ROUTES_COUNT];
+static K_MUTEX_DEFINE(routes_lock);
+
+static struct gw_slot queue[QUEUE_SIZE];
+static uint32_t queue_head;
+static uint32_t queue_tail;
+static struct k_spinlock queue_lock;
+static K_SEM_DEFINE(queue_sem, 0, QUEUE_SIZE);
+static struct k_spinlock stats_lock;
+
+K_MEM_SLAB_DEFINE_STATIC(tx_slab, sizeof(struct gw_tx), QUEUE_SIZE, 4);
+
+/*****************************************************************************/
+static bool rate_allow(struct gw_route_ctx *r, bsp_ts_t now)
+{
+    const struct bsp_can_gw_route *route = &r->route;
+
+    if (route->rate_hz == 0) {
+        return true;
+    }
+
+    uint32_t burst = CLAMP(route->burst, 1, BURST_MAX);
+    uint32_t cap = burst * TOKEN_ONE;
+    uint32_t hz = bsp_ts_hz();
+    uint64_t elapsed = now - r->last_ts;
+    // Time to refill an empty bucket, the refill below is bounded by it:
+    // elapsed * rate_hz < hz * burst < 2^48
+    uint64_t full = ((uint64_t)hz * burst) / route->rate_hz;
+
+    r->last_ts = now;
+
+    if (elapsed >= full) {
+        r->tokens = cap;
+    } else {
+        uint64_t refill = (elapsed * route->rate_hz * TOKEN_ONE) / hz;
+        r->tokens = (uint32_t)MIN((uint64_t)r->tokens + refill, cap);
+    }
+
+    if (r->tokens < TOKEN_ONE) {
+        return false;
+    }
+
+    r->tokens -= TOKEN_ONE;
+    return true;
+}
+
+/*****************************************************************************/
+// Receive handler of a route, runs on the CAN dispatch thread. Bus statistics
+// and recording are done by bsp_can in the ISR.
+static void gw_rx(const struct device *dev, const struct can_frame *frame, void *user_data)
+{
+    ARG_UNUSED(dev);
+
+    struct gw_route_ctx *r = user_data;
+    bsp_ts_t now = bsp_can_rx_ts();
+
+    if (!rate_allow(r, now)) {
+        atomic_inc(&r->stats.rate_limited);
+        return;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&queue_lock);
+
+    if (queue_head - queue_tail >= QUEUE_SIZE) {
+        k_spin_unlock(&queue_lock, key);
+        atomic_inc(&r->stats.dropped);
+#ifdef CONFIG_BSP_CAN_STATS
+        bsp_can_stats_rx_overrun(dev);
+#endif
+        return;
+    }
+
+    struct gw_slot *slot = &queue[queue_head % QUEUE_SIZE];
+
+    memcpy(&slot->frame, frame, offsetof(struct can_frame, data) + can_dlc_to_bytes(frame->dlc));
+    if (r->route.rewrite_mask != 0) {
+        slot->frame.id = (frame->id & ~r->route.rewrite_mask) |
+                         (r->route.rewrite_id & r->route.rewrite_mask);
+    }
+    slot->ts = now;
+    slot->route = r - routes;
+    slot->gen = r->gen;
+    queue_head++;
+
+    k_spin_unlock(&queue_lock, key);
+
+    k_sem_give(&queue_sem);
+}
+
+/*****************************************************************************/
+static void gw_tx_done(const struct device *dev, int error, void *user_data)
+{
+    ARG_UNUSED(dev);
+
+    struct gw_tx *tx = user_data;
+    struct gw_route_ctx *r = &routes[tx->route];
+
+    if (tx->gen != r->gen) {
+        // Route removed, or replaced by another one, while in flight
+    } else if (error) {
+        atomic_inc(&r->stats.tx_errors);
+    } else {
+        uint32_t latency_us = bsp_ts_to_us(bsp_ts_now() - tx->ts);
+        k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+        atomic_inc(&r->stats.forwarded);
+        r->stats.sum_latency_us += latency_us;
+        r->stats.max_latency_us = MAX(r->stats.max_latency_us, latency_us);
+
+        k_spin_unlock(&stats_lock, key);
+    }
+
+    k_mem_slab_free(&tx_slab, tx);
+}
+
+/*****************************************************************************/
+static void gw_thread(void *p1, void *p2, void *p3)
+{
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    struct gw_slot slot;
+
+    for (;;) {
+        k_sem_take(&queue_sem, K_FOREVER);
+
+        k_spinlock_key_t key = k_spin_lock(&queue_lock);
+        slot = queue[queue_tail % QUEUE_SIZE];
+        queue_tail++;
+        k_spin_unlock(&queue_lock, key);
+
+        struct gw_route_ctx *r = &routes[slot.route];
+        struct gw_tx *tx;
+
+        if (!r->used || slot.gen != r->gen) {
+            // Removed, or replaced by another route, while the frame was queued
+            continue;
+        }
+
+        if (k_mem_slab_alloc(&tx_slab, (void **)&tx, K_NO_WAIT) != 0) {
+            atomic_inc(&r->stats.dropped);
+            continue;
+        }
+
+        tx->ts = slot.ts;
+        tx->route = slot.route;
+        tx->gen = slot.gen;
+
+        if (bsp_can_send(r->route.dst, &slot.frame, TX_TIMEOUT, gw_tx_done, tx) != 0) {
+            atomic_inc(&r->stats.tx_errors);
+            k_mem_slab_free(&tx_slab, tx);
+        }
+    }
+}
+
+K_THREAD_DEFINE(can_gw_thread, CONFIG_BSP_CAN_GW_THREAD_STACK_SIZE, gw_thread, NULL, NULL, NULL,
+                CONFIG_BSP_CAN_GW_THREAD_PRIORITY, 0, 0);
+
+/*****************************************************************************/
+int bsp_can_gw_route_add(const struct bsp_can_gw_route *route)
+{
+    if (route == NULL) {
+        return -EINVAL;
+    }
+
+    if (route->src == NULL || route->dst == NULL || !device_is_ready(route->src) ||
+        !device_is_ready(route->dst)) {
+        return -ENODEV;
+    }
+
+    if (route->src == route->dst) {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&routes_lock, K_FOREVER);
+
+    int handle = -ENOSPC;
+    for (int i = 0; i < ROUTES_COUNT; i++) {
+        if (!routes[i].used) {
+            handle = i;
+            break;
+        }
+    }
+
+    if (handle >= 0) {
+        struct gw_route_ctx *r = &routes[handle];
+        uint8_t gen = r->gen;
+
+        memset(r, 0, sizeof(*r));
+        r->gen = gen;
+        r->route = *route;
+        r->tokens = CLAMP(route->burst, 1, BURST_MAX) * TOKEN_ONE;
+        r->last_ts = bsp_ts_now();
+        r->used = true;
+
+        r->rx = (struct bsp_can_rx_entry){
+            .filter = route->filter,
+            .handler = gw_rx,
+            .user_data = r,
+        };
+
+        int err = bsp_can_attach(route->src, &r->rx, 1);
+        if (err) {
+            LOG_ERR("%s: route filter not attached (err %d)", route->src->name, err);
+            r->used = false;
+            handle = err;
+        }
+    }
+
+    k_mutex_unlock(&routes_lock);
+
+    return handle;
+}
+
+/*****************************************************************************/
+int bsp_can_gw_route_remove(int handle)
+{
+    if (handle < 0 || handle >= ROUTES_COUNT) {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&routes_lock, K_FOREVER);
+
+    struct gw_route_ctx *r = &routes[handle];
+    int err = -ENOENT;
+
+    if (r->used) {
+        bsp_can_detach(r->route.src, &r->rx);
+        r->used = false;
+        r->gen++;
+        err = 0;
+    }
+
+    k_mutex_unlock(&routes_lock);
+
+    return err;
+}
+
+/*****************************************************************************/
+int bsp_can_gw_stats_get(int handle, struct bsp_can_gw_stats *stats)
+{
+    if (handle < 0 || handle >= ROUTES_COUNT || stats == NULL || !routes[handle].used) {
+        return -EINVAL;
+    }
+
+    struct gw_route_stats *s = &routes[handle].stats;
+    k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+    stats->forwarded = atomic_get(&s->forwarded);
+    stats->rate_limited = atomic_get(&s->rate_limited);
+    stats->dropped = atomic_get(&s->dropped);
+    stats->tx_errors = atomic_get(&s->tx_errors);
+    stats->max_latency_us = s->max_latency_us;
+    stats->sum_latency_us = s->sum_latency_us;
+
+    k_spin_unlock(&stats_lock, key);
+
+    return 0;
+}
+
+/*****************************************************************************/
+/* Shell */
+#ifdef CONFIG_SHELL
+static int cmd_can_gw_add(const struct shell *sh, size_t argc, char **argv)
+{
+    struct bsp_can_gw_route route = {
+        .src = device_get_binding(argv[1]),
+        .dst = device_get_binding(argv[2]),
+        .filter.id = strtoul(argv[3], NULL, 0),
+        .filter.mask = strtoul(argv[4], NULL, 0),
+    };
+
+    if (route.filter.id > CAN_STD_ID_MASK || route.filter.mask > CAN_STD_ID_MASK) {
+        route.filter.flags = CAN_FILTER_IDE;
+    }
+
+    if (argc > 5) {
+        route.rewrite_id = strtoul(argv[5], NULL, 0);
+        route.rewrite_mask = (route.filter.flags & CAN_FILTER_IDE) ? CAN_EXT_ID_MASK
+                                                                    : CAN_STD_ID_MASK;
+    }
+
+    if (argc > 6) {
+        route.rate_hz = strtoul(argv[6], NULL, 0);
+        route.burst = 1;
+    }
+
+    int handle = bsp_can_gw_route_add(&route);
+    if (handle < 0) {
+        shell_error(sh, "Route not added (err %d)", handle);
+        return handle;
+    }
+
+    shell_print(sh, "Route %d", handle);
+
+    return 0;
+}
+
+/*****************************************************************************/
+static int cmd_can_gw_remove(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+
+    int err = bsp_can_gw_route_remove(atoi(argv[1]));
+    if (err) {
+        shell_error(sh, "No such route");
+    }
+
+    return err;
+}
+
+/*****************************************************************************/
+static int cmd_can_gw_stats(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    for (int i = 0; i < ROUTES_COUNT; i++) {
+        const struct gw_route_ctx *r = &routes[i];
+
+        struct bsp_can_gw_stats s;
+
+        if (bsp_can_gw_stats_get(i, &s) != 0) {
+            continue;
+        }
+
+        uint32_t avg_us = s.forwarded ? (uint32_t)(s.sum_latency_us / s.forwarded) : 0;
+
+        shell_print(sh, "%d: %s -> %s id 0x%x/0x%x: %u forwarded, %u rate limited, %u dropped, "
+                        "%u tx errors, latency avg %u max %u us",
+                    i, r->route.src->name, r->route.dst->name, r->route.filter.id,
+                    r->route.filter.mask, s.forwarded, s.rate_limited, s.dropped, s.tx_errors,
+                    avg_us, s.max_latency_us);
+    }
+
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_can_gw,
+                               SHELL_CMD_ARG(add, NULL,
+                                             "<src> <dst> <id> <mask> [new id] [rate Hz]",
+                                             cmd_can_gw_add, 5, 2),
+                               SHELL_CMD_ARG(remove, NULL, "<route>", cmd_can_gw_remove, 2, 0),
+                               SHELL_CMD_ARG(stats, NULL, "Show route statistics",
+                                             cmd_can_gw_stats, 1, 0),
+                               SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(can_gw, &sub_can_gw, "CAN gateway", NULL);
+#endif /* CONFIG_SHELL */
@@ -0,0 +1,50 @@
+#ifndef BSP_CAN_GW_H_
+#define BSP_CAN_GW_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/can.h>
+
+struct bsp_can_gw_route {
+    const struct device *src;
+    const struct device *dst;
+    struct can_filter filter; // Frames on src matching the filter are forwarded
+    uint32_t rewrite_mask;    // ID bits replaced on the way out, 0 keeps the ID
+    uint32_t rewrite_id;
+    uint32_t rate_hz;         // Sustained frame rate limit, 0 for no limit
+    uint32_t burst;           // Frames allowed back to back when rate limited, max 65535
+};
+
+struct bsp_can_gw_stats {
+    uint32_t forwarded;
+    uint32_t rate_limited;
+    uint32_t dropped;   // Forwarding queue full
+    uint32_t tx_errors;
+    uint32_t max_latency_us; // Reception on src to transmission done on dst
+    uint64_t sum_latency_us;
+};
+
+/*****************************************************************************/
+
+/// @brief Adds a route. The filter is attached to the source controller as a
+/// bsp_can receive table, rate limiting runs on the CAN dispatch thread and
+/// transmission in the gateway thread. The route is copied.
+/// @param route
+/// @return Route handle, -ENODEV if a controller is missing or not ready,
+/// -ENOSPC if the route table or the bsp_can filters of the controller are full
+int bsp_can_gw_route_add(const struct bsp_can_gw_route *route);
+
+/// @brief Removes a route
+/// @param handle
+/// @return 0 on success
+int bsp_can_gw_route_remove(int handle);
+
+/// @brief Returns the statistics of a route
+/// @param handle
+/// @param stats
+/// @return 0 on success
+int bsp_can_gw_stats_get(int handle, struct bsp_can_gw_stats *stats);
+
+#endif // BSP_CAN_GW_H_
@@ -0,0 +1,1136 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/can.h>
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/linker/section_tags.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/util.h>
+
+#include "bsp_can_rec.h"
+#include "bsp_flash.h"
+#include "bsp_ts.h"
+
+#ifdef CONFIG_BSP_PTP
+#include "bsp_ptp.h"
+#endif
+
+LOG_MODULE_REGISTER(bsp_can_rec, CONFIG_LOG_DEFAULT_LEVEL);
+
+/*****************************************************************************/
+#define BUSES_COUNT CONFIG_BSP_CAN_REC_MAX_BUSES
+#define RING_SIZE CONFIG_BSP_CAN_REC_RING_SIZE
+#define RING_MASK (RING_SIZE - 1)
+#define REC_OFFSET CONFIG_BSP_CAN_REC_OFFSET
+#define REC_SIZE CONFIG_BSP_CAN_REC_SIZE
+#define BLOCK_SIZE CONFIG_BSP_CAN_REC_BLOCK_SIZE
+#define BLOCKS_COUNT (REC_SIZE / BLOCK_SIZE)
+#define FLUSH_MS CONFIG_BSP_CAN_REC_FLUSH_MS
+#define POLL_MS 20
+#define ERASE_AHEAD 8 // Blocks erased in advance while the bus is quiet
+#define REC_ALIGN 8
+
+#define STORAGE_PARTITION storage_partition
+#define CANBUS_NODE DT_CHOSEN(zephyr_canbus)
+#define NMEA_NODE DT_ALIAS(canbus_nmea)
+
+BUILD_ASSERT(IS_POWER_OF_TWO(RING_SIZE), "CAN recorder ring size must be a power of two");
+BUILD_ASSERT(BUSES_COUNT <= 3, "Bus number 3 is reserved for markers");
+BUILD_ASSERT(REC_SIZE % BLOCK_SIZE == 0);
+BUILD_ASSERT(BLOCK_SIZE % REC_ALIGN == 0);
+
+/*****************************************************************************/
+/* Flash block layout */
+#define BLOCK_MAGIC 0x43455243 // "CREC"
+#define BLOCK_FORMAT_VERSION 1
+#define BLOCK_FLAG_CAPTURE_START BIT(0) // First block of a session or capture
+#define BLOCK_FLAG_HW_TIMESTAMP BIT(1)  // Records carry the controller timestamp
+#define BLOCK_FLAG_PTP_TIME BIT(2)      // Timestamps are PTP time, otherwise uptime
+
+struct block_header {
+    uint32_t magic;
+    uint8_t format_version;
+    uint8_t flags;
+    uint16_t header_size;
+    uint32_t seq;
+    uint32_t capture;
+    uint32_t records;
+    uint32_t payload_len;
+    uint64_t base_ts_us;
+    uint32_t payload_crc;
+    uint32_t header_crc; // Must be the last member
+};
+
+BUILD_ASSERT(sizeof(struct block_header) % REC_ALIGN == 0);
+
+#define BLOCK_PAYLOAD_MAX (BLOCK_SIZE - sizeof(struct block_header))
+
+/* Record encoding. The encoder state is reset at every block, so each block
+ * decodes on its own (scripts/can_rec_decode.py).
+ *   tag      bits 0-1 bus, bit 2 cached ID, bit 4 extended, bit 5 FD,
+ *            bit 6 BRS, bit 7 RTR
+ *   varint   microseconds since the previous record, the first one since the
+ *            block base timestamp
+ *   le16     controller timestamp, blocks with BLOCK_FLAG_HW_TIMESTAMP only
+ *   id       cache index byte, or varint ID which then enters the cache at
+ *            the next round-robin position
+ *   dlc      byte
+ *   payload  XORed with the previous payload of a cached ID; per started 8
+ *            bytes a mask of the non-zero bytes followed by those bytes
+ * Bus 3 is a marker: bit 2 clear marks the trigger (tag, time), bit 2 set
+ * reports frames lost in the RAM ring (tag, time, varint count).
+ */
+#define TAG_BUS_MASK 0x03
+#define TAG_MARKER 0x03
+#define TAG_CACHED BIT(2)
+#define TAG_EXT BIT(4)
+#define TAG_FD BIT(5)
+#define TAG_BRS BIT(6)
+#define TAG_RTR BIT(7)
+#define MARKER_DROPS TAG_CACHED
+
+#define ID_CACHE_SIZE 32
+#define RECORD_MAX (1 + 10 + 2 + 5 + 1 + CAN_MAX_DLEN / 8 + CAN_MAX_DLEN)
+
+/*****************************************************************************/
+struct rec_slot {
+    uint64_t ts_us;
+    uint32_t id;
+    uint16_t hw_ts;
+    uint8_t flags;
+    uint8_t dlc;
+    uint8_t bus;
+    uint8_t data[CAN_MAX_DLEN];
+};
+
+enum rec_state {
+    REC_IDLE,
+    REC_CONTINUOUS,
+    REC_ARMED,   // Triggered mode, ring holds the pre-trigger history
+    REC_CAPTURE, // Triggered, writer copies the capture window to flash
+};
+
+struct id_cache_entry {
+    uint32_t key; // ID, bit 29 extended, bits 30-31 bus
+    uint8_t data[CAN_MAX_DLEN];
+};
+
+/*****************************************************************************/
+/* Private objects */
+
+// Shared with the receive interrupts, under rec_lock
+static struct {
+    const struct device *dev[BUSES_COUNT];
+    bool monitor[BUSES_COUNT];
+    enum rec_state state;
+    uint32_t head;
+    uint32_t tail;
+    uint64_t window_start_us; // Older frames may be overwritten when the ring is full
+    uint64_t trigger_ts_us;
+    uint64_t pre_us;
+    uint64_t post_us;
+    uint32_t pending_drops;
+    bool trigger_filter_on;
+    struct can_filter trigger_filter;
+    struct bsp_can_rec_stats stats;
+} rec;
+
+static struct k_spinlock rec_lock;
+static K_SEM_DEFINE(rec_sem, 0, 1);
+
+// Writer side, under flash_lock
+static struct {
+    const struct flash_area *fa;
+    uint32_t seq;        // Sequence number of the next block
+    uint32_t erased_seq; // Blocks from seq up to this one are erased
+    uint32_t capture;
+    bool capture_start;
+    bool capturing;
+    bool trigger_pending;
+    bool block_open;
+    uint32_t block_len;
+    uint32_t block_records;
+    uint64_t block_base_us;
+    bool block_ptp;
+    int64_t block_opened_ms;
+    uint64_t last_ts_us;
+    uint8_t cache_used;
+    uint8_t cache_next;
+    struct id_cache_entry cache[ID_CACHE_SIZE];
+} wr;
+
+static K_MUTEX_DEFINE(flash_lock);
+
+// Ring lives in the system RAM (SDRAM on the target), not zeroed at boot
+static struct rec_slot ring[RING_SIZE] __noinit;
+static uint8_t block_buf[BLOCK_SIZE] __aligned(REC_ALIGN);
+
+/*****************************************************************************/
+static uint64_t now_us(void)
+{
+#ifdef CONFIG_BSP_PTP
+    return bsp_ptp_ts_to_ns(bsp_ts_now()) / NSEC_PER_USEC;
+#else
+    return bsp_ts_to_us(bsp_ts_now());
+#endif
+}
+
+/*****************************************************************************/
+static int bus_find(const struct device *dev)
+{
+    for (int i = 0; i < BUSES_COUNT; i++) {
+        if (rec.dev[i] == dev) {
+            return i;
+        }
+    }
+
+    return -ENOENT;
+}
+
+/*****************************************************************************/
+static bool filter_match(const struct can_filter *filter, const struct can_frame *frame)
+{
+    if (((filter->flags & CAN_FILTER_IDE) != 0) != ((frame->flags & CAN_FRAME_IDE) != 0)) {
+        return false;
+    }
+
+    return ((frame->id ^ filter->id) & filter->mask) == 0;
+}
+
+/*****************************************************************************/
+static void trigger_locked(uint64_t ts_us)
+{
+    rec.state = REC_CAPTURE;
+    rec.trigger_ts_us = ts_us;
+    rec.window_start_us = ts_us > rec.pre_us ? ts_us - rec.pre_us : 0;
+}
+
+/*****************************************************************************/
+// Runs in the controller ISR
+static void ring_push(int bus, const struct can_frame *frame)
+{
+    bool wake = false;
+    k_spinlock_key_t key = k_spin_lock(&rec_lock);
+
+    if (rec.state == REC_IDLE) {
+        k_spin_unlock(&rec_lock, key);
+        return;
+    }
+
+    uint64_t ts_us = now_us();
+
+    if (rec.head - rec.tail >= RING_SIZE) {
+        if (ring[rec.tail & RING_MASK].ts_us < rec.window_start_us) {
+            // Outside the pre-trigger window, overwrite the oldest
+            rec.tail++;
+        } else {
+            rec.stats.dropped++;
+            rec.pending_drops++;
+            k_spin_unlock(&rec_lock, key);
+            return;
+        }
+    }
+
+    struct rec_slot *slot = &ring[rec.head & RING_MASK];
+    size_t len = (frame->flags & CAN_FRAME_RTR) ? 0 : can_dlc_to_bytes(frame->dlc);
+
+    slot->ts_us = ts_us;
+    slot->id = frame->id;
+#ifdef CONFIG_CAN_RX_TIMESTAMP
+    slot->hw_ts = frame->timestamp;
+#endif
+    slot->flags = frame->flags;
+    slot->dlc = frame->dlc;
+    slot->bus = bus;
+    memcpy(slot->data, frame->data, len);
+    rec.head++;
+
+    uint32_t used = rec.head - rec.tail;
+
+    if (rec.state == REC_ARMED) {
+        if (rec.trigger_filter_on && filter_match(&rec.trigger_filter, frame)) {
+            trigger_locked(ts_us);
+            wake = true;
+        }
+    } else {
+        rec.stats.ring_high_water = MAX(rec.stats.ring_high_water, used);
+        wake = (used == RING_SIZE / 4);
+    }
+
+    k_spin_unlock(&rec_lock, key);
+
+    if (wake) {
+        k_sem_give(&rec_sem);
+    }
+}
+
+/*****************************************************************************/
+void bsp_can_rec_rx(const struct device *dev, const struct can_frame *frame)
+{
+    int bus = bus_find(dev);
+
+    if (bus >= 0 && !rec.monitor[bus]) {
+        ring_push(bus, frame);
+    }
+}
+
+/*****************************************************************************/
+static void monitor_rx(const struct device *dev, struct can_frame *frame, void *user_data)
+{
+    ARG_UNUSED(dev);
+
+    ring_push((int)(uintptr_t)user_data, frame);
+}
+
+/*****************************************************************************/
+/* Encoder */
+static uint8_t *varint_put(uint8_t *p, uint64_t v)
+{
+    while (v >= 0x80) {
+        *p++ = (uint8_t)v | 0x80;
+        v >>= 7;
+    }
+    *p++ = (uint8_t)v;
+
+    return p;
+}
+
+/*****************************************************************************/
+static uint8_t *time_put(uint8_t *p, uint64_t ts_us)
+{
+    // Ring order is time order, only a marker can be behind the last frame
+    ts_us = MAX(ts_us, wr.last_ts_us);
+    p = varint_put(p, ts_us - wr.last_ts_us);
+    wr.last_ts_us = ts_us;
+
+    return p;
+}
+
+/*****************************************************************************/
+static uint8_t *payload_put(uint8_t *p, const uint8_t *data, size_t len)
+{
+    for (size_t group = 0; group < len; group += 8) {
+        uint8_t *mask = p++;
+
+        *mask = 0;
+        for (size_t i = group; i < MIN(group + 8, len); i++) {
+            if (data[i] != 0) {
+                *mask |= BIT(i - group);
+                *p++ = data[i];
+            }
+        }
+    }
+
+    return p;
+}
+
+/*****************************************************************************/
+static int cache_find(uint32_t key)
+{
+    for (int i = 0; i < wr.cache_used; i++) {
+        if (wr.cache[i].key == key) {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/*****************************************************************************/
+static int cache_insert(uint32_t key)
+{
+    int idx = wr.cache_next;
+
+    wr.cache_next = (wr.cache_next + 1) % ID_CACHE_SIZE;
+    if (wr.cache_used < ID_CACHE_SIZE) {
+        wr.cache_used++;
+    }
+    wr.cache[idx].key = key;
+    memset(wr.cache[idx].data, 0, sizeof(wr.cache[idx].data));
+
+    return idx;
+}
+
+/*****************************************************************************/
+static int block_write(uint32_t seq, size_t len)
+{
+    off_t off = REC_OFFSET + (off_t)(seq % BLOCKS_COUNT) * BLOCK_SIZE;
+    int err = 0;
+
+    if ((int32_t)(seq - wr.erased_seq) >= 0) {
+        err = flash_area_erase(wr.fa, off, BLOCK_SIZE);
+        wr.erased_seq = seq + 1;
+    }
+
+    // Payload first and header last, so a torn block never looks valid
+    if (err == 0 && len > sizeof(struct block_header)) {
+        err = bsp_flash_write(wr.fa, off + sizeof(struct block_header),
+                              block_buf + sizeof(struct block_header),
+                              len - sizeof(struct block_header));
+    }
+
+    if (err == 0) {
+        err = flash_area_write(wr.fa, off, block_buf, sizeof(struct block_header));
+    }
+
+    return err;
+}
+
+/*****************************************************************************/
+static void block_flush(void)
+{
+    if (!wr.block_open) {
+        return;
+    }
+
+    wr.block_open = false;
+
+    if (wr.block_records == 0) {
+        return;
+    }
+
+    struct block_header *hdr = (struct block_header *)block_buf;
+    const uint8_t *payload = block_buf + sizeof(*hdr);
+    size_t padded = ROUND_UP(wr.block_len, REC_ALIGN);
+
+    memset(block_buf + sizeof(*hdr) + wr.block_len, 0, padded - wr.block_len);
+
+    hdr->magic = BLOCK_MAGIC;
+    hdr->format_version = BLOCK_FORMAT_VERSION;
+    hdr->flags = wr.capture_start ? BLOCK_FLAG_CAPTURE_START : 0;
+#ifdef CONFIG_CAN_RX_TIMESTAMP
+    hdr->flags |= BLOCK_FLAG_HW_TIMESTAMP;
+#endif
+    if (wr.block_ptp) {
+        hdr->flags |= BLOCK_FLAG_PTP_TIME;
+    }
+    hdr->header_size = sizeof(*hdr);
+    hdr->seq = wr.seq;
+    hdr->capture = wr.capture;
+    hdr->records = wr.block_records;
+    hdr->payload_len = wr.block_len;
+    hdr->base_ts_us = wr.block_base_us;
+    hdr->payload_crc = crc32_ieee(payload, wr.block_len);
+    hdr->header_crc = crc32_ieee(hdr, offsetof(struct block_header, header_crc));
+
+    int err = block_write(wr.seq, sizeof(*hdr) + padded);
+    if (err) {
+        LOG_ERR("Block %u not written (err %d)", wr.seq, err);
+        rec.stats.flash_errors++;
+    } else {
+        rec.stats.blocks++;
+        rec.stats.bytes_stored += wr.block_len;
+    }
+
+    // A failed block is skipped, the next one goes to the following location
+    wr.seq++;
+    wr.capture_start = false;
+}
+
+/*****************************************************************************/
+// Returns the write position for one record, flushing and opening blocks as needed
+static uint8_t *record_begin(uint64_t ts_us)
+{
+    if (wr.block_open && wr.block_len + RECORD_MAX > BLOCK_PAYLOAD_MAX) {
+        block_flush();
+    }
+
+    if (!wr.block_open) {
+        wr.block_open = true;
+        wr.block_len = 0;
+        wr.block_records = 0;
+        wr.block_base_us = ts_us;
+#ifdef CONFIG_BSP_PTP
+        wr.block_ptp = bsp_ptp_valid();
+#endif
+        wr.block_opened_ms = k_uptime_get();
+        wr.last_ts_us = ts_us;
+        wr.cache_used = 0;
+        wr.cache_next = 0;
+    }
+
+    return block_buf + sizeof(struct block_header) + wr.block_len;
+}
+
+/*****************************************************************************/
+static void record_end(const uint8_t *p)
+{
+    wr.block_len = p - (block_buf + sizeof(struct block_header));
+    wr.block_records++;
+}
+
+/*****************************************************************************/
+static void marker_put(uint64_t ts_us, bool drops, uint32_t count)
+{
+    uint8_t *p = record_begin(ts_us);
+
+    *p++ = TAG_MARKER | (drops ? MARKER_DROPS : 0);
+    p = time_put(p, ts_us);
+    if (drops) {
+        p = varint_put(p, count);
+    }
+
+    record_end(p);
+}
+
+/*****************************************************************************/
+static void frame_put(const struct rec_slot *slot)
+{
+    bool ext = (slot->flags & CAN_FRAME_IDE) != 0;
+    size_t len = (slot->flags & CAN_FRAME_RTR) ? 0 : can_dlc_to_bytes(slot->dlc);
+    uint32_t key = slot->id | (ext ? BIT(29) : 0) | ((uint32_t)slot->bus << 30);
+    uint8_t *p = record_begin(slot->ts_us);
+    uint8_t tag = slot->bus;
+    uint8_t payload[CAN_MAX_DLEN];
+
+    tag |= ext ? TAG_EXT : 0;
+    tag |= (slot->flags & CAN_FRAME_FDF) ? TAG_FD : 0;
+    tag |= (slot->flags & CAN_FRAME_BRS) ? TAG_BRS : 0;
+    tag |= (slot->flags & CAN_FRAME_RTR) ? TAG_RTR : 0;
+
+    int idx = cache_find(key);
+
+    memcpy(payload, slot->data, len);
+    if (idx >= 0) {
+        tag |= TAG_CACHED;
+        for (size_t i = 0; i < len; i++) {
+            payload[i] ^= wr.cache[idx].data[i];
+        }
+    }
+
+    *p++ = tag;
+    p = time_put(p, slot->ts_us);
+#ifdef CONFIG_CAN_RX_TIMESTAMP
+    sys_put_le16(slot->hw_ts, p);
+    p += 2;
+#endif
+    if (idx >= 0) {
+        *p++ = idx;
+    } else {
+        p = varint_put(p, slot->id);
+        idx = cache_insert(key);
+    }
+    *p++ = slot->dlc;
+    p = payload_put(p, payload, len);
+
+    memcpy(wr.cache[idx].data, slot->data, len);
+    record_end(p);
+
+    rec.stats.frames++;
+    rec.stats.bytes_raw += 16 + len;
+}
+
+/*****************************************************************************/
+// Writes ring frames up to end_us, returns true when a later frame is reached
+static bool ring_drain(uint64_t end_us)
+{
+    k_spinlock_key_t key = k_spin_lock(&rec_lock);
+    uint32_t tail = rec.tail;
+    uint32_t head = rec.head;
+    k_spin_unlock(&rec_lock, key);
+
+    // Bounded by the head seen on entry, so flash_lock is released regularly
+    for (; tail != head; tail++) {
+        const struct rec_slot *slot = &ring[tail & RING_MASK];
+
+        if (slot->ts_us > end_us) {
+            return true;
+        }
+
+        if (wr.trigger_pending && slot->ts_us >= rec.trigger_ts_us) {
+            marker_put(rec.trigger_ts_us, false, 0);
+            wr.trigger_pending = false;
+        }
+
+        frame_put(slot);
+
+        key = k_spin_lock(&rec_lock);
+        rec.tail = tail + 1;
+        k_spin_unlock(&rec_lock, key);
+    }
+
+    return false;
+}
+
+/*****************************************************************************/
+static void capture_begin(void)
+{
+    // Skip the history older than the pre-trigger window
+    k_spinlock_key_t key = k_spin_lock(&rec_lock);
+    while (rec.tail != rec.head && ring[rec.tail & RING_MASK].ts_us < rec.window_start_us) {
+        rec.tail++;
+    }
+    k_spin_unlock(&rec_lock, key);
+
+    block_flush();
+    wr.capture++;
+    wr.capture_start = true;
+    wr.capturing = true;
+    wr.trigger_pending = true;
+    rec.stats.captures++;
+}
+
+/*****************************************************************************/
+static void capture_end(void)
+{
+    if (wr.trigger_pending) {
+        marker_put(MAX(rec.trigger_ts_us, wr.last_ts_us), false, 0);
+        wr.trigger_pending = false;
+    }
+
+    block_flush();
+    wr.capturing = false;
+
+    k_spinlock_key_t key = k_spin_lock(&rec_lock);
+    if (rec.state == REC_CAPTURE) {
+        rec.state = REC_ARMED;
+        rec.window_start_us = UINT64_MAX;
+    } else if (rec.state == REC_IDLE) {
+        rec.tail = rec.head;
+    }
+    k_spin_unlock(&rec_lock, key);
+
+    LOG_INF("Capture %u written", wr.capture);
+}
+
+/*****************************************************************************/
+static void erase_ahead(void)
+{
+    if ((int32_t)(wr.erased_seq - wr.seq) < 0) {
+        wr.erased_seq = wr.seq;
+    }
+
+    if ((int32_t)(wr.erased_seq - wr.seq) >= MIN(ERASE_AHEAD, BLOCKS_COUNT - 1)) {
+        return;
+    }
+
+    off_t off = REC_OFFSET + (off_t)(wr.erased_seq % BLOCKS_COUNT) * BLOCK_SIZE;
+
+    if (flash_area_erase(wr.fa, off, BLOCK_SIZE) == 0) {
+        wr.erased_seq++;
+    }
+}
+
+/*****************************************************************************/
+// One writer pass, called with flash_lock held
+static void writer_poll(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&rec_lock);
+    enum rec_state state = rec.state;
+    uint32_t drops = rec.pending_drops;
+    uint32_t used = rec.head - rec.tail;
+    rec.pending_drops = 0;
+    k_spin_unlock(&rec_lock, key);
+
+    if (state == REC_CAPTURE && !wr.capturing) {
+        capture_begin();
+    }
+
+    uint64_t end_us = wr.capturing ? rec.trigger_ts_us + rec.post_us : UINT64_MAX;
+    bool ended = false;
+
+    // In the armed state the ring is only history, nothing to write
+    if (state != REC_ARMED) {
+        ended = ring_drain(end_us);
+    }
+
+    // Frames are lost while the ring is full, so after the frames it held
+    if (drops > 0 && (state == REC_CONTINUOUS || wr.capturing)) {
+        marker_put(wr.block_open ? wr.last_ts_us : now_us(), true, drops);
+    }
+
+    if (wr.capturing && (ended || state == REC_IDLE || now_us() > end_us)) {
+        capture_end();
+    }
+
+    if (wr.block_open && (state == REC_IDLE || k_uptime_get() - wr.block_opened_ms >= FLUSH_MS)) {
+        block_flush();
+    }
+
+    // Erase while the ring has room to absorb it
+    if (state != REC_IDLE && used < RING_SIZE / 8) {
+        erase_ahead();
+    }
+}
+
+/*****************************************************************************/
+static void writer_thread(void *p1, void *p2, void *p3)
+{
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    for (;;) {
+        k_sem_take(&rec_sem, K_MSEC(POLL_MS));
+
+        if (wr.fa == NULL) {
+            continue;
+        }
+
+        k_mutex_lock(&flash_lock, K_FOREVER);
+        writer_poll();
+        k_mutex_unlock(&flash_lock);
+    }
+}
+
+K_THREAD_DEFINE(can_rec_thread, CONFIG_BSP_CAN_REC_THREAD_STACK_SIZE, writer_thread, NULL, NULL,
+                NULL, CONFIG_BSP_CAN_REC_THREAD_PRIORITY, 0, 0);
+
+/*****************************************************************************/
+int bsp_can_rec_bus_add(const struct device *dev, bool monitor)
+{
+    if (dev == NULL || !device_is_ready(dev)) {
+        return -ENODEV;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&rec_lock);
+
+    int bus = bus_find(dev);
+    if (bus >= 0) {
+        k_spin_unlock(&rec_lock, key);
+        return -EALREADY;
+    }
+
+    bus = bus_find(NULL);
+    if (bus < 0) {
+        k_spin_unlock(&rec_lock, key);
+        return -ENOSPC;
+    }
+
+    rec.monitor[bus] = monitor;
+    rec.dev[bus] = dev;
+
+    k_spin_unlock(&rec_lock, key);
+
+    if (monitor) {
+        static const struct can_filter monitor_filters[] = {
+            {.id = 0, .mask = 0},
+            {.id = 0, .mask = 0, .flags = CAN_FILTER_IDE},
+        };
+
+        for (size_t i = 0; i < ARRAY_SIZE(monitor_filters); i++) {
+            int err = can_add_rx_filter(dev, monitor_rx, (void *)(uintptr_t)bus,
+                                        &monitor_filters[i]);
+            if (err < 0) {
+                LOG_WRN("%s: no filter left for recording (err %d)", dev->name, err);
+            }
+        }
+    }
+
+    return bus;
+}
+
+/*****************************************************************************/
+int bsp_can_rec_start(enum bsp_can_rec_mode mode, uint32_t pre_ms, uint32_t post_ms)
+{
+    if (wr.fa == NULL) {
+        return -ENODEV;
+    }
+
+    k_mutex_lock(&flash_lock, K_FOREVER);
+
+    k_spinlock_key_t key = k_spin_lock(&rec_lock);
+
+    if (rec.state != REC_IDLE) {
+        k_spin_unlock(&rec_lock, key);
+        k_mutex_unlock(&flash_lock);
+        return -EBUSY;
+    }
+
+    rec.tail = rec.head;
+    rec.pending_drops = 0;
+    rec.pre_us = (uint64_t)pre_ms * USEC_PER_MSEC;
+    rec.post_us = (uint64_t)post_ms * USEC_PER_MSEC;
+
+    if (mode == BSP_CAN_REC_CONTINUOUS) {
+        rec.window_start_us = 0;
+        rec.state = REC_CONTINUOUS;
+    } else {
+        rec.window_start_us = UINT64_MAX;
+        rec.state = REC_ARMED;
+    }
+
+    k_spin_unlock(&rec_lock, key);
+
+    if (mode == BSP_CAN_REC_CONTINUOUS) {
+        wr.capture++;
+        wr.capture_start = true;
+        rec.stats.captures++;
+    }
+
+    k_mutex_unlock(&flash_lock);
+
+    return 0;
+}
+
+/*****************************************************************************/
+int bsp_can_rec_stop(void)
+{
+    k_mutex_lock(&flash_lock, K_FOREVER);
+
+    k_spinlock_key_t key = k_spin_lock(&rec_lock);
+    if (rec.state == REC_ARMED) {
+        // Only history, discard it
+        rec.tail = rec.head;
+    }
+    rec.state = REC_IDLE;
+    k_spin_unlock(&rec_lock, key);
+
+    // Write what is left in the ring and the open block
+    if (wr.fa != NULL) {
+        writer_poll();
+    }
+
+    k_mutex_unlock(&flash_lock);
+
+    return 0;
+}
+
+/*****************************************************************************/
+int bsp_can_rec_trigger(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&rec_lock);
+
+    if (rec.state != REC_ARMED) {
+        k_spin_unlock(&rec_lock, key);
+        return -EAGAIN;
+    }
+
+    trigger_locked(now_us());
+    k_spin_unlock(&rec_lock, key);
+
+    k_sem_give(&rec_sem);
+
+    return 0;
+}
+
+/*****************************************************************************/
+void bsp_can_rec_trigger_set(const struct can_filter *filter)
+{
+    k_spinlock_key_t key = k_spin_lock(&rec_lock);
+
+    rec.trigger_filter_on = (filter != NULL);
+    if (filter != NULL) {
+        rec.trigger_filter = *filter;
+    }
+
+    k_spin_unlock(&rec_lock, key);
+}
+
+/*****************************************************************************/
+int bsp_can_rec_erase(void)
+{
+    if (wr.fa == NULL) {
+        return -ENODEV;
+    }
+
+    // Sequence numbers keep counting, the whole area is ready to program once
+    // erased_seq reaches end. One block per lock, the writer runs in between.
+    k_mutex_lock(&flash_lock, K_FOREVER);
+    uint32_t end = wr.seq + BLOCKS_COUNT;
+    if ((int32_t)(wr.erased_seq - wr.seq) < 0) {
+        wr.erased_seq = wr.seq;
+    }
+    k_mutex_unlock(&flash_lock);
+
+    int err = 0;
+    for (;;) {
+        k_mutex_lock(&flash_lock, K_FOREVER);
+
+        bool done = (int32_t)(wr.erased_seq - end) >= 0;
+        if (rec.state != REC_IDLE) {
+            // Armed meanwhile, blocks being recorded must not be erased
+            err = -EBUSY;
+        } else if (!done) {
+            off_t off = REC_OFFSET + (off_t)(wr.erased_seq % BLOCKS_COUNT) * BLOCK_SIZE;
+
+            err = flash_area_erase(wr.fa, off, BLOCK_SIZE);
+            if (err == 0) {
+                wr.erased_seq++;
+            }
+        }
+
+        k_mutex_unlock(&flash_lock);
+
+        if (done || err) {
+            return err;
+        }
+    }
+}
+
+/*****************************************************************************/
+int bsp_can_rec_read(off_t offset, void *buf, size_t len)
+{
+    if (wr.fa == NULL) {
+        return -ENODEV;
+    }
+
+    if (offset < 0 || offset + len > REC_SIZE) {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&flash_lock, K_FOREVER);
+    int err = flash_area_read(wr.fa, REC_OFFSET + offset, buf, len);
+    k_mutex_unlock(&flash_lock);
+
+    return err;
+}
+
+/*****************************************************************************/
+void bsp_can_rec_stats_get(struct bsp_can_rec_stats *stats)
+{
+    k_spinlock_key_t key = k_spin_lock(&rec_lock);
+    *stats = rec.stats;
+    k_spin_unlock(&rec_lock, key);
+}
+
+/*****************************************************************************/
+static bool header_valid(const struct block_header *hdr)
+{
+    if (hdr->magic != BLOCK_MAGIC || hdr->format_version != BLOCK_FORMAT_VERSION ||
+        hdr->header_size != sizeof(struct block_header) || hdr->payload_len > BLOCK_PAYLOAD_MAX) {
+        return false;
+    }
+
+    return crc32_ieee(hdr, offsetof(struct block_header, header_crc)) == hdr->header_crc;
+}
+
+/*****************************************************************************/
+static int bsp_can_rec_init(void)
+{
+    const struct flash_area *fa;
+    int err = flash_area_open(FIXED_PARTITION_ID(STORAGE_PARTITION), &fa);
+
+    if (err) {
+        LOG_ERR("Storage partition not available (err %d)", err);
+        return 0;
+    }
+
+    if (REC_OFFSET + REC_SIZE > fa->fa_size) {
+        LOG_ERR("Recording area 0x%x+0x%x outside the storage partition", REC_OFFSET,
+                REC_SIZE);
+        flash_area_close(fa);
+        return 0;
+    }
+
+    // Continue after the newest block
+    bool found = false;
+    uint32_t seq = 0;
+    uint32_t capture = 0;
+
+    for (int i = 0; i < BLOCKS_COUNT; i++) {
+        struct block_header hdr;
+
+        if (flash_area_read(fa, REC_OFFSET + (off_t)i * BLOCK_SIZE, &hdr, sizeof(hdr)) ||
+            !header_valid(&hdr)) {
+            continue;
+        }
+
+        if (!found || (int32_t)(hdr.seq - seq) > 0) {
+            seq = hdr.seq;
+            capture = hdr.capture;
+            found = true;
+        }
+    }
+
+    wr.seq = found ? seq + 1 : 0;
+    wr.erased_seq = wr.seq;
+    wr.capture = capture;
+    wr.fa = fa;
+
+#if DT_NODE_HAS_STATUS(CANBUS_NODE, okay)
+    bsp_can_rec_bus_add(DEVICE_DT_GET(CANBUS_NODE), false);
+#endif
+#if DT_NODE_HAS_STATUS(NMEA_NODE, okay)
+    bsp_can_rec_bus_add(DEVICE_DT_GET(NMEA_NODE), false);
+#endif
+
+    LOG_INF("CAN recorder: %d blocks of %d bytes, next block %u", BLOCKS_COUNT, BLOCK_SIZE,
+            wr.seq);
+
+    return 0;
+}
+
+SYS_INIT(bsp_can_rec_init, APPLICATION, 30);
+
+/*****************************************************************************/
+/* Shell */
+#ifdef CONFIG_SHELL
+static int cmd_can_rec_start(const struct shell *sh, size_t argc, char **argv)
+{
+    enum bsp_can_rec_mode mode = BSP_CAN_REC_CONTINUOUS;
+    uint32_t pre_ms = 1000;
+    uint32_t post_ms = 1000;
+
+    if (argc > 1 && strcmp(argv[1], "trig") == 0) {
+        mode = BSP_CAN_REC_TRIGGERED;
+    } else if (argc > 1 && strcmp(argv[1], "cont") != 0) {
+        shell_error(sh, "Mode is cont or trig");
+        return -EINVAL;
+    }
+
+    if (argc > 2) {
+        pre_ms = strtoul(argv[2], NULL, 0);
+    }
+    if (argc > 3) {
+        post_ms = strtoul(argv[3], NULL, 0);
+    }
+
+    int err = bsp_can_rec_start(mode, pre_ms, post_ms);
+    if (err) {
+        shell_error(sh, "Recording not started (err %d)", err);
+    }
+
+    return err;
+}
+
+/*****************************************************************************/
+static int cmd_can_rec_stop(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(sh);
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    return bsp_can_rec_stop();
+}
+
+/*****************************************************************************/
+static int cmd_can_rec_trigger(const struct shell *sh, size_t argc, char **argv)
+{
+    if (argc > 2) {
+        struct can_filter filter = {
+            .id = strtoul(argv[1], NULL, 0),
+            .mask = strtoul(argv[2], NULL, 0),
+        };
+
+        if (filter.id > CAN_STD_ID_MASK || filter.mask > CAN_STD_ID_MASK) {
+            filter.flags = CAN_FILTER_IDE;
+        }
+
+        bsp_can_rec_trigger_set(&filter);
+        return 0;
+    }
+
+    int err = bsp_can_rec_trigger();
+    if (err) {
+        shell_error(sh, "Not armed");
+    }
+
+    return err;
+}
+
+/*****************************************************************************/
+static int cmd_can_rec_bus(const struct shell *sh, size_t argc, char **argv)
+{
+    const struct device *dev = device_get_binding(argv[1]);
+    bool monitor = argc > 2 && strcmp(argv[2], "monitor") == 0;
+
+    int bus = bsp_can_rec_bus_add(dev, monitor);
+    if (bus < 0) {
+        shell_error(sh, "Bus not added (err %d)", bus);
+        return bus;
+    }
+
+    shell_print(sh, "%s recorded as can%d", argv[1], bus);
+
+    return 0;
+}
+
+/*****************************************************************************/
+static int cmd_can_rec_status(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    static const char *const state_names[] = {"idle", "continuous", "armed", "capturing"};
+    struct bsp_can_rec_stats s;
+
+    bsp_can_rec_stats_get(&s);
+
+    shell_print(sh, "State %s, next block %u of %d", state_names[rec.state], wr.seq,
+                BLOCKS_COUNT);
+    for (int i = 0; i < BUSES_COUNT; i++) {
+        if (rec.dev[i] != NULL) {
+            shell_print(sh, "  can%d: %s (%s)", i, rec.dev[i]->name,
+                        rec.monitor[i] ? "monitor" : "tap");
+        }
+    }
+    shell_print(sh, "Frames %u, dropped %u, ring high water %u of %d", s.frames, s.dropped,
+                s.ring_high_water, RING_SIZE);
+    shell_print(sh, "Captures %u, blocks %u, flash errors %u", s.captures, s.blocks,
+                s.flash_errors);
+    shell_print(sh, "Raw %llu bytes, stored %llu bytes", (unsigned long long)s.bytes_raw,
+                (unsigned long long)s.bytes_stored);
+
+    return 0;
+}
+
+/*****************************************************************************/
+// Prints the valid blocks oldest first as ":<offset> <hex>" lines for
+// scripts/can_rec_decode.py
+static int cmd_can_rec_dump(const struct shell *sh, size_t argc, char **argv)
+{
+    uint32_t count = argc > 1 ? strtoul(argv[1], NULL, 0) : BLOCKS_COUNT;
+    uint32_t last = wr.seq;
+    uint32_t first = last - MIN(MIN(count, BLOCKS_COUNT), last);
+    static uint8_t buf[BLOCK_SIZE];
+    char hex[2 * 32 + 1];
+
+    for (uint32_t seq = first; seq != last; seq++) {
+        off_t off = (off_t)(seq % BLOCKS_COUNT) * BLOCK_SIZE;
+        struct block_header *hdr = (struct block_header *)buf;
+
+        if (bsp_can_rec_read(off, buf, BLOCK_SIZE) != 0 || !header_valid(hdr) ||
+            hdr->seq != seq) {
+            continue;
+        }
+
+        size_t len = sizeof(*hdr) + hdr->payload_len;
+
+        for (size_t pos = 0; pos < len; pos += 32) {
+            size_t n = MIN(32, len - pos);
+
+            bin2hex(buf + pos, n, hex, sizeof(hex));
+            shell_print(sh, ":%08lx %s", (unsigned long)(off + pos), hex);
+        }
+    }
+
+    return 0;
+}
+
+/*****************************************************************************/
+static int cmd_can_rec_erase(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    int err = bsp_can_rec_erase();
+    if (err) {
+        shell_error(sh, "Not erased (err %d)", err);
+    }
+
+    return err;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(
+    sub_can_rec,
+    SHELL_CMD_ARG(start, NULL, "[cont|trig] [pre ms] [post ms]", cmd_can_rec_start, 1, 3),
+    SHELL_CMD_ARG(stop, NULL, "Stop recording", cmd_can_rec_stop, 1, 0),
+    SHELL_CMD_ARG(trigger, NULL, "Trigger now, or [<id> <mask>] trigger on a frame",
+                  cmd_can_rec_trigger, 1, 2),
+    SHELL_CMD_ARG(bus, NULL, "<device> [monitor]", cmd_can_rec_bus, 2, 1),
+    SHELL_CMD_ARG(status, NULL, "Show recorder status", cmd_can_rec_status, 1, 0),
+    SHELL_CMD_ARG(dump, NULL, "[blocks] Export the newest blocks", cmd_can_rec_dump, 1, 1),
+    SHELL_CMD_ARG(erase, NULL, "Erase the recording area", cmd_can_rec_erase, 1, 0),
+    SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(can_rec, &sub_can_rec, "CAN traffic recorder", NULL);
+#endif /* CONFIG_SHELL */
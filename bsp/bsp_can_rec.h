@@ -0,0 +1,77 @@
+#ifndef BSP_CAN_REC_H_
+#define BSP_CAN_REC_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/can.h>
+
+enum bsp_can_rec_mode {
+    BSP_CAN_REC_CONTINUOUS, // Every frame goes to flash
+    BSP_CAN_REC_TRIGGERED,  // Frames around each trigger go to flash
+};
+
+struct bsp_can_rec_stats {
+    uint32_t frames;          // Frames written to flash
+    uint32_t dropped;         // Frames lost because the RAM ring was full
+    uint32_t ring_high_water; // Most frames waiting in the RAM ring
+    uint32_t captures;        // Recording sessions and triggered captures
+    uint32_t blocks;          // Flash blocks written
+    uint32_t flash_errors;
+    uint64_t bytes_raw;       // Frames as 16 byte headers plus payload
+    uint64_t bytes_stored;    // Compressed block payload
+};
+
+/*****************************************************************************/
+
+/// @brief Adds a controller to the recording. In tap mode the recorder sees
+/// the frames accepted by the BSP CAN services (bsp_can, gateway); in monitor
+/// mode it adds its own accept-all filters. The zephyr,canbus controller and
+/// the canbus-nmea alias are added in tap mode at boot.
+/// @param dev
+/// @param monitor
+/// @return Bus number used in the recording, -ENOSPC if all slots are in use
+int bsp_can_rec_bus_add(const struct device *dev, bool monitor);
+
+/// @brief Starts recording
+/// @param mode
+/// @param pre_ms Triggered mode: history kept before the trigger
+/// @param post_ms Triggered mode: recording time after the trigger
+/// @return 0 on success, -EBUSY if already recording
+int bsp_can_rec_start(enum bsp_can_rec_mode mode, uint32_t pre_ms, uint32_t post_ms);
+
+/// @brief Stops recording, frames already received are still written
+/// @return 0 on success
+int bsp_can_rec_stop(void);
+
+/// @brief Triggers a capture in triggered mode. ISR safe.
+/// @return 0 on success, -EAGAIN if not armed
+int bsp_can_rec_trigger(void);
+
+/// @brief Triggers a capture when a recorded frame matches the filter
+/// @param filter NULL disables the frame trigger
+void bsp_can_rec_trigger_set(const struct can_filter *filter);
+
+/// @brief Erases the recording area, one block at a time
+/// @return 0 on success, -EBUSY while recording or armed before the end
+int bsp_can_rec_erase(void);
+
+/// @brief Reads the recording area as stored, for export
+/// @param offset
+/// @param buf
+/// @param len
+/// @return 0 on success
+int bsp_can_rec_read(off_t offset, void *buf, size_t len);
+
+/// @brief Returns the recorder statistics
+/// @param stats
+void bsp_can_rec_stats_get(struct bsp_can_rec_stats *stats);
+
+/// @brief Hands a received frame to the recorder, called from receive filter
+/// callbacks of the BSP CAN services
+void bsp_can_rec_rx(const struct device *dev, const struct can_frame *frame);
+
+#endif // BSP_CAN_REC_H_
@@ -0,0 +1,484 @@
+#include <errno.h>
+#include <string.h>
+
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/can.h>
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/util.h>
+
+#include "bsp_can_stats.h"
+
+LOG_MODULE_REGISTER(bsp_can_stats, CONFIG_LOG_DEFAULT_LEVEL);
+
+/*****************************************************************************/
+#define BUSES_COUNT CONFIG_BSP_CAN_STATS_MAX_BUSES
+#define WINDOW_MS CONFIG_BSP_CAN_STATS_WINDOW_MS
+#define INFLIGHT_COUNT CONFIG_BSP_CAN_STATS_TX_INFLIGHT
+
+#define CANBUS_NODE DT_CHOSEN(zephyr_canbus)
+#define NMEA_NODE DT_ALIAS(canbus_nmea)
+
+#ifdef CONFIG_CAN_FD_MODE
+#define NODE_BITRATE_DATA(node) DT_PROP_OR(node, bitrate_data, CONFIG_CAN_DEFAULT_BITRATE_DATA)
+#else
+#define NODE_BITRATE_DATA(node) 0
+#endif
+#define NODE_BITRATE(node) DT_PROP_OR(node, bitrate, CONFIG_CAN_DEFAULT_BITRATE)
+
+struct can_stats_ctx {
+    const struct device *dev;
+    uint32_t bitrate;
+    uint32_t bitrate_data;
+    atomic_t window_bits; // Nominal bit times on the bus in the current window
+    atomic_t rx_frames;
+    atomic_t tx_frames;
+    atomic_t tx_errors;
+    atomic_t rx_overruns;
+    struct bsp_can_stats stats; // Window, state and histogram part
+};
+
+// In flight between can_send() and the transmit done callback
+struct tx_ctx {
+    struct can_stats_ctx *ctx;
+    uint32_t cycles;
+    can_tx_callback_t callback;
+    void *user_data;
+};
+
+/*****************************************************************************/
+/* Private objects */
+static struct can_stats_ctx buses[BUSES_COUNT];
+static struct k_spinlock stats_lock;
+
+K_MEM_SLAB_DEFINE_STATIC(tx_slab, sizeof(struct tx_ctx), INFLIGHT_COUNT, 4);
+
+static void window_expiry(struct k_timer *timer);
+static K_TIMER_DEFINE(window_timer, window_expiry, NULL);
+
+/*****************************************************************************/
+static struct can_stats_ctx *ctx_find(const struct device *dev)
+{
+    for (int i = 0; i < BUSES_COUNT; i++) {
+        if (buses[i].dev == dev) {
+            return &buses[i];
+        }
+    }
+
+    return NULL;
+}
+
+/*****************************************************************************/
+// Frame length in nominal bit times: header, payload, CRC and trailer, with
+// a 10% allowance for stuff bits. The CAN-FD data phase is scaled by the
+// bitrate ratio when the frame switches bitrate.
+static uint32_t frame_bits(const struct can_stats_ctx *ctx, const struct can_frame *frame)
+{
+    uint32_t len = can_dlc_to_bytes(frame->dlc);
+    bool ext = (frame->flags & CAN_FRAME_IDE) != 0;
+    uint32_t arb_bits;
+    uint32_t data_bits;
+
+    if (frame->flags & CAN_FRAME_FDF) {
+        // SOF..BRS and ACK..IFS at nominal rate, ESI..CRC delimiter at data rate
+        arb_bits = (ext ? 33 : 14) + 1 + 13;
+        data_bits = 1 + 4 + 8 * len + (len > 16 ? 26 : 22);
+
+        if ((frame->flags & CAN_FRAME_BRS) && ctx->bitrate_data > ctx->bitrate) {
+            data_bits = DIV_ROUND_UP(data_bits * ctx->bitrate, ctx->bitrate_data);
+        }
+    } else {
+        arb_bits = ext ? 67 : 47;
+        data_bits = 8 * len;
+    }
+
+    uint32_t bits = arb_bits + data_bits;
+
+    return bits + bits / 10;
+}
+
+/*****************************************************************************/
+static void hist_add(struct can_stats_ctx *ctx, uint32_t latency_us)
+{
+    int bin = 0;
+
+    while (bin < BSP_CAN_STATS_HIST_BINS - 1 &&
+           latency_us >= ((uint32_t)BSP_CAN_STATS_HIST_BASE_US << bin)) {
+        bin++;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&stats_lock);
+    ctx->stats.tx_latency_hist[bin]++;
+    ctx->stats.tx_latency_max_us = MAX(ctx->stats.tx_latency_max_us, latency_us);
+    k_spin_unlock(&stats_lock, key);
+}
+
+/*****************************************************************************/
+static void window_expiry(struct k_timer *timer)
+{
+    ARG_UNUSED(timer);
+
+    for (int i = 0; i < BUSES_COUNT; i++) {
+        struct can_stats_ctx *ctx = &buses[i];
+
+        if (ctx->dev == NULL) {
+            continue;
+        }
+
+        uint64_t bits = (uint32_t)atomic_clear(&ctx->window_bits);
+        uint32_t capacity = (uint64_t)ctx->bitrate * WINDOW_MS / 1000;
+        uint16_t load = (uint16_t)MIN(bits * 1000 / MAX(capacity, 1), 1000);
+        struct bsp_can_stats *s = &ctx->stats;
+
+        k_spinlock_key_t key = k_spin_lock(&stats_lock);
+        s->load_permille = load;
+        s->load_peak_permille = MAX(s->load_peak_permille, load);
+        // Average with a weight of 1/8 per window
+        s->load_avg_permille = (s->load_avg_permille * 7 + load + 4) / 8;
+        k_spin_unlock(&stats_lock, key);
+    }
+}
+
+/*****************************************************************************/
+static void state_changed(const struct device *dev, enum can_state state,
+                          struct can_bus_err_cnt err_cnt, void *user_data)
+{
+    ARG_UNUSED(dev);
+
+    struct can_stats_ctx *ctx = user_data;
+    struct bsp_can_stats *s = &ctx->stats;
+
+    switch (state) {
+    case CAN_STATE_ERROR_WARNING:
+        s->error_warning++;
+        break;
+    case CAN_STATE_ERROR_PASSIVE:
+        s->error_passive++;
+        break;
+    case CAN_STATE_BUS_OFF:
+        s->bus_off++;
+        break;
+    default:
+        break;
+    }
+
+    s->state = state;
+    s->err_cnt = err_cnt;
+}
+
+/*****************************************************************************/
+static void tx_done(const struct device *dev, int error, void *user_data)
+{
+    struct tx_ctx *tx = user_data;
+    struct can_stats_ctx *ctx = tx->ctx;
+    can_tx_callback_t callback = tx->callback;
+    void *cb_user_data = tx->user_data;
+
+    if (error) {
+        atomic_inc(&ctx->tx_errors);
+    } else {
+        hist_add(ctx, k_cyc_to_us_floor32(k_cycle_get_32() - tx->cycles));
+    }
+
+    k_mem_slab_free(&tx_slab, tx);
+
+    callback(dev, error, cb_user_data);
+}
+
+/*****************************************************************************/
+int bsp_can_stats_send(const struct device *dev, const struct can_frame *frame,
+                       k_timeout_t timeout, can_tx_callback_t callback, void *user_data)
+{
+    struct can_stats_ctx *ctx = ctx_find(dev);
+    struct tx_ctx *tx;
+    int err;
+
+    if (ctx == NULL) {
+        return can_send(dev, frame, timeout, callback, user_data);
+    }
+
+    uint32_t start = k_cycle_get_32();
+
+    if (callback == NULL) {
+        // Blocking send, done when can_send() returns
+        err = can_send(dev, frame, timeout, NULL, NULL);
+        if (err == 0) {
+            hist_add(ctx, k_cyc_to_us_floor32(k_cycle_get_32() - start));
+        }
+    } else if (k_mem_slab_alloc(&tx_slab, (void **)&tx, K_NO_WAIT) == 0) {
+        tx->ctx = ctx;
+        tx->cycles = start;
+        tx->callback = callback;
+        tx->user_data = user_data;
+
+        err = can_send(dev, frame, timeout, tx_done, tx);
+        if (err) {
+            k_mem_slab_free(&tx_slab, tx);
+        }
+    } else {
+        // All in flight slots taken, send without latency tracking
+        err = can_send(dev, frame, timeout, callback, user_data);
+    }
+
+    if (err) {
+        atomic_inc(&ctx->tx_errors);
+    } else {
+        atomic_inc(&ctx->tx_frames);
+        atomic_add(&ctx->window_bits, frame_bits(ctx, frame));
+    }
+
+    return err;
+}
+
+/*****************************************************************************/
+void bsp_can_stats_rx(const struct device *dev, const struct can_frame *frame)
+{
+#ifdef CONFIG_BSP_CAN_STATS_MONITOR
+    // Counted by the monitor filters
+    ARG_UNUSED(dev);
+    ARG_UNUSED(frame);
+#else
+    struct can_stats_ctx *ctx = ctx_find(dev);
+
+    if (ctx == NULL) {
+        return;
+    }
+
+    atomic_inc(&ctx->rx_frames);
+    atomic_add(&ctx->window_bits, frame_bits(ctx, frame));
+#endif
+}
+
+/*****************************************************************************/
+void bsp_can_stats_rx_overrun(const struct device *dev)
+{
+    struct can_stats_ctx *ctx = ctx_find(dev);
+
+    if (ctx != NULL) {
+        atomic_inc(&ctx->rx_overruns);
+    }
+}
+
+/*****************************************************************************/
+#ifdef CONFIG_BSP_CAN_STATS_MONITOR
+static void monitor_rx(const struct device *dev, struct can_frame *frame, void *user_data)
+{
+    ARG_UNUSED(dev);
+
+    struct can_stats_ctx *ctx = user_data;
+
+    atomic_inc(&ctx->rx_frames);
+    atomic_add(&ctx->window_bits, frame_bits(ctx, frame));
+}
+#endif
+
+/*****************************************************************************/
+int bsp_can_stats_register(const struct device *dev, uint32_t bitrate, uint32_t bitrate_data)
+{
+    if (dev == NULL || bitrate == 0) {
+        return -EINVAL;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&stats_lock);
+
+    if (ctx_find(dev) != NULL) {
+        k_spin_unlock(&stats_lock, key);
+        return -EALREADY;
+    }
+
+    struct can_stats_ctx *ctx = ctx_find(NULL);
+    if (ctx == NULL) {
+        k_spin_unlock(&stats_lock, key);
+        return -ENOSPC;
+    }
+
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->bitrate = bitrate;
+    ctx->bitrate_data = bitrate_data;
+    ctx->dev = dev;
+
+    k_spin_unlock(&stats_lock, key);
+
+    can_set_state_change_callback(dev, state_changed, ctx);
+    can_get_state(dev, &ctx->stats.state, &ctx->stats.err_cnt);
+
+#ifdef CONFIG_BSP_CAN_STATS_MONITOR
+    static const struct can_filter monitor_filters[] = {
+        {.id = 0, .mask = 0},
+        {.id = 0, .mask = 0, .flags = CAN_FILTER_IDE},
+    };
+
+    for (size_t i = 0; i < ARRAY_SIZE(monitor_filters); i++) {
+        int err = can_add_rx_filter(dev, monitor_rx, ctx, &monitor_filters[i]);
+        if (err < 0) {
+            LOG_WRN("%s: no filter left for bus monitoring (err %d)", dev->name, err);
+        }
+    }
+#endif
+
+    return 0;
+}
+
+/*****************************************************************************/
+int bsp_can_stats_get(const struct device *dev, struct bsp_can_stats *stats)
+{
+    struct can_stats_ctx *ctx = ctx_find(dev);
+
+    if (ctx == NULL || dev == NULL || stats == NULL) {
+        return -ENOENT;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&stats_lock);
+    *stats = ctx->stats;
+    k_spin_unlock(&stats_lock, key);
+
+    stats->rx_frames = atomic_get(&ctx->rx_frames);
+    stats->tx_frames = atomic_get(&ctx->tx_frames);
+    stats->tx_errors = atomic_get(&ctx->tx_errors);
+    stats->rx_overruns = atomic_get(&ctx->rx_overruns);
+#ifdef CONFIG_CAN_STATS
+    stats->rx_overruns += can_stats_get_rx_overruns(dev);
+#endif
+
+    // Error counters move without state changes, read them fresh
+    can_get_state(dev, &stats->state, &stats->err_cnt);
+
+    return 0;
+}
+
+/*****************************************************************************/
+int bsp_can_stats_reset(const struct device *dev)
+{
+    struct can_stats_ctx *ctx = ctx_find(dev);
+
+    if (ctx == NULL || dev == NULL) {
+        return -ENOENT;
+    }
+
+    atomic_clear(&ctx->rx_frames);
+    atomic_clear(&ctx->tx_frames);
+    atomic_clear(&ctx->tx_errors);
+    atomic_clear(&ctx->rx_overruns);
+
+    k_spinlock_key_t key = k_spin_lock(&stats_lock);
+    ctx->stats.load_peak_permille = 0;
+    ctx->stats.error_warning = 0;
+    ctx->stats.error_passive = 0;
+    ctx->stats.bus_off = 0;
+    ctx->stats.tx_latency_max_us = 0;
+    memset(ctx->stats.tx_latency_hist, 0, sizeof(ctx->stats.tx_latency_hist));
+    k_spin_unlock(&stats_lock, key);
+
+    return 0;
+}
+
+/*****************************************************************************/
+static int bsp_can_stats_init(void)
+{
+#if DT_NODE_HAS_STATUS(CANBUS_NODE, okay)
+    bsp_can_stats_register(DEVICE_DT_GET(CANBUS_NODE), NODE_BITRATE(CANBUS_NODE),
+                           NODE_BITRATE_DATA(CANBUS_NODE));
+#endif
+#if DT_NODE_HAS_STATUS(NMEA_NODE, okay)
+    bsp_can_stats_register(DEVICE_DT_GET(NMEA_NODE), NODE_BITRATE(NMEA_NODE),
+                           NODE_BITRATE_DATA(NMEA_NODE));
+#endif
+
+    k_timer_start(&window_timer, K_MSEC(WINDOW_MS), K_MSEC(WINDOW_MS));
+
+    return 0;
+}
+
+// Before the CAN services attach, so their first frames are counted
+SYS_INIT(bsp_can_stats_init, APPLICATION, 30);
+
+/*****************************************************************************/
+/* Shell */
+#ifdef CONFIG_SHELL
+static const char *state_name(enum can_state state)
+{
+    switch (state) {
+    case CAN_STATE_ERROR_ACTIVE:
+        return "error active";
+    case CAN_STATE_ERROR_WARNING:
+        return "error warning";
+    case CAN_STATE_ERROR_PASSIVE:
+        return "error passive";
+    case CAN_STATE_BUS_OFF:
+        return "bus off";
+    case CAN_STATE_STOPPED:
+        return "stopped";
+    default:
+        return "unknown";
+    }
+}
+
+/*****************************************************************************/
+static int cmd_can_stats_show(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    for (int i = 0; i < BUSES_COUNT; i++) {
+        struct bsp_can_stats s;
+
+        if (buses[i].dev == NULL || bsp_can_stats_get(buses[i].dev, &s) != 0) {
+            continue;
+        }
+
+        shell_print(sh, "%s @ %u bit/s, %s (tx err %u, rx err %u)", buses[i].dev->name,
+                    buses[i].bitrate, state_name(s.state), s.err_cnt.tx_err_cnt,
+                    s.err_cnt.rx_err_cnt);
+        shell_print(sh, "  load %u.%u%% avg %u.%u%% peak %u.%u%% (%d ms windows)",
+                    s.load_permille / 10, s.load_permille % 10, s.load_avg_permille / 10,
+                    s.load_avg_permille % 10, s.load_peak_permille / 10,
+                    s.load_peak_permille % 10, WINDOW_MS);
+        shell_print(sh, "  rx %u, tx %u, tx errors %u, rx overruns %u", s.rx_frames,
+                    s.tx_frames, s.tx_errors, s.rx_overruns);
+        shell_print(sh, "  warning %u, passive %u, bus off %u", s.error_warning,
+                    s.error_passive, s.bus_off);
+        shell_print(sh, "  tx latency max %u us", s.tx_latency_max_us);
+
+        for (int b = 0; b < BSP_CAN_STATS_HIST_BINS; b++) {
+            if (b < BSP_CAN_STATS_HIST_BINS - 1) {
+                shell_print(sh, "    < %5u us: %u", BSP_CAN_STATS_HIST_BASE_US << b,
+                            s.tx_latency_hist[b]);
+            } else {
+                shell_print(sh, "   >= %5u us: %u", BSP_CAN_STATS_HIST_BASE_US << (b - 1),
+                            s.tx_latency_hist[b]);
+            }
+        }
+    }
+
+    return 0;
+}
+
+/*****************************************************************************/
+static int cmd_can_stats_reset(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(sh);
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    for (int i = 0; i < BUSES_COUNT; i++) {
+        if (buses[i].dev != NULL) {
+            bsp_can_stats_reset(buses[i].dev);
+        }
+    }
+
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_can_stats,
+                               SHELL_CMD_ARG(show, NULL, "Show bus statistics",
+                                             cmd_can_stats_show, 1, 0),
+                               SHELL_CMD_ARG(reset, NULL, "Clear counters", cmd_can_stats_reset,
+                                             1, 0),
+                               SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(can_stats, &sub_can_stats, "CAN bus statistics", NULL);
+#endif /* CONFIG_SHELL */
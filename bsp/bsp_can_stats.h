@@ -0,0 +1,77 @@
+#ifndef BSP_CAN_STATS_H_
+#define BSP_CAN_STATS_H_
+
+#include <stdint.h>
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/can.h>
+#include <zephyr/kernel.h>
+
+/// TX latency histogram: bin 0 counts below 64 us, bin n below 64 << n us,
+/// the last bin everything above
+#define BSP_CAN_STATS_HIST_BINS 10
+#define BSP_CAN_STATS_HIST_BASE_US 64
+
+struct bsp_can_stats {
+    uint16_t load_permille;      // Bus load of the last complete window
+    uint16_t load_peak_permille; // Highest window load since reset
+    uint16_t load_avg_permille;  // Exponential average over windows
+    uint32_t rx_frames;
+    uint32_t tx_frames;
+    uint32_t tx_errors;
+    uint32_t rx_overruns; // Controller overruns and BSP receive ring drops
+    uint32_t error_warning;
+    uint32_t error_passive;
+    uint32_t bus_off;
+    enum can_state state;
+    struct can_bus_err_cnt err_cnt;
+    uint32_t tx_latency_max_us; // can_send() call to transmission done
+    uint32_t tx_latency_hist[BSP_CAN_STATS_HIST_BINS];
+};
+
+/*****************************************************************************/
+
+/// @brief Starts collecting statistics for a controller. The zephyr,canbus
+/// controller and the canbus-nmea alias are registered at boot.
+/// @param dev
+/// @param bitrate Nominal bitrate used for the bus load
+/// @param bitrate_data CAN-FD data phase bitrate, 0 if not used
+/// @return 0 on success, -ENOSPC if all controller slots are in use
+int bsp_can_stats_register(const struct device *dev, uint32_t bitrate, uint32_t bitrate_data);
+
+/// @brief Returns the statistics of a controller
+/// @param dev
+/// @param stats
+/// @return 0 on success, -ENOENT if the controller is not registered
+int bsp_can_stats_get(const struct device *dev, struct bsp_can_stats *stats);
+
+/// @brief Clears counters, peak load and the latency histogram
+/// @param dev
+/// @return 0 on success
+int bsp_can_stats_reset(const struct device *dev);
+
+/// @brief can_send() wrapper measuring TX latency and bus load, use through bsp_can_send()
+int bsp_can_stats_send(const struct device *dev, const struct can_frame *frame,
+                       k_timeout_t timeout, can_tx_callback_t callback, void *user_data);
+
+/// @brief Accounts a received frame, called from receive filter callbacks
+void bsp_can_stats_rx(const struct device *dev, const struct can_frame *frame);
+
+/// @brief Accounts frames lost in a BSP receive queue
+void bsp_can_stats_rx_overrun(const struct device *dev);
+
+/*****************************************************************************/
+
+/// @brief can_send() used by the BSP CAN services, accounted in the bus
+/// statistics when they are enabled
+static inline int bsp_can_send(const struct device *dev, const struct can_frame *frame,
+                               k_timeout_t timeout, can_tx_callback_t callback, void *user_data)
+{
+#ifdef CONFIG_BSP_CAN_STATS
+    return bsp_can_stats_send(dev, frame, timeout, callback, user_data);
+#else
+    return can_send(dev, frame, timeout, callback, user_data);
+#endif
+}
+
+#endif // BSP_CAN_STATS_H_
@@ -0,0 +1,987 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/can.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+
+#include "bsp_can.h"
+#include "bsp_canopen.h"
+#ifdef CONFIG_BSP_CANOPEN_PI_IO
+#include "bsp_pi.h"
+#endif
+
+LOG_MODULE_REGISTER(bsp_canopen, CONFIG_LOG_DEFAULT_LEVEL);
+
+/*****************************************************************************/
+#define CANBUS_NODE DT_CHOSEN(zephyr_canbus)
+#define RPDO_MAX CONFIG_BSP_CANOPEN_MAX_RPDO
+#define TPDO_MAX CONFIG_BSP_CANOPEN_MAX_TPDO
+#define TX_TIMEOUT K_MSEC(2)
+#define PDO_LEN_MAX 8
+
+#define COB_NMT 0x000
+#define COB_SYNC_DEFAULT 0x080
+#define COB_SDO_TX 0x580
+#define COB_SDO_RX 0x600
+#define COB_HEARTBEAT 0x700
+#define COB_ID_INVALID BIT(31)
+#define COB_ID_SYNC_PRODUCER BIT(30)
+
+#define TRANS_SYNC_ACYCLIC 0
+#define TRANS_SYNC_MAX 240
+#define TRANS_EVENT 254
+
+/* SDO command specifiers and abort codes */
+#define SDO_CCS_DOWNLOAD_INIT 1
+#define SDO_CCS_UPLOAD_INIT 2
+#define SDO_CCS_UPLOAD_SEGMENT 3
+#define SDO_CCS_ABORT 4
+
+#define SDO_ABORT_TOGGLE 0x05030000
+#define SDO_ABORT_COMMAND 0x05040001
+#define SDO_ABORT_UNSUPPORTED 0x06010000
+#define SDO_ABORT_WRITE_ONLY 0x06010001
+#define SDO_ABORT_READ_ONLY 0x06010002
+#define SDO_ABORT_NO_OBJECT 0x06020000
+#define SDO_ABORT_NOT_MAPPABLE 0x06040041
+#define SDO_ABORT_PDO_LENGTH 0x06040042
+#define SDO_ABORT_INCOMPATIBLE 0x06040043
+#define SDO_ABORT_LENGTH 0x06070010
+#define SDO_ABORT_NO_SUB 0x06090011
+#define SDO_ABORT_STATE 0x08000022
+
+// Objects are copied between frames and storage as they are
+BUILD_ASSERT(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "PDO copies need a little-endian CPU");
+
+struct pdo_ctx {
+    const struct bsp_canopen_pdo *pdo;
+    const struct bsp_canopen_copy *copies; // Generated list, or ram_copies once remapped
+    uint8_t copies_count;
+    uint8_t len;
+    uint8_t sync_count; // TPDO: SYNCs since the last transmission
+    bool pending;       // RPDO: received, applied with the next SYNC. TPDO: requested
+    uint8_t buf[PDO_LEN_MAX];
+    struct bsp_canopen_copy ram_copies[BSP_CANOPEN_PDO_MAP_MAX];
+};
+
+// TPDO frame built under pdo_lock and sent after releasing it
+struct tpdo_frame {
+    uint16_t cob_id;
+    uint8_t len;
+    uint8_t data[PDO_LEN_MAX];
+};
+
+/*****************************************************************************/
+/* Private objects */
+static struct {
+    const struct device *dev;
+    const struct bsp_canopen_od *od;
+    uint8_t node_id;
+    bsp_canopen_state_t state;
+    size_t rpdo_count;
+    size_t tpdo_count;
+    struct pdo_ctx rpdo[RPDO_MAX];
+    struct pdo_ctx tpdo[TPDO_MAX];
+    uint32_t *sync_cob_id;    // 0x1005, NULL if not in the dictionary
+    uint32_t *sync_period_us; // 0x1006
+    uint16_t *heartbeat_ms;   // 0x1017
+    bsp_canopen_sync_cb_t sync_cb;
+    void *sync_user_data;
+    struct bsp_canopen_stats stats;
+    // SDO segmented upload in progress
+    const struct bsp_canopen_od_entry *sdo_entry;
+    size_t sdo_offset;
+    size_t sdo_len;
+    uint8_t sdo_toggle;
+} co;
+
+static struct k_spinlock pdo_lock;
+static struct bsp_can_rx_entry rx_table[3 + RPDO_MAX];
+
+static void heartbeat_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(heartbeat_work, heartbeat_handler);
+
+// Filter changes are requested from the CAN dispatch thread (NMT, SDO) and
+// must not detach the table it is dispatching from
+static void rx_work_handler(struct k_work *work);
+static K_WORK_DEFINE(rx_work, rx_work_handler);
+static void comm_reset_handler(struct k_work *work);
+static K_WORK_DEFINE(comm_reset_work, comm_reset_handler);
+
+static K_TIMER_DEFINE(sync_timer, NULL, NULL);
+static K_SEM_DEFINE(sync_start_sem, 0, 1);
+
+/*****************************************************************************/
+static const struct bsp_canopen_od_entry *od_find(uint16_t index, uint8_t sub)
+{
+    const struct bsp_canopen_od_entry *entries = co.od->entries;
+    uint32_t key = ((uint32_t)index << 8) | sub;
+    size_t lo = 0;
+    size_t hi = co.od->count;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        uint32_t mid_key = ((uint32_t)entries[mid].index << 8) | entries[mid].sub;
+
+        if (mid_key == key) {
+            return &entries[mid];
+        }
+        if (mid_key < key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return NULL;
+}
+
+/*****************************************************************************/
+static void tx_done(const struct device *dev, int error, void *user_data)
+{
+    ARG_UNUSED(dev);
+    ARG_UNUSED(user_data);
+
+    if (error) {
+        co.stats.errors++;
+    }
+}
+
+/*****************************************************************************/
+static int frame_send(uint16_t cob_id, const uint8_t *data, uint8_t len)
+{
+    struct can_frame frame = {
+        .id = cob_id,
+        .dlc = len,
+    };
+
+    memcpy(frame.data, data, len);
+
+    int err = bsp_can_send(co.dev, &frame, TX_TIMEOUT, tx_done, NULL);
+    if (err) {
+        co.stats.errors++;
+    }
+
+    return err;
+}
+
+/*****************************************************************************/
+/* PDO */
+static inline void copies_from_frame(const struct pdo_ctx *ctx, const uint8_t *d)
+{
+    const struct bsp_canopen_copy *c = ctx->copies;
+
+    for (uint8_t i = 0; i < ctx->copies_count; i++) {
+        memcpy(c[i].data, d + c[i].offset, c[i].size);
+    }
+}
+
+/*****************************************************************************/
+static inline void copies_to_frame(const struct pdo_ctx *ctx, uint8_t *d)
+{
+    const struct bsp_canopen_copy *c = ctx->copies;
+
+    for (uint8_t i = 0; i < ctx->copies_count; i++) {
+        memcpy(d + c[i].offset, c[i].data, c[i].size);
+    }
+}
+
+/*****************************************************************************/
+// Copies the mapped objects into a frame. Called with pdo_lock held.
+static bool tpdo_build(const struct pdo_ctx *ctx, struct tpdo_frame *f)
+{
+    uint32_t cob_id = *ctx->pdo->cob_id;
+
+    if (cob_id & COB_ID_INVALID) {
+        return false;
+    }
+
+    f->cob_id = cob_id & CAN_STD_ID_MASK;
+    f->len = ctx->len;
+    copies_to_frame(ctx, f->data);
+
+    return true;
+}
+
+/*****************************************************************************/
+static void tpdo_transmit(const struct tpdo_frame *f)
+{
+    if (frame_send(f->cob_id, f->data, f->len) == 0) {
+        co.stats.tpdo++;
+    }
+}
+
+/*****************************************************************************/
+// Rebuilds the copy list of a PDO from its mapping objects
+static uint32_t pdo_remap(struct pdo_ctx *ctx, bool tx)
+{
+    const struct bsp_canopen_pdo *pdo = ctx->pdo;
+    uint8_t count = *pdo->map_count;
+    struct bsp_canopen_copy copies[BSP_CANOPEN_PDO_MAP_MAX];
+    size_t offset = 0;
+
+    if (count > BSP_CANOPEN_PDO_MAP_MAX) {
+        return SDO_ABORT_PDO_LENGTH;
+    }
+
+    for (uint8_t i = 0; i < count; i++) {
+        uint32_t map = pdo->map[i];
+        const struct bsp_canopen_od_entry *e = od_find(map >> 16, (map >> 8) & 0xFF);
+        uint8_t access = tx ? BSP_CANOPEN_ACCESS_READ : BSP_CANOPEN_ACCESS_WRITE;
+
+        if (e == NULL || !(e->access & BSP_CANOPEN_ACCESS_PDO) || !(e->access & access) ||
+            (map & 0xFF) != e->size * 8) {
+            return SDO_ABORT_NOT_MAPPABLE;
+        }
+
+        if (offset + e->size > PDO_LEN_MAX) {
+            return SDO_ABORT_PDO_LENGTH;
+        }
+
+        copies[i] = (struct bsp_canopen_copy){.data = e->data, .offset = offset, .size = e->size};
+        offset += e->size;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&pdo_lock);
+    memcpy(ctx->ram_copies, copies, count * sizeof(copies[0]));
+    ctx->copies = ctx->ram_copies;
+    ctx->copies_count = count;
+    ctx->len = offset;
+    ctx->pending = false;
+    k_spin_unlock(&pdo_lock, key);
+
+    return 0;
+}
+
+/*****************************************************************************/
+// Rebuilt under pdo_lock, the SYNC thread may be processing the PDOs meanwhile
+static void pdo_setup(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&pdo_lock);
+
+    co.rpdo_count = MIN(co.od->rpdo_count, RPDO_MAX);
+    co.tpdo_count = MIN(co.od->tpdo_count, TPDO_MAX);
+
+    for (size_t i = 0; i < co.rpdo_count + co.tpdo_count; i++) {
+        bool tx = i >= co.rpdo_count;
+        struct pdo_ctx *ctx = tx ? &co.tpdo[i - co.rpdo_count] : &co.rpdo[i];
+        const struct bsp_canopen_pdo *pdo = tx ? &co.od->tpdo[i - co.rpdo_count]
+                                               : &co.od->rpdo[i];
+
+        memset(ctx, 0, sizeof(*ctx));
+        ctx->pdo = pdo;
+        ctx->copies = pdo->copies;
+        ctx->copies_count = pdo->copies_count;
+        ctx->len = pdo->len;
+    }
+
+    k_spin_unlock(&pdo_lock, key);
+}
+
+/*****************************************************************************/
+static void sync_process(void)
+{
+    if (co.state != BSP_CANOPEN_STATE_OPERATIONAL) {
+        return;
+    }
+
+    uint32_t start = k_cycle_get_32();
+
+    k_spinlock_key_t key = k_spin_lock(&pdo_lock);
+    for (size_t i = 0; i < co.rpdo_count; i++) {
+        struct pdo_ctx *ctx = &co.rpdo[i];
+
+        if (ctx->pending) {
+            copies_from_frame(ctx, ctx->buf);
+            ctx->pending = false;
+        }
+    }
+    k_spin_unlock(&pdo_lock, key);
+
+    uint32_t cycles = k_cycle_get_32() - start;
+
+#ifdef CONFIG_BSP_CANOPEN_PI_IO
+    bsp_pi_outputs_apply();
+    bsp_pi_inputs_update();
+#endif
+
+    if (co.sync_cb != NULL) {
+        co.sync_cb(co.sync_user_data);
+    }
+
+    start = k_cycle_get_32();
+
+    // Each TPDO is read under the lock and sent without it, the send may block
+    for (size_t i = 0; i < TPDO_MAX; i++) {
+        struct tpdo_frame f;
+        bool send = false;
+
+        key = k_spin_lock(&pdo_lock);
+        if (i < co.tpdo_count) {
+            struct pdo_ctx *ctx = &co.tpdo[i];
+            uint8_t trans = *ctx->pdo->trans_type;
+
+            if (trans == TRANS_SYNC_ACYCLIC) {
+                send = ctx->pending && tpdo_build(ctx, &f);
+                ctx->pending = false;
+            } else if (trans <= TRANS_SYNC_MAX && ++ctx->sync_count >= trans) {
+                ctx->sync_count = 0;
+                send = tpdo_build(ctx, &f);
+            }
+        }
+        k_spin_unlock(&pdo_lock, key);
+
+        if (send) {
+            tpdo_transmit(&f);
+        }
+    }
+
+    uint32_t us = k_cyc_to_us_floor32(cycles + k_cycle_get_32() - start);
+
+    co.stats.sync++;
+    co.stats.sync_sum_us += us;
+    co.stats.sync_max_us = MAX(co.stats.sync_max_us, us);
+}
+
+/*****************************************************************************/
+static void rpdo_rx(const struct device *dev, const struct can_frame *frame, void *user_data)
+{
+    ARG_UNUSED(dev);
+
+    struct pdo_ctx *ctx = user_data;
+
+    if (co.state != BSP_CANOPEN_STATE_OPERATIONAL) {
+        return;
+    }
+
+    if (can_dlc_to_bytes(frame->dlc) < ctx->len) {
+        co.stats.errors++;
+        return;
+    }
+
+    co.stats.rpdo++;
+
+    k_spinlock_key_t key = k_spin_lock(&pdo_lock);
+    if (*ctx->pdo->trans_type <= TRANS_SYNC_MAX) {
+        memcpy(ctx->buf, frame->data, ctx->len);
+        ctx->pending = true;
+    } else {
+        copies_from_frame(ctx, frame->data);
+    }
+    k_spin_unlock(&pdo_lock, key);
+}
+
+/*****************************************************************************/
+static void sync_rx(const struct device *dev, const struct can_frame *frame, void *user_data)
+{
+    ARG_UNUSED(dev);
+    ARG_UNUSED(frame);
+    ARG_UNUSED(user_data);
+
+    // The producer processes its own SYNC when sending it
+    if (co.sync_cob_id != NULL && (*co.sync_cob_id & COB_ID_SYNC_PRODUCER)) {
+        return;
+    }
+
+    sync_process();
+}
+
+/*****************************************************************************/
+static void sync_thread(void *p1, void *p2, void *p3)
+{
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    for (;;) {
+        // Returns at once with 0 while the timer is stopped
+        if (k_timer_status_sync(&sync_timer) == 0) {
+            k_sem_take(&sync_start_sem, K_FOREVER);
+            continue;
+        }
+
+        uint16_t cob_id = co.sync_cob_id ? (*co.sync_cob_id & CAN_STD_ID_MASK) : COB_SYNC_DEFAULT;
+
+        frame_send(cob_id, NULL, 0);
+        sync_process();
+    }
+}
+
+K_THREAD_DEFINE(canopen_sync_thread, CONFIG_BSP_CANOPEN_SYNC_THREAD_STACK_SIZE, sync_thread, NULL,
+                NULL, NULL, CONFIG_BSP_CANOPEN_SYNC_THREAD_PRIORITY, 0, 0);
+
+/*****************************************************************************/
+/* NMT and heartbeat */
+static void heartbeat_handler(struct k_work *work)
+{
+    ARG_UNUSED(work);
+
+    uint8_t state = co.state;
+
+    frame_send(COB_HEARTBEAT + co.node_id, &state, 1);
+
+    if (co.heartbeat_ms != NULL && *co.heartbeat_ms != 0) {
+        k_work_reschedule(&heartbeat_work, K_MSEC(*co.heartbeat_ms));
+    }
+}
+
+/*****************************************************************************/
+static void heartbeat_restart(void)
+{
+    if (co.heartbeat_ms != NULL && *co.heartbeat_ms != 0) {
+        k_work_reschedule(&heartbeat_work, K_MSEC(*co.heartbeat_ms));
+    } else {
+        k_work_cancel_delayable(&heartbeat_work);
+    }
+}
+
+static void nmt_rx(const struct device *dev, const struct can_frame *frame, void *user_data);
+static void sdo_rx(const struct device *dev, const struct can_frame *frame, void *user_data);
+
+/*****************************************************************************/
+// Receive table: NMT, SYNC, SDO server and the valid RPDOs
+static void rx_attach(void)
+{
+    size_t n = 0;
+
+    bsp_can_detach(co.dev, rx_table);
+
+    rx_table[n++] = (struct bsp_can_rx_entry){
+        .filter = {.id = COB_NMT, .mask = CAN_STD_ID_MASK},
+        .handler = nmt_rx,
+    };
+    rx_table[n++] = (struct bsp_can_rx_entry){
+        .filter = {.id = co.sync_cob_id ? (*co.sync_cob_id & CAN_STD_ID_MASK) : COB_SYNC_DEFAULT,
+                   .mask = CAN_STD_ID_MASK},
+        .handler = sync_rx,
+    };
+    rx_table[n++] = (struct bsp_can_rx_entry){
+        .filter = {.id = COB_SDO_RX + co.node_id, .mask = CAN_STD_ID_MASK},
+        .handler = sdo_rx,
+    };
+
+    for (size_t i = 0; i < co.rpdo_count; i++) {
+        uint32_t cob_id = *co.rpdo[i].pdo->cob_id;
+
+        if (cob_id & COB_ID_INVALID) {
+            continue;
+        }
+
+        rx_table[n++] = (struct bsp_can_rx_entry){
+            .filter = {.id = cob_id & CAN_STD_ID_MASK, .mask = CAN_STD_ID_MASK},
+            .handler = rpdo_rx,
+            .user_data = &co.rpdo[i],
+        };
+    }
+
+    int err = bsp_can_attach(co.dev, rx_table, n);
+    if (err) {
+        LOG_ERR("CANopen receive filters not attached (err %d)", err);
+    }
+}
+
+/*****************************************************************************/
+static void rx_work_handler(struct k_work *work)
+{
+    ARG_UNUSED(work);
+
+    rx_attach();
+}
+
+/*****************************************************************************/
+// Second half of the communication reset, boot-up is sent once the new
+// filters are in place
+static void comm_reset_handler(struct k_work *work)
+{
+    ARG_UNUSED(work);
+
+    uint8_t bootup = BSP_CANOPEN_STATE_INITIALISING;
+
+    rx_attach();
+
+    frame_send(COB_HEARTBEAT + co.node_id, &bootup, 1);
+    if (co.state == BSP_CANOPEN_STATE_INITIALISING) {
+        co.state = BSP_CANOPEN_STATE_PRE_OPERATIONAL;
+    }
+    heartbeat_restart();
+}
+
+/*****************************************************************************/
+static void comm_reset(void)
+{
+    co.state = BSP_CANOPEN_STATE_INITIALISING;
+    co.sdo_entry = NULL;
+    co.od->reset_comm(co.node_id);
+    pdo_setup();
+
+    k_work_submit(&comm_reset_work);
+}
+
+/*****************************************************************************/
+static void nmt_command(uint8_t command)
+{
+    switch (command) {
+    case BSP_CANOPEN_NMT_START:
+        co.state = BSP_CANOPEN_STATE_OPERATIONAL;
+        break;
+    case BSP_CANOPEN_NMT_STOP:
+        co.state = BSP_CANOPEN_STATE_STOPPED;
+        break;
+    case BSP_CANOPEN_NMT_PRE_OPERATIONAL:
+        co.state = BSP_CANOPEN_STATE_PRE_OPERATIONAL;
+        break;
+    case BSP_CANOPEN_NMT_RESET_NODE:
+        co.od->reset_app();
+        comm_reset();
+        break;
+    case BSP_CANOPEN_NMT_RESET_COMM:
+        comm_reset();
+        break;
+    default:
+        co.stats.errors++;
+        break;
+    }
+}
+
+/*****************************************************************************/
+static void nmt_rx(const struct device *dev, const struct can_frame *frame, void *user_data)
+{
+    ARG_UNUSED(dev);
+    ARG_UNUSED(user_data);
+
+    if (frame->dlc < 2 || (frame->data[1] != 0 && frame->data[1] != co.node_id)) {
+        return;
+    }
+
+    nmt_command(frame->data[0]);
+}
+
+/*****************************************************************************/
+/* SDO server */
+static void sdo_respond(const uint8_t *d)
+{
+    frame_send(COB_SDO_TX + co.node_id, d, 8);
+}
+
+/*****************************************************************************/
+static void sdo_abort(uint16_t index, uint8_t sub, uint32_t code)
+{
+    uint8_t d[8] = {SDO_CCS_ABORT << 5, index & 0xFF, index >> 8, sub};
+
+    sys_put_le32(code, &d[4]);
+    sdo_respond(d);
+
+    co.sdo_entry = NULL;
+    co.stats.sdo_aborts++;
+}
+
+/*****************************************************************************/
+static size_t entry_len(const struct bsp_canopen_od_entry *e)
+{
+    if (e->access & BSP_CANOPEN_ACCESS_STRING) {
+        return strnlen(e->data, e->size);
+    }
+
+    return e->size;
+}
+
+/*****************************************************************************/
+static struct pdo_ctx *map_pdo(uint16_t index, bool *tx)
+{
+    if (index >= 0x1600 && index < 0x1600 + co.rpdo_count) {
+        *tx = false;
+        return &co.rpdo[index - 0x1600];
+    }
+
+    if (index >= 0x1A00 && index < 0x1A00 + co.tpdo_count) {
+        *tx = true;
+        return &co.tpdo[index - 0x1A00];
+    }
+
+    return NULL;
+}
+
+/*****************************************************************************/
+static uint32_t sdo_write(const struct bsp_canopen_od_entry *e, const uint8_t *data, size_t len)
+{
+    bool tx;
+    struct pdo_ctx *ctx = map_pdo(e->index, &tx);
+
+    if (ctx != NULL) {
+        // Mapping changes: sub 0 to 0, write the entries, sub 0 to the count
+        if (co.state == BSP_CANOPEN_STATE_OPERATIONAL) {
+            return SDO_ABORT_STATE;
+        }
+
+        if (e->sub != 0 && *ctx->pdo->map_count != 0) {
+            return SDO_ABORT_INCOMPATIBLE;
+        }
+
+        if (e->sub == 0) {
+            uint8_t old = *ctx->pdo->map_count;
+
+            *ctx->pdo->map_count = data[0];
+
+            uint32_t abort = pdo_remap(ctx, tx);
+            if (abort) {
+                *ctx->pdo->map_count = old;
+            }
+
+            return abort;
+        }
+    }
+
+    if (e->access & BSP_CANOPEN_ACCESS_STRING) {
+        memset(e->data, 0, e->size);
+    }
+    memcpy(e->data, data, len);
+
+    if (e->index == 0x1005 || (e->index >= 0x1400 && e->index < 0x1400 + co.rpdo_count)) {
+        k_work_submit(&rx_work);
+    } else if (e->index == 0x1017) {
+        heartbeat_restart();
+    }
+
+    return 0;
+}
+
+/*****************************************************************************/
+static void sdo_rx(const struct device *dev, const struct can_frame *frame, void *user_data)
+{
+    ARG_UNUSED(dev);
+    ARG_UNUSED(user_data);
+
+    const uint8_t *req = frame->data;
+    uint8_t ccs = req[0] >> 5;
+    uint16_t index = sys_get_le16(&req[1]);
+    uint8_t sub = req[3];
+    uint8_t d[8] = {0};
+
+    if (co.state == BSP_CANOPEN_STATE_STOPPED || frame->dlc < 8) {
+        return;
+    }
+
+    co.stats.sdo++;
+
+    if (ccs == SDO_CCS_UPLOAD_SEGMENT) {
+        const struct bsp_canopen_od_entry *e = co.sdo_entry;
+        uint8_t toggle = req[0] & BIT(4);
+
+        if (e == NULL) {
+            sdo_abort(0, 0, SDO_ABORT_COMMAND);
+            return;
+        }
+        if (toggle != co.sdo_toggle) {
+            sdo_abort(e->index, e->sub, SDO_ABORT_TOGGLE);
+            return;
+        }
+
+        size_t n = MIN(co.sdo_len - co.sdo_offset, 7);
+        bool last = co.sdo_offset + n == co.sdo_len;
+
+        d[0] = toggle | ((7 - n) << 1) | (last ? 1 : 0);
+        memcpy(&d[1], (const uint8_t *)e->data + co.sdo_offset, n);
+        co.sdo_offset += n;
+        co.sdo_toggle ^= BIT(4);
+        if (last) {
+            co.sdo_entry = NULL;
+        }
+
+        sdo_respond(d);
+        return;
+    }
+
+    if (ccs == SDO_CCS_ABORT) {
+        co.sdo_entry = NULL;
+        return;
+    }
+
+    if (ccs != SDO_CCS_UPLOAD_INIT && ccs != SDO_CCS_DOWNLOAD_INIT) {
+        sdo_abort(index, sub, SDO_ABORT_COMMAND);
+        return;
+    }
+
+    const struct bsp_canopen_od_entry *e = od_find(index, sub);
+    if (e == NULL) {
+        sdo_abort(index, sub, od_find(index, 0) ? SDO_ABORT_NO_SUB : SDO_ABORT_NO_OBJECT);
+        return;
+    }
+
+    d[1] = req[1];
+    d[2] = req[2];
+    d[3] = req[3];
+
+    if (ccs == SDO_CCS_UPLOAD_INIT) {
+        size_t len = entry_len(e);
+
+        if (!(e->access & BSP_CANOPEN_ACCESS_READ)) {
+            sdo_abort(index, sub, SDO_ABORT_WRITE_ONLY);
+            return;
+        }
+
+        // An empty entry goes segmented, the expedited size field cannot encode 0
+        if (len > 0 && len <= 4) {
+            // Expedited, size indicated
+            d[0] = (SDO_CCS_UPLOAD_INIT << 5) | ((4 - len) << 2) | 0x03;
+            memcpy(&d[4], e->data, len);
+        } else {
+            d[0] = (SDO_CCS_UPLOAD_INIT << 5) | 0x01;
+            sys_put_le32(len, &d[4]);
+            co.sdo_entry = e;
+            co.sdo_offset = 0;
+            co.sdo_len = len;
+            co.sdo_toggle = 0;
+        }
+
+        sdo_respond(d);
+        return;
+    }
+
+    // Download: only expedited transfers, every writable object fits in 4 bytes
+    if (!(req[0] & BIT(1))) {
+        sdo_abort(index, sub, SDO_ABORT_UNSUPPORTED);
+        return;
+    }
+
+    if (!(e->access & BSP_CANOPEN_ACCESS_WRITE)) {
+        sdo_abort(index, sub, SDO_ABORT_READ_ONLY);
+        return;
+    }
+
+    size_t len = (req[0] & BIT(0)) ? 4 - ((req[0] >> 2) & 0x03) : e->size;
+    bool fits = (e->access & BSP_CANOPEN_ACCESS_STRING) ? len <= e->size : len == e->size;
+
+    if (!fits) {
+        sdo_abort(index, sub, SDO_ABORT_LENGTH);
+        return;
+    }
+
+    uint32_t abort = sdo_write(e, &req[4], len);
+    if (abort) {
+        sdo_abort(index, sub, abort);
+        return;
+    }
+
+    d[0] = 3 << 5;
+    sdo_respond(d);
+}
+
+/*****************************************************************************/
+int bsp_canopen_start(const struct bsp_canopen_od *od, uint8_t node_id)
+{
+    if (od == NULL || node_id < 1 || node_id > 127) {
+        return -EINVAL;
+    }
+
+    co.dev = DEVICE_DT_GET(CANBUS_NODE);
+    if (!device_is_ready(co.dev)) {
+        LOG_ERR("CAN controller %s not ready", co.dev->name);
+        return -ENODEV;
+    }
+
+    if (od->rpdo_count > RPDO_MAX || od->tpdo_count > TPDO_MAX) {
+        LOG_WRN("Object dictionary has more PDOs than configured, extra PDOs unused");
+    }
+
+    co.od = od;
+    co.node_id = node_id;
+
+    const struct bsp_canopen_od_entry *e = od_find(0x1005, 0);
+    co.sync_cob_id = e ? e->data : NULL;
+    e = od_find(0x1006, 0);
+    co.sync_period_us = e ? e->data : NULL;
+    e = od_find(0x1017, 0);
+    co.heartbeat_ms = e ? e->data : NULL;
+
+    od->reset_app();
+    comm_reset();
+
+    int err = can_start(co.dev);
+
+    return (err == -EALREADY) ? 0 : err;
+}
+
+/*****************************************************************************/
+void bsp_canopen_sync_callback_set(bsp_canopen_sync_cb_t cb, void *user_data)
+{
+    co.sync_user_data = user_data;
+    co.sync_cb = cb;
+}
+
+/*****************************************************************************/
+int bsp_canopen_tpdo_send(int pdo)
+{
+    if (co.od == NULL || pdo < 0) {
+        return -EINVAL;
+    }
+
+    if (co.state != BSP_CANOPEN_STATE_OPERATIONAL) {
+        return -EPERM;
+    }
+
+    struct tpdo_frame f;
+    bool send = false;
+    int err = 0;
+    k_spinlock_key_t key = k_spin_lock(&pdo_lock);
+
+    if ((size_t)pdo >= co.tpdo_count) {
+        err = -EINVAL;
+    } else if (*co.tpdo[pdo].pdo->trans_type == TRANS_SYNC_ACYCLIC) {
+        // Goes out with the next SYNC
+        co.tpdo[pdo].pending = true;
+    } else {
+        send = tpdo_build(&co.tpdo[pdo], &f);
+    }
+
+    k_spin_unlock(&pdo_lock, key);
+
+    if (send) {
+        tpdo_transmit(&f);
+    }
+
+    return err;
+}
+
+/*****************************************************************************/
+int bsp_canopen_nmt_send(uint8_t command, uint8_t node_id)
+{
+    uint8_t d[2] = {command, node_id};
+
+    if (co.od == NULL) {
+        return -ENODEV;
+    }
+
+    int err = frame_send(COB_NMT, d, sizeof(d));
+
+    // Commands addressed to all nodes or this node apply locally as well
+    if (err == 0 && (node_id == 0 || node_id == co.node_id)) {
+        nmt_command(command);
+    }
+
+    return err;
+}
+
+/*****************************************************************************/
+int bsp_canopen_sync_start(uint32_t period_us)
+{
+    if (co.od == NULL) {
+        return -ENODEV;
+    }
+
+    if (co.sync_period_us != NULL) {
+        *co.sync_period_us = period_us;
+    }
+
+    if (co.sync_cob_id != NULL) {
+        if (period_us) {
+            *co.sync_cob_id |= COB_ID_SYNC_PRODUCER;
+        } else {
+            *co.sync_cob_id &= ~COB_ID_SYNC_PRODUCER;
+        }
+    }
+
+    if (period_us == 0) {
+        k_timer_stop(&sync_timer);
+        return 0;
+    }
+
+    k_timer_start(&sync_timer, K_USEC(period_us), K_USEC(period_us));
+    k_sem_give(&sync_start_sem);
+
+    return 0;
+}
+
+/*****************************************************************************/
+bsp_canopen_state_t bsp_canopen_state_get(void)
+{
+    return co.state;
+}
+
+/*****************************************************************************/
+void bsp_canopen_stats_get(struct bsp_canopen_stats *stats)
+{
+    *stats = co.stats;
+}
+
+/*****************************************************************************/
+/* Shell */
+#ifdef CONFIG_SHELL
+static int cmd_canopen_status(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    const struct bsp_canopen_stats *s = &co.stats;
+    uint32_t avg_us = s->sync ? (uint32_t)(s->sync_sum_us / s->sync) : 0;
+
+    if (co.od == NULL) {
+        shell_print(sh, "Not started");
+        return 0;
+    }
+
+    shell_print(sh, "Node %u, state %u, %zu RPDOs, %zu TPDOs", co.node_id, co.state,
+                co.rpdo_count, co.tpdo_count);
+    shell_print(sh, "SYNC %u (PDO copies avg %u max %u us), RPDO %u, TPDO %u", s->sync, avg_us,
+                s->sync_max_us, s->rpdo, s->tpdo);
+    shell_print(sh, "SDO %u, aborts %u, errors %u", s->sdo, s->sdo_aborts, s->errors);
+
+    return 0;
+}
+
+/*****************************************************************************/
+static int cmd_canopen_nmt(const struct shell *sh, size_t argc, char **argv)
+{
+    static const struct {
+        const char *name;
+        uint8_t command;
+    } commands[] = {
+        {"start", BSP_CANOPEN_NMT_START},
+        {"stop", BSP_CANOPEN_NMT_STOP},
+        {"preop", BSP_CANOPEN_NMT_PRE_OPERATIONAL},
+        {"reset", BSP_CANOPEN_NMT_RESET_NODE},
+        {"resetcomm", BSP_CANOPEN_NMT_RESET_COMM},
+    };
+    uint8_t node_id = argc > 2 ? strtoul(argv[2], NULL, 0) : 0;
+
+    for (size_t i = 0; i < ARRAY_SIZE(commands); i++) {
+        if (strcmp(argv[1], commands[i].name) == 0) {
+            return bsp_canopen_nmt_send(commands[i].command, node_id);
+        }
+    }
+
+    shell_error(sh, "Command is start, stop, preop, reset or resetcomm");
+
+    return -EINVAL;
+}
+
+/*****************************************************************************/
+static int cmd_canopen_sync(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+
+    int err = bsp_canopen_sync_start(strtoul(argv[1], NULL, 0));
+    if (err) {
+        shell_error(sh, "SYNC producer not started (err %d)", err);
+    }
+
+    return err;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_canopen,
+                               SHELL_CMD_ARG(status, NULL, "Show node status", cmd_canopen_status,
+                                             1, 0),
+                               SHELL_CMD_ARG(nmt, NULL, "<start|stop|preop|reset|resetcomm> [node]",
+                                             cmd_canopen_nmt, 2, 1),
+                               SHELL_CMD_ARG(sync, NULL, "<period us> SYNC producer, 0 stops",
+                                             cmd_canopen_sync, 2, 0),
+                               SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(canopen, &sub_canopen, "CANopen node", NULL);
+#endif /* CONFIG_SHELL */
@@ -0,0 +1,123 @@
+#ifndef BSP_CANOPEN_H_
+#define BSP_CANOPEN_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define BSP_CANOPEN_PDO_MAP_MAX 8
+
+/* Object access, BSP_CANOPEN_ACCESS_* */
+#define BSP_CANOPEN_ACCESS_READ 0x01
+#define BSP_CANOPEN_ACCESS_WRITE 0x02
+#define BSP_CANOPEN_ACCESS_RW (BSP_CANOPEN_ACCESS_READ | BSP_CANOPEN_ACCESS_WRITE)
+#define BSP_CANOPEN_ACCESS_PDO 0x04 // May be mapped into a PDO
+#define BSP_CANOPEN_ACCESS_STRING 0x08 // Visible string, size is the capacity
+
+/* NMT commands */
+#define BSP_CANOPEN_NMT_START 0x01
+#define BSP_CANOPEN_NMT_STOP 0x02
+#define BSP_CANOPEN_NMT_PRE_OPERATIONAL 0x80
+#define BSP_CANOPEN_NMT_RESET_NODE 0x81
+#define BSP_CANOPEN_NMT_RESET_COMM 0x82
+
+typedef enum {
+    BSP_CANOPEN_STATE_INITIALISING = 0,
+    BSP_CANOPEN_STATE_STOPPED = 4,
+    BSP_CANOPEN_STATE_OPERATIONAL = 5,
+    BSP_CANOPEN_STATE_PRE_OPERATIONAL = 127,
+} bsp_canopen_state_t;
+
+/// @brief Object dictionary entry, one per index and sub-index
+struct bsp_canopen_od_entry {
+    uint16_t index;
+    uint8_t sub;
+    uint8_t access;
+    uint16_t size; // Bytes
+    void *data;
+};
+
+/// @brief One mapped object of a PDO, resolved to its storage
+struct bsp_canopen_copy {
+    void *data;
+    uint8_t offset; // Byte offset in the frame
+    uint8_t size;
+};
+
+/// @brief PDO communication and mapping objects with the copy list of the
+/// default mapping resolved at build time
+struct bsp_canopen_pdo {
+    uint32_t *cob_id;    // Sub 1 of the communication object
+    uint8_t *trans_type; // Sub 2
+    uint8_t *map_count;  // Sub 0 of the mapping object
+    uint32_t *map;       // Subs 1..BSP_CANOPEN_PDO_MAP_MAX
+    const struct bsp_canopen_copy *copies;
+    uint8_t copies_count;
+    uint8_t len;
+};
+
+/// @brief Generated object dictionary, see scripts/gen_canopen_od.py
+struct bsp_canopen_od {
+    const struct bsp_canopen_od_entry *entries; // Sorted by index and sub-index
+    size_t count;
+    const struct bsp_canopen_pdo *rpdo;
+    size_t rpdo_count;
+    const struct bsp_canopen_pdo *tpdo;
+    size_t tpdo_count;
+    void (*reset_comm)(uint8_t node_id); // Loads defaults of 0x1000-0x1FFF
+    void (*reset_app)(void);             // Loads defaults of 0x2000-0x9FFF
+};
+
+struct bsp_canopen_stats {
+    uint32_t sync;
+    uint32_t rpdo;
+    uint32_t tpdo;
+    uint32_t sdo;
+    uint32_t sdo_aborts;
+    uint32_t errors;            // Failed transmissions and invalid frames
+    uint32_t sync_max_us;       // PDO copy time per SYNC
+    uint64_t sync_sum_us;
+};
+
+/// @brief Called on every SYNC while operational, in the CAN dispatch thread or
+/// in the SYNC producer thread, after the synchronous RPDOs are applied and
+/// before the synchronous TPDOs are sampled
+typedef void (*bsp_canopen_sync_cb_t)(void *user_data);
+
+/*****************************************************************************/
+
+/// @brief Starts the node on the zephyr,canbus controller: loads the object
+/// dictionary defaults, sends the boot-up message and enters pre-operational
+/// @param od
+/// @param node_id 1..127
+/// @return 0 on success
+int bsp_canopen_start(const struct bsp_canopen_od *od, uint8_t node_id);
+
+/// @brief Sets the SYNC callback, NULL removes it
+void bsp_canopen_sync_callback_set(bsp_canopen_sync_cb_t cb, void *user_data);
+
+/// @brief Requests a TPDO: sent now, or with the next SYNC for transmission
+/// type 0 (synchronous acyclic)
+/// @param pdo TPDO number, 0 based
+/// @return 0 on success, -EPERM if not operational
+int bsp_canopen_tpdo_send(int pdo);
+
+/// @brief NMT master: sends a command to one node or to all nodes
+/// @param command BSP_CANOPEN_NMT_*
+/// @param node_id 0 for all nodes
+/// @return 0 on success
+int bsp_canopen_nmt_send(uint8_t command, uint8_t node_id);
+
+/// @brief SYNC producer: sends SYNC every period_us and processes the local
+/// synchronous PDOs with it. The period is stored in object 0x1006.
+/// @param period_us 0 stops the producer
+/// @return 0 on success
+int bsp_canopen_sync_start(uint32_t period_us);
+
+/// @brief Returns the NMT state of the node
+bsp_canopen_state_t bsp_canopen_state_get(void);
+
+/// @brief Returns the protocol statistics
+void bsp_canopen_stats_get(struct bsp_canopen_stats *stats);
+
+#endif // BSP_CANOPEN_H_
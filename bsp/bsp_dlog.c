@@ -0,0 +1,641 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/util.h>
+
+#include "bsp_dlog.h"
+#include "bsp_flash.h"
+#include "bsp_ts.h"
+
+#ifdef CONFIG_BSP_PTP
+#include "bsp_ptp.h"
+#endif
+
+LOG_MODULE_REGISTER(bsp_dlog, CONFIG_LOG_DEFAULT_LEVEL);
+
+/*****************************************************************************/
+#define DLOG_OFFSET CONFIG_BSP_DLOG_OFFSET
+#define DLOG_SIZE CONFIG_BSP_DLOG_SIZE
+#define BLOCK_SIZE CONFIG_BSP_DLOG_BLOCK_SIZE
+#define BLOCKS_COUNT (DLOG_SIZE / BLOCK_SIZE)
+#define RECORD_SIZE CONFIG_BSP_DLOG_RECORD_SIZE
+#define BUFFERS_COUNT CONFIG_BSP_DLOG_BUFFERS
+#define FLUSH_MS CONFIG_BSP_DLOG_FLUSH_MS
+#define ERASE_AHEAD MIN(CONFIG_BSP_DLOG_ERASE_AHEAD, BLOCKS_COUNT - 2)
+#define POLL_MS 20
+#define DLOG_ALIGN 8
+
+#define STORAGE_PARTITION storage_partition
+
+BUILD_ASSERT(DLOG_SIZE % BLOCK_SIZE == 0);
+BUILD_ASSERT(BLOCKS_COUNT >= 4, "The log needs at least four blocks");
+BUILD_ASSERT(RECORD_SIZE % 4 == 0);
+
+/*****************************************************************************/
+/* Flash layout. The log area is a ring of blocks; block seq is stored at
+ * seq % BLOCKS_COUNT, so sequence numbers increase along the ring with a
+ * single step back after the newest block. A block is the header followed by
+ * its records. The header is programmed after the records and is the commit
+ * marker: a block torn by a power failure has no valid header. */
+#define BLOCK_MAGIC 0x474F4C44 // "DLOG"
+#define BLOCK_FORMAT_VERSION 1
+#define BLOCK_FLAG_PTP_TIME BIT(0) // time_ns is PTP time, otherwise bsp_ts time
+
+struct block_header {
+    uint32_t magic;
+    uint8_t format_version;
+    uint8_t header_size;
+    uint16_t record_size;
+    uint32_t seq;
+    uint16_t records;
+    uint16_t flags;
+    uint64_t time_ns;    // Time of the first record
+    uint32_t payload_crc;
+    uint32_t header_crc; // Must be the last member
+};
+
+BUILD_ASSERT(sizeof(struct block_header) % DLOG_ALIGN == 0);
+
+#define RECORDS_PER_BLOCK ((BLOCK_SIZE - sizeof(struct block_header)) / RECORD_SIZE)
+
+BUILD_ASSERT(RECORDS_PER_BLOCK > 0 && RECORDS_PER_BLOCK <= UINT16_MAX);
+
+// RAM block buffer, records are copied straight to their place in the block
+struct dlog_buf {
+    uint8_t data[BLOCK_SIZE] __aligned(DLOG_ALIGN);
+    bsp_ts_t ts; // First record
+    uint16_t records;
+    bool sealed; // Full or flushed, owned by the writer
+};
+
+/*****************************************************************************/
+/* Private objects */
+
+// Producer side, under dlog_lock
+static struct dlog_buf bufs[BUFFERS_COUNT];
+static uint8_t fill_idx;  // Buffer taking records
+static uint8_t write_idx; // Next buffer to program
+static struct bsp_dlog_stats stats;
+static struct k_spinlock dlog_lock;
+static K_SEM_DEFINE(dlog_sem, 0, 1);
+
+// Writer side, under flash_lock
+static struct {
+    const struct flash_area *fa;
+    uint32_t seq;        // Sequence number of the next block
+    uint32_t erased_seq; // Blocks from seq up to this one are erased
+} wr;
+
+static K_MUTEX_DEFINE(flash_lock);
+
+/*****************************************************************************/
+static off_t block_offset(uint32_t seq)
+{
+    return DLOG_OFFSET + (off_t)(seq % BLOCKS_COUNT) * BLOCK_SIZE;
+}
+
+/*****************************************************************************/
+// Returns the buffer taking a record, moving on to the next one if the
+// current buffer is sealed. Called with dlog_lock held.
+static struct dlog_buf *fill_buf(void)
+{
+    struct dlog_buf *b = &bufs[fill_idx];
+
+    if (!b->sealed) {
+        return b;
+    }
+
+    uint8_t next = (fill_idx + 1) % BUFFERS_COUNT;
+    if (next == write_idx) {
+        return NULL; // All other buffers wait for the writer
+    }
+
+    fill_idx = next;
+    b = &bufs[next];
+    b->records = 0;
+    b->sealed = false;
+
+    return b;
+}
+
+/*****************************************************************************/
+int bsp_dlog_write(const void *record)
+{
+    if (wr.fa == NULL) {
+        return -ENODEV;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&dlog_lock);
+    struct dlog_buf *b = fill_buf();
+
+    if (b == NULL) {
+        stats.dropped++;
+        k_spin_unlock(&dlog_lock, key);
+        return -ENOBUFS;
+    }
+
+    if (b->records == 0) {
+        b->ts = bsp_ts_now();
+    }
+
+    memcpy(&b->data[sizeof(struct block_header) + b->records * RECORD_SIZE], record,
+           RECORD_SIZE);
+    b->records++;
+    stats.records++;
+
+    bool full = (b->records == RECORDS_PER_BLOCK);
+    b->sealed = full;
+
+    k_spin_unlock(&dlog_lock, key);
+
+    if (full) {
+        k_sem_give(&dlog_sem);
+    }
+
+    return 0;
+}
+
+/*****************************************************************************/
+void bsp_dlog_flush(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&dlog_lock);
+    struct dlog_buf *b = &bufs[fill_idx];
+
+    if (b->records > 0) {
+        b->sealed = true;
+    }
+
+    k_spin_unlock(&dlog_lock, key);
+
+    k_sem_give(&dlog_sem);
+}
+
+/*****************************************************************************/
+static int block_erase(uint32_t seq)
+{
+    int err = flash_area_erase(wr.fa, block_offset(seq), BLOCK_SIZE);
+
+    if (err == 0) {
+        wr.erased_seq = seq + 1;
+    }
+
+    return err;
+}
+
+/*****************************************************************************/
+// Programs a sealed buffer as block wr.seq, called with flash_lock held
+static int block_write(struct dlog_buf *b)
+{
+    struct block_header *hdr = (struct block_header *)b->data;
+    uint8_t *payload = b->data + sizeof(*hdr);
+    size_t len = b->records * RECORD_SIZE;
+    size_t padded = ROUND_UP(len, DLOG_ALIGN);
+    off_t off = block_offset(wr.seq);
+    int err = 0;
+
+    memset(payload + len, 0xFF, padded - len);
+
+    *hdr = (struct block_header){
+        .magic = BLOCK_MAGIC,
+        .format_version = BLOCK_FORMAT_VERSION,
+        .header_size = sizeof(*hdr),
+        .record_size = RECORD_SIZE,
+        .seq = wr.seq,
+        .records = b->records,
+#ifdef CONFIG_BSP_PTP
+        .flags = bsp_ptp_valid() ? BLOCK_FLAG_PTP_TIME : 0,
+        .time_ns = bsp_ptp_ts_to_ns(b->ts),
+#else
+        .time_ns = bsp_ts_to_ns(b->ts),
+#endif
+        .payload_crc = crc32_ieee(payload, len),
+    };
+    hdr->header_crc = crc32_ieee(hdr, offsetof(struct block_header, header_crc));
+
+    if ((int32_t)(wr.seq - wr.erased_seq) >= 0) {
+        // Erase ahead fell behind, the writer stalls for the erase
+        stats.erase_stalls++;
+        err = block_erase(wr.seq);
+    }
+
+    // Records first and header last, so a torn block never looks valid
+    if (err == 0) {
+        err = bsp_flash_write(wr.fa, off + sizeof(*hdr), payload, padded);
+    }
+
+    if (err == 0) {
+        err = flash_area_write(wr.fa, off, hdr, sizeof(*hdr));
+    }
+
+    return err;
+}
+
+/*****************************************************************************/
+// One writer pass, called with flash_lock held
+static void writer_poll(void)
+{
+    static bsp_ts_t flush_ticks;
+
+    if (flush_ticks == 0) {
+        flush_ticks = bsp_ts_from_ns((uint64_t)FLUSH_MS * NSEC_PER_MSEC);
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&dlog_lock);
+    struct dlog_buf *f = &bufs[fill_idx];
+    if (!f->sealed && f->records > 0 && bsp_ts_now() - f->ts >= flush_ticks) {
+        f->sealed = true;
+    }
+    k_spin_unlock(&dlog_lock, key);
+
+    for (;;) {
+        struct dlog_buf *b = &bufs[write_idx];
+
+        if (!b->sealed) {
+            break;
+        }
+
+        bsp_ts_t t0 = bsp_ts_now();
+        int err = block_write(b);
+        uint32_t us = bsp_ts_to_us(bsp_ts_now() - t0);
+
+        if (err) {
+            // The records are lost, the next buffer retries the same location
+            LOG_ERR("Block %u not written (err %d)", wr.seq, err);
+            stats.flash_errors++;
+            wr.erased_seq = wr.seq;
+        } else {
+            stats.blocks++;
+            stats.bytes += b->records * RECORD_SIZE;
+            stats.write_us_max = MAX(stats.write_us_max, us);
+            wr.seq++;
+        }
+
+        key = k_spin_lock(&dlog_lock);
+        b->records = 0;
+        b->sealed = false;
+        if (write_idx != fill_idx) {
+            write_idx = (write_idx + 1) % BUFFERS_COUNT;
+        }
+        k_spin_unlock(&dlog_lock, key);
+    }
+
+    // Erase while no block waits, so programming does not stall on erases
+    if ((int32_t)(wr.erased_seq - wr.seq) < 0) {
+        wr.erased_seq = wr.seq;
+    }
+
+    if ((int32_t)(wr.erased_seq - wr.seq) < ERASE_AHEAD) {
+        (void)block_erase(wr.erased_seq);
+        k_sem_give(&dlog_sem); // Continue with the next erase after other work
+    }
+}
+
+/*****************************************************************************/
+static void writer_thread(void *p1, void *p2, void *p3)
+{
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    for (;;) {
+        k_sem_take(&dlog_sem, K_MSEC(POLL_MS));
+
+        if (wr.fa == NULL) {
+            continue;
+        }
+
+        k_mutex_lock(&flash_lock, K_FOREVER);
+        writer_poll();
+        k_mutex_unlock(&flash_lock);
+    }
+}
+
+K_THREAD_DEFINE(dlog_thread, CONFIG_BSP_DLOG_THREAD_STACK_SIZE, writer_thread, NULL, NULL, NULL,
+                CONFIG_BSP_DLOG_THREAD_PRIORITY, 0, 0);
+
+/*****************************************************************************/
+static bool header_valid(const struct block_header *hdr)
+{
+    if (hdr->magic != BLOCK_MAGIC || hdr->format_version != BLOCK_FORMAT_VERSION ||
+        hdr->header_size != sizeof(struct block_header) || hdr->record_size != RECORD_SIZE ||
+        hdr->records == 0 || hdr->records > RECORDS_PER_BLOCK) {
+        return false;
+    }
+
+    return crc32_ieee(hdr, offsetof(struct block_header, header_crc)) == hdr->header_crc;
+}
+
+/*****************************************************************************/
+void bsp_dlog_range(uint32_t *first, uint32_t *next)
+{
+    uint32_t seq = wr.seq;
+
+    // Blocks erased ahead of the writer are gone
+    *first = (seq > BLOCKS_COUNT - ERASE_AHEAD) ? seq - (BLOCKS_COUNT - ERASE_AHEAD) : 0;
+    *next = seq;
+}
+
+/*****************************************************************************/
+int bsp_dlog_read(uint32_t seq, struct bsp_dlog_block *block, void *records, size_t size)
+{
+    if (wr.fa == NULL) {
+        return -ENODEV;
+    }
+
+    struct block_header hdr;
+    off_t off = block_offset(seq);
+
+    k_mutex_lock(&flash_lock, K_FOREVER);
+
+    int err = flash_area_read(wr.fa, off, &hdr, sizeof(hdr));
+    if (err == 0 && (!header_valid(&hdr) || hdr.seq != seq)) {
+        err = -ENOENT;
+    }
+
+    if (err == 0 && records != NULL) {
+        size_t len = hdr.records * RECORD_SIZE;
+
+        if (size < len) {
+            err = -ENOMEM;
+        } else {
+            err = flash_area_read(wr.fa, off + sizeof(hdr), records, len);
+            if (err == 0 && crc32_ieee(records, len) != hdr.payload_crc) {
+                err = -EBADMSG;
+            }
+        }
+    }
+
+    k_mutex_unlock(&flash_lock);
+
+    if (err) {
+        return err;
+    }
+
+    *block = (struct bsp_dlog_block){
+        .seq = hdr.seq,
+        .records = hdr.records,
+        .ptp_time = (hdr.flags & BLOCK_FLAG_PTP_TIME) != 0,
+        .time_ns = hdr.time_ns,
+    };
+
+    return hdr.records;
+}
+
+/*****************************************************************************/
+int bsp_dlog_erase(void)
+{
+    if (wr.fa == NULL) {
+        return -ENODEV;
+    }
+
+    // Start over from block 0, recovery relies on seq % BLOCKS_COUNT
+    k_mutex_lock(&flash_lock, K_FOREVER);
+    wr.seq = 0;
+    wr.erased_seq = 0;
+    k_mutex_unlock(&flash_lock);
+
+    // One block per lock, so the writer keeps logging in between. It only
+    // writes below wr.erased_seq, which both sides move up as they erase.
+    int err = 0;
+    for (;;) {
+        k_mutex_lock(&flash_lock, K_FOREVER);
+        bool done = (int32_t)(wr.erased_seq - BLOCKS_COUNT) >= 0;
+        if (!done) {
+            err = block_erase(wr.erased_seq);
+        }
+        k_mutex_unlock(&flash_lock);
+
+        if (done || err) {
+            return err;
+        }
+    }
+}
+
+/*****************************************************************************/
+void bsp_dlog_stats_get(struct bsp_dlog_stats *s)
+{
+    k_spinlock_key_t key = k_spin_lock(&dlog_lock);
+    *s = stats;
+    k_spin_unlock(&dlog_lock, key);
+}
+
+/*****************************************************************************/
+// Returns the sequence number of the block at index i, or false if the block
+// has no valid header
+static bool block_seq(const struct flash_area *fa, uint32_t i, uint32_t *seq)
+{
+    struct block_header hdr;
+
+    stats.recover_reads++;
+
+    if (flash_area_read(fa, DLOG_OFFSET + (off_t)i * BLOCK_SIZE, &hdr, sizeof(hdr)) ||
+        !header_valid(&hdr) || hdr.seq % BLOCKS_COUNT != i) {
+        return false;
+    }
+
+    *seq = hdr.seq;
+    return true;
+}
+
+/*****************************************************************************/
+// Finds the block written next without reading every header. Only the blocks
+// right after the newest one can be invalid: erased ahead, or torn by a power
+// failure. The first valid block within that distance of index 0 anchors a
+// binary search for the end of the run of consecutive sequence numbers.
+static uint32_t log_recover(const struct flash_area *fa)
+{
+    uint32_t anchor = 0;
+    uint32_t anchor_seq;
+    bool found = false;
+
+    for (; anchor <= ERASE_AHEAD + 1; anchor++) {
+        if (block_seq(fa, anchor, &anchor_seq)) {
+            found = true;
+            break;
+        }
+    }
+
+    if (!found) {
+        return 0; // Empty log
+    }
+
+    // Blocks anchor..lo continue the sequence, hi does not
+    uint32_t lo = anchor;
+    uint32_t hi = BLOCKS_COUNT;
+
+    while (hi - lo > 1) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        uint32_t seq;
+
+        if (block_seq(fa, mid, &seq) && seq == anchor_seq + (mid - anchor)) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    return anchor_seq + (lo - anchor) + 1;
+}
+
+/*****************************************************************************/
+static int bsp_dlog_init(void)
+{
+    const struct flash_area *fa;
+    int err = flash_area_open(FIXED_PARTITION_ID(STORAGE_PARTITION), &fa);
+
+    if (err) {
+        LOG_ERR("Storage partition not available (err %d)", err);
+        return 0;
+    }
+
+    if (DLOG_OFFSET + DLOG_SIZE > fa->fa_size) {
+        LOG_ERR("Log area 0x%x+0x%x outside the storage partition", DLOG_OFFSET, DLOG_SIZE);
+        flash_area_close(fa);
+        return 0;
+    }
+
+    bsp_ts_t t0 = bsp_ts_now();
+
+    wr.seq = log_recover(fa);
+    wr.erased_seq = wr.seq;
+    stats.recover_us = bsp_ts_to_us(bsp_ts_now() - t0);
+    wr.fa = fa;
+
+    LOG_INF("Data log: %d blocks of %d records, next block %u (%u headers read)", BLOCKS_COUNT,
+            (int)RECORDS_PER_BLOCK, wr.seq, stats.recover_reads);
+
+    return 0;
+}
+
+SYS_INIT(bsp_dlog_init, APPLICATION, 30);
+
+/*****************************************************************************/
+/* Shell */
+#ifdef CONFIG_SHELL
+static int cmd_dlog_status(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    struct bsp_dlog_stats s;
+    uint32_t first;
+    uint32_t next;
+
+    bsp_dlog_stats_get(&s);
+    bsp_dlog_range(&first, &next);
+
+    shell_print(sh, "Blocks %u..%u of %d, %d records of %d bytes per block", first, next,
+                BLOCKS_COUNT, (int)RECORDS_PER_BLOCK, RECORD_SIZE);
+    shell_print(sh, "Records %u, dropped %u, blocks written %u, %llu bytes", s.records,
+                s.dropped, s.blocks, (unsigned long long)s.bytes);
+    shell_print(sh, "Block write max %u us, erase stalls %u, flash errors %u", s.write_us_max,
+                s.erase_stalls, s.flash_errors);
+    shell_print(sh, "Recovery %u headers in %u us", s.recover_reads, s.recover_us);
+
+    return 0;
+}
+
+/*****************************************************************************/
+// Prints the records of the newest blocks as "<seq>.<index> <hex>" lines
+static int cmd_dlog_dump(const struct shell *sh, size_t argc, char **argv)
+{
+    static uint8_t buf[RECORDS_PER_BLOCK * RECORD_SIZE];
+    uint32_t count = argc > 1 ? strtoul(argv[1], NULL, 0) : 1;
+    uint32_t first;
+    uint32_t next;
+    char hex[2 * 32 + 1];
+
+    bsp_dlog_range(&first, &next);
+    first = MAX(first, next - MIN(count, next));
+
+    for (uint32_t seq = first; seq != next; seq++) {
+        struct bsp_dlog_block block;
+        int n = bsp_dlog_read(seq, &block, buf, sizeof(buf));
+
+        if (n < 0) {
+            shell_print(sh, "Block %u: err %d", seq, n);
+            continue;
+        }
+
+        shell_print(sh, "Block %u: %d records at %llu.%09llu%s", seq, n,
+                    block.time_ns / NSEC_PER_SEC, block.time_ns % NSEC_PER_SEC,
+                    block.ptp_time ? " PTP" : "");
+
+        for (int i = 0; i < n; i++) {
+            bin2hex(&buf[i * RECORD_SIZE], MIN(RECORD_SIZE, 32), hex, sizeof(hex));
+            shell_print(sh, "%u.%d %s", seq, i, hex);
+        }
+    }
+
+    return 0;
+}
+
+/*****************************************************************************/
+// Writes records as fast as the buffers accept them and reports the rate
+static int cmd_dlog_bench(const struct shell *sh, size_t argc, char **argv)
+{
+    uint32_t count = strtoul(argv[1], NULL, 0);
+    uint32_t record[RECORD_SIZE / 4];
+    struct bsp_dlog_stats s0;
+    struct bsp_dlog_stats s1;
+
+    bsp_dlog_stats_get(&s0);
+    bsp_ts_t t0 = bsp_ts_now();
+
+    for (uint32_t i = 0; i < count; i++) {
+        for (size_t j = 0; j < ARRAY_SIZE(record); j++) {
+            record[j] = i;
+        }
+
+        while (bsp_dlog_write(record) == -ENOBUFS) {
+            k_sleep(K_MSEC(1));
+        }
+    }
+
+    bsp_dlog_flush();
+    do {
+        k_sleep(K_MSEC(10));
+        bsp_dlog_stats_get(&s1);
+    } while (s1.bytes - s0.bytes < (uint64_t)count * RECORD_SIZE &&
+             s1.flash_errors == s0.flash_errors);
+
+    uint64_t us = MAX(bsp_ts_to_us(bsp_ts_now() - t0), 1);
+
+    shell_print(sh, "%u records, %llu bytes in %llu ms, %llu kB/s", count,
+                (unsigned long long)(s1.bytes - s0.bytes), (unsigned long long)us / 1000,
+                (unsigned long long)((s1.bytes - s0.bytes) * 1000 / us));
+
+    return 0;
+}
+
+/*****************************************************************************/
+static int cmd_dlog_erase(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    int err = bsp_dlog_erase();
+    if (err) {
+        shell_error(sh, "Not erased (err %d)", err);
+    }
+
+    return err;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(
+    sub_dlog, SHELL_CMD_ARG(status, NULL, "Show logger status", cmd_dlog_status, 1, 0),
+    SHELL_CMD_ARG(dump, NULL, "[blocks] Print the records of the newest blocks", cmd_dlog_dump,
+                  1, 1),
+    SHELL_CMD_ARG(bench, NULL, "<records> Measure the write throughput", cmd_dlog_bench, 2, 0),
+    SHELL_CMD_ARG(erase, NULL, "Erase the log area", cmd_dlog_erase, 1, 0),
+    SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(dlog, &sub_dlog, "Data logger", NULL);
+#endif /* CONFIG_SHELL */
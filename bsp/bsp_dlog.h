@@ -0,0 +1,68 @@
+#ifndef BSP_DLOG_H_
+#define BSP_DLOG_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define BSP_DLOG_RECORD_SIZE CONFIG_BSP_DLOG_RECORD_SIZE
+
+/// Header of a stored block as returned by bsp_dlog_read()
+struct bsp_dlog_block {
+    uint32_t seq;
+    uint16_t records;
+    bool ptp_time;    // time_ns is PTP time, otherwise bsp_ts time since boot
+    uint64_t time_ns; // Time of the first record
+};
+
+struct bsp_dlog_stats {
+    uint32_t records;       // Records accepted
+    uint32_t dropped;       // Records lost with all RAM buffers waiting for flash
+    uint32_t blocks;        // Blocks committed to flash
+    uint32_t flash_errors;
+    uint64_t bytes;         // Record bytes committed
+    uint32_t write_us_max;  // Longest block program, erase included
+    uint32_t erase_stalls;  // Blocks that had to be erased before programming
+    uint32_t recover_reads; // Block headers read to find the end of the log at boot
+    uint32_t recover_us;
+};
+
+/*****************************************************************************/
+
+/// @brief Appends a record of BSP_DLOG_RECORD_SIZE bytes. The record is
+/// copied into a RAM block buffer; full buffers are programmed by the writer
+/// thread, so the call never waits for flash. ISR safe.
+/// @param record
+/// @return 0 on success, -ENOBUFS if dropped, -ENODEV without a log area
+int bsp_dlog_write(const void *record);
+
+/// @brief Hands the partly filled buffer to the writer without waiting for
+/// CONFIG_BSP_DLOG_FLUSH_MS. ISR safe.
+void bsp_dlog_flush(void);
+
+/// @brief Returns the sequence numbers of the oldest block that may still be
+/// stored and of the block written next
+/// @param first
+/// @param next
+void bsp_dlog_range(uint32_t *first, uint32_t *next);
+
+/// @brief Reads a committed block
+/// @param seq Block sequence number, see bsp_dlog_range()
+/// @param block Filled with the block header
+/// @param records Buffer for the records, may be NULL to read the header only
+/// @param size Size of the buffer
+/// @return Number of records, -ENOENT if the block is not stored (overwritten,
+/// not yet written or torn by a power failure), -EBADMSG on a CRC mismatch,
+/// -ENOMEM if the buffer is too small
+int bsp_dlog_read(uint32_t seq, struct bsp_dlog_block *block, void *records, size_t size);
+
+/// @brief Erases the log area, the log starts over from block 0. Erases one
+/// block at a time, records logged meanwhile are kept.
+/// @return 0 on success
+int bsp_dlog_erase(void);
+
+/// @brief Returns the logger statistics
+/// @param stats
+void bsp_dlog_stats_get(struct bsp_dlog_stats *stats);
+
+#endif // BSP_DLOG_H_
@@ -0,0 +1,456 @@
+#include <errno.h>
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/util.h>
+
+#include "bsp_dsp.h"
+
+#ifdef CONFIG_CMSIS_DSP
+#include <arm_math.h>
+#endif
+
+LOG_MODULE_REGISTER(bsp_dsp, CONFIG_LOG_DEFAULT_LEVEL);
+
+/*****************************************************************************/
+/* Limits */
+#define WINDOW_MAX 65535U // Energy is accumulated in 2.48 format, 2^16 terms fit in 64 bits
+#define CIC_DECIM_MAX 64U // R^N must stay below 2^24 to keep the comb output in 55 bits
+
+#define FIR_STATE_LEN (BSP_DSP_MAX_FIR_TAPS + BSP_DSP_BLOCK_SIZE - 1)
+#define BIQUAD_STATE_LEN (4 * BSP_DSP_MAX_BIQUAD_STAGES)
+
+/*****************************************************************************/
+/* Private objects */
+struct dsp_channel {
+    struct bsp_dsp_channel_cfg cfg;
+    bool configured;
+
+    /* CIC decimator, integrators wrap modulo 2^64 by design */
+    uint64_t cic_integ[BSP_DSP_MAX_CIC_ORDER];
+    uint64_t cic_comb[BSP_DSP_MAX_CIC_ORDER];
+    int64_t cic_gain;
+    uint8_t cic_phase;
+
+    /* FIR decimator and biquad cascade, same layout as the CMSIS-DSP instances */
+    int32_t fir_state[FIR_STATE_LEN];
+    int32_t biquad_state[BIQUAD_STATE_LEN];
+#ifdef CONFIG_CMSIS_DSP
+    arm_fir_decimate_instance_q31 fir;
+    arm_biquad_casd_df1_inst_q31 biquad;
+#endif
+
+    /* Current window */
+    uint64_t win_energy;
+    int32_t win_min;
+    int32_t win_max;
+    uint32_t win_count;
+
+    /* Last published window */
+    struct k_spinlock lock;
+    struct bsp_dsp_result result;
+    bool result_valid;
+};
+
+static struct dsp_channel channels[BSP_DSP_CHANNELS_COUNT];
+static bsp_dsp_publish_cb_t publish_hook;
+static void *publish_hook_user_data;
+
+/*****************************************************************************/
+static uint32_t isqrt64(uint64_t value)
+{
+    uint64_t res = 0;
+    uint64_t bit = (uint64_t)1 << 62;
+
+    while (bit > value) {
+        bit >>= 2;
+    }
+
+    while (bit != 0) {
+        if (value >= res + bit) {
+            value -= res + bit;
+            res = (res >> 1) + bit;
+        } else {
+            res >>= 1;
+        }
+        bit >>= 2;
+    }
+
+    return (uint32_t)res;
+}
+
+/*****************************************************************************/
+static void window_clear(struct dsp_channel *ch)
+{
+    ch->win_energy = 0;
+    ch->win_min = INT32_MAX;
+    ch->win_max = INT32_MIN;
+    ch->win_count = 0;
+}
+
+/*****************************************************************************/
+static void state_clear(struct dsp_channel *ch)
+{
+    memset(ch->cic_integ, 0, sizeof(ch->cic_integ));
+    memset(ch->cic_comb, 0, sizeof(ch->cic_comb));
+    ch->cic_phase = 0;
+    memset(ch->fir_state, 0, sizeof(ch->fir_state));
+    memset(ch->biquad_state, 0, sizeof(ch->biquad_state));
+    window_clear(ch);
+}
+
+/*****************************************************************************/
+// CIC decimator: N integrators at the input rate, N combs (M = 1) at the output rate
+static size_t cic_decimate(struct dsp_channel *ch, const int32_t *in, size_t count, int32_t *out)
+{
+    const uint8_t order = ch->cfg.cic_order;
+    const uint8_t factor = ch->cfg.decim_factor;
+    size_t produced = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        uint64_t acc = (uint64_t)(int64_t)in[i];
+
+        for (uint8_t s = 0; s < order; s++) {
+            ch->cic_integ[s] += acc;
+            acc = ch->cic_integ[s];
+        }
+
+        if (++ch->cic_phase < factor) {
+            continue;
+        }
+        ch->cic_phase = 0;
+
+        for (uint8_t s = 0; s < order; s++) {
+            uint64_t prev = ch->cic_comb[s];
+
+            ch->cic_comb[s] = acc;
+            acc -= prev;
+        }
+
+        out[produced++] = (int32_t)((int64_t)acc / ch->cic_gain);
+    }
+
+    return produced;
+}
+
+/*****************************************************************************/
+// FIR decimator. Coefficients are stored time-reversed, as expected by CMSIS-DSP
+static size_t fir_decimate(struct dsp_channel *ch, const int32_t *in, size_t count, int32_t *out)
+{
+#ifdef CONFIG_CMSIS_DSP
+    arm_fir_decimate_q31(&ch->fir, (const q31_t *)in, (q31_t *)out, count);
+#else
+    const uint16_t taps = ch->cfg.fir_taps;
+    const uint8_t factor = ch->cfg.decim_factor;
+    int32_t *state = ch->fir_state;
+
+    memcpy(&state[taps - 1], in, count * sizeof(int32_t));
+
+    for (size_t o = 0; o < count / factor; o++) {
+        const int32_t *px = &state[o * factor];
+        int64_t acc = 0;
+
+        for (uint16_t k = 0; k < taps; k++) {
+            acc += (int64_t)px[k] * ch->cfg.fir_coeffs[k];
+        }
+        out[o] = (int32_t)(acc >> 31);
+    }
+
+    memmove(state, &state[count], (taps - 1) * sizeof(int32_t));
+#endif
+    return count / ch->cfg.decim_factor;
+}
+
+/*****************************************************************************/
+// Direct form I biquad cascade, in place. Matches arm_biquad_cascade_df1_q31()
+static void biquad_run(struct dsp_channel *ch, int32_t *buf, size_t count)
+{
+#ifdef CONFIG_CMSIS_DSP
+    arm_biquad_cascade_df1_q31(&ch->biquad, (const q31_t *)buf, (q31_t *)buf, count);
+#else
+    const int32_t *coeffs = ch->cfg.biquad_coeffs;
+    const uint8_t shift = 31 - ch->cfg.biquad_post_shift;
+
+    for (uint8_t s = 0; s < ch->cfg.biquad_stages; s++) {
+        const int32_t *c = &coeffs[s * BSP_DSP_BIQUAD_COEFFS_PER_STAGE];
+        int32_t *st = &ch->biquad_state[s * 4];
+        int32_t x1 = st[0], x2 = st[1], y1 = st[2], y2 = st[3];
+
+        for (size_t i = 0; i < count; i++) {
+            int32_t x = buf[i];
+            int64_t acc = (int64_t)c[0] * x + (int64_t)c[1] * x1 + (int64_t)c[2] * x2 +
+                          (int64_t)c[3] * y1 + (int64_t)c[4] * y2;
+            int32_t y = (int32_t)(acc >> shift);
+
+            x2 = x1;
+            x1 = x;
+            y2 = y1;
+            y1 = y;
+            buf[i] = y;
+        }
+
+        st[0] = x1;
+        st[1] = x2;
+        st[2] = y1;
+        st[3] = y2;
+    }
+#endif
+}
+
+/*****************************************************************************/
+// Energy in 2.48 format (same as arm_power_q31()), min and max of a segment
+static void segment_stats(const int32_t *buf, size_t count, uint64_t *energy, int32_t *min,
+                          int32_t *max)
+{
+#ifdef CONFIG_CMSIS_DSP
+    q63_t power;
+    uint32_t index;
+
+    arm_power_q31((const q31_t *)buf, count, &power);
+    arm_min_q31((const q31_t *)buf, count, (q31_t *)min, &index);
+    arm_max_q31((const q31_t *)buf, count, (q31_t *)max, &index);
+    *energy = (uint64_t)power;
+#else
+    uint64_t acc = 0;
+    int32_t lo = INT32_MAX;
+    int32_t hi = INT32_MIN;
+
+    for (size_t i = 0; i < count; i++) {
+        acc += (uint64_t)(((int64_t)buf[i] * buf[i]) >> 14);
+        lo = MIN(lo, buf[i]);
+        hi = MAX(hi, buf[i]);
+    }
+
+    *energy = acc;
+    *min = lo;
+    *max = hi;
+#endif
+}
+
+/*****************************************************************************/
+static void window_publish(uint8_t channel, struct dsp_channel *ch, int32_t last, bsp_ts_t ts)
+{
+    struct bsp_dsp_result result;
+    uint64_t rms = (uint64_t)isqrt64(ch->win_energy / ch->win_count) << 7; // 1.24 -> 1.31
+
+    result.rms = (int32_t)MIN(rms, (uint64_t)INT32_MAX);
+    result.min = ch->win_min;
+    result.max = ch->win_max;
+    result.last = last;
+    result.count = ch->win_count;
+    result.ts = ts;
+
+    k_spinlock_key_t key = k_spin_lock(&ch->lock);
+    result.seq = ch->result.seq + 1;
+    ch->result = result;
+    ch->result_valid = true;
+    k_spin_unlock(&ch->lock, key);
+
+    window_clear(ch);
+
+    if (ch->cfg.publish) {
+        ch->cfg.publish(channel, &result, ch->cfg.user_data);
+    }
+
+    bsp_dsp_publish_cb_t hook = publish_hook;
+    if (hook) {
+        hook(channel, &result, publish_hook_user_data);
+    }
+}
+
+/*****************************************************************************/
+// ts is the time of buf[0], step_ns the period of the decimated samples
+static void window_accumulate(uint8_t channel, struct dsp_channel *ch, const int32_t *buf,
+                              size_t count, bsp_ts_t ts, uint64_t step_ns)
+{
+    size_t pos = 0;
+
+    while (count > 0) {
+        size_t n = MIN(count, (size_t)(ch->cfg.window - ch->win_count));
+        uint64_t energy;
+        int32_t min;
+        int32_t max;
+
+        segment_stats(buf, n, &energy, &min, &max);
+
+        ch->win_energy += energy;
+        ch->win_min = MIN(ch->win_min, min);
+        ch->win_max = MAX(ch->win_max, max);
+        ch->win_count += n;
+
+        if (ch->win_count == ch->cfg.window) {
+            bsp_ts_t last_ts = ts + bsp_ts_from_ns((pos + n - 1) * step_ns);
+
+            window_publish(channel, ch, buf[n - 1], last_ts);
+        }
+
+        buf += n;
+        pos += n;
+        count -= n;
+    }
+}
+
+/*****************************************************************************/
+int bsp_dsp_channel_configure(uint8_t channel, const struct bsp_dsp_channel_cfg *cfg)
+{
+    if (channel >= BSP_DSP_CHANNELS_COUNT || cfg == NULL) {
+        return -EINVAL;
+    }
+
+    if (cfg->decim >= BSP_DSP_DECIM_MAX || cfg->decim_factor == 0 || cfg->window == 0 ||
+        cfg->window > WINDOW_MAX || cfg->biquad_stages > BSP_DSP_MAX_BIQUAD_STAGES ||
+        (cfg->biquad_stages > 0 && cfg->biquad_coeffs == NULL) || cfg->biquad_post_shift > 30) {
+        return -EINVAL;
+    }
+
+    if (cfg->decim == BSP_DSP_DECIM_CIC &&
+        (cfg->cic_order == 0 || cfg->cic_order > BSP_DSP_MAX_CIC_ORDER ||
+         cfg->decim_factor > CIC_DECIM_MAX)) {
+        return -EINVAL;
+    }
+
+    if (cfg->decim == BSP_DSP_DECIM_FIR &&
+        (cfg->fir_coeffs == NULL || cfg->fir_taps == 0 || cfg->fir_taps > BSP_DSP_MAX_FIR_TAPS ||
+         (BSP_DSP_BLOCK_SIZE % cfg->decim_factor) != 0)) {
+        return -EINVAL;
+    }
+
+    struct dsp_channel *ch = &channels[channel];
+
+    ch->configured = false;
+    ch->cfg = *cfg;
+    if (ch->cfg.decim_factor == 1) {
+        ch->cfg.decim = BSP_DSP_DECIM_NONE;
+    }
+
+    state_clear(ch);
+
+    if (ch->cfg.decim == BSP_DSP_DECIM_CIC) {
+        ch->cic_gain = 1;
+        for (uint8_t s = 0; s < ch->cfg.cic_order; s++) {
+            ch->cic_gain *= ch->cfg.decim_factor;
+        }
+    }
+
+#ifdef CONFIG_CMSIS_DSP
+    if (ch->cfg.decim == BSP_DSP_DECIM_FIR) {
+        arm_status status = arm_fir_decimate_init_q31(
+            &ch->fir, ch->cfg.fir_taps, ch->cfg.decim_factor, (const q31_t *)ch->cfg.fir_coeffs,
+            (q31_t *)ch->fir_state, BSP_DSP_BLOCK_SIZE);
+
+        if (status != ARM_MATH_SUCCESS) {
+            return -EINVAL;
+        }
+    }
+
+    if (ch->cfg.biquad_stages > 0) {
+        arm_biquad_cascade_df1_init_q31(&ch->biquad, ch->cfg.biquad_stages,
+                                        (const q31_t *)ch->cfg.biquad_coeffs,
+                                        (q31_t *)ch->biquad_state, ch->cfg.biquad_post_shift);
+    }
+#endif
+
+    k_spinlock_key_t key = k_spin_lock(&ch->lock);
+    ch->result_valid = false;
+    k_spin_unlock(&ch->lock, key);
+
+    ch->configured = true;
+
+    LOG_DBG("Channel %u: decim %d/%u, %u biquad stages, window %u", channel, ch->cfg.decim,
+            ch->cfg.decim_factor, ch->cfg.biquad_stages, ch->cfg.window);
+
+    return 0;
+}
+
+/*****************************************************************************/
+int bsp_dsp_channel_reset(uint8_t channel)
+{
+    if (channel >= BSP_DSP_CHANNELS_COUNT || !channels[channel].configured) {
+        return -EINVAL;
+    }
+
+    state_clear(&channels[channel]);
+
+    return 0;
+}
+
+/*****************************************************************************/
+int bsp_dsp_process(uint8_t channel, const int32_t *samples, size_t count, bsp_ts_t ts)
+{
+    if (channel >= BSP_DSP_CHANNELS_COUNT || !channels[channel].configured) {
+        return -EINVAL;
+    }
+
+    struct dsp_channel *ch = &channels[channel];
+
+    if (ch->cfg.decim == BSP_DSP_DECIM_FIR && (count % ch->cfg.decim_factor) != 0) {
+        return -EINVAL;
+    }
+
+    int32_t buf[BSP_DSP_BLOCK_SIZE];
+    const uint8_t factor = (ch->cfg.decim == BSP_DSP_DECIM_NONE) ? 1 : ch->cfg.decim_factor;
+    const uint64_t period_ns = ch->cfg.sample_period_ns;
+
+    while (count > 0) {
+        size_t n = MIN(count, (size_t)BSP_DSP_BLOCK_SIZE);
+        // Input samples up to and including the one completing the first output
+        size_t lead = factor - ((ch->cfg.decim == BSP_DSP_DECIM_CIC) ? ch->cic_phase : 0);
+        size_t produced;
+
+        switch (ch->cfg.decim) {
+        case BSP_DSP_DECIM_CIC:
+            produced = cic_decimate(ch, samples, n, buf);
+            break;
+        case BSP_DSP_DECIM_FIR:
+            produced = fir_decimate(ch, samples, n, buf);
+            break;
+        default:
+            memcpy(buf, samples, n * sizeof(int32_t));
+            produced = n;
+            break;
+        }
+
+        if (produced > 0) {
+            if (ch->cfg.biquad_stages > 0) {
+                biquad_run(ch, buf, produced);
+            }
+            // Dated back from the last input sample of the call
+            bsp_ts_t first = ts - bsp_ts_from_ns((count - lead) * period_ns);
+
+            window_accumulate(channel, ch, buf, produced, first, factor * period_ns);
+        }
+
+        samples += n;
+        count -= n;
+    }
+
+    return 0;
+}
+
+/*****************************************************************************/
+void bsp_dsp_publish_hook_set(bsp_dsp_publish_cb_t hook, void *user_data)
+{
+    publish_hook_user_data = user_data;
+    publish_hook = hook;
+}
+
+/*****************************************************************************/
+int bsp_dsp_result_get(uint8_t channel, struct bsp_dsp_result *result)
+{
+    if (channel >= BSP_DSP_CHANNELS_COUNT || result == NULL) {
+        return -EINVAL;
+    }
+
+    struct dsp_channel *ch = &channels[channel];
+    int ret = -EAGAIN;
+
+    k_spinlock_key_t key = k_spin_lock(&ch->lock);
+    if (ch->result_valid) {
+        *result = ch->result;
+        ret = 0;
+    }
+    k_spin_unlock(&ch->lock, key);
+
+    return ret;
+}
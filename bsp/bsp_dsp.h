@@ -0,0 +1,102 @@
+#ifndef BSP_DSP_H_
+#define BSP_DSP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bsp_ts.h"
+
+#define BSP_DSP_CHANNELS_COUNT CONFIG_BSP_DSP_CHANNELS
+#define BSP_DSP_BLOCK_SIZE CONFIG_BSP_DSP_BLOCK_SIZE
+#define BSP_DSP_MAX_FIR_TAPS CONFIG_BSP_DSP_MAX_FIR_TAPS
+#define BSP_DSP_MAX_BIQUAD_STAGES CONFIG_BSP_DSP_MAX_BIQUAD_STAGES
+#define BSP_DSP_MAX_CIC_ORDER 4
+
+/// @brief Number of q31 coefficients per biquad stage: {b0, b1, b2, a1, a2}.
+/// Feedback coefficients use the CMSIS-DSP sign convention (y += a1*y[n-1] + a2*y[n-2]).
+#define BSP_DSP_BIQUAD_COEFFS_PER_STAGE 5
+
+typedef enum {
+    BSP_DSP_DECIM_NONE,
+    BSP_DSP_DECIM_CIC,
+    BSP_DSP_DECIM_FIR,
+    BSP_DSP_DECIM_MAX
+} bsp_dsp_decim_t;
+
+/// @brief Values derived from one RMS/min/max window of filtered samples (q31)
+struct bsp_dsp_result {
+    int32_t rms;
+    int32_t min;
+    int32_t max;
+    int32_t last;
+    uint32_t count;
+    uint32_t seq;
+    bsp_ts_t ts; // Acquisition time of the last sample of the window
+};
+
+/// @brief Called from the context of bsp_dsp_process() every time a window completes
+typedef void (*bsp_dsp_publish_cb_t)(uint8_t channel, const struct bsp_dsp_result *result,
+                                     void *user_data);
+
+struct bsp_dsp_channel_cfg {
+    bsp_dsp_decim_t decim;
+    uint8_t decim_factor;    // 1 disables decimation regardless of decim
+    uint8_t cic_order;       // 1..BSP_DSP_MAX_CIC_ORDER, BSP_DSP_DECIM_CIC only
+    const int32_t *fir_coeffs; // q31, BSP_DSP_DECIM_FIR only. Must outlive the channel
+    uint16_t fir_taps;
+    const int32_t *biquad_coeffs; // q31, BSP_DSP_BIQUAD_COEFFS_PER_STAGE per stage, may be NULL
+    uint8_t biquad_stages;
+    uint8_t biquad_post_shift; // coefficients are scaled by 2^-post_shift
+    uint32_t window;           // Decimated samples per published result, max 65535
+    uint32_t sample_period_ns; // Input sample period, dates the results back from the block
+    bsp_dsp_publish_cb_t publish;
+    void *user_data;
+};
+
+/*****************************************************************************/
+
+/// @brief Converts a sign-extended 24-bit NAFE conversion code to q31
+static inline int32_t bsp_dsp_from_nafe24(int32_t code)
+{
+    return (int32_t)((uint32_t)code << 8);
+}
+
+/// @brief Configures the pipeline of a channel and clears its filter state.
+/// The configuration is copied; coefficient arrays are referenced.
+/// @param channel 0..BSP_DSP_CHANNELS_COUNT-1
+/// @param cfg
+/// @return 0 on success, -EINVAL on invalid configuration
+int bsp_dsp_channel_configure(uint8_t channel, const struct bsp_dsp_channel_cfg *cfg);
+
+/// @brief Clears filter state and the current window, keeps the configuration
+/// @param channel
+/// @return 0 on success
+int bsp_dsp_channel_reset(uint8_t channel);
+
+/// @brief Runs a block of raw q31 samples through the channel pipeline
+/// (decimation, biquad cascade, windowed statistics). Publishes a result
+/// through the channel callback every time a window completes.
+/// With FIR decimation, count must be a multiple of the decimation factor.
+/// Calls for one channel must not be made concurrently.
+/// @param channel
+/// @param samples
+/// @param count
+/// @param ts Acquisition time of the last sample, earlier samples are dated
+/// back by the sample period of the channel configuration
+/// @return 0 on success
+int bsp_dsp_process(uint8_t channel, const int32_t *samples, size_t count, bsp_ts_t ts);
+
+/// @brief Sets a callback invoked for the results of all channels, after the
+/// callback of the channel configuration. Used by the services mapping the
+/// analog values, independent of who configures the channels.
+/// @param hook NULL removes the hook
+/// @param user_data
+void bsp_dsp_publish_hook_set(bsp_dsp_publish_cb_t hook, void *user_data);
+
+/// @brief Returns the last published result of a channel
+/// @param channel
+/// @param result
+/// @return 0 on success, -EAGAIN if no window has completed yet
+int bsp_dsp_result_get(uint8_t channel, struct bsp_dsp_result *result);
+
+#endif // BSP_DSP_H_
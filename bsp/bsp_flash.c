@@ -0,0 +1,337 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/sys/util.h>
+
+#include "bsp_flash.h"
+#include "bsp_ts.h"
+
+LOG_MODULE_REGISTER(bsp_flash, CONFIG_LOG_DEFAULT_LEVEL);
+
+/*****************************************************************************/
+#define PAGE_SIZE BSP_FLASH_PAGE_SIZE
+#define ERASE_SIZE CONFIG_BSP_FLASH_ERASE_BLOCK_SIZE
+
+BUILD_ASSERT(IS_POWER_OF_TWO(PAGE_SIZE), "Flash page size must be a power of two");
+BUILD_ASSERT(ERASE_SIZE % PAGE_SIZE == 0);
+
+/*****************************************************************************/
+/* Private objects */
+static struct k_work_q flash_workq;
+static K_THREAD_STACK_DEFINE(flash_workq_stack, CONFIG_BSP_FLASH_THREAD_STACK_SIZE);
+
+static struct bsp_flash_stats stats;
+static struct k_spinlock jobs_lock;
+
+/*****************************************************************************/
+static void step_time(bsp_ts_t t0)
+{
+    uint32_t us = bsp_ts_to_us(bsp_ts_now() - t0);
+
+    stats.steps++;
+    stats.step_us_max = MAX(stats.step_us_max, us);
+}
+
+/*****************************************************************************/
+int bsp_flash_write(const struct flash_area *fa, off_t offset, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+
+    while (len > 0) {
+        // Up to the next page boundary, so no call programs two pages
+        size_t n = MIN(len, PAGE_SIZE - (offset & (PAGE_SIZE - 1)));
+        int err = flash_area_write(fa, offset, p, n);
+
+        if (err) {
+            return err;
+        }
+
+        offset += n;
+        p += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+/*****************************************************************************/
+// Runs one step of a job and queues the next one behind the other work
+static void job_step(struct k_work *work)
+{
+    struct bsp_flash_job *job = CONTAINER_OF(work, struct bsp_flash_job, work);
+    off_t off = job->offset + job->pos;
+    bsp_ts_t t0 = bsp_ts_now();
+    size_t n;
+    int err;
+
+    if (job->op == BSP_FLASH_ERASE) {
+        n = ERASE_SIZE;
+        err = flash_area_erase(job->fa, off, n);
+    } else {
+        n = MIN(job->len - job->pos, PAGE_SIZE - (off & (PAGE_SIZE - 1)));
+        err = flash_area_write(job->fa, off, (const uint8_t *)job->data + job->pos, n);
+    }
+
+    step_time(t0);
+    job->pos += n;
+
+    if (err == 0 && job->pos < job->len) {
+        k_work_submit_to_queue(&flash_workq, work);
+        return;
+    }
+
+    if (err) {
+        stats.errors++;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&jobs_lock);
+    job->busy = false;
+    k_spin_unlock(&jobs_lock, key);
+
+    if (job->done) {
+        job->done(job, err);
+    }
+}
+
+/*****************************************************************************/
+int bsp_flash_submit(struct bsp_flash_job *job)
+{
+    if (job == NULL || job->fa == NULL || job->len == 0 ||
+        (job->op == BSP_FLASH_WRITE && job->data == NULL) ||
+        (job->op == BSP_FLASH_ERASE && (job->offset % ERASE_SIZE || job->len % ERASE_SIZE))) {
+        return -EINVAL;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&jobs_lock);
+
+    if (job->busy) {
+        k_spin_unlock(&jobs_lock, key);
+        return -EBUSY;
+    }
+
+    job->busy = true;
+    job->pos = 0;
+    k_work_init(&job->work, job_step);
+    stats.jobs++;
+
+    k_spin_unlock(&jobs_lock, key);
+
+    k_work_submit_to_queue(&flash_workq, &job->work);
+
+    return 0;
+}
+
+/*****************************************************************************/
+int bsp_flash_work_schedule(struct k_work_delayable *dwork, k_timeout_t delay)
+{
+    return k_work_schedule_for_queue(&flash_workq, dwork, delay);
+}
+
+/*****************************************************************************/
+void bsp_flash_stats_get(struct bsp_flash_stats *s)
+{
+    *s = stats;
+}
+
+/*****************************************************************************/
+static int bsp_flash_init(void)
+{
+    k_work_queue_start(&flash_workq, flash_workq_stack, K_THREAD_STACK_SIZEOF(flash_workq_stack),
+                       CONFIG_BSP_FLASH_THREAD_PRIORITY, NULL);
+    k_thread_name_set(&flash_workq.thread, "flash_workq");
+
+    return 0;
+}
+
+SYS_INIT(bsp_flash_init, APPLICATION, 30);
+
+/*****************************************************************************/
+/* Shell */
+#ifdef CONFIG_SHELL
+static int cmd_flash_status(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    shell_print(sh, "Page %d, erase block %d", PAGE_SIZE, ERASE_SIZE);
+    shell_print(sh, "Jobs %u, steps %u, errors %u, longest step %u us", stats.jobs, stats.steps,
+                stats.errors, stats.step_us_max);
+
+    return 0;
+}
+
+#ifdef CONFIG_BSP_FLASH_BENCH
+#define STORAGE_PARTITION storage_partition
+#define BENCH_CHUNK 4096
+
+static uint8_t bench_buf[BENCH_CHUNK] __aligned(8);
+static K_SEM_DEFINE(bench_sem, 0, 1);
+static int bench_err;
+
+/*****************************************************************************/
+static void bench_done(struct bsp_flash_job *job, int err)
+{
+    ARG_UNUSED(job);
+
+    bench_err = err;
+    k_sem_give(&bench_sem);
+}
+
+/*****************************************************************************/
+// End of the highest storage_partition area in use, the bench stays above it
+static off_t bench_floor(void)
+{
+    off_t end = 0;
+
+#ifdef CONFIG_BSP_CALIB
+    end = MAX(end, CONFIG_BSP_CALIB_OFFSET + 2 * CONFIG_BSP_CALIB_SLOT_SIZE);
+#endif
+#ifdef CONFIG_BSP_SETTINGS
+    end = MAX(end, CONFIG_BSP_SETTINGS_OFFSET + CONFIG_BSP_SETTINGS_SIZE);
+#endif
+#ifdef CONFIG_BSP_CAN_REC
+    end = MAX(end, CONFIG_BSP_CAN_REC_OFFSET + CONFIG_BSP_CAN_REC_SIZE);
+#endif
+#ifdef CONFIG_BSP_DLOG
+    end = MAX(end, CONFIG_BSP_DLOG_OFFSET + CONFIG_BSP_DLOG_SIZE);
+#endif
+
+    return ROUND_UP(end, ERASE_SIZE);
+}
+
+/*****************************************************************************/
+static void bench_print(const struct shell *sh, const char *what, size_t len, bsp_ts_t t0,
+                        int err)
+{
+    uint64_t us = MAX(bsp_ts_to_us(bsp_ts_now() - t0), 1);
+
+    if (err) {
+        shell_error(sh, "%-16s failed (err %d)", what, err);
+        return;
+    }
+
+    shell_print(sh, "%-16s %6llu us %7llu kB/s", what, (unsigned long long)us,
+                (unsigned long long)(len * 1000 / us));
+}
+
+/*****************************************************************************/
+// Runs erase, program and read through the flash API on the end of
+// storage_partition, above the areas of the storage modules
+static int cmd_flash_bench(const struct shell *sh, size_t argc, char **argv)
+{
+    size_t len = (argc > 1 ? strtoul(argv[1], NULL, 0) : 16) * 1024;
+    const struct flash_area *fa;
+    int err = flash_area_open(FIXED_PARTITION_ID(STORAGE_PARTITION), &fa);
+
+    if (err) {
+        shell_error(sh, "Storage partition not available (err %d)", err);
+        return err;
+    }
+
+    off_t floor = bench_floor();
+
+    if (floor >= (off_t)fa->fa_size) {
+        shell_error(sh, "No free space in the storage partition above 0x%lx",
+                    (unsigned long)floor);
+        flash_area_close(fa);
+        return -ENOSPC;
+    }
+
+    len = ROUND_DOWN(MIN(len, fa->fa_size - floor), ERASE_SIZE);
+    if (len == 0) {
+        shell_error(sh, "Less than one erase block free above 0x%lx", (unsigned long)floor);
+        flash_area_close(fa);
+        return -ENOSPC;
+    }
+    off_t base = fa->fa_size - len;
+
+    for (size_t i = 0; i < sizeof(bench_buf); i++) {
+        bench_buf[i] = i * 7;
+    }
+
+    shell_print(sh, "%u kB at storage offset 0x%lx", (unsigned)(len / 1024), (unsigned long)base);
+
+    bsp_ts_t t0 = bsp_ts_now();
+    err = flash_area_erase(fa, base, len);
+    bench_print(sh, "erase", len, t0, err);
+
+    t0 = bsp_ts_now();
+    for (size_t pos = 0; err == 0 && pos < len; pos += BENCH_CHUNK) {
+        err = bsp_flash_write(fa, base + pos, bench_buf, BENCH_CHUNK);
+    }
+    bench_print(sh, "program paged", len, t0, err);
+
+    t0 = bsp_ts_now();
+    for (size_t pos = 0; err == 0 && pos < len; pos += BENCH_CHUNK) {
+        err = flash_area_read(fa, base + pos, bench_buf, BENCH_CHUNK);
+    }
+    bench_print(sh, "read", len, t0, err);
+
+    err = err ? err : flash_area_erase(fa, base, len);
+    t0 = bsp_ts_now();
+    for (size_t pos = 0; err == 0 && pos < len; pos += BENCH_CHUNK) {
+        err = flash_area_write(fa, base + pos, bench_buf, BENCH_CHUNK);
+    }
+    bench_print(sh, "program 4k calls", len, t0, err);
+
+    // The same through the work queue, the shell thread only waits
+    struct bsp_flash_stats s0;
+    struct bsp_flash_stats s1;
+    struct bsp_flash_job job = {
+        .fa = fa,
+        .op = BSP_FLASH_ERASE,
+        .offset = base,
+        .len = len,
+        .done = bench_done,
+    };
+
+    bsp_flash_stats_get(&s0);
+    t0 = bsp_ts_now();
+    if (err == 0) {
+        err = bsp_flash_submit(&job);
+    }
+    if (err == 0) {
+        k_sem_take(&bench_sem, K_FOREVER);
+        err = bench_err;
+    }
+    for (size_t pos = 0; err == 0 && pos < len; pos += BENCH_CHUNK) {
+        job.op = BSP_FLASH_WRITE;
+        job.offset = base + pos;
+        job.data = bench_buf;
+        job.len = BENCH_CHUNK;
+        err = bsp_flash_submit(&job);
+        if (err == 0) {
+            k_sem_take(&bench_sem, K_FOREVER);
+            err = bench_err;
+        }
+    }
+    bench_print(sh, "erase+program job", len, t0, err);
+    bsp_flash_stats_get(&s1);
+
+    shell_print(sh, "Job steps %u, longest step %u us", s1.steps - s0.steps, s1.step_us_max);
+
+    flash_area_close(fa);
+
+    return err;
+}
+
+#endif /* CONFIG_BSP_FLASH_BENCH */
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_flash,
+                               SHELL_CMD_ARG(status, NULL, "Show flash job statistics",
+                                             cmd_flash_status, 1, 0),
+#ifdef CONFIG_BSP_FLASH_BENCH
+                               SHELL_CMD_ARG(bench, NULL,
+                                             "[kB] Throughput on the end of storage_partition",
+                                             cmd_flash_bench, 1, 1),
+#endif
+                               SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(flash, &sub_flash, "Flash programming", NULL);
+#endif /* CONFIG_SHELL */
@@ -0,0 +1,85 @@
+#ifndef BSP_FLASH_H_
+#define BSP_FLASH_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/storage/flash_map.h>
+
+#define BSP_FLASH_PAGE_SIZE CONFIG_BSP_FLASH_PAGE_SIZE
+
+enum bsp_flash_op {
+    BSP_FLASH_ERASE,
+    BSP_FLASH_WRITE,
+};
+
+struct bsp_flash_job;
+
+/// @brief Invoked from the flash work queue when a job finishes
+/// @param job
+/// @param err 0 on success, error of the failed step otherwise
+typedef void (*bsp_flash_done_cb_t)(struct bsp_flash_job *job, int err);
+
+/// Erase or program job run in steps on the flash work queue. The job starts
+/// zeroed; it and the data must stay valid until the done callback.
+struct bsp_flash_job {
+    const struct flash_area *fa;
+    enum bsp_flash_op op;
+    off_t offset;
+    const void *data; // BSP_FLASH_WRITE only
+    size_t len;
+    bsp_flash_done_cb_t done;
+    void *user_data;
+
+    // Private
+    struct k_work work;
+    size_t pos;
+    bool busy;
+};
+
+struct bsp_flash_stats {
+    uint32_t jobs;
+    uint32_t steps;
+    uint32_t errors;
+    uint32_t step_us_max; // Longest single erase or page program
+};
+
+/*****************************************************************************/
+
+/// @brief Programs data in page-aligned chunks of at most BSP_FLASH_PAGE_SIZE
+/// bytes, one driver call each. While the flash executes code in place the
+/// driver masks interrupts for the duration of a call, so chunking bounds the
+/// interrupt latency to one page program instead of the whole buffer.
+/// @param fa
+/// @param offset
+/// @param data
+/// @param len
+/// @return 0 on success
+int bsp_flash_write(const struct flash_area *fa, off_t offset, const void *data, size_t len);
+
+/// @brief Queues an erase or program job. The flash work queue runs one
+/// erase block or page per work item, so higher priority threads get the CPU
+/// between steps and the caller does not wait for the flash. Each step is
+/// still a blocking driver call: while the flash executes code in place,
+/// interrupts stay masked for a whole erase block, about 30 ms for 4 kB.
+/// @param job
+/// @return 0 on success, -EBUSY if the job is still queued, -EINVAL for an
+/// invalid job
+int bsp_flash_submit(struct bsp_flash_job *job);
+
+/// @brief Schedules work on the flash work queue, for modules that run their
+/// own flash state machine behind the other flash jobs. An already scheduled
+/// item keeps its deadline.
+/// @param dwork
+/// @param delay
+/// @return As k_work_schedule_for_queue()
+int bsp_flash_work_schedule(struct k_work_delayable *dwork, k_timeout_t delay);
+
+/// @brief Returns the flash job statistics
+/// @param stats
+void bsp_flash_stats_get(struct bsp_flash_stats *stats);
+
+#endif // BSP_FLASH_H_
@@ -0,0 +1,420 @@
+#define DT_DRV_COMPAT bsp_sim_flash
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/flash.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/util.h>
+
+#include "cmdline.h"
+#include "posix_board_if.h"
+#include "posix_native_task.h"
+
+#include "bsp_flash_sim.h"
+#include "bsp_flash_sim_bottom.h"
+
+LOG_MODULE_REGISTER(bsp_flash_sim, CONFIG_LOG_DEFAULT_LEVEL);
+
+/*****************************************************************************/
+/* Geometry from the soc-nv-flash child, timing of the target's IS25LX064 */
+#define SOC_NV_FLASH_NODE DT_INST_CHILD(0, flash_0)
+#define FLASH_SIZE DT_REG_SIZE(SOC_NV_FLASH_NODE)
+#define ERASE_BLOCK_SIZE DT_PROP(SOC_NV_FLASH_NODE, erase_block_size)
+#define WRITE_BLOCK_SIZE DT_PROP(SOC_NV_FLASH_NODE, write_block_size)
+#define ERASE_VALUE DT_INST_PROP(0, erase_value)
+#define BLOCKS_COUNT (FLASH_SIZE / ERASE_BLOCK_SIZE)
+
+#define PAGE_SIZE CONFIG_BSP_FLASH_SIM_PAGE_SIZE
+#define PROGRAM_NS (CONFIG_BSP_FLASH_SIM_PAGE_PROGRAM_US * (uint64_t)NSEC_PER_USEC)
+#define ERASE_NS (CONFIG_BSP_FLASH_SIM_ERASE_US * (uint64_t)NSEC_PER_USEC)
+#define SPEED_MAX 1000
+
+// Programming clears bits, as on the NOR part
+BUILD_ASSERT(ERASE_VALUE == 0xff, "bsp,sim-flash models NOR flash erased to 0xff");
+BUILD_ASSERT(FLASH_SIZE % ERASE_BLOCK_SIZE == 0, "Flash size must be a multiple of the block");
+
+/*****************************************************************************/
+/* Private objects */
+static K_MUTEX_DEFINE(sim_lock);
+static uint8_t *sim_mem;
+static uint32_t *sim_wear;
+static struct bsp_flash_sim_stats sim_stats;
+static uint32_t sim_speed = 1;
+static uint64_t wait_ns;       // Modelled time not waited yet, below 1 us
+static uint32_t powerfail_ops; // Program or erase operations left, 0 if not armed
+
+static const struct flash_parameters sim_parameters = {
+    .write_block_size = WRITE_BLOCK_SIZE,
+    .erase_value = ERASE_VALUE,
+};
+
+/* Command line options */
+static char *opt_path = "flash.bin";
+static bool opt_erase;
+static uint32_t opt_speed = 1;
+static uint32_t opt_powerfail;
+
+/*****************************************************************************/
+static bool range_valid(off_t offset, size_t len)
+{
+    return offset >= 0 && (size_t)offset <= FLASH_SIZE && len <= FLASH_SIZE - (size_t)offset;
+}
+
+/*****************************************************************************/
+// The caller is held for the modelled time, as the CPU is while the flash it
+// executes from is busy. native_sim keeps simulated time in step with real
+// time by default, so host timestamps see the wait too.
+static void flash_busy(uint64_t ns)
+{
+    sim_stats.busy_us += ns / NSEC_PER_USEC;
+
+    if (sim_speed == 0) {
+        return;
+    }
+
+    wait_ns += ns / sim_speed;
+    if (wait_ns >= NSEC_PER_USEC) {
+        k_busy_wait(wait_ns / NSEC_PER_USEC);
+        wait_ns %= NSEC_PER_USEC;
+    }
+}
+
+/*****************************************************************************/
+static bool powerfail_due(void)
+{
+    return powerfail_ops != 0 && --powerfail_ops == 0;
+}
+
+/*****************************************************************************/
+// The shared mapping keeps what was programmed so far, like the chip would
+static void powerfail(const char *op, off_t offset)
+{
+    printk("flash_sim: power failure during %s at 0x%08lx\n", op, (long)offset);
+    posix_exit(BSP_FLASH_SIM_POWERFAIL_EXIT);
+}
+
+/*****************************************************************************/
+static int sim_read(const struct device *dev, off_t offset, void *data, size_t len)
+{
+    ARG_UNUSED(dev);
+
+    if (!range_valid(offset, len)) {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&sim_lock, K_FOREVER);
+    memcpy(data, sim_mem + offset, len);
+    sim_stats.reads++;
+    sim_stats.read_bytes += len;
+    flash_busy(len * (uint64_t)NSEC_PER_MSEC / CONFIG_BSP_FLASH_SIM_READ_KBPS);
+    k_mutex_unlock(&sim_lock);
+
+    return 0;
+}
+
+/*****************************************************************************/
+static int sim_write(const struct device *dev, off_t offset, const void *data, size_t len)
+{
+    ARG_UNUSED(dev);
+
+    const uint8_t *src = data;
+    uint8_t *dst = sim_mem + offset;
+    bool overwrite = false;
+
+    if (!range_valid(offset, len) || offset % WRITE_BLOCK_SIZE || len % WRITE_BLOCK_SIZE) {
+        return -EINVAL;
+    }
+    if (len == 0) {
+        return 0;
+    }
+
+    k_mutex_lock(&sim_lock, K_FOREVER);
+
+    for (size_t i = 0; i < len && !overwrite; i++) {
+        overwrite = dst[i] != ERASE_VALUE;
+    }
+    if (overwrite) {
+        sim_stats.overwrites++;
+        if (IS_ENABLED(CONFIG_BSP_FLASH_SIM_STRICT)) {
+            k_mutex_unlock(&sim_lock);
+            LOG_WRN("Program over data at 0x%08lx", (long)offset);
+            return -EIO;
+        }
+    }
+
+    // A page program takes about the same time however few bytes it carries
+    bool fail = powerfail_due();
+    size_t count = fail ? len / 2 : len;
+    size_t pages = (offset + len - 1) / PAGE_SIZE - offset / PAGE_SIZE + 1;
+
+    for (size_t i = 0; i < count; i++) {
+        dst[i] &= src[i];
+    }
+    sim_stats.programs++;
+    sim_stats.program_bytes += count;
+    flash_busy(pages * PROGRAM_NS);
+
+    if (fail) {
+        powerfail("program", offset + count);
+    }
+
+    k_mutex_unlock(&sim_lock);
+
+    return 0;
+}
+
+/*****************************************************************************/
+static int sim_erase(const struct device *dev, off_t offset, size_t size)
+{
+    ARG_UNUSED(dev);
+
+    if (!range_valid(offset, size) || offset % ERASE_BLOCK_SIZE || size % ERASE_BLOCK_SIZE) {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&sim_lock, K_FOREVER);
+
+    for (off_t pos = offset; pos < offset + (off_t)size; pos += ERASE_BLOCK_SIZE) {
+        // An interrupted erase leaves the block partly erased, approximated
+        // by its first half
+        bool fail = powerfail_due();
+
+        memset(sim_mem + pos, ERASE_VALUE, fail ? ERASE_BLOCK_SIZE / 2 : ERASE_BLOCK_SIZE);
+        sim_wear[pos / ERASE_BLOCK_SIZE]++;
+        sim_stats.erases++;
+        flash_busy(fail ? ERASE_NS / 2 : ERASE_NS);
+
+        if (fail) {
+            powerfail("erase", pos);
+        }
+    }
+
+    k_mutex_unlock(&sim_lock);
+
+    return 0;
+}
+
+/*****************************************************************************/
+static const struct flash_parameters *sim_get_parameters(const struct device *dev)
+{
+    ARG_UNUSED(dev);
+
+    return &sim_parameters;
+}
+
+#ifdef CONFIG_FLASH_PAGE_LAYOUT
+static const struct flash_pages_layout sim_pages_layout = {
+    .pages_count = BLOCKS_COUNT,
+    .pages_size = ERASE_BLOCK_SIZE,
+};
+
+/*****************************************************************************/
+static void sim_page_layout(const struct device *dev, const struct flash_pages_layout **layout,
+                            size_t *layout_size)
+{
+    ARG_UNUSED(dev);
+
+    *layout = &sim_pages_layout;
+    *layout_size = 1;
+}
+#endif
+
+static const struct flash_driver_api sim_api = {
+    .read = sim_read,
+    .write = sim_write,
+    .erase = sim_erase,
+    .get_parameters = sim_get_parameters,
+#ifdef CONFIG_FLASH_PAGE_LAYOUT
+    .page_layout = sim_page_layout,
+#endif
+};
+
+/*****************************************************************************/
+int bsp_flash_sim_speed_set(uint32_t speed)
+{
+    if (speed > SPEED_MAX) {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&sim_lock, K_FOREVER);
+    sim_speed = speed;
+    wait_ns = 0;
+    k_mutex_unlock(&sim_lock);
+
+    return 0;
+}
+
+/*****************************************************************************/
+void bsp_flash_sim_powerfail_arm(uint32_t ops)
+{
+    k_mutex_lock(&sim_lock, K_FOREVER);
+    powerfail_ops = ops;
+    k_mutex_unlock(&sim_lock);
+}
+
+/*****************************************************************************/
+uint32_t bsp_flash_sim_erase_count(uint32_t block)
+{
+    if (block >= BLOCKS_COUNT || sim_wear == NULL) {
+        return 0;
+    }
+
+    return sim_wear[block];
+}
+
+/*****************************************************************************/
+void bsp_flash_sim_stats_get(struct bsp_flash_sim_stats *stats)
+{
+    k_mutex_lock(&sim_lock, K_FOREVER);
+
+    *stats = sim_stats;
+    stats->erase_min = UINT32_MAX;
+    stats->erase_max = 0;
+    for (size_t i = 0; i < BLOCKS_COUNT && sim_wear != NULL; i++) {
+        stats->erase_min = MIN(stats->erase_min, sim_wear[i]);
+        stats->erase_max = MAX(stats->erase_max, sim_wear[i]);
+    }
+
+    k_mutex_unlock(&sim_lock);
+}
+
+/*****************************************************************************/
+/* Command line */
+static void flash_sim_options(void)
+{
+    static struct args_struct_t options[] = {
+        {.option = "flash",
+         .name = "path",
+         .type = 's',
+         .dest = (void *)&opt_path,
+         .descript = "Flash backing file, flash.bin by default; erase counts go to <path>.wear"},
+        {.is_switch = true,
+         .option = "flash-erase",
+         .type = 'b',
+         .dest = (void *)&opt_erase,
+         .descript = "Start with an erased flash and cleared erase counts"},
+        {.option = "flash-speed",
+         .name = "factor",
+         .type = 'u',
+         .dest = (void *)&opt_speed,
+         .descript = "Flash timing relative to the real part, 1 by default, 0 for no waits"},
+        {.option = "flash-powerfail",
+         .name = "ops",
+         .type = 'u',
+         .dest = (void *)&opt_powerfail,
+         .descript = "Cut the power during the given program or erase operation"},
+        ARG_TABLE_ENDMARKER,
+    };
+
+    native_add_command_line_opts(options);
+}
+
+NATIVE_TASK(flash_sim_options, PRE_BOOT_1, 10);
+
+/*****************************************************************************/
+static int sim_init(const struct device *dev)
+{
+    ARG_UNUSED(dev);
+
+    sim_mem = bsp_flash_sim_map_bottom(opt_path, FLASH_SIZE, ERASE_VALUE, opt_erase);
+    sim_wear = bsp_flash_sim_wear_map_bottom(opt_path, BLOCKS_COUNT, opt_erase);
+    if (sim_mem == NULL || sim_wear == NULL) {
+        LOG_ERR("Cannot map %s", opt_path);
+        return -EIO;
+    }
+
+    if (bsp_flash_sim_speed_set(opt_speed)) {
+        LOG_WRN("Invalid --flash-speed %u, using real time", opt_speed);
+    }
+    powerfail_ops = opt_powerfail;
+
+    return 0;
+}
+
+DEVICE_DT_INST_DEFINE(0, sim_init, NULL, NULL, NULL, POST_KERNEL, CONFIG_FLASH_INIT_PRIORITY,
+                      &sim_api);
+
+/*****************************************************************************/
+/* Shell */
+#ifdef CONFIG_SHELL
+static int cmd_status(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    struct bsp_flash_sim_stats stats;
+
+    bsp_flash_sim_stats_get(&stats);
+
+    shell_print(sh, "%s, speed x%u, power failure in %u ops", opt_path, sim_speed,
+                powerfail_ops);
+    shell_print(sh, "reads %u (%llu B), programs %u (%llu B), erases %u", stats.reads,
+                (unsigned long long)stats.read_bytes, stats.programs,
+                (unsigned long long)stats.program_bytes, stats.erases);
+    shell_print(sh, "overwrites %u, busy %llu ms, erase count %u..%u", stats.overwrites,
+                (unsigned long long)(stats.busy_us / USEC_PER_MSEC), stats.erase_min,
+                stats.erase_max);
+
+    return 0;
+}
+
+static int cmd_wear(const struct shell *sh, size_t argc, char **argv)
+{
+    uint32_t offset = (argc > 1) ? strtoul(argv[1], NULL, 0) : 0;
+    uint32_t size = (argc > 2) ? strtoul(argv[2], NULL, 0) : FLASH_SIZE;
+    uint32_t first = offset / ERASE_BLOCK_SIZE;
+    uint32_t end = MIN(DIV_ROUND_UP((uint64_t)offset + size, ERASE_BLOCK_SIZE), BLOCKS_COUNT);
+
+    // Runs of blocks with the same erase count, one line each
+    for (uint32_t block = first; block < end;) {
+        uint32_t count = bsp_flash_sim_erase_count(block);
+        uint32_t next = block + 1;
+
+        while (next < end && bsp_flash_sim_erase_count(next) == count) {
+            next++;
+        }
+        shell_print(sh, "0x%08x..0x%08x: %u", block * ERASE_BLOCK_SIZE,
+                    next * ERASE_BLOCK_SIZE - 1, count);
+        block = next;
+    }
+
+    return 0;
+}
+
+static int cmd_speed(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+
+    int err = bsp_flash_sim_speed_set(strtoul(argv[1], NULL, 0));
+    if (err) {
+        shell_error(sh, "Speed must be 0..%u", SPEED_MAX);
+    }
+
+    return err;
+}
+
+static int cmd_powerfail(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(sh);
+    ARG_UNUSED(argc);
+
+    bsp_flash_sim_powerfail_arm(strtoul(argv[1], NULL, 0));
+
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(
+    sub_flash_sim, SHELL_CMD_ARG(status, NULL, "Show flash statistics", cmd_status, 1, 0),
+    SHELL_CMD_ARG(wear, NULL, "[offset] [size] Erase counts per block", cmd_wear, 1, 2),
+    SHELL_CMD_ARG(speed, NULL, "<factor> 0 for no waits", cmd_speed, 2, 0),
+    SHELL_CMD_ARG(powerfail, NULL, "<ops> Cut the power during that operation, 0 disarms",
+                  cmd_powerfail, 2, 0),
+    SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(flash_sim, &sub_flash_sim, "Simulated flash", NULL);
+#endif /* CONFIG_SHELL */
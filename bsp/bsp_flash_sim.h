@@ -0,0 +1,44 @@
+#ifndef BSP_FLASH_SIM_H_
+#define BSP_FLASH_SIM_H_
+
+#include <stdint.h>
+
+/// Exit status of the simulator when an injected power failure cuts an operation
+#define BSP_FLASH_SIM_POWERFAIL_EXIT 3
+
+struct bsp_flash_sim_stats {
+    uint32_t reads;
+    uint32_t programs;
+    uint32_t erases;         // Erase blocks, not erase calls
+    uint64_t read_bytes;
+    uint64_t program_bytes;
+    uint32_t overwrites;     // Programs over bytes not erased
+    uint64_t busy_us;        // Modelled flash busy time, before the speed-up
+    uint32_t erase_min;      // Lowest and highest erase count of a block
+    uint32_t erase_max;
+};
+
+/*****************************************************************************/
+
+/// @brief Sets how much faster than the modelled flash the simulation runs,
+/// busy waits are divided by the factor. 0 drops the waits altogether.
+/// @param speed 0..1000
+/// @return 0 on success, -EINVAL if out of range
+int bsp_flash_sim_speed_set(uint32_t speed);
+
+/// @brief Arms a power failure: the given program or erase operation, counted
+/// from now, is cut halfway and the simulator exits with
+/// BSP_FLASH_SIM_POWERFAIL_EXIT. The backing file keeps the partial result.
+/// @param ops 1 for the next operation, 0 disarms
+void bsp_flash_sim_powerfail_arm(uint32_t ops);
+
+/// @brief Returns the erase cycles of a block, kept across runs
+/// @param block Erase block index from the start of the flash
+/// @return Erase count, 0 for an invalid block
+uint32_t bsp_flash_sim_erase_count(uint32_t block);
+
+/// @brief Returns the simulated flash statistics
+/// @param stats
+void bsp_flash_sim_stats_get(struct bsp_flash_sim_stats *stats);
+
+#endif // BSP_FLASH_SIM_H_
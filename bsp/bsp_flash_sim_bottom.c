@@ -0,0 +1,61 @@
+/*
+ * Host side of the simulated flash, built into the native simulator runner.
+ * The mappings are shared with the files, so the contents and the erase
+ * counters survive the process like the flash survives a reset.
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bsp_flash_sim_bottom.h"
+
+/*****************************************************************************/
+static void *map_file(const char *path, size_t size, int fill, int clear)
+{
+    struct stat st;
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+
+    if (fd < 0) {
+        return NULL;
+    }
+
+    if (fstat(fd, &st) || ftruncate(fd, size)) {
+        close(fd);
+        return NULL;
+    }
+
+    uint8_t *mem = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (mem == MAP_FAILED) {
+        return NULL;
+    }
+
+    // ftruncate() extends with zeros, a new chip reads erased
+    size_t keep = clear ? 0 : (size_t)st.st_size;
+    if (keep < size) {
+        memset(mem + keep, fill, size - keep);
+    }
+
+    return mem;
+}
+
+/*****************************************************************************/
+void *bsp_flash_sim_map_bottom(const char *path, size_t size, uint8_t erase_value, int erase)
+{
+    return map_file(path, size, erase_value, erase);
+}
+
+/*****************************************************************************/
+uint32_t *bsp_flash_sim_wear_map_bottom(const char *path, size_t blocks, int clear)
+{
+    char wear_path[4096];
+
+    if (snprintf(wear_path, sizeof(wear_path), "%s.wear", path) >= (int)sizeof(wear_path)) {
+        return NULL;
+    }
+
+    return map_file(wear_path, blocks * sizeof(uint32_t), 0, clear);
+}
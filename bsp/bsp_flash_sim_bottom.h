@@ -0,0 +1,28 @@
+/*
+ * Host side of the simulated flash. Only standard C types may cross this
+ * interface, as the implementation is built into the native simulator runner.
+ * Functions return NULL on failure; host errno values are not meaningful here.
+ */
+#ifndef BSP_FLASH_SIM_BOTTOM_H_
+#define BSP_FLASH_SIM_BOTTOM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// @brief Maps the flash backing file, created or grown to size. New bytes
+/// read as erase_value, all of them if erase is set.
+void *bsp_flash_sim_map_bottom(const char *path, size_t size, uint8_t erase_value, int erase);
+
+/// @brief Maps the erase counters kept next to the backing file, in
+/// <path>.wear, one per block. Cleared together with the flash contents.
+uint32_t *bsp_flash_sim_wear_map_bottom(const char *path, size_t blocks, int clear);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BSP_FLASH_SIM_BOTTOM_H_
@@ -0,0 +1,840 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zephyr/devicetree.h>
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/util.h>
+
+#ifdef CONFIG_MCUBOOT_BOOTLOADER_MODE_DIRECT_XIP
+#include <bootutil/bootutil_public.h>
+#endif
+
+#include "bsp_flash.h"
+#include "bsp_fwup.h"
+#include "bsp_settings.h"
+
+#ifdef CONFIG_BSP_FWUP_ISOTP
+#include "bsp_isotp.h"
+#endif
+
+LOG_MODULE_REGISTER(bsp_fwup, CONFIG_LOG_DEFAULT_LEVEL);
+
+/*****************************************************************************/
+#define CHUNK_SIZE CONFIG_BSP_FLASH_ERASE_BLOCK_SIZE
+#define FWUP_ALIGN 8
+#define VERIFY_SIZE 256
+#define WAIT_TIMEOUT K_SECONDS(5)
+#define PROGRESS_KEY "fwup"
+
+#define SLOT0_PARTITION slot0_partition
+#define SLOT1_PARTITION slot1_partition
+
+#if defined(CONFIG_XIP) && !defined(CONFIG_ARCH_POSIX)
+#define SLOT_XIP
+#define FLASH_NODE DT_CHOSEN(zephyr_flash)
+// Second reg entry of the FlexSPI controller is the AHB (XIP) window
+#define XIP_BASE DT_REG_ADDR_BY_IDX(DT_PARENT(FLASH_NODE), 1)
+#endif
+
+/*****************************************************************************/
+/* MCUboot image header, see bootutil/image.h */
+#define IMAGE_MAGIC 0x96f3b83d
+
+struct image_version {
+    uint8_t major;
+    uint8_t minor;
+    uint16_t revision;
+    uint32_t build_num;
+};
+
+struct image_header {
+    uint32_t ih_magic;
+    uint32_t ih_load_addr;
+    uint16_t ih_hdr_size;
+    uint16_t ih_protect_tlv_size;
+    uint32_t ih_img_size;
+    uint32_t ih_flags;
+    struct image_version ih_ver;
+    uint32_t pad;
+};
+
+/*****************************************************************************/
+// Progress kept in the settings store; offset and crc_running always match
+struct fwup_progress {
+    uint32_t size;
+    uint32_t crc;         // Expected CRC of the whole image
+    uint32_t offset;      // Programmed and read back
+    uint32_t crc_running; // CRC of the first offset bytes
+    uint8_t slot;
+    uint8_t state;
+    uint16_t reserved;
+};
+
+BUILD_ASSERT(sizeof(struct fwup_progress) <= BSP_SETTINGS_VALUE_MAX);
+
+// One erase block of the image, erased, programmed and read back as a unit
+struct chunk {
+    uint8_t data[CHUNK_SIZE] __aligned(FWUP_ALIGN);
+    uint32_t offset;
+    size_t len;
+    uint32_t crc;
+    struct bsp_flash_job job;
+};
+
+/*****************************************************************************/
+/* Private objects */
+
+// Writer side, under fwup_lock
+static struct chunk chunks[2];
+static uint8_t fill_idx; // Chunk taking data
+static bool owned;       // chunks[fill_idx] is held by the writer
+static uint32_t received;
+static const struct flash_area *slot_fa;
+static int running;
+static K_MUTEX_DEFINE(fwup_lock);
+static K_SEM_DEFINE(chunk_sem, 2, 2); // Chunks not in flight
+
+// Shared with the flash work queue, under fwup_spin
+static struct fwup_progress prog;
+static int fwup_err;
+static struct k_spinlock fwup_spin;
+
+static uint8_t verify_buf[VERIFY_SIZE] __aligned(FWUP_ALIGN);
+
+/*****************************************************************************/
+static int slot_id(int slot)
+{
+    return slot ? FIXED_PARTITION_ID(SLOT1_PARTITION) : FIXED_PARTITION_ID(SLOT0_PARTITION);
+}
+
+/*****************************************************************************/
+// The slot holding the code that runs, slot 0 unless executed in place from
+// slot 1
+static int running_slot(void)
+{
+#ifdef SLOT_XIP
+    uintptr_t pc = (uintptr_t)running_slot;
+    uintptr_t base = XIP_BASE + FIXED_PARTITION_OFFSET(SLOT1_PARTITION);
+
+    return (pc >= base && pc < base + FIXED_PARTITION_SIZE(SLOT1_PARTITION)) ? 1 : 0;
+#else
+    return 0;
+#endif
+}
+
+/*****************************************************************************/
+static void progress_save(void)
+{
+    struct fwup_progress p;
+
+    k_spinlock_key_t key = k_spin_lock(&fwup_spin);
+    p = prog;
+    k_spin_unlock(&fwup_spin, key);
+
+    int err = bsp_settings_set(PROGRESS_KEY, &p, sizeof(p));
+    if (err) {
+        LOG_WRN("Update progress not saved (err %d)", err);
+    }
+}
+
+/*****************************************************************************/
+static void fail(int err)
+{
+    k_spinlock_key_t key = k_spin_lock(&fwup_spin);
+
+    if (prog.state != BSP_FWUP_ERROR) {
+        prog.state = BSP_FWUP_ERROR;
+        fwup_err = err;
+    }
+
+    k_spin_unlock(&fwup_spin, key);
+
+    LOG_ERR("Firmware update failed (err %d)", err);
+}
+
+/*****************************************************************************/
+#ifdef CONFIG_MCUBOOT_BOOTLOADER_MODE_DIRECT_XIP
+static int version_cmp(const struct image_version *a, const struct image_version *b)
+{
+    if (a->major != b->major) {
+        return a->major - b->major;
+    }
+    if (a->minor != b->minor) {
+        return a->minor - b->minor;
+    }
+    if (a->revision != b->revision) {
+        return a->revision - b->revision;
+    }
+
+    return (a->build_num > b->build_num) - (a->build_num < b->build_num);
+}
+#endif
+
+/*****************************************************************************/
+// Checks the start of the image before anything is programmed: MCUboot
+// header, size, reset vector inside the slot it is written to and, as
+// direct-XIP boots the highest version, a version above the running one
+static int image_check(const uint8_t *data, size_t len)
+{
+    struct image_header hdr;
+
+    if (len < sizeof(hdr)) {
+        return -ENOEXEC;
+    }
+
+    memcpy(&hdr, data, sizeof(hdr));
+
+    if (hdr.ih_magic != IMAGE_MAGIC || hdr.ih_hdr_size < sizeof(hdr) ||
+        hdr.ih_hdr_size + hdr.ih_img_size > prog.size) {
+        LOG_ERR("No MCUboot image header");
+        return -ENOEXEC;
+    }
+
+#ifdef SLOT_XIP
+    if (len < hdr.ih_hdr_size + 8) {
+        return -ENOEXEC;
+    }
+
+    uint32_t reset = sys_get_le32(data + hdr.ih_hdr_size + 4);
+    uintptr_t base = XIP_BASE + slot_fa->fa_off;
+
+    if (reset < base || reset >= base + slot_fa->fa_size) {
+        LOG_ERR("Image linked for another slot, reset vector 0x%08x", reset);
+        return -ENOEXEC;
+    }
+#endif
+
+#ifdef CONFIG_MCUBOOT_BOOTLOADER_MODE_DIRECT_XIP
+    const struct flash_area *fa;
+    struct image_header cur;
+
+    if (flash_area_open(slot_id(running), &fa) == 0) {
+        int err = flash_area_read(fa, 0, &cur, sizeof(cur));
+
+        flash_area_close(fa);
+
+        if (err == 0 && cur.ih_magic == IMAGE_MAGIC &&
+            version_cmp(&hdr.ih_ver, &cur.ih_ver) <= 0) {
+            LOG_ERR("Image version %u.%u.%u not above the running one", hdr.ih_ver.major,
+                    hdr.ih_ver.minor, hdr.ih_ver.revision);
+            return -ENOEXEC;
+        }
+    }
+#endif
+
+    return 0;
+}
+
+/*****************************************************************************/
+// Runs on the flash work queue
+static void chunk_done(struct chunk *c, int err)
+{
+    if (err) {
+        fail(err);
+    } else {
+        k_spinlock_key_t key = k_spin_lock(&fwup_spin);
+
+        // Chunks complete in order, see bsp_fwup_finish(). A chunk finishing
+        // after an abort is dropped.
+        if (prog.state == BSP_FWUP_RECEIVING && c->offset == prog.offset) {
+            prog.crc_running = crc32_ieee_update(prog.crc_running, c->data, c->len);
+            prog.offset += c->len;
+        }
+
+        k_spin_unlock(&fwup_spin, key);
+
+        progress_save();
+    }
+
+    k_sem_give(&chunk_sem);
+}
+
+/*****************************************************************************/
+// Reads the programmed chunk back and compares it with the RAM copy
+static void chunk_written(struct bsp_flash_job *job, int err)
+{
+    struct chunk *c = job->user_data;
+    uint32_t crc = 0;
+
+    for (size_t pos = 0; err == 0 && pos < c->len; pos += VERIFY_SIZE) {
+        size_t n = MIN(VERIFY_SIZE, c->len - pos);
+
+        err = flash_area_read(slot_fa, c->offset + pos, verify_buf, n);
+        crc = crc32_ieee_update(crc, verify_buf, n);
+    }
+
+    if (err == 0 && crc != c->crc) {
+        LOG_ERR("Read back mismatch at 0x%x", c->offset);
+        err = -EIO;
+    }
+
+    chunk_done(c, err);
+}
+
+/*****************************************************************************/
+static void chunk_erased(struct bsp_flash_job *job, int err)
+{
+    struct chunk *c = job->user_data;
+
+    if (err == 0) {
+        job->op = BSP_FLASH_WRITE;
+        job->data = c->data;
+        job->len = ROUND_UP(c->len, FWUP_ALIGN);
+        job->done = chunk_written;
+        err = bsp_flash_submit(job);
+    }
+
+    if (err) {
+        chunk_done(c, err);
+    }
+}
+
+/*****************************************************************************/
+// Hands the filled chunk to the flash work queue. Called with fwup_lock held.
+static int chunk_submit(void)
+{
+    struct chunk *c = &chunks[fill_idx];
+
+    if (c->offset == 0) {
+        int err = image_check(c->data, c->len);
+        if (err) {
+            owned = false;
+            k_sem_give(&chunk_sem);
+            fail(err);
+            return err;
+        }
+    }
+
+    owned = false;
+    fill_idx ^= 1;
+
+    c->crc = crc32_ieee(c->data, c->len);
+    memset(c->data + c->len, 0xFF, ROUND_UP(c->len, FWUP_ALIGN) - c->len);
+
+    c->job = (struct bsp_flash_job){
+        .fa = slot_fa,
+        .op = BSP_FLASH_ERASE,
+        .offset = c->offset,
+        .len = CHUNK_SIZE,
+        .done = chunk_erased,
+        .user_data = c,
+    };
+
+    int err = bsp_flash_submit(&c->job);
+    if (err) {
+        chunk_done(c, err);
+    }
+
+    return 0;
+}
+
+/*****************************************************************************/
+// Waits until no chunk is in flight. Called with fwup_lock held.
+static void drain(void)
+{
+    for (int held = owned ? 1 : 0; held < 2; held++) {
+        k_sem_take(&chunk_sem, K_FOREVER);
+    }
+
+    owned = false;
+    k_sem_give(&chunk_sem);
+    k_sem_give(&chunk_sem);
+}
+
+/*****************************************************************************/
+int bsp_fwup_begin(uint32_t size, uint32_t crc)
+{
+    if (slot_fa == NULL) {
+        return -ENODEV;
+    }
+
+    // The last erase block stays free for the MCUboot trailer
+    if (size == 0 || size > slot_fa->fa_size - CHUNK_SIZE) {
+        return -EFBIG;
+    }
+
+    k_mutex_lock(&fwup_lock, K_FOREVER);
+
+    drain();
+
+    int ret = 0;
+    k_spinlock_key_t key = k_spin_lock(&fwup_spin);
+    bool same = prog.size == size && prog.crc == crc;
+
+    // Flash and transport errors resume, a rejected image starts over
+    bool resumable = prog.state == BSP_FWUP_RECEIVING ||
+                     (prog.state == BSP_FWUP_ERROR && fwup_err != -ENOEXEC && fwup_err != -EBADMSG);
+
+    if (same && resumable) {
+        prog.state = BSP_FWUP_RECEIVING;
+        fwup_err = 0;
+        ret = prog.offset;
+    } else if (same && prog.state == BSP_FWUP_VERIFIED) {
+        ret = size;
+    } else {
+        prog = (struct fwup_progress){
+            .size = size,
+            .crc = crc,
+            .slot = running ^ 1,
+            .state = BSP_FWUP_RECEIVING,
+        };
+        fwup_err = 0;
+    }
+
+    k_spin_unlock(&fwup_spin, key);
+
+    received = ret;
+    fill_idx = 0;
+
+    // A resumed update checks the image header again from flash
+    if (ret > 0 && prog.state == BSP_FWUP_RECEIVING) {
+        size_t len = MIN(ret, CHUNK_SIZE);
+        int err = flash_area_read(slot_fa, 0, chunks[0].data, len);
+
+        err = err ? err : image_check(chunks[0].data, len);
+        if (err) {
+            fail(err);
+            ret = err;
+        }
+    }
+
+    if (ret == 0) {
+        progress_save();
+    }
+
+    k_mutex_unlock(&fwup_lock);
+
+    LOG_INF("Firmware update of %u bytes into slot %d from offset %d", size, running ^ 1, ret);
+
+    return ret;
+}
+
+/*****************************************************************************/
+int bsp_fwup_write(uint32_t offset, const void *data, size_t len)
+{
+    const uint8_t *p = data;
+    int err = 0;
+
+    k_mutex_lock(&fwup_lock, K_FOREVER);
+
+    if (prog.state != BSP_FWUP_RECEIVING) {
+        err = prog.state == BSP_FWUP_ERROR ? fwup_err : -EINVAL;
+    } else if (offset != received) {
+        err = -ESPIPE;
+    } else if (received + len > prog.size) {
+        err = -EFBIG;
+    }
+
+    while (err == 0 && len > 0) {
+        struct chunk *c = &chunks[fill_idx];
+
+        if (!owned) {
+            if (k_sem_take(&chunk_sem, WAIT_TIMEOUT)) {
+                err = -ETIMEDOUT;
+                break;
+            }
+
+            owned = true;
+            c->offset = received;
+            c->len = 0;
+        }
+
+        size_t n = MIN(len, CHUNK_SIZE - c->len);
+
+        memcpy(c->data + c->len, p, n);
+        c->len += n;
+        received += n;
+        p += n;
+        len -= n;
+
+        if (c->len == CHUNK_SIZE) {
+            err = chunk_submit();
+        }
+    }
+
+    k_mutex_unlock(&fwup_lock);
+
+    return err;
+}
+
+/*****************************************************************************/
+int bsp_fwup_finish(void)
+{
+    int err = 0;
+
+    k_mutex_lock(&fwup_lock, K_FOREVER);
+
+    if (prog.state == BSP_FWUP_RECEIVING && owned && chunks[fill_idx].len > 0) {
+        // The short last chunk would finish before a full chunk still in
+        // flight, wait for that one first
+        k_sem_take(&chunk_sem, K_FOREVER);
+        k_sem_give(&chunk_sem);
+        err = chunk_submit();
+    }
+
+    drain();
+
+    k_spinlock_key_t key = k_spin_lock(&fwup_spin);
+
+    if (prog.state == BSP_FWUP_ERROR) {
+        err = fwup_err;
+    } else if (prog.state != BSP_FWUP_RECEIVING) {
+        err = prog.state == BSP_FWUP_VERIFIED ? 0 : -EINVAL;
+    } else if (prog.offset != prog.size) {
+        err = -ENODATA;
+    } else if (prog.crc_running != prog.crc) {
+        err = -EBADMSG;
+    }
+
+    bool verify = err == 0 && prog.state == BSP_FWUP_RECEIVING;
+
+    k_spin_unlock(&fwup_spin, key);
+
+    if (err == -EBADMSG) {
+        fail(err);
+    }
+
+    // Leftovers of an older image must not pass for an MCUboot trailer
+    if (verify) {
+        err = flash_area_erase(slot_fa, slot_fa->fa_size - CHUNK_SIZE, CHUNK_SIZE);
+        if (err) {
+            fail(err);
+        } else {
+            key = k_spin_lock(&fwup_spin);
+            prog.state = BSP_FWUP_VERIFIED;
+            k_spin_unlock(&fwup_spin, key);
+            progress_save();
+            LOG_INF("Firmware image in slot %d verified", prog.slot);
+        }
+    }
+
+    k_mutex_unlock(&fwup_lock);
+
+    return err;
+}
+
+/*****************************************************************************/
+int bsp_fwup_activate(bool permanent)
+{
+#ifdef CONFIG_MCUBOOT_BOOTLOADER_MODE_DIRECT_XIP
+    int err;
+
+    k_mutex_lock(&fwup_lock, K_FOREVER);
+
+    if (prog.state != BSP_FWUP_VERIFIED) {
+        err = -EINVAL;
+    } else {
+        err = boot_set_next(slot_fa, false, permanent);
+    }
+
+    if (err == 0) {
+        k_spinlock_key_t key = k_spin_lock(&fwup_spin);
+        prog.state = BSP_FWUP_PENDING;
+        k_spin_unlock(&fwup_spin, key);
+        progress_save();
+        // The reset may follow at once
+        bsp_settings_flush();
+        LOG_INF("Slot %d boots next%s", prog.slot, permanent ? "" : " on trial");
+    }
+
+    k_mutex_unlock(&fwup_lock);
+
+    return err;
+#else
+    ARG_UNUSED(permanent);
+
+    return -ENOTSUP;
+#endif
+}
+
+/*****************************************************************************/
+int bsp_fwup_confirm(void)
+{
+#ifdef CONFIG_MCUBOOT_BOOTLOADER_MODE_DIRECT_XIP
+    const struct flash_area *fa;
+    int err = flash_area_open(slot_id(running), &fa);
+
+    if (err == 0) {
+        err = boot_set_next(fa, true, true);
+        flash_area_close(fa);
+    }
+
+    return err;
+#else
+    return -ENOTSUP;
+#endif
+}
+
+/*****************************************************************************/
+void bsp_fwup_abort(void)
+{
+    k_mutex_lock(&fwup_lock, K_FOREVER);
+
+    drain();
+
+    k_spinlock_key_t key = k_spin_lock(&fwup_spin);
+    prog = (struct fwup_progress){.slot = running ^ 1};
+    fwup_err = 0;
+    k_spin_unlock(&fwup_spin, key);
+
+    received = 0;
+    bsp_settings_delete(PROGRESS_KEY);
+
+    k_mutex_unlock(&fwup_lock);
+}
+
+/*****************************************************************************/
+void bsp_fwup_status_get(struct bsp_fwup_status *status)
+{
+    k_spinlock_key_t key = k_spin_lock(&fwup_spin);
+
+    status->state = prog.state;
+    status->slot = running ^ 1;
+    status->running = running;
+    status->size = prog.size;
+    status->offset = prog.offset;
+    status->err = fwup_err;
+
+    k_spin_unlock(&fwup_spin, key);
+}
+
+/*****************************************************************************/
+static int bsp_fwup_init(void)
+{
+    running = running_slot();
+
+    int err = flash_area_open(slot_id(running ^ 1), &slot_fa);
+    if (err) {
+        LOG_ERR("Failed to open slot %d (err %d)", running ^ 1, err);
+        slot_fa = NULL;
+        return 0;
+    }
+
+    prog.slot = running ^ 1;
+
+    struct fwup_progress p;
+
+    if (bsp_settings_get(PROGRESS_KEY, &p, sizeof(p)) != sizeof(p)) {
+        return 0;
+    }
+
+    if (p.state == BSP_FWUP_PENDING) {
+        // The activated image runs now, or MCUboot did not take it
+        if (p.slot == running) {
+            LOG_INF("Running the updated image from slot %d", running);
+        } else {
+            LOG_WRN("Updated image in slot %d not booted", p.slot);
+        }
+        bsp_settings_delete(PROGRESS_KEY);
+    } else if (p.slot == prog.slot &&
+               (p.state == BSP_FWUP_RECEIVING || p.state == BSP_FWUP_VERIFIED)) {
+        prog = p;
+        LOG_INF("Firmware update at %u of %u bytes, resumable", p.offset, p.size);
+    }
+
+    return 0;
+}
+
+// After the settings store
+SYS_INIT(bsp_fwup_init, APPLICATION, 33);
+
+/*****************************************************************************/
+/* ISO-TP transport. Requests start with a command byte, multi-byte fields
+ * are little endian:
+ *   0x01 begin    size u32, crc u32
+ *   0x02 data     offset u32, data
+ *   0x03 finish
+ *   0x04 activate permanent u8
+ *   0x05 status
+ *   0x06 abort
+ * Every request is answered with the command | 0x80, the result as i8
+ * (0 or a negative errno), the state u8 and the resume offset u32. */
+#ifdef CONFIG_BSP_FWUP_ISOTP
+#define REQ_SIZE (5 + CONFIG_BSP_FWUP_ISOTP_BLOCK_SIZE)
+
+enum {
+    CMD_BEGIN = 0x01,
+    CMD_DATA,
+    CMD_FINISH,
+    CMD_ACTIVATE,
+    CMD_STATUS,
+    CMD_ABORT,
+};
+
+static uint8_t isotp_rx_buf[REQ_SIZE];
+static uint8_t req_buf[REQ_SIZE];
+static size_t req_len;
+static atomic_t req_busy;
+static uint8_t rsp_buf[7];
+static int isotp_session = -1;
+static K_SEM_DEFINE(req_sem, 0, 1);
+
+/*****************************************************************************/
+// Runs in the CAN dispatch thread, the request is handled by the fwup thread
+static void isotp_rx(int session, const uint8_t *data, size_t len, void *user_data)
+{
+    ARG_UNUSED(session);
+    ARG_UNUSED(user_data);
+
+    if (len == 0 || len > sizeof(req_buf) || !atomic_cas(&req_busy, 0, 1)) {
+        return; // Requests are sent one at a time
+    }
+
+    memcpy(req_buf, data, len);
+    req_len = len;
+    k_sem_give(&req_sem);
+}
+
+/*****************************************************************************/
+static int request_handle(void)
+{
+    switch (req_buf[0]) {
+    case CMD_BEGIN:
+        return req_len >= 9 ? bsp_fwup_begin(sys_get_le32(&req_buf[1]), sys_get_le32(&req_buf[5]))
+                            : -EINVAL;
+    case CMD_DATA:
+        return req_len >= 5 ? bsp_fwup_write(sys_get_le32(&req_buf[1]), &req_buf[5], req_len - 5)
+                            : -EINVAL;
+    case CMD_FINISH:
+        return bsp_fwup_finish();
+    case CMD_ACTIVATE:
+        return bsp_fwup_activate(req_len >= 2 && req_buf[1] != 0);
+    case CMD_STATUS:
+        return 0;
+    case CMD_ABORT:
+        bsp_fwup_abort();
+        return 0;
+    default:
+        return -ENOTSUP;
+    }
+}
+
+/*****************************************************************************/
+static void fwup_isotp_thread(void *p1, void *p2, void *p3)
+{
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    static const struct bsp_isotp_session_cfg cfg = {
+        .rx_id = CONFIG_BSP_FWUP_ISOTP_RX_ID,
+        .tx_id = CONFIG_BSP_FWUP_ISOTP_TX_ID,
+        .fd = IS_ENABLED(CONFIG_CAN_FD_MODE),
+        .rx_buf = isotp_rx_buf,
+        .rx_size = sizeof(isotp_rx_buf),
+        .rx_cb = isotp_rx,
+    };
+
+    isotp_session = bsp_isotp_open(&cfg);
+    if (isotp_session < 0) {
+        LOG_ERR("No ISO-TP session for updates (err %d)", isotp_session);
+        return;
+    }
+
+    while (true) {
+        struct bsp_fwup_status s;
+
+        k_sem_take(&req_sem, K_FOREVER);
+
+        int ret = request_handle();
+
+        bsp_fwup_status_get(&s);
+
+        rsp_buf[0] = req_buf[0] | 0x80;
+        rsp_buf[1] = (uint8_t)(int8_t)MIN(ret, 0);
+        rsp_buf[2] = s.state;
+        sys_put_le32(s.offset, &rsp_buf[3]);
+
+        // The next request follows the response, so the buffer is free
+        atomic_set(&req_busy, 0);
+        bsp_isotp_send(isotp_session, rsp_buf, sizeof(rsp_buf), NULL, NULL);
+    }
+}
+
+K_THREAD_DEFINE(fwup_isotp_tid, CONFIG_BSP_FWUP_ISOTP_THREAD_STACK_SIZE, fwup_isotp_thread, NULL,
+                NULL, NULL, CONFIG_BSP_FWUP_ISOTP_THREAD_PRIORITY, 0, 0);
+#endif /* CONFIG_BSP_FWUP_ISOTP */
+
+/*****************************************************************************/
+/* Shell */
+#ifdef CONFIG_SHELL
+static const char *const state_names[] = {
+    [BSP_FWUP_IDLE] = "idle",         [BSP_FWUP_RECEIVING] = "receiving",
+    [BSP_FWUP_VERIFIED] = "verified", [BSP_FWUP_PENDING] = "pending",
+    [BSP_FWUP_ERROR] = "error",
+};
+
+static int cmd_fwup_status(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    struct bsp_fwup_status s;
+
+    bsp_fwup_status_get(&s);
+
+    shell_print(sh, "Running slot %d, update slot %d, %s", s.running, s.slot,
+                state_names[s.state]);
+    shell_print(sh, "%u of %u bytes programmed and read back", s.offset, s.size);
+    if (s.state == BSP_FWUP_ERROR) {
+        shell_print(sh, "Error %d", s.err);
+    }
+
+    return 0;
+}
+
+/*****************************************************************************/
+static int cmd_fwup_activate(const struct shell *sh, size_t argc, char **argv)
+{
+    bool permanent = argc > 1 && strcmp(argv[1], "permanent") == 0;
+    int err = bsp_fwup_activate(permanent);
+
+    if (err) {
+        shell_error(sh, "Not activated (err %d)", err);
+    }
+
+    return err;
+}
+
+/*****************************************************************************/
+static int cmd_fwup_confirm(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    int err = bsp_fwup_confirm();
+    if (err) {
+        shell_error(sh, "Not confirmed (err %d)", err);
+    }
+
+    return err;
+}
+
+/*****************************************************************************/
+static int cmd_fwup_abort(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(sh);
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    bsp_fwup_abort();
+
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(
+    sub_fwup, SHELL_CMD_ARG(status, NULL, "Show update state", cmd_fwup_status, 1, 0),
+    SHELL_CMD_ARG(activate, NULL, "[permanent] Boot the verified image next", cmd_fwup_activate,
+                  1, 1),
+    SHELL_CMD_ARG(confirm, NULL, "Keep booting the running image", cmd_fwup_confirm, 1, 0),
+    SHELL_CMD_ARG(abort, NULL, "Drop the update", cmd_fwup_abort, 1, 0), SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(fwup, &sub_fwup, "Firmware update", NULL);
+#endif /* CONFIG_SHELL */
@@ -0,0 +1,69 @@
+#ifndef BSP_FWUP_H_
+#define BSP_FWUP_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+enum bsp_fwup_state {
+    BSP_FWUP_IDLE,
+    BSP_FWUP_RECEIVING, // Image streamed into the inactive slot
+    BSP_FWUP_VERIFIED,  // Complete and checked, ready to activate
+    BSP_FWUP_PENDING,   // Selected for the next boot
+    BSP_FWUP_ERROR,
+};
+
+struct bsp_fwup_status {
+    enum bsp_fwup_state state;
+    int slot;        // Inactive slot receiving the image
+    int running;     // Slot the firmware executes from
+    uint32_t size;   // Image size announced by bsp_fwup_begin()
+    uint32_t offset; // Bytes programmed and read back, resume point
+    int err;         // Error that put the update into BSP_FWUP_ERROR
+};
+
+/*****************************************************************************/
+
+/// @brief Starts or resumes an update into the inactive slot. An update of
+/// the same size and CRC interrupted by a reset resumes; the transport
+/// continues at the returned offset.
+/// @param size Image size, MCUboot header and TLVs included
+/// @param crc CRC-32 (IEEE) of the whole image
+/// @return Offset to continue from, -EFBIG if the image does not fit the slot
+int bsp_fwup_begin(uint32_t size, uint32_t crc);
+
+/// @brief Streams image data. Full erase blocks are erased, programmed and
+/// read back by the flash work queue while the next block is received; the
+/// call only waits when both block buffers are in flight. The image header
+/// is checked as soon as it has been received.
+/// @param offset Must continue the data written so far
+/// @param data
+/// @param len
+/// @return 0 on success, -ESPIPE if offset does not continue the stream,
+/// -ENOEXEC for an image that cannot run from the inactive slot
+int bsp_fwup_write(uint32_t offset, const void *data, size_t len);
+
+/// @brief Programs the rest of the image and checks the CRC of the read back
+/// slot contents against the one given to bsp_fwup_begin()
+/// @return 0 if verified, -EBADMSG on a CRC mismatch, -ENODATA if incomplete
+int bsp_fwup_finish(void);
+
+/// @brief Selects the verified image for the next boot. MCUboot in direct-XIP
+/// mode boots it in place, without copying; unless permanent it reverts at
+/// the following reset if the new image does not call bsp_fwup_confirm().
+/// @param permanent
+/// @return 0 on success, -ENOTSUP without MCUboot direct-XIP
+int bsp_fwup_activate(bool permanent);
+
+/// @brief Confirms the running image, so MCUboot keeps booting it
+/// @return 0 on success, -ENOTSUP without MCUboot direct-XIP
+int bsp_fwup_confirm(void);
+
+/// @brief Drops the update, the next bsp_fwup_begin() starts from offset 0
+void bsp_fwup_abort(void);
+
+/// @brief Returns the update state
+/// @param status
+void bsp_fwup_status_get(struct bsp_fwup_status *status);
+
+#endif // BSP_FWUP_H_
@@ -0,0 +1,881 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/can.h>
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+
+#include "bsp_can.h"
+#include "bsp_isotp.h"
+
+LOG_MODULE_REGISTER(bsp_isotp, CONFIG_LOG_DEFAULT_LEVEL);
+
+/*****************************************************************************/
+#define CANBUS_NODE DT_CHOSEN(zephyr_canbus)
+#define SESSIONS_COUNT CONFIG_BSP_ISOTP_SESSIONS
+
+#define PCI_SF 0x00
+#define PCI_FF 0x10
+#define PCI_CF 0x20
+#define PCI_FC 0x30
+
+#define FC_CTS 0
+#define FC_WAIT 1
+#define FC_OVFLW 2
+
+#define FF_DL_MAX 4095
+#define PADDING 0xCC
+
+#define N_BS_MS 1000 // Sender wait for flow control
+#define N_CR_MS 1000 // Receiver wait for the next consecutive frame
+#define TX_TIMEOUT K_MSEC(10)
+#define BURST_MAX 16 // Consecutive frames per work item run before yielding to other sessions
+
+typedef enum {
+    TX_IDLE,
+    TX_START,
+    TX_WAIT_FC,
+    TX_SENDING,
+    TX_ABORT,
+} tx_state_t;
+
+struct isotp_session {
+    const struct bsp_isotp_session_cfg *cfg;
+    struct k_spinlock lock;
+
+    /* Transmit, segments straight from the caller buffer */
+    tx_state_t tx_state;
+    const uint8_t *tx_data;
+    size_t tx_len;
+    size_t tx_pos;
+    int tx_err;
+    uint8_t tx_sn;
+    uint8_t tx_bs;
+    uint8_t tx_block; // Consecutive frames left in the current block
+    k_timeout_t tx_stmin;
+    bsp_isotp_tx_cb_t tx_done;
+    void *tx_user_data;
+    struct k_work_delayable tx_work;
+
+    /* Receive, runs in the CAN dispatch thread */
+    bool rx_active;
+    size_t rx_len;
+    size_t rx_pos;
+    uint8_t rx_sn;
+    uint8_t rx_block;
+    int64_t rx_deadline;
+
+    struct bsp_isotp_stats stats;
+};
+
+/*****************************************************************************/
+/* Private objects */
+static const struct device *canbus = DEVICE_DT_GET(CANBUS_NODE);
+static struct isotp_session sessions[SESSIONS_COUNT];
+static K_MUTEX_DEFINE(sessions_lock);
+
+// Two receive tables used alternately, so the one being replaced stays intact
+// while the dispatch thread may still be using it
+static struct bsp_can_rx_entry rx_tables[2][SESSIONS_COUNT];
+static int rx_table_active;
+
+static struct k_work_q isotp_workq;
+static K_THREAD_STACK_DEFINE(isotp_workq_stack, CONFIG_BSP_ISOTP_THREAD_STACK_SIZE);
+
+/*****************************************************************************/
+static inline int session_index(const struct isotp_session *s)
+{
+    return s - sessions;
+}
+
+/*****************************************************************************/
+static inline size_t tx_dl(const struct isotp_session *s)
+{
+    return s->cfg->fd ? CANFD_MAX_DLEN : CAN_MAX_DLEN;
+}
+
+/*****************************************************************************/
+static k_timeout_t stmin_decode(uint8_t stmin)
+{
+    if (stmin <= 0x7F) {
+        return K_MSEC(stmin);
+    }
+
+    if (stmin >= 0xF1 && stmin <= 0xF9) {
+        return K_USEC((stmin - 0xF0) * 100);
+    }
+
+    // Reserved values are treated as the longest STmin
+    return K_MSEC(0x7F);
+}
+
+/*****************************************************************************/
+static void can_tx_done(const struct device *dev, int error, void *user_data)
+{
+    ARG_UNUSED(dev);
+
+    struct isotp_session *s = user_data;
+
+    if (error) {
+        s->stats.tx_errors++;
+    }
+}
+
+/*****************************************************************************/
+// Builds a frame from the protocol control information and a slice of the
+// payload. The payload is copied once, directly into the CAN frame.
+static int frame_send(struct isotp_session *s, const uint8_t *pci, size_t pci_len,
+                      const uint8_t *data, size_t data_len)
+{
+    const struct bsp_isotp_session_cfg *cfg = s->cfg;
+    struct can_frame frame = {
+        .id = cfg->tx_id,
+        .flags = cfg->extended ? CAN_FRAME_IDE : 0,
+    };
+    size_t len = pci_len + data_len;
+
+    memcpy(frame.data, pci, pci_len);
+    if (data_len > 0) {
+        memcpy(&frame.data[pci_len], data, data_len);
+    }
+
+    if (cfg->fd) {
+        frame.flags |= CAN_FRAME_FDF | (cfg->brs ? CAN_FRAME_BRS : 0);
+        frame.dlc = can_bytes_to_dlc(MAX(len, CAN_MAX_DLEN));
+    } else {
+        frame.dlc = CAN_MAX_DLEN;
+    }
+
+    memset(&frame.data[len], PADDING, can_dlc_to_bytes(frame.dlc) - len);
+
+    return bsp_can_send(canbus, &frame, TX_TIMEOUT, can_tx_done, s);
+}
+
+/*****************************************************************************/
+static void fc_send(struct isotp_session *s, uint8_t status)
+{
+    uint8_t pci[3] = {PCI_FC | status, s->cfg->bs, s->cfg->stmin};
+
+    if (frame_send(s, pci, sizeof(pci), NULL, 0)) {
+        s->stats.rx_errors++;
+    }
+}
+
+/*****************************************************************************/
+/* Transmit */
+
+/*****************************************************************************/
+static void tx_finish(struct isotp_session *s, int err)
+{
+    k_spinlock_key_t key = k_spin_lock(&s->lock);
+    bsp_isotp_tx_cb_t done = s->tx_done;
+    void *user_data = s->tx_user_data;
+
+    s->tx_state = TX_IDLE;
+    k_spin_unlock(&s->lock, key);
+
+    if (err) {
+        s->stats.tx_errors++;
+    } else {
+        s->stats.tx_messages++;
+        s->stats.tx_bytes += s->tx_len;
+    }
+
+    if (done != NULL) {
+        done(session_index(s), err, user_data);
+    }
+}
+
+/*****************************************************************************/
+// Sends a single frame or the first frame of a segmented message
+static void tx_start(struct isotp_session *s)
+{
+    size_t dl = tx_dl(s);
+    uint8_t pci[6];
+    size_t pci_len;
+
+    if (s->tx_len <= 7) {
+        pci[0] = PCI_SF | s->tx_len;
+        pci_len = 1;
+    } else if (s->tx_len <= dl - 2) {
+        // CAN-FD single frame escape
+        pci[0] = PCI_SF;
+        pci[1] = s->tx_len;
+        pci_len = 2;
+    } else {
+        if (s->tx_len <= FF_DL_MAX) {
+            pci[0] = PCI_FF | (s->tx_len >> 8);
+            pci[1] = s->tx_len & 0xFF;
+            pci_len = 2;
+        } else {
+            pci[0] = PCI_FF;
+            pci[1] = 0;
+            sys_put_be32(s->tx_len, &pci[2]);
+            pci_len = 6;
+        }
+
+        k_spinlock_key_t key = k_spin_lock(&s->lock);
+        s->tx_pos = dl - pci_len;
+        s->tx_sn = 1;
+        s->tx_state = TX_WAIT_FC;
+        k_work_reschedule_for_queue(&isotp_workq, &s->tx_work, K_MSEC(N_BS_MS));
+        k_spin_unlock(&s->lock, key);
+
+        int err = frame_send(s, pci, pci_len, s->tx_data, dl - pci_len);
+        if (err) {
+            k_work_cancel_delayable(&s->tx_work);
+            tx_finish(s, err);
+        }
+        return;
+    }
+
+    tx_finish(s, frame_send(s, pci, pci_len, s->tx_data, s->tx_len));
+}
+
+/*****************************************************************************/
+static void tx_work_handler(struct k_work *work)
+{
+    struct k_work_delayable *dwork = k_work_delayable_from_work(work);
+    struct isotp_session *s = CONTAINER_OF(dwork, struct isotp_session, tx_work);
+
+    k_spinlock_key_t key = k_spin_lock(&s->lock);
+    tx_state_t state = s->tx_state;
+    k_spin_unlock(&s->lock, key);
+
+    switch (state) {
+    case TX_START:
+        tx_start(s);
+        return;
+    case TX_WAIT_FC:
+        LOG_WRN("Session %d: no flow control", session_index(s));
+        tx_finish(s, -ETIMEDOUT);
+        return;
+    case TX_ABORT:
+        tx_finish(s, s->tx_err);
+        return;
+    case TX_SENDING:
+        break;
+    default:
+        return;
+    }
+
+    size_t dl = tx_dl(s);
+
+    for (int burst = 0; burst < BURST_MAX; burst++) {
+        size_t n = MIN(dl - 1, s->tx_len - s->tx_pos);
+        bool last = (s->tx_pos + n >= s->tx_len);
+        bool block_end = false;
+
+        key = k_spin_lock(&s->lock);
+        if (s->tx_state != TX_SENDING) {
+            // Closed meanwhile
+            k_spin_unlock(&s->lock, key);
+            return;
+        }
+        if (!last && s->tx_bs != 0 && --s->tx_block == 0) {
+            // Arm the flow control wait before the frame leaves, the answer
+            // may arrive before can_send() returns
+            block_end = true;
+            s->tx_state = TX_WAIT_FC;
+            k_work_reschedule_for_queue(&isotp_workq, &s->tx_work, K_MSEC(N_BS_MS));
+        }
+        k_spin_unlock(&s->lock, key);
+
+        uint8_t pci = PCI_CF | (s->tx_sn & 0x0F);
+        int err = frame_send(s, &pci, 1, &s->tx_data[s->tx_pos], n);
+        if (err) {
+            k_work_cancel_delayable(&s->tx_work);
+            tx_finish(s, err);
+            return;
+        }
+
+        s->tx_pos += n;
+        s->tx_sn++;
+
+        if (last) {
+            tx_finish(s, 0);
+            return;
+        }
+        if (block_end) {
+            return;
+        }
+        if (!K_TIMEOUT_EQ(s->tx_stmin, K_NO_WAIT)) {
+            k_work_reschedule_for_queue(&isotp_workq, &s->tx_work, s->tx_stmin);
+            return;
+        }
+    }
+
+    k_work_reschedule_for_queue(&isotp_workq, &s->tx_work, K_NO_WAIT);
+}
+
+/*****************************************************************************/
+static void fc_rx(struct isotp_session *s, const uint8_t *d, size_t len)
+{
+    if (len < 3) {
+        return;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&s->lock);
+
+    if (s->tx_state == TX_WAIT_FC) {
+        switch (d[0] & 0x0F) {
+        case FC_CTS:
+            s->tx_bs = d[1];
+            s->tx_block = d[1];
+            s->tx_stmin = stmin_decode(d[2]);
+            s->tx_state = TX_SENDING;
+            k_work_reschedule_for_queue(&isotp_workq, &s->tx_work, K_NO_WAIT);
+            break;
+        case FC_WAIT:
+            k_work_reschedule_for_queue(&isotp_workq, &s->tx_work, K_MSEC(N_BS_MS));
+            break;
+        default:
+            s->tx_err = -EMSGSIZE;
+            s->tx_state = TX_ABORT;
+            k_work_reschedule_for_queue(&isotp_workq, &s->tx_work, K_NO_WAIT);
+            break;
+        }
+    }
+
+    k_spin_unlock(&s->lock, key);
+}
+
+/*****************************************************************************/
+/* Receive */
+
+/*****************************************************************************/
+static void rx_deliver(struct isotp_session *s, const uint8_t *data, size_t len)
+{
+    s->stats.rx_messages++;
+    s->stats.rx_bytes += len;
+
+    if (s->cfg->rx_cb != NULL) {
+        s->cfg->rx_cb(session_index(s), data, len, s->cfg->user_data);
+    }
+}
+
+/*****************************************************************************/
+static void rx_error(struct isotp_session *s)
+{
+    s->rx_active = false;
+    s->stats.rx_errors++;
+}
+
+/*****************************************************************************/
+static void ff_rx(struct isotp_session *s, const uint8_t *d, size_t len)
+{
+    const struct bsp_isotp_session_cfg *cfg = s->cfg;
+    size_t msg_len = ((d[0] & 0x0F) << 8) | d[1];
+    size_t off = 2;
+
+    if (len < CAN_MAX_DLEN) {
+        rx_error(s);
+        return;
+    }
+
+    if (msg_len == 0) {
+        msg_len = sys_get_be32(&d[2]);
+        off = 6;
+    }
+
+    if (cfg->rx_buf == NULL || msg_len > cfg->rx_size) {
+        fc_send(s, FC_OVFLW);
+        rx_error(s);
+        return;
+    }
+
+    size_t n = MIN(len - off, msg_len);
+
+    memcpy(cfg->rx_buf, &d[off], n);
+    s->rx_pos = n;
+    s->rx_len = msg_len;
+    s->rx_sn = 1;
+    s->rx_block = cfg->bs;
+    s->rx_deadline = k_uptime_get() + N_CR_MS;
+    s->rx_active = true;
+
+    fc_send(s, FC_CTS);
+}
+
+/*****************************************************************************/
+static void cf_rx(struct isotp_session *s, const uint8_t *d, size_t len)
+{
+    const struct bsp_isotp_session_cfg *cfg = s->cfg;
+
+    if (!s->rx_active) {
+        return;
+    }
+
+    if (k_uptime_get() > s->rx_deadline || (d[0] & 0x0F) != (s->rx_sn & 0x0F)) {
+        rx_error(s);
+        return;
+    }
+
+    size_t n = MIN(len - 1, s->rx_len - s->rx_pos);
+
+    memcpy(&cfg->rx_buf[s->rx_pos], &d[1], n);
+    s->rx_pos += n;
+    s->rx_sn++;
+    s->rx_deadline = k_uptime_get() + N_CR_MS;
+
+    if (s->rx_pos >= s->rx_len) {
+        s->rx_active = false;
+        rx_deliver(s, cfg->rx_buf, s->rx_len);
+    } else if (cfg->bs != 0 && --s->rx_block == 0) {
+        s->rx_block = cfg->bs;
+        fc_send(s, FC_CTS);
+    }
+}
+
+/*****************************************************************************/
+// bsp_can handler, runs in the CAN dispatch thread
+static void rx_frame(const struct device *dev, const struct can_frame *frame, void *user_data)
+{
+    ARG_UNUSED(dev);
+
+    struct isotp_session *s = user_data;
+    size_t len = can_dlc_to_bytes(frame->dlc);
+    const uint8_t *d = frame->data;
+
+    if (len == 0 || s->cfg == NULL) {
+        return;
+    }
+
+    switch (d[0] & 0xF0) {
+    case PCI_SF: {
+        size_t sf_len = d[0] & 0x0F;
+        size_t off = 1;
+
+        if (sf_len == 0 && len > CAN_MAX_DLEN) {
+            sf_len = d[1];
+            off = 2;
+        }
+
+        if (sf_len == 0 || sf_len + off > len) {
+            rx_error(s);
+            break;
+        }
+
+        // A single frame terminates any reception in progress
+        s->rx_active = false;
+        rx_deliver(s, &d[off], sf_len);
+        break;
+    }
+    case PCI_FF:
+        ff_rx(s, d, len);
+        break;
+    case PCI_CF:
+        cf_rx(s, d, len);
+        break;
+    case PCI_FC:
+        fc_rx(s, d, len);
+        break;
+    default:
+        break;
+    }
+}
+
+/*****************************************************************************/
+// Reprograms the receive filters for the open sessions. Called with sessions_lock held.
+// The new table is attached before the old one is detached, so the other sessions
+// keep receiving meanwhile; on failure the old table stays active.
+static int filters_update(void)
+{
+    struct bsp_can_rx_entry *table = rx_tables[rx_table_active ^ 1];
+    size_t count = 0;
+
+    for (int i = 0; i < SESSIONS_COUNT; i++) {
+        const struct bsp_isotp_session_cfg *cfg = sessions[i].cfg;
+
+        if (cfg == NULL) {
+            continue;
+        }
+
+        table[count++] = (struct bsp_can_rx_entry){
+            .filter =
+                {
+                    .id = cfg->rx_id,
+                    .mask = cfg->extended ? CAN_EXT_ID_MASK : CAN_STD_ID_MASK,
+                    .flags = cfg->extended ? CAN_FILTER_IDE : 0,
+                },
+            .handler = rx_frame,
+            .user_data = &sessions[i],
+        };
+    }
+
+    if (count > 0) {
+        int err = bsp_can_attach(canbus, table, count);
+
+        if (err) {
+            return err;
+        }
+    }
+
+    bsp_can_detach(canbus, rx_tables[rx_table_active]);
+    rx_table_active ^= 1;
+
+    return 0;
+}
+
+/*****************************************************************************/
+int bsp_isotp_open(const struct bsp_isotp_session_cfg *cfg)
+{
+    if (cfg == NULL) {
+        return -EINVAL;
+    }
+
+#ifndef CONFIG_CAN_FD_MODE
+    if (cfg->fd) {
+        return -ENOTSUP;
+    }
+#endif
+
+    if (!device_is_ready(canbus)) {
+        return -ENODEV;
+    }
+
+    k_mutex_lock(&sessions_lock, K_FOREVER);
+
+    int session = -ENOSPC;
+    for (int i = 0; i < SESSIONS_COUNT; i++) {
+        if (sessions[i].cfg == NULL) {
+            session = i;
+            break;
+        }
+    }
+
+    if (session >= 0) {
+        struct isotp_session *s = &sessions[session];
+
+        memset(&s->stats, 0, sizeof(s->stats));
+        s->rx_active = false;
+        s->tx_state = TX_IDLE;
+        s->cfg = cfg;
+
+        int err = filters_update();
+        if (err) {
+            LOG_ERR("Receive filter update failed (err %d)", err);
+            s->cfg = NULL;
+            session = err;
+        }
+    }
+
+    k_mutex_unlock(&sessions_lock);
+
+    if (session >= 0) {
+        int err = can_start(canbus);
+        if (err && err != -EALREADY) {
+            LOG_ERR("CAN start failed (err %d)", err);
+        }
+    }
+
+    return session;
+}
+
+/*****************************************************************************/
+int bsp_isotp_close(int session)
+{
+    if (session < 0 || session >= SESSIONS_COUNT) {
+        return -EINVAL;
+    }
+
+    struct isotp_session *s = &sessions[session];
+
+    k_mutex_lock(&sessions_lock, K_FOREVER);
+
+    // Taking the callback keeps a transfer finishing meanwhile from completing twice
+    k_spinlock_key_t key = k_spin_lock(&s->lock);
+    bool pending = (s->tx_state != TX_IDLE);
+    bsp_isotp_tx_cb_t done = s->tx_done;
+    void *user_data = s->tx_user_data;
+
+    s->tx_state = TX_IDLE;
+    s->tx_done = NULL;
+    k_spin_unlock(&s->lock, key);
+
+    struct k_work_sync sync;
+    k_work_cancel_delayable_sync(&s->tx_work, &sync);
+
+    if (pending) {
+        s->stats.tx_errors++;
+        if (done != NULL) {
+            done(session, -ECANCELED, user_data);
+        }
+    }
+
+    // If the update fails, the entry left in the old table ignores the closed session
+    s->cfg = NULL;
+    int err = filters_update();
+    if (err) {
+        LOG_WRN("Receive filter update failed (err %d)", err);
+    }
+
+    k_mutex_unlock(&sessions_lock);
+
+    return 0;
+}
+
+/*****************************************************************************/
+int bsp_isotp_send(int session, const uint8_t *data, size_t len, bsp_isotp_tx_cb_t done,
+                   void *user_data)
+{
+    if (session < 0 || session >= SESSIONS_COUNT || sessions[session].cfg == NULL) {
+        return -EINVAL;
+    }
+
+    if (data == NULL || len == 0 || (uint64_t)len > UINT32_MAX) {
+        return -EINVAL;
+    }
+
+    struct isotp_session *s = &sessions[session];
+    k_spinlock_key_t key = k_spin_lock(&s->lock);
+
+    if (s->tx_state != TX_IDLE) {
+        k_spin_unlock(&s->lock, key);
+        return -EBUSY;
+    }
+
+    s->tx_data = data;
+    s->tx_len = len;
+    s->tx_pos = 0;
+    s->tx_done = done;
+    s->tx_user_data = user_data;
+    s->tx_state = TX_START;
+    k_work_reschedule_for_queue(&isotp_workq, &s->tx_work, K_NO_WAIT);
+
+    k_spin_unlock(&s->lock, key);
+
+    return 0;
+}
+
+/*****************************************************************************/
+int bsp_isotp_stats_get(int session, struct bsp_isotp_stats *stats)
+{
+    if (session < 0 || session >= SESSIONS_COUNT || stats == NULL) {
+        return -EINVAL;
+    }
+
+    *stats = sessions[session].stats;
+
+    return 0;
+}
+
+/*****************************************************************************/
+static int bsp_isotp_init(void)
+{
+    for (int i = 0; i < SESSIONS_COUNT; i++) {
+        k_work_init_delayable(&sessions[i].tx_work, tx_work_handler);
+    }
+
+    k_work_queue_start(&isotp_workq, isotp_workq_stack,
+                       K_THREAD_STACK_SIZEOF(isotp_workq_stack),
+                       CONFIG_BSP_ISOTP_THREAD_PRIORITY, NULL);
+    k_thread_name_set(&isotp_workq.thread, "isotp_workq");
+
+    return 0;
+}
+
+SYS_INIT(bsp_isotp_init, APPLICATION, 33);
+
+/*****************************************************************************/
+/* Shell */
+#ifdef CONFIG_BSP_ISOTP_BENCH
+#define BENCH_SIZE CONFIG_BSP_ISOTP_BENCH_SIZE
+#define BENCH_TIMEOUT K_SECONDS(5)
+
+static uint8_t bench_tx[BENCH_SIZE];
+static uint8_t bench_rx[BENCH_SIZE];
+static K_SEM_DEFINE(bench_rx_sem, 0, 1);
+static K_SEM_DEFINE(bench_tx_sem, 0, 1);
+static size_t bench_rx_len;
+static int bench_tx_err;
+
+/*****************************************************************************/
+static void bench_rx_cb(int session, const uint8_t *data, size_t len, void *user_data)
+{
+    ARG_UNUSED(session);
+    ARG_UNUSED(data);
+    ARG_UNUSED(user_data);
+
+    bench_rx_len = len;
+    k_sem_give(&bench_rx_sem);
+}
+
+/*****************************************************************************/
+static void bench_tx_cb(int session, int err, void *user_data)
+{
+    ARG_UNUSED(session);
+    ARG_UNUSED(user_data);
+
+    bench_tx_err = err;
+    k_sem_give(&bench_tx_sem);
+}
+
+/*****************************************************************************/
+static int bench_run(const struct shell *sh, size_t size, int count, bool fd)
+{
+    struct bsp_isotp_session_cfg tester = {
+        .rx_id = 0x7E8,
+        .tx_id = 0x7E0,
+        .fd = fd,
+        .brs = fd,
+    };
+    struct bsp_isotp_session_cfg target = {
+        .rx_id = 0x7E0,
+        .tx_id = 0x7E8,
+        .fd = fd,
+        .brs = fd,
+        .rx_buf = bench_rx,
+        .rx_size = sizeof(bench_rx),
+        .rx_cb = bench_rx_cb,
+    };
+
+    int a = bsp_isotp_open(&tester);
+    int b = bsp_isotp_open(&target);
+    int err = 0;
+
+    if (a < 0 || b < 0) {
+        shell_error(sh, "No free session");
+        err = -ENOSPC;
+        goto close;
+    }
+
+    for (size_t i = 0; i < size; i++) {
+        bench_tx[i] = (uint8_t)(i * 7 + (i >> 8));
+    }
+
+    k_sem_reset(&bench_rx_sem);
+    k_sem_reset(&bench_tx_sem);
+
+    int64_t start = k_uptime_ticks();
+
+    for (int i = 0; i < count && err == 0; i++) {
+        err = bsp_isotp_send(a, bench_tx, size, bench_tx_cb, NULL);
+        if (err == 0 && k_sem_take(&bench_rx_sem, BENCH_TIMEOUT) != 0) {
+            err = -ETIMEDOUT;
+        }
+        if (err == 0 && k_sem_take(&bench_tx_sem, BENCH_TIMEOUT) != 0) {
+            err = -ETIMEDOUT;
+        }
+        if (err == 0) {
+            err = bench_tx_err;
+        }
+        if (err == 0 && (bench_rx_len != size || memcmp(bench_tx, bench_rx, size) != 0)) {
+            err = -EBADMSG;
+        }
+    }
+
+    uint64_t us = k_ticks_to_us_floor64(k_uptime_ticks() - start);
+
+    if (err) {
+        shell_error(sh, "Transfer failed (err %d)", err);
+    } else {
+        uint64_t bytes = (uint64_t)size * count;
+        size_t per_frame = (fd ? CANFD_MAX_DLEN : CAN_MAX_DLEN) - 1;
+
+        shell_print(sh, "%d x %zu bytes in %llu us: %llu bytes/s, ~%zu frames per message",
+                    count, size, (unsigned long long)us,
+                    (unsigned long long)(us ? (bytes * 1000000U) / us : 0),
+                    DIV_ROUND_UP(size, per_frame) + 1);
+    }
+
+close:
+    if (a >= 0) {
+        bsp_isotp_close(a);
+    }
+    if (b >= 0) {
+        bsp_isotp_close(b);
+    }
+
+    return err;
+}
+
+/*****************************************************************************/
+static int cmd_isotp_bench(const struct shell *sh, size_t argc, char **argv)
+{
+    size_t size = strtoul(argv[1], NULL, 0);
+    int count = (argc > 2) ? atoi(argv[2]) : 10;
+    bool fd = (argc > 3) && (strcmp(argv[3], "fd") == 0);
+
+    if (size == 0 || size > BENCH_SIZE || count <= 0) {
+        shell_error(sh, "Size 1..%d, count > 0", BENCH_SIZE);
+        return -EINVAL;
+    }
+
+    can_mode_t mode = can_get_mode(canbus);
+    can_mode_t bench_mode = CAN_MODE_LOOPBACK;
+
+#ifdef CONFIG_CAN_FD_MODE
+    if (fd) {
+        bench_mode |= CAN_MODE_FD;
+    }
+#else
+    if (fd) {
+        shell_error(sh, "CAN-FD support is disabled");
+        return -ENOTSUP;
+    }
+#endif
+
+    // Frames loop back inside the controller; nothing reaches the bus
+    can_stop(canbus);
+    int err = can_set_mode(canbus, bench_mode);
+    if (err) {
+        shell_error(sh, "Loopback mode not supported (err %d)", err);
+        can_start(canbus);
+        return err;
+    }
+    can_start(canbus);
+
+    err = bench_run(sh, size, count, fd);
+
+    can_stop(canbus);
+    can_set_mode(canbus, mode);
+    can_start(canbus);
+
+    return err;
+}
+#endif /* CONFIG_BSP_ISOTP_BENCH */
+
+#ifdef CONFIG_SHELL
+static int cmd_isotp_stats(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    for (int i = 0; i < SESSIONS_COUNT; i++) {
+        const struct isotp_session *s = &sessions[i];
+
+        if (s->cfg == NULL) {
+            continue;
+        }
+
+        shell_print(sh, "%d: rx 0x%x tx 0x%x%s, rx %u msgs %llu bytes %u errors, "
+                        "tx %u msgs %llu bytes %u errors",
+                    i, s->cfg->rx_id, s->cfg->tx_id, s->cfg->fd ? " FD" : "",
+                    s->stats.rx_messages, (unsigned long long)s->stats.rx_bytes,
+                    s->stats.rx_errors, s->stats.tx_messages,
+                    (unsigned long long)s->stats.tx_bytes, s->stats.tx_errors);
+    }
+
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_isotp,
+                               SHELL_CMD_ARG(stats, NULL, "Show session statistics",
+                                             cmd_isotp_stats, 1, 0),
+#ifdef CONFIG_BSP_ISOTP_BENCH
+                               SHELL_CMD_ARG(bench, NULL,
+                                             "Loopback throughput: <size> [count] [fd]",
+                                             cmd_isotp_bench, 2, 2),
+#endif
+                               SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(isotp, &sub_isotp, "ISO-TP transport", NULL);
+#endif /* CONFIG_SHELL */
@@ -0,0 +1,73 @@
+#ifndef BSP_ISOTP_H_
+#define BSP_ISOTP_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/// @brief Invoked from the CAN dispatch thread with a complete message. For
+/// single frames data points into the receive ring, otherwise into the
+/// session receive buffer; either is only valid for the duration of the call.
+typedef void (*bsp_isotp_rx_cb_t)(int session, const uint8_t *data, size_t len, void *user_data);
+
+/// @brief Invoked from the ISO-TP work queue when a transmission has finished
+/// @param err 0 on success, -ETIMEDOUT on missing flow control, -EMSGSIZE on
+/// receiver overflow, other negative error codes on CAN errors
+typedef void (*bsp_isotp_tx_cb_t)(int session, int err, void *user_data);
+
+struct bsp_isotp_session_cfg {
+    uint32_t rx_id;   // CAN ID of frames received by this session
+    uint32_t tx_id;   // CAN ID of frames sent by this session
+    bool extended;    // 29-bit identifiers
+    bool fd;          // CAN-FD frames with up to 64 bytes
+    bool brs;         // CAN-FD bit rate switch
+    uint8_t bs;       // Block size advertised in flow control, 0 = no limit
+    uint8_t stmin;    // STmin advertised in flow control, ISO 15765-2 encoding
+    uint8_t *rx_buf;  // Reassembly buffer for multi-frame messages
+    size_t rx_size;
+    bsp_isotp_rx_cb_t rx_cb;
+    void *user_data;
+};
+
+struct bsp_isotp_stats {
+    uint32_t rx_messages;
+    uint32_t tx_messages;
+    uint32_t rx_errors;
+    uint32_t tx_errors;
+    uint64_t rx_bytes;
+    uint64_t tx_bytes;
+};
+
+/*****************************************************************************/
+
+/// @brief Opens a session on the CAN controller chosen as zephyr,canbus.
+/// The configuration and receive buffer must stay valid until closed.
+/// @param cfg
+/// @return Session handle, -ENOSPC if no session is free
+int bsp_isotp_open(const struct bsp_isotp_session_cfg *cfg);
+
+/// @brief Closes a session. A transfer in progress is completed with -ECANCELED
+/// before returning. Must not be called from a transfer callback.
+/// @param session
+/// @return 0 on success
+int bsp_isotp_close(int session);
+
+/// @brief Starts sending a message. Frames are segmented directly from data,
+/// which must stay unchanged until the completion callback.
+/// @param session
+/// @param data
+/// @param len Up to 4095 bytes with classic first frames, larger messages use
+/// the ISO 15765-2:2016 escape sequence
+/// @param done Optional completion callback
+/// @param user_data
+/// @return 0 on success, -EBUSY if a transmission is in progress
+int bsp_isotp_send(int session, const uint8_t *data, size_t len, bsp_isotp_tx_cb_t done,
+                   void *user_data);
+
+/// @brief Returns session statistics
+/// @param session
+/// @param stats
+/// @return 0 on success
+int bsp_isotp_stats_get(int session, struct bsp_isotp_stats *stats);
+
+#endif // BSP_ISOTP_H_
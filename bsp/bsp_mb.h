@@ -0,0 +1,32 @@
+#ifndef BSP_MB_H_
+#define BSP_MB_H_
+
+/* Modbus application protocol constants shared by the BSP Modbus services */
+
+#define BSP_MB_ADU_MAX 256 // RTU: address, PDU of up to 253 bytes, CRC
+#define BSP_MB_PDU_MAX 253
+
+/* Function codes */
+#define BSP_MB_FC_READ_COILS 0x01
+#define BSP_MB_FC_READ_DISCRETE_INPUTS 0x02
+#define BSP_MB_FC_READ_HOLDING_REGISTERS 0x03
+#define BSP_MB_FC_READ_INPUT_REGISTERS 0x04
+#define BSP_MB_FC_WRITE_SINGLE_COIL 0x05
+#define BSP_MB_FC_WRITE_SINGLE_REGISTER 0x06
+#define BSP_MB_FC_WRITE_MULTIPLE_COILS 0x0F
+#define BSP_MB_FC_WRITE_MULTIPLE_REGISTERS 0x10
+#define BSP_MB_FC_EXCEPTION 0x80
+
+/* Quantity limits per request */
+#define BSP_MB_READ_REGISTERS_MAX 125
+#define BSP_MB_WRITE_REGISTERS_MAX 123
+#define BSP_MB_READ_BITS_MAX 2000
+#define BSP_MB_WRITE_BITS_MAX 1968
+
+/* Exception codes */
+#define BSP_MB_EX_ILLEGAL_FUNCTION 0x01
+#define BSP_MB_EX_ILLEGAL_ADDRESS 0x02
+#define BSP_MB_EX_ILLEGAL_VALUE 0x03
+#define BSP_MB_EX_DEVICE_FAILURE 0x04
+
+#endif // BSP_MB_H_
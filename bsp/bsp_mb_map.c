@@ -0,0 +1,316 @@
+#include <string.h>
+
+#include <zephyr/kernel.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+
+#include "bsp_mb_map.h"
+#include "bsp_pi.h"
+
+/*****************************************************************************/
+enum map_type {
+    MAP_U8,
+    MAP_S32_HI,
+    MAP_S32_LO,
+};
+
+struct map_reg {
+    void *var;
+    uint8_t type;
+};
+
+#define MAP_S32(var) {(var), MAP_S32_HI}, {(var), MAP_S32_LO}
+
+/*****************************************************************************/
+/* Private objects */
+static uint8_t *const discrete_inputs[] = {&bsp_pi.din, &bsp_pi.din_valid};
+static uint8_t *const coils[] = {&bsp_pi.dout, &bsp_pi.dout_enable};
+
+static const struct map_reg input_regs[] = {
+    {&bsp_pi.din, MAP_U8},
+    {&bsp_pi.din_valid, MAP_U8},
+    MAP_S32(&bsp_pi.analog[0]),
+    MAP_S32(&bsp_pi.analog[1]),
+    MAP_S32(&bsp_pi.analog[2]),
+    MAP_S32(&bsp_pi.analog[3]),
+    MAP_S32(&bsp_pi.analog[4]),
+    MAP_S32(&bsp_pi.analog[5]),
+    MAP_S32(&bsp_pi.analog[6]),
+    MAP_S32(&bsp_pi.analog[7]),
+};
+
+static const struct map_reg holding_regs[] = {
+    {&bsp_pi.dout, MAP_U8},
+    {&bsp_pi.dout_enable, MAP_U8},
+};
+
+BUILD_ASSERT(BSP_PI_ANALOG_COUNT == 8, "input register map out of date");
+
+/*****************************************************************************/
+static uint16_t reg_get(const struct map_reg *reg)
+{
+    switch (reg->type) {
+    case MAP_U8:
+        return *(const uint8_t *)reg->var;
+    case MAP_S32_HI:
+        return (uint32_t)*(const int32_t *)reg->var >> 16;
+    default:
+        return (uint32_t)*(const int32_t *)reg->var & 0xFFFF;
+    }
+}
+
+/*****************************************************************************/
+static bool reg_valid(const struct map_reg *reg, uint16_t value)
+{
+    return reg->type != MAP_U8 || value <= UINT8_MAX;
+}
+
+/*****************************************************************************/
+static void reg_set(const struct map_reg *reg, uint16_t value)
+{
+    uint32_t *v32 = reg->var;
+
+    switch (reg->type) {
+    case MAP_U8:
+        *(uint8_t *)reg->var = value;
+        break;
+    case MAP_S32_HI:
+        *v32 = (*v32 & 0xFFFF) | ((uint32_t)value << 16);
+        break;
+    default:
+        *v32 = (*v32 & 0xFFFF0000) | value;
+        break;
+    }
+}
+
+/*****************************************************************************/
+static bool bit_get(uint8_t *const *map, uint16_t bit)
+{
+    return *map[bit / 8] & BIT(bit % 8);
+}
+
+/*****************************************************************************/
+static void bit_set(uint8_t *const *map, uint16_t bit, bool value)
+{
+    WRITE_BIT(*map[bit / 8], bit % 8, value);
+}
+
+/*****************************************************************************/
+// The process functions return the response length or a negative exception code
+static int bits_read(uint8_t *const *map, size_t map_bytes, const uint8_t *req, size_t len,
+                     uint8_t *rsp)
+{
+    if (len != 5) {
+        return -BSP_MB_EX_ILLEGAL_VALUE;
+    }
+
+    uint16_t addr = sys_get_be16(&req[1]);
+    uint16_t count = sys_get_be16(&req[3]);
+
+    if (count == 0 || count > BSP_MB_READ_BITS_MAX) {
+        return -BSP_MB_EX_ILLEGAL_VALUE;
+    }
+    if (addr + count > map_bytes * 8) {
+        return -BSP_MB_EX_ILLEGAL_ADDRESS;
+    }
+
+    uint8_t bytes = DIV_ROUND_UP(count, 8);
+
+    rsp[1] = bytes;
+    memset(&rsp[2], 0, bytes);
+    for (uint16_t i = 0; i < count; i++) {
+        if (bit_get(map, addr + i)) {
+            rsp[2 + i / 8] |= BIT(i % 8);
+        }
+    }
+
+    return 2 + bytes;
+}
+
+/*****************************************************************************/
+static int regs_read(const struct map_reg *map, size_t map_len, const uint8_t *req, size_t len,
+                     uint8_t *rsp)
+{
+    if (len != 5) {
+        return -BSP_MB_EX_ILLEGAL_VALUE;
+    }
+
+    uint16_t addr = sys_get_be16(&req[1]);
+    uint16_t count = sys_get_be16(&req[3]);
+
+    if (count == 0 || count > BSP_MB_READ_REGISTERS_MAX) {
+        return -BSP_MB_EX_ILLEGAL_VALUE;
+    }
+    if (addr + count > map_len) {
+        return -BSP_MB_EX_ILLEGAL_ADDRESS;
+    }
+
+    rsp[1] = 2 * count;
+    for (uint16_t i = 0; i < count; i++) {
+        sys_put_be16(reg_get(&map[addr + i]), &rsp[2 + 2 * i]);
+    }
+
+    return 2 + 2 * count;
+}
+
+/*****************************************************************************/
+static int coil_write(const uint8_t *req, size_t len, uint8_t *rsp)
+{
+    if (len != 5) {
+        return -BSP_MB_EX_ILLEGAL_VALUE;
+    }
+
+    uint16_t addr = sys_get_be16(&req[1]);
+    uint16_t value = sys_get_be16(&req[3]);
+
+    if (value != 0xFF00 && value != 0x0000) {
+        return -BSP_MB_EX_ILLEGAL_VALUE;
+    }
+    if (addr >= ARRAY_SIZE(coils) * 8) {
+        return -BSP_MB_EX_ILLEGAL_ADDRESS;
+    }
+
+    bit_set(coils, addr, value != 0);
+
+    memcpy(rsp, req, 5);
+    return 5;
+}
+
+/*****************************************************************************/
+static int coils_write(const uint8_t *req, size_t len, uint8_t *rsp)
+{
+    if (len < 6) {
+        return -BSP_MB_EX_ILLEGAL_VALUE;
+    }
+
+    uint16_t addr = sys_get_be16(&req[1]);
+    uint16_t count = sys_get_be16(&req[3]);
+    uint8_t bytes = req[5];
+
+    if (count == 0 || count > BSP_MB_WRITE_BITS_MAX || bytes != DIV_ROUND_UP(count, 8) ||
+        len != 6U + bytes) {
+        return -BSP_MB_EX_ILLEGAL_VALUE;
+    }
+    if (addr + count > ARRAY_SIZE(coils) * 8) {
+        return -BSP_MB_EX_ILLEGAL_ADDRESS;
+    }
+
+    for (uint16_t i = 0; i < count; i++) {
+        bit_set(coils, addr + i, req[6 + i / 8] & BIT(i % 8));
+    }
+
+    memcpy(rsp, req, 5);
+    return 5;
+}
+
+/*****************************************************************************/
+static int reg_write(const uint8_t *req, size_t len, uint8_t *rsp)
+{
+    if (len != 5) {
+        return -BSP_MB_EX_ILLEGAL_VALUE;
+    }
+
+    uint16_t addr = sys_get_be16(&req[1]);
+    uint16_t value = sys_get_be16(&req[3]);
+
+    if (addr >= ARRAY_SIZE(holding_regs)) {
+        return -BSP_MB_EX_ILLEGAL_ADDRESS;
+    }
+    if (!reg_valid(&holding_regs[addr], value)) {
+        return -BSP_MB_EX_ILLEGAL_VALUE;
+    }
+
+    reg_set(&holding_regs[addr], value);
+
+    memcpy(rsp, req, 5);
+    return 5;
+}
+
+/*****************************************************************************/
+static int regs_write(const uint8_t *req, size_t len, uint8_t *rsp)
+{
+    if (len < 6) {
+        return -BSP_MB_EX_ILLEGAL_VALUE;
+    }
+
+    uint16_t addr = sys_get_be16(&req[1]);
+    uint16_t count = sys_get_be16(&req[3]);
+    uint8_t bytes = req[5];
+
+    if (count == 0 || count > BSP_MB_WRITE_REGISTERS_MAX || bytes != 2 * count ||
+        len != 6U + bytes) {
+        return -BSP_MB_EX_ILLEGAL_VALUE;
+    }
+    if (addr + count > ARRAY_SIZE(holding_regs)) {
+        return -BSP_MB_EX_ILLEGAL_ADDRESS;
+    }
+
+    // Check all values first, a rejected request changes nothing
+    for (uint16_t i = 0; i < count; i++) {
+        if (!reg_valid(&holding_regs[addr + i], sys_get_be16(&req[6 + 2 * i]))) {
+            return -BSP_MB_EX_ILLEGAL_VALUE;
+        }
+    }
+
+    for (uint16_t i = 0; i < count; i++) {
+        reg_set(&holding_regs[addr + i], sys_get_be16(&req[6 + 2 * i]));
+    }
+
+    memcpy(rsp, req, 5);
+    return 5;
+}
+
+/*****************************************************************************/
+size_t bsp_mb_pdu_process(const uint8_t *req, size_t len, uint8_t *rsp)
+{
+    if (len == 0) {
+        return 0;
+    }
+
+    uint8_t fc = req[0];
+    int ret;
+
+    rsp[0] = fc;
+
+    k_spinlock_key_t key = k_spin_lock(&bsp_pi_lock);
+
+    switch (fc) {
+    case BSP_MB_FC_READ_COILS:
+        ret = bits_read(coils, ARRAY_SIZE(coils), req, len, rsp);
+        break;
+    case BSP_MB_FC_READ_DISCRETE_INPUTS:
+        ret = bits_read(discrete_inputs, ARRAY_SIZE(discrete_inputs), req, len, rsp);
+        break;
+    case BSP_MB_FC_READ_HOLDING_REGISTERS:
+        ret = regs_read(holding_regs, ARRAY_SIZE(holding_regs), req, len, rsp);
+        break;
+    case BSP_MB_FC_READ_INPUT_REGISTERS:
+        ret = regs_read(input_regs, ARRAY_SIZE(input_regs), req, len, rsp);
+        break;
+    case BSP_MB_FC_WRITE_SINGLE_COIL:
+        ret = coil_write(req, len, rsp);
+        break;
+    case BSP_MB_FC_WRITE_SINGLE_REGISTER:
+        ret = reg_write(req, len, rsp);
+        break;
+    case BSP_MB_FC_WRITE_MULTIPLE_COILS:
+        ret = coils_write(req, len, rsp);
+        break;
+    case BSP_MB_FC_WRITE_MULTIPLE_REGISTERS:
+        ret = regs_write(req, len, rsp);
+        break;
+    default:
+        ret = -BSP_MB_EX_ILLEGAL_FUNCTION;
+        break;
+    }
+
+    k_spin_unlock(&bsp_pi_lock, key);
+
+    if (ret < 0) {
+        rsp[0] = fc | BSP_MB_FC_EXCEPTION;
+        rsp[1] = -ret;
+        return 2;
+    }
+
+    return ret;
+}
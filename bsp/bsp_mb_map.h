@@ -0,0 +1,36 @@
+#ifndef BSP_MB_MAP_H_
+#define BSP_MB_MAP_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bsp_mb.h"
+
+/* Modbus data model of the process image bsp_pi, served by the BSP Modbus
+ * slave services. Registers are read from and written to bsp_pi directly.
+ *
+ * Discrete inputs   0..7   bsp_pi.din bits
+ *                   8..15  bsp_pi.din_valid bits
+ * Coils             0..7   bsp_pi.dout bits
+ *                   8..15  bsp_pi.dout_enable bits
+ * Input registers   0      bsp_pi.din
+ *                   1      bsp_pi.din_valid
+ *                   2..17  bsp_pi.analog[0..7], two registers each, high
+ *                          word first
+ * Holding registers 0      bsp_pi.dout
+ *                   1      bsp_pi.dout_enable
+ */
+
+/*****************************************************************************/
+
+/// @brief Executes a request PDU on the process image and builds the response
+/// PDU. The request is executed under bsp_pi_lock, so reads see one cycle of
+/// the image and writes are applied completely or not at all.
+/// Callable from interrupts.
+/// @param req Request PDU, function code first
+/// @param len Bytes in req
+/// @param rsp Response PDU, BSP_MB_PDU_MAX bytes. May not overlap req.
+/// @return Bytes in rsp, normal or exception response
+size_t bsp_mb_pdu_process(const uint8_t *req, size_t len, uint8_t *rsp);
+
+#endif // BSP_MB_MAP_H_
@@ -0,0 +1,660 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+
+#include "bsp_mb_master.h"
+#include "bsp_mb_rtu.h"
+
+LOG_MODULE_REGISTER(bsp_mb_master, CONFIG_LOG_DEFAULT_LEVEL);
+
+/*****************************************************************************/
+#define POLLS_MAX CONFIG_BSP_MB_MASTER_MAX_POLLS
+#define SLAVES_MAX CONFIG_BSP_MB_MASTER_MAX_SLAVES
+#define MERGE_GAP CONFIG_BSP_MB_MASTER_MERGE_GAP
+#define RETRIES CONFIG_BSP_MB_MASTER_RETRIES
+#define SLAVE_MAX 247
+
+BUILD_ASSERT(POLLS_MAX <= UINT8_MAX, "Poll index must fit in a byte");
+
+struct poll_ctx {
+    struct bsp_mb_poll poll;
+    int64_t next_ms;
+};
+
+struct mb_job {
+    uint8_t slave;
+    uint8_t fc;
+    uint16_t addr;
+    uint16_t count;
+    void *data;                // One-shot requests
+    uint8_t members[POLLS_MAX]; // Polls served by the request
+    uint8_t members_count;
+};
+
+struct slave_ctx {
+    uint8_t addr;
+    struct bsp_mb_slave_stats stats;
+};
+
+/*****************************************************************************/
+/* Private objects */
+static struct poll_ctx polls[POLLS_MAX];
+static uint8_t order[POLLS_MAX]; // Poll indexes sorted by slave, function and address
+static size_t polls_count;
+static K_MUTEX_DEFINE(polls_lock);
+
+static struct slave_ctx slaves[SLAVES_MAX];
+static size_t slaves_count;
+
+// Response handoff from the UART interrupt
+static uint8_t resp[BSP_MB_ADU_MAX];
+static size_t resp_len;
+static uint32_t resp_cycles;
+static uint8_t resp_slave;
+static atomic_t resp_wanted;
+static K_SEM_DEFINE(resp_sem, 0, 1);
+
+// One-shot requests, served before the polls
+static K_MUTEX_DEFINE(request_lock);
+static struct mb_job *volatile request;
+static int request_err;
+static K_SEM_DEFINE(request_done, 0, 1);
+
+static K_SEM_DEFINE(wake_sem, 0, 1);
+static K_SEM_DEFINE(start_sem, 0, 1);
+static atomic_t started;
+
+/*****************************************************************************/
+static bool fc_is_bits(uint8_t fc)
+{
+    return fc == BSP_MB_FC_READ_COILS || fc == BSP_MB_FC_READ_DISCRETE_INPUTS ||
+           fc == BSP_MB_FC_WRITE_SINGLE_COIL || fc == BSP_MB_FC_WRITE_MULTIPLE_COILS;
+}
+
+/*****************************************************************************/
+static bool fc_is_read(uint8_t fc)
+{
+    return fc >= BSP_MB_FC_READ_COILS && fc <= BSP_MB_FC_READ_INPUT_REGISTERS;
+}
+
+/*****************************************************************************/
+static uint16_t count_max(uint8_t fc)
+{
+    switch (fc) {
+    case BSP_MB_FC_READ_COILS:
+    case BSP_MB_FC_READ_DISCRETE_INPUTS:
+        return BSP_MB_READ_BITS_MAX;
+    case BSP_MB_FC_READ_HOLDING_REGISTERS:
+    case BSP_MB_FC_READ_INPUT_REGISTERS:
+        return BSP_MB_READ_REGISTERS_MAX;
+    case BSP_MB_FC_WRITE_SINGLE_COIL:
+    case BSP_MB_FC_WRITE_SINGLE_REGISTER:
+        return 1;
+    case BSP_MB_FC_WRITE_MULTIPLE_COILS:
+        return BSP_MB_WRITE_BITS_MAX;
+    case BSP_MB_FC_WRITE_MULTIPLE_REGISTERS:
+        return BSP_MB_WRITE_REGISTERS_MAX;
+    default:
+        return 0;
+    }
+}
+
+/*****************************************************************************/
+static struct slave_ctx *slave_get(uint8_t addr)
+{
+    for (size_t i = 0; i < slaves_count; i++) {
+        if (slaves[i].addr == addr) {
+            return &slaves[i];
+        }
+    }
+
+    if (addr == 0 || slaves_count == SLAVES_MAX) {
+        return NULL;
+    }
+
+    struct slave_ctx *s = &slaves[slaves_count++];
+
+    s->addr = addr;
+    s->stats.latency_min_us = UINT32_MAX;
+    return s;
+}
+
+/*****************************************************************************/
+static void rx_cb(const uint8_t *adu, size_t len, uint32_t cycles, void *user_data)
+{
+    ARG_UNUSED(user_data);
+
+    // Frames from other slaves and late responses are ignored
+    if (adu[0] != resp_slave || !atomic_cas(&resp_wanted, 1, 0)) {
+        return;
+    }
+
+    memcpy(resp, adu, len);
+    resp_len = len;
+    resp_cycles = cycles;
+    k_sem_give(&resp_sem);
+}
+
+/*****************************************************************************/
+static size_t request_build(const struct mb_job *job, uint8_t *d)
+{
+    const uint16_t *regs = job->data;
+    const uint8_t *bits = job->data;
+    uint8_t bytes;
+
+    d[0] = job->slave;
+    d[1] = job->fc;
+    sys_put_be16(job->addr, &d[2]);
+
+    switch (job->fc) {
+    case BSP_MB_FC_WRITE_SINGLE_COIL:
+        sys_put_be16((bits[0] & BIT(0)) ? 0xFF00 : 0x0000, &d[4]);
+        return 6;
+
+    case BSP_MB_FC_WRITE_SINGLE_REGISTER:
+        sys_put_be16(regs[0], &d[4]);
+        return 6;
+
+    case BSP_MB_FC_WRITE_MULTIPLE_COILS:
+        bytes = DIV_ROUND_UP(job->count, 8);
+        sys_put_be16(job->count, &d[4]);
+        d[6] = bytes;
+        memcpy(&d[7], bits, bytes);
+        return 7 + bytes;
+
+    case BSP_MB_FC_WRITE_MULTIPLE_REGISTERS:
+        sys_put_be16(job->count, &d[4]);
+        d[6] = job->count * 2;
+        for (uint16_t i = 0; i < job->count; i++) {
+            sys_put_be16(regs[i], &d[7 + 2 * i]);
+        }
+        return 7 + d[6];
+
+    default:
+        sys_put_be16(job->count, &d[4]);
+        return 6;
+    }
+}
+
+/*****************************************************************************/
+static int response_check(const struct mb_job *job, const uint8_t *r, size_t len)
+{
+    if (len >= 3 && r[1] == (job->fc | BSP_MB_FC_EXCEPTION)) {
+        return -EIO;
+    }
+
+    if (len < 2 || r[1] != job->fc) {
+        return -EBADMSG;
+    }
+
+    if (fc_is_read(job->fc)) {
+        size_t bytes = fc_is_bits(job->fc) ? DIV_ROUND_UP(job->count, 8U) : job->count * 2U;
+
+        return (len == 3 + bytes && r[2] == bytes) ? 0 : -EBADMSG;
+    }
+
+    // Writes echo the address, and the value or quantity
+    return (len == 6 && sys_get_be16(&r[2]) == job->addr) ? 0 : -EBADMSG;
+}
+
+/*****************************************************************************/
+// Stores the part of a read response covered by a poll or request
+static void data_store(void *dest, uint8_t fc, uint16_t offset, uint16_t count,
+                       const uint8_t *data)
+{
+    if (fc_is_bits(fc)) {
+        uint8_t *bits = dest;
+
+        for (uint16_t i = 0; i < count; i++) {
+            uint32_t src = offset + i;
+
+            WRITE_BIT(bits[i / 8], i % 8, (data[src / 8] >> (src % 8)) & 1);
+        }
+    } else {
+        uint16_t *regs = dest;
+
+        for (uint16_t i = 0; i < count; i++) {
+            regs[i] = sys_get_be16(&data[2 * (offset + i)]);
+        }
+    }
+}
+
+/*****************************************************************************/
+static int job_execute(struct mb_job *job)
+{
+    struct slave_ctx *s = slave_get(job->slave);
+    uint8_t *d = bsp_mb_rtu_tx_buf();
+    size_t len = request_build(job, d);
+    int err = -ETIMEDOUT;
+
+    for (int attempt = 0; attempt <= RETRIES; attempt++) {
+        k_sem_reset(&resp_sem);
+        resp_slave = job->slave;
+        atomic_set(&resp_wanted, job->slave != 0);
+
+        err = bsp_mb_rtu_send(len);
+        if (err) {
+            atomic_clear(&resp_wanted);
+            return err;
+        }
+
+        if (s != NULL) {
+            s->stats.requests++;
+        }
+
+        // The response timeout starts at the end of the request
+        k_timeout_t timeout = K_USEC(bsp_mb_rtu_frame_us(len) + bsp_mb_rtu_t35_us() +
+                                     CONFIG_BSP_MB_MASTER_TIMEOUT_MS * USEC_PER_MSEC);
+
+        if (job->slave == 0) {
+            // Broadcast: no response, give the slaves time to process it
+            k_sleep(K_MSEC(CONFIG_BSP_MB_MASTER_TURNAROUND_MS));
+            return 0;
+        }
+
+        if (k_sem_take(&resp_sem, timeout) != 0) {
+            atomic_clear(&resp_wanted);
+            err = -ETIMEDOUT;
+            if (s != NULL) {
+                s->stats.timeouts++;
+            }
+            continue;
+        }
+
+        err = response_check(job, resp, resp_len);
+        if (s == NULL) {
+            return err;
+        }
+
+        if (err == -EIO) {
+            s->stats.exceptions++;
+            s->stats.last_exception = resp[2];
+        } else if (err) {
+            s->stats.errors++;
+        } else {
+            uint32_t us = k_cyc_to_us_floor32(resp_cycles - bsp_mb_rtu_tx_done_cycles());
+
+            s->stats.responses++;
+            s->stats.latency_sum_us += us;
+            s->stats.latency_min_us = MIN(s->stats.latency_min_us, us);
+            s->stats.latency_max_us = MAX(s->stats.latency_max_us, us);
+        }
+
+        return err;
+    }
+
+    return err;
+}
+
+/*****************************************************************************/
+static void poll_insert(size_t idx)
+{
+    const struct bsp_mb_poll *p = &polls[idx].poll;
+    uint32_t key = ((uint32_t)p->slave << 24) | ((uint32_t)p->fc << 16) | p->addr;
+    size_t pos = polls_count;
+
+    while (pos > 0) {
+        const struct bsp_mb_poll *q = &polls[order[pos - 1]].poll;
+
+        if ((((uint32_t)q->slave << 24) | ((uint32_t)q->fc << 16) | q->addr) <= key) {
+            break;
+        }
+        order[pos] = order[pos - 1];
+        pos--;
+    }
+
+    order[pos] = idx;
+}
+
+/*****************************************************************************/
+// Builds the request for the earliest due poll, extended to the neighbouring
+// polls of the same slave and function that are due within half a period.
+// Returns 0 with a job, otherwise the time to wait in ms, -1 for no polls.
+static int64_t job_from_polls(int64_t now, struct mb_job *job)
+{
+    size_t first = SIZE_MAX;
+    int64_t due = INT64_MAX;
+
+    for (size_t k = 0; k < polls_count; k++) {
+        if (polls[order[k]].next_ms < due) {
+            due = polls[order[k]].next_ms;
+            first = k;
+        }
+    }
+
+    if (first == SIZE_MAX) {
+        return -1;
+    }
+
+    if (due > now) {
+        return due - now;
+    }
+
+    const struct bsp_mb_poll *p = &polls[order[first]].poll;
+    uint32_t lo = p->addr;
+    uint32_t hi = p->addr + p->count;
+    uint16_t limit = count_max(p->fc);
+
+    job->slave = p->slave;
+    job->fc = p->fc;
+    job->data = NULL;
+    job->members[0] = order[first];
+    job->members_count = 1;
+
+    for (int dir = -1; dir <= 1; dir += 2) {
+        for (size_t k = first + dir; k < polls_count; k += dir) {
+            const struct poll_ctx *q = &polls[order[k]];
+            uint32_t q_lo = q->poll.addr;
+            uint32_t q_hi = q_lo + q->poll.count;
+
+            if (q->poll.slave != p->slave || q->poll.fc != p->fc) {
+                break;
+            }
+            if ((dir < 0 && q_hi + MERGE_GAP < lo) || (dir > 0 && q_lo > hi + MERGE_GAP)) {
+                break;
+            }
+            if (MAX(hi, q_hi) - MIN(lo, q_lo) > limit) {
+                break;
+            }
+            if (q->next_ms > now + q->poll.period_ms / 2) {
+                continue;
+            }
+
+            lo = MIN(lo, q_lo);
+            hi = MAX(hi, q_hi);
+            job->members[job->members_count++] = order[k];
+        }
+    }
+
+    job->addr = lo;
+    job->count = hi - lo;
+    return 0;
+}
+
+/*****************************************************************************/
+static void job_complete(const struct mb_job *job, int err)
+{
+    int64_t now = k_uptime_get();
+
+    k_mutex_lock(&polls_lock, K_FOREVER);
+    for (uint8_t i = 0; i < job->members_count; i++) {
+        struct poll_ctx *p = &polls[job->members[i]];
+
+        if (err == 0) {
+            data_store(p->poll.dest, p->poll.fc, p->poll.addr - job->addr, p->poll.count,
+                       &resp[3]);
+        }
+
+        // Keeps the phase, skips the periods missed when the bus is overloaded
+        p->next_ms += p->poll.period_ms;
+        if (p->next_ms <= now) {
+            p->next_ms = now + p->poll.period_ms;
+        }
+    }
+    k_mutex_unlock(&polls_lock);
+
+    for (uint8_t i = 0; i < job->members_count; i++) {
+        const struct bsp_mb_poll *poll = &polls[job->members[i]].poll;
+
+        if (poll->cb != NULL) {
+            poll->cb(poll, err, poll->user_data);
+        }
+    }
+}
+
+/*****************************************************************************/
+static void master_thread(void *p1, void *p2, void *p3)
+{
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    k_sem_take(&start_sem, K_FOREVER);
+
+    for (;;) {
+        struct mb_job *req = request;
+
+        if (req != NULL) {
+            request_err = job_execute(req);
+            if (request_err == 0 && fc_is_read(req->fc)) {
+                data_store(req->data, req->fc, 0, req->count, &resp[3]);
+            }
+            request = NULL;
+            k_sem_give(&request_done);
+            continue;
+        }
+
+        struct mb_job job;
+
+        k_mutex_lock(&polls_lock, K_FOREVER);
+        int64_t wait = job_from_polls(k_uptime_get(), &job);
+        k_mutex_unlock(&polls_lock);
+
+        if (wait == 0) {
+            job_complete(&job, job_execute(&job));
+            continue;
+        }
+
+        k_sem_take(&wake_sem, wait < 0 ? K_FOREVER : K_MSEC(wait));
+    }
+}
+
+K_THREAD_DEFINE(mb_master_thread, CONFIG_BSP_MB_MASTER_THREAD_STACK_SIZE, master_thread, NULL,
+                NULL, NULL, CONFIG_BSP_MB_MASTER_THREAD_PRIORITY, 0, 0);
+
+/*****************************************************************************/
+int bsp_mb_master_start(void)
+{
+    if (atomic_get(&started)) {
+        return -EALREADY;
+    }
+
+    int err = bsp_mb_rtu_open(rx_cb, NULL);
+    if (err) {
+        return err;
+    }
+
+    atomic_set(&started, 1);
+    k_sem_give(&start_sem);
+
+    return 0;
+}
+
+/*****************************************************************************/
+int bsp_mb_master_poll_add(const struct bsp_mb_poll *poll)
+{
+    if (poll == NULL || poll->slave == 0 || poll->slave > SLAVE_MAX || !fc_is_read(poll->fc) ||
+        poll->count == 0 || poll->count > count_max(poll->fc) || poll->period_ms == 0 ||
+        poll->dest == NULL || poll->addr + poll->count > 0x10000) {
+        return -EINVAL;
+    }
+
+    k_mutex_lock(&polls_lock, K_FOREVER);
+
+    if (polls_count == POLLS_MAX) {
+        k_mutex_unlock(&polls_lock);
+        return -ENOSPC;
+    }
+
+    size_t idx = polls_count;
+
+    polls[idx].poll = *poll;
+    polls[idx].next_ms = k_uptime_get();
+    poll_insert(idx);
+    polls_count++;
+
+    k_mutex_unlock(&polls_lock);
+    k_sem_give(&wake_sem);
+
+    return idx;
+}
+
+/*****************************************************************************/
+int bsp_mb_master_request(uint8_t slave, uint8_t fc, uint16_t addr, uint16_t count, void *data,
+                          k_timeout_t timeout)
+{
+    struct mb_job job = {
+        .slave = slave,
+        .fc = fc,
+        .addr = addr,
+        .count = count,
+        .data = data,
+    };
+
+    if (slave > SLAVE_MAX || (slave == 0 && fc_is_read(fc)) || count == 0 ||
+        count > count_max(fc) || data == NULL || addr + count > 0x10000) {
+        return -EINVAL;
+    }
+
+    if (!atomic_get(&started)) {
+        return -ENODEV;
+    }
+
+    if (k_mutex_lock(&request_lock, timeout) != 0) {
+        return -EAGAIN;
+    }
+
+    k_sem_reset(&request_done);
+    request = &job;
+    k_sem_give(&wake_sem);
+
+    // Bounded by the response timeout and retries of the request in progress
+    // and of this one, the job must not leave scope while in use
+    k_sem_take(&request_done, K_FOREVER);
+    int err = request_err;
+
+    k_mutex_unlock(&request_lock);
+
+    return err;
+}
+
+/*****************************************************************************/
+int bsp_mb_master_stats_get(uint8_t slave, struct bsp_mb_slave_stats *stats)
+{
+    for (size_t i = 0; i < slaves_count; i++) {
+        if (slaves[i].addr == slave) {
+            *stats = slaves[i].stats;
+            return 0;
+        }
+    }
+
+    return -ENOENT;
+}
+
+/*****************************************************************************/
+#ifdef CONFIG_BSP_MB_MASTER_AUTO_START
+static int mb_master_init(void)
+{
+    int err = bsp_mb_master_start();
+
+    if (err) {
+        LOG_ERR("Modbus master not started (err %d)", err);
+    }
+
+    return 0;
+}
+
+SYS_INIT(mb_master_init, APPLICATION, 35);
+#endif
+
+/*****************************************************************************/
+/* Shell */
+#ifdef CONFIG_SHELL
+static int cmd_mb_master_status(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    struct bsp_mb_rtu_stats link;
+
+    bsp_mb_rtu_stats_get(&link);
+    shell_print(sh, "Link: tx %u, rx %u, CRC errors %u, rx errors %u, %zu polls", link.tx_frames,
+                link.rx_frames, link.crc_errors, link.rx_errors, polls_count);
+
+    for (size_t i = 0; i < slaves_count; i++) {
+        const struct bsp_mb_slave_stats *s = &slaves[i].stats;
+        uint32_t avg = s->responses ? (uint32_t)(s->latency_sum_us / s->responses) : 0;
+
+        shell_print(sh,
+                    "Slave %3u: req %u, resp %u, timeouts %u, exceptions %u (last %u), "
+                    "errors %u, latency min %u avg %u max %u us",
+                    slaves[i].addr, s->requests, s->responses, s->timeouts, s->exceptions,
+                    s->last_exception, s->errors, s->responses ? s->latency_min_us : 0, avg,
+                    s->latency_max_us);
+    }
+
+    return 0;
+}
+
+/*****************************************************************************/
+static int cmd_mb_master_read(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+
+    uint8_t slave = strtoul(argv[1], NULL, 0);
+    uint8_t fc = strtoul(argv[2], NULL, 0);
+    uint16_t addr = strtoul(argv[3], NULL, 0);
+    uint16_t count = strtoul(argv[4], NULL, 0);
+    uint16_t regs[32];
+
+    if (!fc_is_read(fc) || count == 0 || count > (fc_is_bits(fc) ? 256 : ARRAY_SIZE(regs))) {
+        shell_error(sh, "Function 1..4, up to 32 registers or 256 bits");
+        return -EINVAL;
+    }
+
+    int err = bsp_mb_master_request(slave, fc, addr, count, regs, K_SECONDS(1));
+    if (err) {
+        shell_error(sh, "Read failed (err %d)", err);
+        return err;
+    }
+
+    for (uint16_t i = 0; i < count; i++) {
+        uint32_t value = fc_is_bits(fc) ? (((uint8_t *)regs)[i / 8] >> (i % 8)) & 1 : regs[i];
+
+        shell_print(sh, "%5u: 0x%04x %u", addr + i, value, value);
+    }
+
+    return 0;
+}
+
+/*****************************************************************************/
+static int cmd_mb_master_write(const struct shell *sh, size_t argc, char **argv)
+{
+    uint8_t slave = strtoul(argv[1], NULL, 0);
+    uint16_t addr = strtoul(argv[2], NULL, 0);
+    uint16_t regs[16];
+    uint16_t count = MIN(argc - 3, ARRAY_SIZE(regs));
+
+    for (uint16_t i = 0; i < count; i++) {
+        regs[i] = strtoul(argv[3 + i], NULL, 0);
+    }
+
+    uint8_t fc = (count == 1) ? BSP_MB_FC_WRITE_SINGLE_REGISTER
+                              : BSP_MB_FC_WRITE_MULTIPLE_REGISTERS;
+    int err = bsp_mb_master_request(slave, fc, addr, count, regs, K_SECONDS(1));
+    if (err) {
+        shell_error(sh, "Write failed (err %d)", err);
+    }
+
+    return err;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_mb_master,
+                               SHELL_CMD_ARG(status, NULL, "Show link and slave statistics",
+                                             cmd_mb_master_status, 1, 0),
+                               SHELL_CMD_ARG(read, NULL, "<slave> <function> <addr> <count>",
+                                             cmd_mb_master_read, 5, 0),
+                               SHELL_CMD_ARG(write, NULL, "<slave> <addr> <value> [value...]",
+                                             cmd_mb_master_write, 4, 15),
+                               SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(mb_master, &sub_mb_master, "Modbus RTU master", NULL);
+#endif /* CONFIG_SHELL */
@@ -0,0 +1,75 @@
+#ifndef BSP_MB_MASTER_H_
+#define BSP_MB_MASTER_H_
+
+#include <stdint.h>
+
+#include <zephyr/kernel.h>
+
+#include "bsp_mb.h"
+
+struct bsp_mb_poll;
+
+/// @brief Called in the master thread when a poll completed
+/// @param poll
+/// @param err 0 on success, -ETIMEDOUT without response, -EIO on an exception
+/// response, -EBADMSG on a malformed response
+typedef void (*bsp_mb_poll_cb_t)(const struct bsp_mb_poll *poll, int err, void *user_data);
+
+/// @brief Block of registers or bits read periodically from a slave
+struct bsp_mb_poll {
+    uint8_t slave;      // 1..247
+    uint8_t fc;         // BSP_MB_FC_READ_*
+    uint16_t addr;
+    uint16_t count;     // Registers or bits
+    uint32_t period_ms;
+    void *dest;         // uint16_t[count] for registers, bits packed LSB first
+    bsp_mb_poll_cb_t cb; // Optional
+    void *user_data;
+};
+
+struct bsp_mb_slave_stats {
+    uint32_t requests;
+    uint32_t responses;
+    uint32_t timeouts;
+    uint32_t exceptions;
+    uint32_t errors;            // Malformed responses
+    uint8_t last_exception;
+    uint32_t latency_min_us;    // End of request to end of response
+    uint32_t latency_max_us;
+    uint64_t latency_sum_us;
+};
+
+/*****************************************************************************/
+
+/// @brief Opens the RTU link and starts the polling scheduler
+/// @return 0 on success
+int bsp_mb_master_start(void);
+
+/// @brief Adds a periodic poll. Polls due around the same time on the same
+/// slave and function with nearby addresses are read with one request.
+/// The poll is copied.
+/// @param poll
+/// @return Poll handle, -EINVAL for an invalid poll, -ENOSPC if the poll
+/// table is full
+int bsp_mb_master_poll_add(const struct bsp_mb_poll *poll);
+
+/// @brief Sends one request ahead of the pending polls and waits for the
+/// response. Reads store into data, writes send data (registers as uint16_t,
+/// bits packed LSB first). Slave 0 broadcasts a write.
+/// @param slave
+/// @param fc BSP_MB_FC_*
+/// @param addr
+/// @param count Registers or bits
+/// @param data
+/// @param timeout Wait for the master thread and the response
+/// @return 0 on success, negative errno as for bsp_mb_poll_cb_t
+int bsp_mb_master_request(uint8_t slave, uint8_t fc, uint16_t addr, uint16_t count, void *data,
+                          k_timeout_t timeout);
+
+/// @brief Returns the statistics of a slave
+/// @param slave
+/// @param stats
+/// @return 0 on success, -ENOENT if the slave was never addressed
+int bsp_mb_master_stats_get(uint8_t slave, struct bsp_mb_slave_stats *stats);
+
+#endif // BSP_MB_MASTER_H_
@@ -0,0 +1,320 @@
+#include <errno.h>
+#include <string.h>
+
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/drivers/uart.h>
+#include <zephyr/kernel.h>
+#include <zephyr/linker/section_tags.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/util.h>
+
+#include "bsp_mb_rtu.h"
+
+#if DT_HAS_COMPAT_STATUS_OKAY(nxp_lpuart)
+#include <fsl_lpuart.h>
+#endif
+
+LOG_MODULE_REGISTER(bsp_mb_rtu, CONFIG_LOG_DEFAULT_LEVEL);
+
+/*****************************************************************************/
+#define MODBUS_NODE DT_ALIAS(modbus)
+#define MODBUS_UART DT_PARENT(MODBUS_NODE)
+#define BAUDRATE DT_PROP(MODBUS_UART, current_speed)
+
+#define CHAR_BITS 11             // Start, 8 data, parity or second stop, stop
+#define T35_FIXED_US 1750        // Recommended above 19200 baud
+#define RX_BUF_SIZE (2 * BSP_MB_ADU_MAX)
+#define CRC_POLY 0xA001          // Reflected 0x8005
+#define CRC_SEED 0xFFFF
+#define CHAR_US DIV_ROUND_UP(CHAR_BITS * USEC_PER_SEC, BAUDRATE)
+
+// The DMA transfer completes with the last characters still in the transmit
+// FIFO and shifter. On the LPUART the end of the frame is the TC flag.
+#if DT_NODE_HAS_COMPAT(MODBUS_UART, nxp_lpuart)
+#define LPUART ((LPUART_Type *)DT_REG_ADDR(MODBUS_UART))
+#endif
+
+// Driver enable by the LPUART on its RTS pin instead of the de-gpios line
+#define HW_DE IS_ENABLED(CONFIG_BSP_MB_RTU_HW_DE)
+
+BUILD_ASSERT(!HW_DE || DT_NODE_HAS_COMPAT(MODBUS_UART, nxp_lpuart),
+             "Hardware driver enable needs the modbus node on an LPUART");
+
+/*****************************************************************************/
+/* Private objects */
+static const struct device *const uart = DEVICE_DT_GET(MODBUS_UART);
+static const struct gpio_dt_spec de = GPIO_DT_SPEC_GET_OR(MODBUS_NODE, de_gpios, {0});
+
+// DMA buffers, kept out of the data cache where the platform supports it
+static uint8_t rx_bufs[2][RX_BUF_SIZE] __nocache;
+static uint8_t tx_buf[BSP_MB_ADU_MAX] __nocache;
+static uint8_t rx_next;
+
+static uint8_t frame[BSP_MB_ADU_MAX];
+static size_t frame_len;
+static bool frame_overflow;
+
+static atomic_t opened;
+static atomic_t tx_busy;
+static uint32_t tx_done_cycles;
+static uint32_t t35_us;
+static bsp_mb_rtu_rx_cb_t rx_cb;
+static void *rx_user_data;
+static struct bsp_mb_rtu_stats stats;
+
+#ifdef LPUART
+static void tc_poll(struct k_timer *timer);
+static K_TIMER_DEFINE(tc_timer, tc_poll, NULL);
+#endif
+
+/*****************************************************************************/
+uint16_t bsp_mb_rtu_crc(const uint8_t *data, size_t len)
+{
+    return crc16_reflect(CRC_POLY, CRC_SEED, data, len);
+}
+
+/*****************************************************************************/
+static void frame_end(void)
+{
+    uint32_t cycles = k_cycle_get_32();
+    size_t len = frame_len;
+
+    frame_len = 0;
+
+    if (frame_overflow || len < 4) {
+        frame_overflow = false;
+        stats.crc_errors++;
+        return;
+    }
+
+    // CRC is sent low byte first
+    uint16_t crc = frame[len - 2] | (frame[len - 1] << 8);
+    if (bsp_mb_rtu_crc(frame, len - 2) != crc) {
+        stats.crc_errors++;
+        return;
+    }
+
+    stats.rx_frames++;
+    rx_cb(frame, len - 2, cycles, rx_user_data);
+}
+
+/*****************************************************************************/
+// Data arrives when the line was idle for 3.5 characters or a buffer filled up
+static void rx_chunk(const uint8_t *data, size_t len, bool buf_full)
+{
+    if (frame_len + len > sizeof(frame)) {
+        frame_overflow = true;
+    } else {
+        memcpy(&frame[frame_len], data, len);
+        frame_len += len;
+    }
+
+    // A frame ending exactly at the end of a buffer merges with the next
+    // frame and is dropped by the CRC check
+    if (!buf_full) {
+        frame_end();
+    }
+}
+
+/*****************************************************************************/
+static void de_set(int value)
+{
+    if (!HW_DE && de.port != NULL) {
+        gpio_pin_set_dt(&de, value);
+    }
+}
+
+/*****************************************************************************/
+// The last stop bit left the shifter, the bus is released
+static void tx_complete(void)
+{
+    de_set(0);
+    tx_done_cycles = k_cycle_get_32();
+    atomic_clear(&tx_busy);
+}
+
+/*****************************************************************************/
+#ifdef LPUART
+// Runs from the timer interrupt once per character time until TC is set,
+// at most the FIFO depth plus the shifter
+static void tc_poll(struct k_timer *timer)
+{
+    if (!(LPUART->STAT & LPUART_STAT_TC_MASK)) {
+        k_timer_start(timer, K_USEC(CHAR_US), K_NO_WAIT);
+        return;
+    }
+
+    tx_complete();
+}
+#endif
+
+/*****************************************************************************/
+static void uart_cb(const struct device *dev, struct uart_event *evt, void *user_data)
+{
+    ARG_UNUSED(user_data);
+
+    switch (evt->type) {
+    case UART_TX_DONE:
+#ifdef LPUART
+        if (!(LPUART->STAT & LPUART_STAT_TC_MASK)) {
+            k_timer_start(&tc_timer, K_USEC(CHAR_US), K_NO_WAIT);
+            break;
+        }
+#endif
+        tx_complete();
+        break;
+
+    case UART_TX_ABORTED:
+        tx_complete();
+        break;
+
+    case UART_RX_RDY:
+        rx_chunk(evt->data.rx.buf + evt->data.rx.offset, evt->data.rx.len,
+                 evt->data.rx.offset + evt->data.rx.len == RX_BUF_SIZE);
+        break;
+
+    case UART_RX_BUF_REQUEST:
+        uart_rx_buf_rsp(dev, rx_bufs[rx_next], RX_BUF_SIZE);
+        rx_next ^= 1;
+        break;
+
+    case UART_RX_STOPPED:
+        stats.rx_errors++;
+        frame_len = 0;
+        break;
+
+    case UART_RX_DISABLED:
+        // Restart after an error
+        frame_len = 0;
+        rx_next = 1;
+        uart_rx_enable(dev, rx_bufs[0], RX_BUF_SIZE, t35_us);
+        break;
+
+    default:
+        break;
+    }
+}
+
+/*****************************************************************************/
+int bsp_mb_rtu_open(bsp_mb_rtu_rx_cb_t cb, void *user_data)
+{
+    int err;
+
+    if (cb == NULL) {
+        return -EINVAL;
+    }
+
+    if (!atomic_cas(&opened, 0, 1)) {
+        return -EBUSY;
+    }
+
+    if (!device_is_ready(uart) || (!HW_DE && de.port != NULL && !gpio_is_ready_dt(&de))) {
+        LOG_ERR("Modbus UART not ready");
+        err = -ENODEV;
+        goto fail;
+    }
+
+    if (HW_DE) {
+#ifdef LPUART
+        // RTS asserted, active high, from the start bit to the end of the last
+        // stop bit. MODIR is only written with the transmitter disabled.
+        uint32_t ctrl = LPUART->CTRL;
+
+        LPUART->CTRL = ctrl & ~LPUART_CTRL_TE_MASK;
+        LPUART->MODIR |= LPUART_MODIR_TXRTSE_MASK | LPUART_MODIR_TXRTSPOL_MASK;
+        LPUART->CTRL = ctrl;
+#endif
+    } else if (de.port != NULL) {
+        err = gpio_pin_configure_dt(&de, GPIO_OUTPUT_INACTIVE);
+        if (err) {
+            goto fail;
+        }
+    }
+
+    t35_us = (BAUDRATE > 19200) ? T35_FIXED_US
+                                : DIV_ROUND_UP(7U * CHAR_BITS * USEC_PER_SEC, 2U * BAUDRATE);
+    rx_cb = cb;
+    rx_user_data = user_data;
+
+    err = uart_callback_set(uart, uart_cb, NULL);
+    if (err) {
+        LOG_ERR("Modbus UART has no asynchronous API (err %d), DMA channels missing?", err);
+        goto fail;
+    }
+
+    rx_next = 1;
+    err = uart_rx_enable(uart, rx_bufs[0], RX_BUF_SIZE, t35_us);
+    if (err) {
+        goto fail;
+    }
+
+    LOG_INF("Modbus RTU on %s, %u baud, t3.5 %u us", uart->name, BAUDRATE, t35_us);
+    return 0;
+
+fail:
+    atomic_clear(&opened);
+    return err;
+}
+
+/*****************************************************************************/
+uint8_t *bsp_mb_rtu_tx_buf(void)
+{
+    return tx_buf;
+}
+
+/*****************************************************************************/
+int bsp_mb_rtu_send(size_t len)
+{
+    if (len == 0 || len > BSP_MB_ADU_MAX - 2) {
+        return -EINVAL;
+    }
+
+    if (!atomic_cas(&tx_busy, 0, 1)) {
+        return -EBUSY;
+    }
+
+    uint16_t crc = bsp_mb_rtu_crc(tx_buf, len);
+
+    tx_buf[len] = crc & 0xFF;
+    tx_buf[len + 1] = crc >> 8;
+
+    de_set(1);
+
+    int err = uart_tx(uart, tx_buf, len + 2, SYS_FOREVER_US);
+    if (err) {
+        de_set(0);
+        atomic_clear(&tx_busy);
+        return err;
+    }
+
+    stats.tx_frames++;
+    return 0;
+}
+
+/*****************************************************************************/
+uint32_t bsp_mb_rtu_tx_done_cycles(void)
+{
+    return tx_done_cycles;
+}
+
+/*****************************************************************************/
+uint32_t bsp_mb_rtu_t35_us(void)
+{
+    return t35_us;
+}
+
+/*****************************************************************************/
+uint32_t bsp_mb_rtu_frame_us(size_t len)
+{
+    return DIV_ROUND_UP((uint64_t)(len + 2) * CHAR_BITS * USEC_PER_SEC, BAUDRATE);
+}
+
+/*****************************************************************************/
+void bsp_mb_rtu_stats_get(struct bsp_mb_rtu_stats *s)
+{
+    *s = stats;
+}
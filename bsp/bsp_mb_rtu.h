@@ -0,0 +1,60 @@
+#ifndef BSP_MB_RTU_H_
+#define BSP_MB_RTU_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bsp_mb.h"
+
+struct bsp_mb_rtu_stats {
+    uint32_t tx_frames;
+    uint32_t rx_frames;
+    uint32_t crc_errors; // Also frames shorter than 4 bytes
+    uint32_t rx_errors;  // Overrun, framing and parity errors
+};
+
+/// @brief Called from the UART interrupt with every received frame whose CRC
+/// is correct. The frame is only valid during the call.
+/// @param adu Address and PDU, without the CRC
+/// @param len Bytes in adu
+/// @param cycles Cycle counter when the end of the frame was detected
+typedef void (*bsp_mb_rtu_rx_cb_t)(const uint8_t *adu, size_t len, uint32_t cycles,
+                                   void *user_data);
+
+/*****************************************************************************/
+
+/// @brief Takes the UART of the modbus alias node and starts reception with
+/// the DMA driven asynchronous API. The end of a frame is detected by the
+/// receive inactivity timeout set to 3.5 character times.
+/// @param cb
+/// @param user_data
+/// @return 0 on success, -EBUSY if another service opened the link
+int bsp_mb_rtu_open(bsp_mb_rtu_rx_cb_t cb, void *user_data);
+
+/// @brief Returns the transmit DMA buffer, BSP_MB_ADU_MAX bytes. ADUs are
+/// assembled in place and sent with bsp_mb_rtu_send().
+uint8_t *bsp_mb_rtu_tx_buf(void);
+
+/// @brief Appends the CRC to the ADU in the transmit buffer and sends it with
+/// the RS-485 driver enabled
+/// @param len ADU length without the CRC
+/// @return 0 on success, -EBUSY while the previous frame is being sent
+int bsp_mb_rtu_send(size_t len);
+
+/// @brief Returns the cycle counter at the end of the last transmission
+uint32_t bsp_mb_rtu_tx_done_cycles(void);
+
+/// @brief Returns the 3.5 character inter-frame time in microseconds
+uint32_t bsp_mb_rtu_t35_us(void);
+
+/// @brief Returns the time on the wire of an ADU in microseconds
+/// @param len ADU length without the CRC
+uint32_t bsp_mb_rtu_frame_us(size_t len);
+
+/// @brief Modbus CRC-16 of data
+uint16_t bsp_mb_rtu_crc(const uint8_t *data, size_t len);
+
+/// @brief Returns the link statistics
+void bsp_mb_rtu_stats_get(struct bsp_mb_rtu_stats *stats);
+
+#endif // BSP_MB_RTU_H_
@@ -0,0 +1,141 @@
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/util.h>
+
+#include "bsp_mb_map.h"
+#include "bsp_mb_rtu.h"
+#include "bsp_mb_slave.h"
+
+LOG_MODULE_REGISTER(bsp_mb_slave, CONFIG_LOG_DEFAULT_LEVEL);
+
+/*****************************************************************************/
+#define BROADCAST 0
+
+/*****************************************************************************/
+/* Private objects */
+static struct bsp_mb_slave_counters counters;
+
+/*****************************************************************************/
+// Runs in the UART interrupt, so the response does not wait for threads
+static void rx_handler(const uint8_t *adu, size_t len, uint32_t cycles, void *user_data)
+{
+    ARG_UNUSED(user_data);
+
+    uint8_t addr = adu[0];
+
+    if ((addr != CONFIG_BSP_MB_SLAVE_ADDRESS && addr != BROADCAST) || len < 2) {
+        return;
+    }
+
+    // The master waits for the response before the next request, so the
+    // previous response has left the transmit buffer
+    uint8_t *tx = bsp_mb_rtu_tx_buf();
+    size_t n = bsp_mb_pdu_process(&adu[1], len - 1, &tx[1]);
+
+    counters.requests++;
+    if (tx[1] & BSP_MB_FC_EXCEPTION) {
+        counters.exceptions++;
+    }
+
+    if (addr == BROADCAST) {
+        counters.broadcasts++;
+        return;
+    }
+
+    tx[0] = addr;
+    if (bsp_mb_rtu_send(n + 1)) {
+        counters.tx_errors++;
+        return;
+    }
+
+    uint32_t us = k_cyc_to_us_ceil32(k_cycle_get_32() - cycles);
+    counters.response_max_us = MAX(counters.response_max_us, us);
+}
+
+/*****************************************************************************/
+int bsp_mb_slave_start(void)
+{
+    int err = bsp_mb_rtu_open(rx_handler, NULL);
+
+    if (err) {
+        return err;
+    }
+
+    LOG_INF("Modbus slave %u", CONFIG_BSP_MB_SLAVE_ADDRESS);
+    return 0;
+}
+
+/*****************************************************************************/
+void bsp_mb_slave_counters_get(struct bsp_mb_slave_counters *c)
+{
+    unsigned int key = irq_lock();
+    *c = counters;
+    irq_unlock(key);
+}
+
+/*****************************************************************************/
+#ifdef CONFIG_BSP_MB_SLAVE_AUTO_START
+static int mb_slave_init(void)
+{
+    int err = bsp_mb_slave_start();
+
+    if (err) {
+        LOG_ERR("Modbus slave not started (err %d)", err);
+    }
+
+    return 0;
+}
+
+SYS_INIT(mb_slave_init, APPLICATION, 35);
+#endif
+
+/*****************************************************************************/
+/* Shell */
+#ifdef CONFIG_SHELL
+static int cmd_mb_slave_status(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    struct bsp_mb_rtu_stats link;
+    struct bsp_mb_slave_counters c;
+
+    bsp_mb_rtu_stats_get(&link);
+    bsp_mb_slave_counters_get(&c);
+
+    shell_print(sh, "Link: tx %u, rx %u, CRC errors %u, rx errors %u", link.tx_frames,
+                link.rx_frames, link.crc_errors, link.rx_errors);
+    shell_print(sh,
+                "Slave %u: req %u, broadcasts %u, exceptions %u, tx errors %u, "
+                "response max %u us (t3.5 %u us)",
+                CONFIG_BSP_MB_SLAVE_ADDRESS, c.requests, c.broadcasts, c.exceptions,
+                c.tx_errors, c.response_max_us, bsp_mb_rtu_t35_us());
+
+    return 0;
+}
+
+/*****************************************************************************/
+static int cmd_mb_slave_reset(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(sh);
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    unsigned int key = irq_lock();
+    counters = (struct bsp_mb_slave_counters){0};
+    irq_unlock(key);
+
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_mb_slave,
+                               SHELL_CMD_ARG(status, NULL, "Show link and slave statistics",
+                                             cmd_mb_slave_status, 1, 0),
+                               SHELL_CMD_ARG(reset, NULL, "Reset the slave statistics",
+                                             cmd_mb_slave_reset, 1, 0),
+                               SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(mb_slave, &sub_mb_slave, "Modbus RTU slave", NULL);
+#endif /* CONFIG_SHELL */
@@ -0,0 +1,26 @@
+#ifndef BSP_MB_SLAVE_H_
+#define BSP_MB_SLAVE_H_
+
+#include <stdint.h>
+
+struct bsp_mb_slave_counters {
+    uint32_t requests;     // Addressed to this slave, broadcasts included
+    uint32_t broadcasts;
+    uint32_t exceptions;
+    uint32_t tx_errors;    // Responses not sent
+    uint32_t response_max_us; // End of request to start of response
+};
+
+/*****************************************************************************/
+
+/// @brief Opens the RTU link and answers requests addressed to
+/// CONFIG_BSP_MB_SLAVE_ADDRESS from the process image, see bsp_mb_map.h.
+/// Requests are executed in the UART interrupt and the response is built in
+/// the transmit DMA buffer.
+/// @return 0 on success
+int bsp_mb_slave_start(void);
+
+/// @brief Returns the slave statistics
+void bsp_mb_slave_counters_get(struct bsp_mb_slave_counters *counters);
+
+#endif // BSP_MB_SLAVE_H_
@@ -0,0 +1,309 @@
+#include <errno.h>
+#include <string.h>
+
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/net/socket.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/util.h>
+
+#include "bsp_mb_map.h"
+#include "bsp_mb_tcp.h"
+
+LOG_MODULE_REGISTER(bsp_mb_tcp, CONFIG_LOG_DEFAULT_LEVEL);
+
+/*****************************************************************************/
+#define MBAP_SIZE 7 // Transaction, protocol, length, unit
+#define ADU_MAX (MBAP_SIZE + BSP_MB_PDU_MAX)
+#define POLL_TIMEOUT_MS 1000
+#define SEND_TIMEOUT_MS 100 // A client not reading its responses stalls all others
+
+struct mb_client {
+    uint8_t rx[ADU_MAX];
+    size_t len;
+    int64_t last_rx;
+};
+
+/*****************************************************************************/
+/* Private objects */
+static K_SEM_DEFINE(start_sem, 0, 1);
+static atomic_t started;
+
+// fds[0] is the listening socket, fds[1 + i] the socket of clients[i]
+static struct zsock_pollfd fds[1 + CONFIG_BSP_MB_TCP_MAX_CLIENTS];
+static struct mb_client clients[CONFIG_BSP_MB_TCP_MAX_CLIENTS];
+static uint8_t tx[ADU_MAX];
+static struct bsp_mb_tcp_stats stats;
+
+/*****************************************************************************/
+static int listen_open(void)
+{
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(CONFIG_BSP_MB_TCP_PORT),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    int opt = 1;
+    int fd = zsock_socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+
+    if (fd < 0) {
+        return -errno;
+    }
+
+    (void)zsock_setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    if (zsock_bind(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        zsock_listen(fd, CONFIG_BSP_MB_TCP_MAX_CLIENTS) < 0) {
+        int err = -errno;
+
+        zsock_close(fd);
+        return err;
+    }
+
+    return fd;
+}
+
+/*****************************************************************************/
+static void client_accept(void)
+{
+    int fd = zsock_accept(fds[0].fd, NULL, NULL);
+    struct timeval timeout = {
+        .tv_sec = SEND_TIMEOUT_MS / MSEC_PER_SEC,
+        .tv_usec = (SEND_TIMEOUT_MS % MSEC_PER_SEC) * USEC_PER_MSEC,
+    };
+
+    if (fd < 0) {
+        return;
+    }
+
+    (void)zsock_setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    for (size_t i = 0; i < ARRAY_SIZE(clients); i++) {
+        if (fds[1 + i].fd < 0) {
+            fds[1 + i].fd = fd;
+            clients[i].len = 0;
+            clients[i].last_rx = k_uptime_get();
+            stats.connections++;
+            stats.clients++;
+            return;
+        }
+    }
+
+    stats.rejected++;
+    zsock_close(fd);
+}
+
+/*****************************************************************************/
+static void client_close(size_t i)
+{
+    zsock_close(fds[1 + i].fd);
+    fds[1 + i].fd = -1;
+    stats.clients--;
+}
+
+/*****************************************************************************/
+static int send_all(int fd, const uint8_t *data, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = zsock_send(fd, data, len, 0);
+
+        if (n < 0) {
+            if (errno == EAGAIN) {
+                stats.send_timeouts++;
+            }
+            return -errno;
+        }
+        data += n;
+        len -= n;
+    }
+
+    return 0;
+}
+
+/*****************************************************************************/
+// Answers all complete requests in the receive buffer, a client may send
+// several requests before waiting for the responses
+static int client_process(int fd, struct mb_client *c)
+{
+    while (c->len >= MBAP_SIZE) {
+        uint16_t protocol = sys_get_be16(&c->rx[2]);
+        uint16_t length = sys_get_be16(&c->rx[4]); // Unit and PDU
+
+        if (protocol != 0 || length < 2 || length > 1 + BSP_MB_PDU_MAX) {
+            stats.protocol_errors++;
+            return -EBADMSG;
+        }
+
+        size_t adu_len = MBAP_SIZE - 1 + length;
+        if (c->len < adu_len) {
+            break;
+        }
+
+        uint32_t start = k_cycle_get_32();
+        size_t n = bsp_mb_pdu_process(&c->rx[MBAP_SIZE], length - 1, &tx[MBAP_SIZE]);
+
+        // Transaction and protocol identifier and unit are echoed
+        memcpy(tx, c->rx, 4);
+        sys_put_be16(n + 1, &tx[4]);
+        tx[6] = c->rx[6];
+
+        stats.requests++;
+        if (tx[MBAP_SIZE] & BSP_MB_FC_EXCEPTION) {
+            stats.exceptions++;
+        }
+
+        int err = send_all(fd, tx, MBAP_SIZE + n);
+        if (err) {
+            return err;
+        }
+
+        uint32_t us = k_cyc_to_us_ceil32(k_cycle_get_32() - start);
+        stats.response_max_us = MAX(stats.response_max_us, us);
+
+        c->len -= adu_len;
+        memmove(c->rx, &c->rx[adu_len], c->len);
+    }
+
+    return 0;
+}
+
+/*****************************************************************************/
+static void client_receive(size_t i)
+{
+    struct mb_client *c = &clients[i];
+    int fd = fds[1 + i].fd;
+    ssize_t n = zsock_recv(fd, &c->rx[c->len], sizeof(c->rx) - c->len, 0);
+
+    if (n <= 0) {
+        client_close(i);
+        return;
+    }
+
+    // The buffer holds a complete ADU, so it is never full after processing
+    c->len += n;
+    c->last_rx = k_uptime_get();
+
+    if (client_process(fd, c) != 0) {
+        client_close(i);
+    }
+}
+
+/*****************************************************************************/
+static void server_thread(void *p1, void *p2, void *p3)
+{
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    k_sem_take(&start_sem, K_FOREVER);
+
+    for (size_t i = 0; i < ARRAY_SIZE(fds); i++) {
+        fds[i].fd = -1;
+        fds[i].events = ZSOCK_POLLIN;
+    }
+
+    while ((fds[0].fd = listen_open()) < 0) {
+        LOG_ERR("Modbus TCP port %u not opened (err %d)", CONFIG_BSP_MB_TCP_PORT, fds[0].fd);
+        k_sleep(K_SECONDS(5));
+    }
+
+    LOG_INF("Modbus TCP server on port %u", CONFIG_BSP_MB_TCP_PORT);
+
+    for (;;) {
+        if (zsock_poll(fds, ARRAY_SIZE(fds), POLL_TIMEOUT_MS) < 0) {
+            LOG_ERR("poll failed (err %d)", -errno);
+            k_sleep(K_MSEC(POLL_TIMEOUT_MS));
+            continue;
+        }
+
+        for (size_t i = 0; i < ARRAY_SIZE(clients); i++) {
+            short revents = fds[1 + i].revents;
+
+            if (fds[1 + i].fd < 0) {
+                continue;
+            }
+
+            if (revents & (ZSOCK_POLLERR | ZSOCK_POLLHUP | ZSOCK_POLLNVAL)) {
+                client_close(i);
+                continue;
+            }
+
+            if (revents & ZSOCK_POLLIN) {
+                client_receive(i);
+            }
+
+            // Checked on every pass, whatever the poll events
+            if (fds[1 + i].fd >= 0 && CONFIG_BSP_MB_TCP_IDLE_TIMEOUT_S > 0 &&
+                k_uptime_get() - clients[i].last_rx >
+                    CONFIG_BSP_MB_TCP_IDLE_TIMEOUT_S * MSEC_PER_SEC) {
+                client_close(i);
+            }
+        }
+
+        if (fds[0].revents & ZSOCK_POLLIN) {
+            client_accept();
+        }
+    }
+}
+
+K_THREAD_DEFINE(mb_tcp_thread, CONFIG_BSP_MB_TCP_THREAD_STACK_SIZE, server_thread, NULL, NULL,
+                NULL, CONFIG_BSP_MB_TCP_THREAD_PRIORITY, 0, 0);
+
+/*****************************************************************************/
+int bsp_mb_tcp_start(void)
+{
+    if (!atomic_cas(&started, 0, 1)) {
+        return -EALREADY;
+    }
+
+    k_sem_give(&start_sem);
+    return 0;
+}
+
+/*****************************************************************************/
+void bsp_mb_tcp_stats_get(struct bsp_mb_tcp_stats *s)
+{
+    *s = stats;
+}
+
+/*****************************************************************************/
+#ifdef CONFIG_BSP_MB_TCP_AUTO_START
+static int mb_tcp_init(void)
+{
+    bsp_mb_tcp_start();
+    return 0;
+}
+
+SYS_INIT(mb_tcp_init, APPLICATION, 35);
+#endif
+
+/*****************************************************************************/
+/* Shell */
+#ifdef CONFIG_SHELL
+static int cmd_mb_tcp_status(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    struct bsp_mb_tcp_stats s;
+
+    bsp_mb_tcp_stats_get(&s);
+    shell_print(sh, "Port %u: %u of %u clients, %u connections, %u rejected", CONFIG_BSP_MB_TCP_PORT,
+                s.clients, CONFIG_BSP_MB_TCP_MAX_CLIENTS, s.connections, s.rejected);
+    shell_print(sh, "Requests %u, exceptions %u, protocol errors %u, response max %u us",
+                s.requests, s.exceptions, s.protocol_errors, s.response_max_us);
+    shell_print(sh, "Send timeouts %u", s.send_timeouts);
+
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_mb_tcp,
+                               SHELL_CMD_ARG(status, NULL, "Show server statistics",
+                                             cmd_mb_tcp_status, 1, 0),
+                               SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(mb_tcp, &sub_mb_tcp, "Modbus TCP server", NULL);
+#endif /* CONFIG_SHELL */
@@ -0,0 +1,28 @@
+#ifndef BSP_MB_TCP_H_
+#define BSP_MB_TCP_H_
+
+#include <stdint.h>
+
+struct bsp_mb_tcp_stats {
+    uint32_t connections;     // Accepted since boot
+    uint32_t rejected;        // Refused with all client slots in use
+    uint32_t clients;         // Connected now
+    uint32_t requests;
+    uint32_t exceptions;
+    uint32_t protocol_errors; // Connections closed on an invalid MBAP header
+    uint32_t send_timeouts;   // Connections closed on a response not taken in time
+    uint32_t response_max_us; // Complete request received to response sent
+};
+
+/*****************************************************************************/
+
+/// @brief Starts the Modbus TCP server on CONFIG_BSP_MB_TCP_PORT. Requests of
+/// up to CONFIG_BSP_MB_TCP_MAX_CLIENTS connections are executed on the
+/// process image with the register map of the serial slave, see bsp_mb_map.h.
+/// @return 0 on success, -EALREADY if the server runs
+int bsp_mb_tcp_start(void);
+
+/// @brief Returns the server statistics
+void bsp_mb_tcp_stats_get(struct bsp_mb_tcp_stats *stats);
+
+#endif // BSP_MB_TCP_H_
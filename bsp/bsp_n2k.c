@@ -0,0 +1,799 @@
+#include <errno.h>
+#include <string.h>
+
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/can.h>
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/byteorder.h>
+#include <zephyr/sys/iterable_sections.h>
+#include <zephyr/sys/util.h>
+
+#include "bsp_can.h"
+#include "bsp_n2k.h"
+
+LOG_MODULE_REGISTER(bsp_n2k, CONFIG_LOG_DEFAULT_LEVEL);
+
+/*****************************************************************************/
+#if DT_HAS_ALIAS(canbus_nmea)
+#define N2K_NODE DT_ALIAS(canbus_nmea)
+#else
+#define N2K_NODE DT_CHOSEN(zephyr_canbus)
+#endif
+
+#define HASH_SIZE CONFIG_BSP_N2K_HASH_SIZE
+#define HASH_MASK (HASH_SIZE - 1)
+#define SESSIONS_COUNT CONFIG_BSP_N2K_RX_SESSIONS
+#define TP_MAX_SIZE CONFIG_BSP_N2K_TP_MAX_SIZE
+
+BUILD_ASSERT(IS_POWER_OF_TWO(HASH_SIZE), "PGN hash size must be a power of two");
+BUILD_ASSERT(TP_MAX_SIZE >= BSP_N2K_FAST_PACKET_MAX, "Reassembly buffer below fast-packet size");
+
+#define CLAIM_TIMEOUT K_MSEC(250)
+#define TX_TIMEOUT K_MSEC(10)
+#define RX_TIMEOUT_MS 750 // ISO 11783-3 T1, also used between fast-packet frames
+
+#define TP_CM_RTS 16
+#define TP_CM_CTS 17
+#define TP_CM_EOMA 19
+#define TP_CM_BAM 32
+#define TP_CM_ABORT 255
+
+#define TP_ABORT_BUSY 1
+#define TP_ABORT_RESOURCES 2
+#define TP_ABORT_OTHER 250 // Reason not listed in J1939-21
+
+#define ARBITRARY_ADDRESS_CAPABLE BIT64(63)
+#define DYNAMIC_ADDRESS_FIRST 128
+#define DYNAMIC_ADDRESS_LAST 247
+
+typedef enum {
+    SESSION_FREE,
+    SESSION_FAST_PACKET,
+    SESSION_TP_BAM,
+    SESSION_TP_CMDT,
+} session_type_t;
+
+struct rx_session {
+    session_type_t type;
+    uint32_t pgn;
+    uint8_t priority;
+    uint8_t source;
+    uint8_t destination;
+    uint8_t seq;        // Fast-packet sequence counter
+    uint8_t next;       // Next expected frame or TP packet number
+    uint8_t packets;    // TP packet count
+    uint8_t window_end; // Last TP packet of the current CTS window
+    uint8_t window_max; // TP packets per CTS requested by the sender
+    uint16_t size;
+    uint16_t received;
+    int64_t deadline;
+    uint8_t data[TP_MAX_SIZE];
+};
+
+struct n2k_ctx {
+    const struct device *dev;
+    bsp_n2k_state_t state;
+    uint64_t name;
+    uint8_t address;
+    uint8_t fast_packet_seq;
+    uint32_t claimed[256 / 32]; // Addresses claimed by other nodes
+    struct bsp_n2k_stats stats;
+};
+
+/*****************************************************************************/
+/* Private objects */
+static struct n2k_ctx n2k = {
+    .dev = DEVICE_DT_GET_OR_NULL(N2K_NODE),
+    .address = BSP_N2K_ADDRESS_NULL,
+};
+
+static K_MUTEX_DEFINE(n2k_lock);
+
+// Handler index + 1 per slot, 0 marks an empty slot. Open addressing with
+// linear probing, filled once at init from the handler section.
+static uint16_t pgn_index[HASH_SIZE];
+
+static struct rx_session sessions[SESSIONS_COUNT];
+
+static void claim_work_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(claim_work, claim_work_handler);
+
+static void rx_frame(const struct device *dev, const struct can_frame *frame, void *user_data);
+
+static const struct bsp_can_rx_entry rx_table[] = {
+    {
+        // Everything extended; PGN demultiplexing is done by the hash lookup
+        .filter = {.id = 0, .mask = 0, .flags = CAN_FILTER_IDE},
+        .handler = rx_frame,
+    },
+};
+
+/*****************************************************************************/
+static inline uint32_t pgn_hash(uint32_t pgn)
+{
+    return ((pgn * 2654435761U) >> 16) & HASH_MASK;
+}
+
+/*****************************************************************************/
+static const struct bsp_n2k_handler *handler_find(uint32_t pgn)
+{
+    for (uint32_t slot = pgn_hash(pgn);; slot = (slot + 1) & HASH_MASK) {
+        uint16_t index = pgn_index[slot];
+
+        if (index == 0) {
+            return NULL;
+        }
+
+        const struct bsp_n2k_handler *h;
+        STRUCT_SECTION_GET(bsp_n2k_handler, index - 1, &h);
+        if (h->pgn == pgn) {
+            return h;
+        }
+    }
+}
+
+/*****************************************************************************/
+static void tx_done(const struct device *dev, int error, void *user_data)
+{
+    ARG_UNUSED(dev);
+    ARG_UNUSED(user_data);
+
+    if (error) {
+        n2k.stats.tx_errors++;
+    }
+}
+
+/*****************************************************************************/
+static int frame_send(uint32_t pgn, uint8_t priority, uint8_t source, uint8_t destination,
+                      const uint8_t *data, uint8_t len)
+{
+    struct can_frame frame = {
+        .flags = CAN_FRAME_IDE,
+        .dlc = len,
+    };
+
+    uint32_t id = ((uint32_t)(priority & 0x7) << 26) | ((pgn & 0x3FFFF) << 8) | source;
+    if (((pgn >> 8) & 0xFF) < 240) {
+        // PDU1: the PS field carries the destination address
+        id = (id & ~0xFF00U) | ((uint32_t)destination << 8);
+    }
+    frame.id = id;
+    memcpy(frame.data, data, len);
+
+    int err = bsp_can_send(n2k.dev, &frame, TX_TIMEOUT, tx_done, NULL);
+    if (err) {
+        n2k.stats.tx_errors++;
+    }
+
+    return err;
+}
+
+/*****************************************************************************/
+static void tp_cm_send(uint8_t destination, const uint8_t cm[8])
+{
+    frame_send(BSP_N2K_PGN_TP_CM, 7, n2k.address, destination, cm, 8);
+}
+
+/*****************************************************************************/
+static void tp_abort_send(uint8_t destination, uint32_t pgn, uint8_t reason)
+{
+    uint8_t cm[8] = {TP_CM_ABORT, reason, 0xFF, 0xFF, 0xFF};
+
+    sys_put_le24(pgn, &cm[5]);
+    tp_cm_send(destination, cm);
+}
+
+/*****************************************************************************/
+/* Address claim */
+
+/*****************************************************************************/
+static void claim_send(void)
+{
+    uint8_t data[8];
+
+    sys_put_le64(n2k.name, data);
+    frame_send(BSP_N2K_PGN_ISO_ADDRESS_CLAIM, 6, n2k.address, BSP_N2K_ADDRESS_GLOBAL, data,
+               sizeof(data));
+}
+
+/*****************************************************************************/
+static void claim_start(uint8_t address)
+{
+    n2k.address = address;
+    n2k.state = BSP_N2K_STATE_CLAIMING;
+    claim_send();
+    k_work_reschedule(&claim_work, CLAIM_TIMEOUT);
+}
+
+/*****************************************************************************/
+static void claim_lost(void)
+{
+    if (n2k.name & ARBITRARY_ADDRESS_CAPABLE) {
+        for (int a = DYNAMIC_ADDRESS_FIRST; a <= DYNAMIC_ADDRESS_LAST; a++) {
+            if (!(n2k.claimed[a / 32] & BIT(a % 32))) {
+                LOG_INF("Address %u lost, claiming %u", n2k.address, a);
+                claim_start(a);
+                return;
+            }
+        }
+    }
+
+    LOG_WRN("Address %u lost, cannot claim", n2k.address);
+    k_work_cancel_delayable(&claim_work);
+    n2k.state = BSP_N2K_STATE_CANNOT_CLAIM;
+    n2k.address = BSP_N2K_ADDRESS_NULL;
+    claim_send();
+}
+
+/*****************************************************************************/
+static void claim_work_handler(struct k_work *work)
+{
+    ARG_UNUSED(work);
+
+    k_mutex_lock(&n2k_lock, K_FOREVER);
+    if (n2k.state == BSP_N2K_STATE_CLAIMING) {
+        n2k.state = BSP_N2K_STATE_CLAIMED;
+        LOG_INF("Address %u claimed", n2k.address);
+    }
+    k_mutex_unlock(&n2k_lock);
+}
+
+/*****************************************************************************/
+static void claim_received(uint8_t source, const uint8_t *data, uint8_t len)
+{
+    if (len < 8 || source >= BSP_N2K_ADDRESS_NULL) {
+        return;
+    }
+
+    uint64_t name = sys_get_le64(data);
+
+    k_mutex_lock(&n2k_lock, K_FOREVER);
+
+    n2k.claimed[source / 32] |= BIT(source % 32);
+
+    if (source == n2k.address && name != n2k.name &&
+        (n2k.state == BSP_N2K_STATE_CLAIMING || n2k.state == BSP_N2K_STATE_CLAIMED)) {
+        // The lower NAME wins the contested address
+        if (name < n2k.name) {
+            claim_lost();
+        } else {
+            claim_send();
+        }
+    }
+
+    k_mutex_unlock(&n2k_lock);
+}
+
+/*****************************************************************************/
+/* Reassembly */
+
+/*****************************************************************************/
+static struct rx_session *session_find(session_type_t type, uint8_t source, uint32_t pgn)
+{
+    for (int i = 0; i < SESSIONS_COUNT; i++) {
+        struct rx_session *s = &sessions[i];
+
+        if (s->type == type && s->source == source && (pgn == UINT32_MAX || s->pgn == pgn)) {
+            return s;
+        }
+    }
+
+    return NULL;
+}
+
+/*****************************************************************************/
+static struct rx_session *session_alloc(void)
+{
+    int64_t now = k_uptime_get();
+    struct rx_session *expired = NULL;
+
+    for (int i = 0; i < SESSIONS_COUNT; i++) {
+        struct rx_session *s = &sessions[i];
+
+        if (s->type == SESSION_FREE) {
+            return s;
+        }
+        if (expired == NULL && now > s->deadline) {
+            expired = s;
+        }
+    }
+
+    if (expired != NULL) {
+        n2k.stats.timeouts++;
+    }
+
+    return expired;
+}
+
+/*****************************************************************************/
+static void deliver(const struct bsp_n2k_handler *h, const struct bsp_n2k_msg *msg)
+{
+    if (h == NULL) {
+        h = handler_find(msg->pgn);
+    }
+
+    if (h == NULL) {
+        n2k.stats.unhandled++;
+        return;
+    }
+
+    n2k.stats.messages++;
+    h->handler(msg, h->user_data);
+}
+
+/*****************************************************************************/
+static void session_deliver(struct rx_session *s)
+{
+    struct bsp_n2k_msg msg = {
+        .pgn = s->pgn,
+        .priority = s->priority,
+        .source = s->source,
+        .destination = s->destination,
+        .len = s->size,
+        .data = s->data,
+    };
+
+    s->type = SESSION_FREE;
+    deliver(NULL, &msg);
+}
+
+/*****************************************************************************/
+static void fast_packet_rx(const struct bsp_n2k_handler *h, const struct bsp_n2k_msg *frame)
+{
+    if (frame->len < 2) {
+        return;
+    }
+
+    uint8_t seq = frame->data[0] >> 5;
+    uint8_t index = frame->data[0] & 0x1F;
+    struct rx_session *s = session_find(SESSION_FAST_PACKET, frame->source, frame->pgn);
+
+    if (index == 0) {
+        // Larger than 32 frames carry, dropped instead of delivered truncated
+        if (frame->data[1] > BSP_N2K_FAST_PACKET_MAX) {
+            if (s != NULL) {
+                s->type = SESSION_FREE;
+            }
+            n2k.stats.protocol_errs++;
+            return;
+        }
+
+        if (s == NULL) {
+            s = session_alloc();
+        }
+        if (s == NULL) {
+            n2k.stats.pool_full++;
+            return;
+        }
+
+        s->type = SESSION_FAST_PACKET;
+        s->pgn = frame->pgn;
+        s->priority = frame->priority;
+        s->source = frame->source;
+        s->destination = frame->destination;
+        s->seq = seq;
+        s->next = 1;
+        s->size = frame->data[1];
+        s->received = MIN(frame->len - 2, s->size);
+        memcpy(s->data, &frame->data[2], s->received);
+    } else {
+        if (s == NULL) {
+            return;
+        }
+        if (s->seq != seq || s->next != index) {
+            s->type = SESSION_FREE;
+            n2k.stats.sequence_errs++;
+            return;
+        }
+
+        uint16_t n = MIN(frame->len - 1, s->size - s->received);
+        memcpy(&s->data[s->received], &frame->data[1], n);
+        s->received += n;
+        s->next++;
+    }
+
+    s->deadline = k_uptime_get() + RX_TIMEOUT_MS;
+
+    if (s->received >= s->size) {
+        struct bsp_n2k_msg msg = {
+            .pgn = s->pgn,
+            .priority = s->priority,
+            .source = s->source,
+            .destination = s->destination,
+            .len = s->size,
+            .data = s->data,
+        };
+
+        s->type = SESSION_FREE;
+        deliver(h, &msg);
+    }
+}
+
+/*****************************************************************************/
+// Requests the next window, never more packets than the sender announced
+static void tp_cts_send(struct rx_session *s)
+{
+    if (s->next > s->packets) {
+        tp_abort_send(s->source, s->pgn, TP_ABORT_OTHER);
+        s->type = SESSION_FREE;
+        n2k.stats.protocol_errs++;
+        return;
+    }
+
+    uint8_t count = MIN(s->packets - s->next + 1, s->window_max);
+    uint8_t cm[8] = {TP_CM_CTS, count, s->next, 0xFF, 0xFF};
+
+    sys_put_le24(s->pgn, &cm[5]);
+    s->window_end = s->next + count - 1;
+    tp_cm_send(s->source, cm);
+}
+
+/*****************************************************************************/
+static void tp_cm_rx(const struct bsp_n2k_msg *frame)
+{
+    if (frame->len < 8) {
+        return;
+    }
+
+    const uint8_t *d = frame->data;
+    uint8_t control = d[0];
+    uint32_t pgn = sys_get_le24(&d[5]);
+    bool to_us = frame->destination == n2k.address;
+
+    if (control == TP_CM_RTS || control == TP_CM_BAM) {
+        session_type_t type = (control == TP_CM_BAM) ? SESSION_TP_BAM : SESSION_TP_CMDT;
+        uint16_t size = sys_get_le16(&d[1]);
+        uint8_t packets = d[3];
+
+        if (type == SESSION_TP_CMDT && !to_us) {
+            return;
+        }
+
+        // The announced packets must carry the whole message
+        if (packets == 0 || packets * 7 < size) {
+            n2k.stats.protocol_errs++;
+            if (type == SESSION_TP_CMDT) {
+                tp_abort_send(frame->source, pgn, TP_ABORT_OTHER);
+            }
+            return;
+        }
+
+        // A new announcement from the same source replaces a stale transfer
+        struct rx_session *s = session_find(type, frame->source, UINT32_MAX);
+        if (s == NULL) {
+            s = session_alloc();
+        }
+
+        if (s == NULL || size > TP_MAX_SIZE) {
+            n2k.stats.pool_full++;
+            if (type == SESSION_TP_CMDT) {
+                tp_abort_send(frame->source, pgn, TP_ABORT_RESOURCES);
+            }
+            return;
+        }
+
+        s->type = type;
+        s->pgn = pgn;
+        s->priority = frame->priority;
+        s->source = frame->source;
+        s->destination = frame->destination;
+        s->size = size;
+        s->received = 0;
+        s->packets = packets;
+        s->next = 1;
+        s->window_max = (d[4] == 0) ? 0xFF : d[4];
+        s->deadline = k_uptime_get() + RX_TIMEOUT_MS;
+
+        if (type == SESSION_TP_CMDT) {
+            tp_cts_send(s);
+        }
+    } else if (control == TP_CM_ABORT) {
+        struct rx_session *s = session_find(SESSION_TP_CMDT, frame->source, pgn);
+        if (s != NULL) {
+            s->type = SESSION_FREE;
+        }
+    }
+}
+
+/*****************************************************************************/
+static void tp_dt_rx(const struct bsp_n2k_msg *frame)
+{
+    if (frame->len < 8) {
+        return;
+    }
+
+    session_type_t type =
+        (frame->destination == BSP_N2K_ADDRESS_GLOBAL) ? SESSION_TP_BAM : SESSION_TP_CMDT;
+    struct rx_session *s = session_find(type, frame->source, UINT32_MAX);
+
+    if (s == NULL) {
+        return;
+    }
+
+    if (frame->data[0] != s->next) {
+        if (type == SESSION_TP_CMDT) {
+            tp_abort_send(s->source, s->pgn, TP_ABORT_RESOURCES);
+        }
+        s->type = SESSION_FREE;
+        n2k.stats.sequence_errs++;
+        return;
+    }
+
+    uint16_t n = MIN(7, s->size - s->received);
+    memcpy(&s->data[s->received], &frame->data[1], n);
+    s->received += n;
+    s->next++;
+    s->deadline = k_uptime_get() + RX_TIMEOUT_MS;
+
+    if (s->received >= s->size) {
+        if (type == SESSION_TP_CMDT) {
+            uint8_t cm[8] = {TP_CM_EOMA, 0, 0, s->packets, 0xFF};
+
+            sys_put_le16(s->size, &cm[1]);
+            sys_put_le24(s->pgn, &cm[5]);
+            tp_cm_send(s->source, cm);
+        }
+        session_deliver(s);
+    } else if (type == SESSION_TP_CMDT && s->next > s->window_end) {
+        tp_cts_send(s);
+    }
+}
+
+/*****************************************************************************/
+static void request_rx(const struct bsp_n2k_msg *frame)
+{
+    if (frame->len < 3) {
+        return;
+    }
+
+    if (sys_get_le24(frame->data) == BSP_N2K_PGN_ISO_ADDRESS_CLAIM) {
+        k_mutex_lock(&n2k_lock, K_FOREVER);
+        if (n2k.state != BSP_N2K_STATE_IDLE) {
+            claim_send();
+        }
+        k_mutex_unlock(&n2k_lock);
+        return;
+    }
+
+    deliver(NULL, frame);
+}
+
+/*****************************************************************************/
+// bsp_can handler, runs in the CAN dispatch thread
+static void rx_frame(const struct device *dev, const struct can_frame *frame, void *user_data)
+{
+    ARG_UNUSED(dev);
+    ARG_UNUSED(user_data);
+
+    if (frame->flags & CAN_FRAME_RTR) {
+        return;
+    }
+
+    n2k.stats.frames++;
+
+    struct bsp_n2k_msg msg = {
+        .pgn = (frame->id >> 8) & 0x3FFFF,
+        .priority = (frame->id >> 26) & 0x7,
+        .source = frame->id & 0xFF,
+        .destination = BSP_N2K_ADDRESS_GLOBAL,
+        .len = can_dlc_to_bytes(frame->dlc),
+        .data = frame->data,
+    };
+
+    if (((msg.pgn >> 8) & 0xFF) < 240) {
+        msg.destination = msg.pgn & 0xFF;
+        msg.pgn &= 0x3FF00;
+
+        if (msg.destination != BSP_N2K_ADDRESS_GLOBAL && msg.destination != n2k.address) {
+            return;
+        }
+    }
+
+    switch (msg.pgn) {
+    case BSP_N2K_PGN_ISO_ADDRESS_CLAIM:
+        claim_received(msg.source, msg.data, msg.len);
+        break;
+    case BSP_N2K_PGN_ISO_REQUEST:
+        request_rx(&msg);
+        break;
+    case BSP_N2K_PGN_TP_CM:
+        tp_cm_rx(&msg);
+        break;
+    case BSP_N2K_PGN_TP_DT:
+        tp_dt_rx(&msg);
+        break;
+    default: {
+        const struct bsp_n2k_handler *h = handler_find(msg.pgn);
+
+        if (h == NULL) {
+            n2k.stats.unhandled++;
+        } else if (h->flags & BSP_N2K_FAST_PACKET) {
+            fast_packet_rx(h, &msg);
+        } else {
+            deliver(h, &msg);
+        }
+        break;
+    }
+    }
+}
+
+/*****************************************************************************/
+int bsp_n2k_start(uint64_t name, uint8_t preferred_address)
+{
+    if (n2k.dev == NULL) {
+        LOG_ERR("No NMEA 2000 controller");
+        return -ENODEV;
+    }
+
+    if (preferred_address >= BSP_N2K_ADDRESS_NULL) {
+        return -EINVAL;
+    }
+
+    int err = bsp_can_attach(n2k.dev, rx_table, ARRAY_SIZE(rx_table));
+    if (err && err != -EALREADY) {
+        return err;
+    }
+
+    err = can_start(n2k.dev);
+    if (err && err != -EALREADY) {
+        LOG_ERR("CAN start failed (err %d)", err);
+        return err;
+    }
+
+    k_mutex_lock(&n2k_lock, K_FOREVER);
+    n2k.name = name;
+    claim_start(preferred_address);
+    k_mutex_unlock(&n2k_lock);
+
+    return 0;
+}
+
+/*****************************************************************************/
+int bsp_n2k_send(uint32_t pgn, uint8_t priority, uint8_t destination, const uint8_t *data,
+                 size_t len)
+{
+    if (len > BSP_N2K_FAST_PACKET_MAX) {
+        return -EMSGSIZE;
+    }
+
+    k_mutex_lock(&n2k_lock, K_FOREVER);
+
+    if (n2k.state != BSP_N2K_STATE_CLAIMED) {
+        k_mutex_unlock(&n2k_lock);
+        return -EAGAIN;
+    }
+
+    int err = 0;
+    if (len <= 8) {
+        err = frame_send(pgn, priority, n2k.address, destination, data, len);
+    } else {
+        // Fast-packet: frame 0 carries the length and 6 bytes, the rest 7 bytes each
+        uint8_t seq = n2k.fast_packet_seq++ & 0x7;
+        uint8_t buf[8];
+        size_t sent = 0;
+
+        for (uint8_t index = 0; sent < len && index < 32; index++) {
+            size_t n;
+
+            memset(buf, 0xFF, sizeof(buf));
+            buf[0] = (seq << 5) | index;
+            if (index == 0) {
+                n = MIN(len, 6);
+                buf[1] = len;
+                memcpy(&buf[2], data, n);
+            } else {
+                n = MIN(len - sent, 7);
+                memcpy(&buf[1], &data[sent], n);
+            }
+
+            err = frame_send(pgn, priority, n2k.address, destination, buf, sizeof(buf));
+            if (err) {
+                break;
+            }
+            sent += n;
+        }
+    }
+
+    k_mutex_unlock(&n2k_lock);
+
+    return err;
+}
+
+/*****************************************************************************/
+uint8_t bsp_n2k_address_get(void)
+{
+    return (n2k.state == BSP_N2K_STATE_CLAIMED) ? n2k.address : BSP_N2K_ADDRESS_NULL;
+}
+
+/*****************************************************************************/
+bsp_n2k_state_t bsp_n2k_state_get(void)
+{
+    return n2k.state;
+}
+
+/*****************************************************************************/
+int bsp_n2k_stats_get(struct bsp_n2k_stats *stats)
+{
+    if (stats == NULL) {
+        return -EINVAL;
+    }
+
+    *stats = n2k.stats;
+
+    return 0;
+}
+
+/*****************************************************************************/
+static int bsp_n2k_init(void)
+{
+    int count = 0;
+
+    STRUCT_SECTION_COUNT(bsp_n2k_handler, &count);
+
+    if (count > HASH_SIZE / 2) {
+        LOG_ERR("%d PGN handlers exceed half of the hash table (%d)", count, HASH_SIZE);
+        return -ENOSPC;
+    }
+
+    STRUCT_SECTION_FOREACH(bsp_n2k_handler, h) {
+        uint32_t slot = pgn_hash(h->pgn);
+
+        if (handler_find(h->pgn) != NULL) {
+            LOG_ERR("Duplicate handler for PGN %u", h->pgn);
+            continue;
+        }
+
+        while (pgn_index[slot] != 0) {
+            slot = (slot + 1) & HASH_MASK;
+        }
+
+        const struct bsp_n2k_handler *first;
+        STRUCT_SECTION_GET(bsp_n2k_handler, 0, &first);
+        pgn_index[slot] = (uint16_t)(h - first) + 1;
+    }
+
+    LOG_DBG("%d PGN handlers", count);
+
+    return 0;
+}
+
+SYS_INIT(bsp_n2k_init, APPLICATION, 33);
+
+/*****************************************************************************/
+/* Shell */
+#ifdef CONFIG_SHELL
+static int cmd_n2k_status(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    static const char *const state_names[] = {"idle", "claiming", "claimed", "cannot claim"};
+    int busy = 0;
+
+    for (int i = 0; i < SESSIONS_COUNT; i++) {
+        busy += (sessions[i].type != SESSION_FREE);
+    }
+
+    shell_print(sh, "State %s, address %u, NAME 0x%016llx", state_names[n2k.state], n2k.address,
+                (unsigned long long)n2k.name);
+    shell_print(sh, "Frames %u, messages %u, unhandled %u, tx errors %u", n2k.stats.frames,
+                n2k.stats.messages, n2k.stats.unhandled, n2k.stats.tx_errors);
+    shell_print(sh, "Reassembly %d/%d busy, pool full %u, sequence errors %u, timeouts %u", busy,
+                SESSIONS_COUNT, n2k.stats.pool_full, n2k.stats.sequence_errs,
+                n2k.stats.timeouts);
+    shell_print(sh, "Protocol errors %u", n2k.stats.protocol_errs);
+
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_n2k,
+                               SHELL_CMD_ARG(status, NULL, "Show address claim and statistics",
+                                             cmd_n2k_status, 1, 0),
+                               SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(n2k, &sub_n2k, "NMEA 2000", NULL);
+#endif /* CONFIG_SHELL */
@@ -0,0 +1,106 @@
+#ifndef BSP_N2K_H_
+#define BSP_N2K_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <zephyr/sys/iterable_sections.h>
+#include <zephyr/sys/util.h>
+
+#define BSP_N2K_ADDRESS_GLOBAL 0xFF
+#define BSP_N2K_ADDRESS_NULL   0xFE
+
+#define BSP_N2K_PGN_ISO_ACK           59392
+#define BSP_N2K_PGN_ISO_REQUEST       59904
+#define BSP_N2K_PGN_TP_DT             60160
+#define BSP_N2K_PGN_TP_CM             60416
+#define BSP_N2K_PGN_ISO_ADDRESS_CLAIM 60928
+
+#define BSP_N2K_FAST_PACKET_MAX 223
+
+/// @brief Handler flag: the PGN is transported with the NMEA 2000 fast-packet
+/// protocol and is reassembled before the handler is called
+#define BSP_N2K_FAST_PACKET BIT(0)
+
+struct bsp_n2k_msg {
+    uint32_t pgn;
+    uint8_t priority;
+    uint8_t source;
+    uint8_t destination;
+    uint16_t len;
+    const uint8_t *data;
+};
+
+/// @brief PGN handler, invoked from the CAN dispatch thread. Message data is
+/// only valid for the duration of the call.
+typedef void (*bsp_n2k_handler_t)(const struct bsp_n2k_msg *msg, void *user_data);
+
+struct bsp_n2k_handler {
+    uint32_t pgn;
+    uint32_t flags;
+    bsp_n2k_handler_t handler;
+    void *user_data;
+};
+
+/// @brief Registers a PGN handler at build time. One handler per PGN.
+#define BSP_N2K_HANDLER_DEFINE(_name, _pgn, _flags, _handler, _user_data)                        \
+    static const STRUCT_SECTION_ITERABLE(bsp_n2k_handler, _name) = {                             \
+        .pgn = (_pgn),                                                                           \
+        .flags = (_flags),                                                                       \
+        .handler = (_handler),                                                                   \
+        .user_data = (_user_data),                                                               \
+    }
+
+typedef enum {
+    BSP_N2K_STATE_IDLE,
+    BSP_N2K_STATE_CLAIMING,
+    BSP_N2K_STATE_CLAIMED,
+    BSP_N2K_STATE_CANNOT_CLAIM,
+    BSP_N2K_STATE_MAX
+} bsp_n2k_state_t;
+
+struct bsp_n2k_stats {
+    uint32_t frames;
+    uint32_t messages;      // Messages delivered to handlers
+    uint32_t unhandled;     // Frames of PGNs without a handler
+    uint32_t pool_full;     // Multi-frame messages dropped for lack of a reassembly slot
+    uint32_t sequence_errs; // Multi-frame messages dropped on a missing frame
+    uint32_t protocol_errs; // Multi-frame messages dropped on inconsistent size fields
+    uint32_t timeouts;
+    uint32_t tx_errors;
+};
+
+/*****************************************************************************/
+
+/// @brief Attaches to the NMEA 2000 controller and starts the ISO address claim
+/// @param name 64-bit ISO NAME of this device
+/// @param preferred_address Source address to claim first
+/// @return 0 on success, -ENODEV if there is no NMEA 2000 controller
+int bsp_n2k_start(uint64_t name, uint8_t preferred_address);
+
+/// @brief Sends a message. Messages longer than 8 bytes are sent as fast-packet.
+/// @param pgn
+/// @param priority 0 (highest) to 7
+/// @param destination Destination address for PDU1 PGNs, ignored for PDU2
+/// @param data
+/// @param len At most BSP_N2K_FAST_PACKET_MAX bytes
+/// @return 0 on success, -EAGAIN while no address is claimed, -EMSGSIZE if too long
+int bsp_n2k_send(uint32_t pgn, uint8_t priority, uint8_t destination, const uint8_t *data,
+                 size_t len);
+
+/// @brief Returns the claimed source address
+/// @param
+/// @return BSP_N2K_ADDRESS_NULL while no address is claimed
+uint8_t bsp_n2k_address_get(void);
+
+/// @brief Returns the address claim state
+/// @param
+/// @return
+bsp_n2k_state_t bsp_n2k_state_get(void);
+
+/// @brief Returns protocol statistics
+/// @param stats
+/// @return 0 on success
+int bsp_n2k_stats_get(struct bsp_n2k_stats *stats);
+
+#endif // BSP_N2K_H_
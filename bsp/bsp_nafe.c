@@ -0,0 +1,247 @@
+#include <errno.h>
+
+#include <zephyr/device.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+
+#include "bsp.h"
+#include "bsp_nafe.h"
+
+LOG_MODULE_REGISTER(bsp_nafe, CONFIG_LOG_DEFAULT_LEVEL);
+
+/*****************************************************************************/
+/* Device tree */
+#define NAFE13388 DT_NODELABEL(nafe13388)
+
+/*****************************************************************************/
+/* Events */
+#define NAFE_EVT_READY BIT(0)
+#define NAFE_EVT_FAILED BIT(1)
+
+#define NAFE_RESET_PULSE_US 10
+
+/*****************************************************************************/
+/* Private objects */
+static const struct device *nafe = DEVICE_DT_GET(NAFE13388);
+static struct gpio_dt_spec const nafe_reset = GPIO_DT_SPEC_GET_OR(NAFE13388, reset_gpios, {0});
+
+static const char *const phase_names[BSP_NAFE_PHASE_MAX] = {
+    [BSP_NAFE_PHASE_RAIL_ENABLE] = "rails",
+    [BSP_NAFE_PHASE_SETTLE] = "settle",
+    [BSP_NAFE_PHASE_RESET] = "reset",
+    [BSP_NAFE_PHASE_INIT] = "init",
+    [BSP_NAFE_PHASE_PROFILE_LOAD] = "profile",
+};
+
+static struct {
+    struct k_work_delayable work;
+    struct k_event events;
+    bsp_nafe_state_t state;
+    bsp_nafe_phase_t phase;
+    uint32_t phase_start;
+    uint32_t phase_time_us[BSP_NAFE_PHASE_MAX];
+    bsp_nafe_profile_load_cb_t profile_load;
+    bsp_nafe_ready_cb_t ready;
+} bringup;
+
+/*****************************************************************************/
+static void phase_enter(bsp_nafe_phase_t phase)
+{
+    bringup.phase = phase;
+    bringup.phase_start = k_cycle_get_32();
+}
+
+/*****************************************************************************/
+static void phase_done(void)
+{
+    uint32_t cycles = k_cycle_get_32() - bringup.phase_start;
+
+    bringup.phase_time_us[bringup.phase] = k_cyc_to_us_floor32(cycles);
+}
+
+/*****************************************************************************/
+static void bringup_finish(int err)
+{
+    uint32_t total_us = 0;
+
+    for (int i = 0; i < BSP_NAFE_PHASE_MAX; i++) {
+        total_us += bringup.phase_time_us[i];
+    }
+
+    if (err) {
+        bringup.state = BSP_NAFE_STATE_FAILED;
+        LOG_ERR("NAFE bring-up failed in phase '%s' (err %d)", phase_names[bringup.phase], err);
+        k_event_post(&bringup.events, NAFE_EVT_FAILED);
+    } else {
+        bringup.state = BSP_NAFE_STATE_READY;
+        LOG_INF("NAFE ready in %u us (rails %u, settle %u, reset %u, init %u, profile %u)",
+                total_us, bringup.phase_time_us[BSP_NAFE_PHASE_RAIL_ENABLE],
+                bringup.phase_time_us[BSP_NAFE_PHASE_SETTLE],
+                bringup.phase_time_us[BSP_NAFE_PHASE_RESET],
+                bringup.phase_time_us[BSP_NAFE_PHASE_INIT],
+                bringup.phase_time_us[BSP_NAFE_PHASE_PROFILE_LOAD]);
+        k_event_post(&bringup.events, NAFE_EVT_READY);
+    }
+
+    if (bringup.ready) {
+        bringup.ready(err);
+    }
+}
+
+/*****************************************************************************/
+// The chip was just reset and lost its configuration, so the driver init runs
+// again on every start. device_init() only runs a deferred device once and
+// returns -EALREADY afterwards, hence the device state is cleared first.
+static int nafe_device_init(void)
+{
+    nafe->state->initialized = false;
+    nafe->state->init_res = 0;
+
+    return device_init(nafe);
+}
+
+/*****************************************************************************/
+// Bring-up state machine. Waits are done by rescheduling the work item, so the
+// workqueue thread is never blocked while rails settle or the chip recovers.
+static void bringup_work_handler(struct k_work *item)
+{
+    ARG_UNUSED(item);
+
+    int err = 0;
+
+    switch (bringup.phase) {
+    case BSP_NAFE_PHASE_RAIL_ENABLE: {
+        err = bsp_nafe_power_on();
+        phase_done();
+        if (err) {
+            break;
+        }
+
+        phase_enter(BSP_NAFE_PHASE_SETTLE);
+        k_work_schedule(&bringup.work, K_MSEC(CONFIG_BSP_NAFE_RAIL_SETTLE_MS));
+        return;
+    }
+    case BSP_NAFE_PHASE_SETTLE: {
+        phase_done();
+
+        phase_enter(BSP_NAFE_PHASE_RESET);
+        if (nafe_reset.port != NULL) {
+            // RESETB is active low on the pin regardless of the DT flags
+            err = gpio_pin_configure_dt(&nafe_reset, GPIO_OUTPUT);
+            if (err == 0) {
+                gpio_pin_set_raw(nafe_reset.port, nafe_reset.pin, 0);
+                k_busy_wait(NAFE_RESET_PULSE_US);
+                gpio_pin_set_raw(nafe_reset.port, nafe_reset.pin, 1);
+            }
+        }
+        if (err) {
+            phase_done();
+            break;
+        }
+
+        k_work_schedule(&bringup.work, K_MSEC(CONFIG_BSP_NAFE_RESET_RECOVERY_MS));
+        return;
+    }
+    case BSP_NAFE_PHASE_RESET: {
+        phase_done();
+
+        phase_enter(BSP_NAFE_PHASE_INIT);
+        err = nafe_device_init();
+        phase_done();
+        if (err) {
+            break;
+        }
+
+        phase_enter(BSP_NAFE_PHASE_PROFILE_LOAD);
+        if (bringup.profile_load) {
+            err = bringup.profile_load(nafe);
+        }
+        phase_done();
+        break;
+    }
+    default: {
+        err = -EINVAL;
+        break;
+    }
+    }
+
+    bringup_finish(err);
+}
+
+/*****************************************************************************/
+int bsp_nafe_start(bsp_nafe_profile_load_cb_t profile_load, bsp_nafe_ready_cb_t ready)
+{
+    if (bringup.state == BSP_NAFE_STATE_STARTING || bringup.state == BSP_NAFE_STATE_READY) {
+        return -EBUSY;
+    }
+
+    k_event_clear(&bringup.events, NAFE_EVT_READY | NAFE_EVT_FAILED);
+
+    for (int i = 0; i < BSP_NAFE_PHASE_MAX; i++) {
+        bringup.phase_time_us[i] = 0;
+    }
+
+    bringup.profile_load = profile_load;
+    bringup.ready = ready;
+    bringup.state = BSP_NAFE_STATE_STARTING;
+
+    phase_enter(BSP_NAFE_PHASE_RAIL_ENABLE);
+    k_work_schedule(&bringup.work, K_NO_WAIT);
+
+    return 0;
+}
+
+/*****************************************************************************/
+int bsp_nafe_stop(void)
+{
+    struct k_work_sync sync;
+
+    k_work_cancel_delayable_sync(&bringup.work, &sync);
+    k_event_clear(&bringup.events, NAFE_EVT_READY | NAFE_EVT_FAILED);
+    bringup.state = BSP_NAFE_STATE_OFF;
+
+    return bsp_nafe_power_off();
+}
+
+/*****************************************************************************/
+int bsp_nafe_wait_ready(k_timeout_t timeout)
+{
+    uint32_t events =
+        k_event_wait(&bringup.events, NAFE_EVT_READY | NAFE_EVT_FAILED, false, timeout);
+
+    if (events & NAFE_EVT_READY) {
+        return 0;
+    }
+
+    return (events & NAFE_EVT_FAILED) ? -EIO : -EAGAIN;
+}
+
+/*****************************************************************************/
+bsp_nafe_state_t bsp_nafe_state_get(void)
+{
+    return bringup.state;
+}
+
+/*****************************************************************************/
+uint32_t bsp_nafe_phase_time_get(bsp_nafe_phase_t phase)
+{
+    if (phase >= BSP_NAFE_PHASE_MAX) {
+        return 0;
+    }
+
+    return bringup.phase_time_us[phase];
+}
+
+/*****************************************************************************/
+static int bsp_nafe_init(void)
+{
+    k_work_init_delayable(&bringup.work, bringup_work_handler);
+    k_event_init(&bringup.events);
+    bringup.state = BSP_NAFE_STATE_OFF;
+
+    return 0;
+}
+
+SYS_INIT(bsp_nafe_init, APPLICATION, 31);
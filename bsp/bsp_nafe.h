@@ -0,0 +1,65 @@
+#ifndef BSP_NAFE_H_
+#define BSP_NAFE_H_
+
+#include <stdint.h>
+
+#include <zephyr/device.h>
+#include <zephyr/kernel.h>
+
+typedef enum {
+    BSP_NAFE_PHASE_RAIL_ENABLE,
+    BSP_NAFE_PHASE_SETTLE,
+    BSP_NAFE_PHASE_RESET,
+    BSP_NAFE_PHASE_INIT,
+    BSP_NAFE_PHASE_PROFILE_LOAD,
+    BSP_NAFE_PHASE_MAX
+} bsp_nafe_phase_t;
+
+typedef enum {
+    BSP_NAFE_STATE_OFF,
+    BSP_NAFE_STATE_STARTING,
+    BSP_NAFE_STATE_READY,
+    BSP_NAFE_STATE_FAILED,
+    BSP_NAFE_STATE_MAX
+} bsp_nafe_state_t;
+
+/// @brief Loads channel profiles into the freshly initialised NAFE device.
+/// Invoked on the workqueue thread in the profile load phase.
+/// @return 0 on success
+typedef int (*bsp_nafe_profile_load_cb_t)(const struct device *nafe);
+
+/// @brief Invoked on the workqueue thread once the bring-up sequence finishes
+/// @param err 0 when the NAFE is ready, negative error code of the failed phase otherwise
+typedef void (*bsp_nafe_ready_cb_t)(int err);
+
+/*****************************************************************************/
+
+/// @brief Starts the asynchronous NAFE bring-up sequence (rail enable, settle,
+/// reset, device init, channel profile load) and returns immediately. The
+/// driver is initialised again on every start, also after bsp_nafe_stop().
+/// @param profile_load Optional channel profile loader, may be NULL
+/// @param ready Optional completion callback, may be NULL
+/// @return 0 on success, -EBUSY if a sequence is already running or finished
+int bsp_nafe_start(bsp_nafe_profile_load_cb_t profile_load, bsp_nafe_ready_cb_t ready);
+
+/// @brief Cancels a running sequence and switches the NAFE rails off
+/// @param
+/// @return 0 on success
+int bsp_nafe_stop(void);
+
+/// @brief Blocks until the bring-up sequence finishes
+/// @param timeout
+/// @return 0 when ready, -EIO if the sequence failed, -EAGAIN on timeout
+int bsp_nafe_wait_ready(k_timeout_t timeout);
+
+/// @brief Returns the state of the bring-up sequence
+/// @param
+/// @return
+bsp_nafe_state_t bsp_nafe_state_get(void);
+
+/// @brief Returns the time spent in a bring-up phase during the last sequence
+/// @param phase
+/// @return Duration in microseconds, 0 if the phase did not run
+uint32_t bsp_nafe_phase_time_get(bsp_nafe_phase_t phase);
+
+#endif // BSP_NAFE_H_
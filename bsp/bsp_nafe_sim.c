@@ -0,0 +1,461 @@
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/util.h>
+
+#include "cmdline.h"
+#include "posix_native_task.h"
+
+#include "bsp_nafe_sim.h"
+#include "bsp_nafe_sim_bottom.h"
+
+LOG_MODULE_REGISTER(bsp_nafe_sim, CONFIG_LOG_DEFAULT_LEVEL);
+
+/*****************************************************************************/
+/* Generator */
+#define TICK_MS CONFIG_BSP_NAFE_SIM_TICK_MS
+#define BLOCK_MAX CONFIG_BSP_NAFE_SIM_BLOCK_MAX
+#define REPLAY_COLUMNS_MAX 16
+#define SPEED_MAX 1000
+#define TWO_PI 6.28318531f
+
+/*****************************************************************************/
+/* Private objects */
+struct sim_channel {
+    struct bsp_nafe_sim_channel_cfg cfg;
+    bool restart;
+    uint32_t sample_acc; // Fractional samples, in 1/1000 of a sample
+    float phase;         // Fraction of the signal period, 0..1
+    uint32_t noise_state;
+    uint64_t samples;
+    size_t fill;
+    int32_t block[BLOCK_MAX];
+};
+
+static struct sim_channel channels[BSP_NAFE_SIM_CHANNELS_COUNT];
+
+static struct k_spinlock sim_lock;
+static bsp_nafe_sim_block_cb_t block_cb;
+static void *block_cb_user_data;
+static uint32_t sim_speed = 1;
+static uint32_t replay_rate_hz;
+static uint32_t replay_acc;
+
+/* Command line options */
+static char *opt_replay_path;
+static uint32_t opt_replay_rate_hz = 1000;
+static uint32_t opt_speed = 1;
+
+/*****************************************************************************/
+static int32_t code_clamp(int64_t value)
+{
+    return (int32_t)CLAMP(value, BSP_NAFE_SIM_CODE_MIN, BSP_NAFE_SIM_CODE_MAX);
+}
+
+/*****************************************************************************/
+static uint32_t xorshift32(uint32_t *state)
+{
+    uint32_t x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+
+    return x;
+}
+
+/*****************************************************************************/
+static int32_t wave_sample(struct sim_channel *ch, const struct bsp_nafe_sim_channel_cfg *cfg)
+{
+    int64_t value = cfg->offset;
+
+    switch (cfg->wave) {
+    case BSP_NAFE_SIM_WAVE_SINE:
+        value += (int64_t)(cfg->amplitude * sinf(TWO_PI * ch->phase));
+        break;
+    case BSP_NAFE_SIM_WAVE_STEP:
+        value += (ch->phase < 0.5f) ? cfg->amplitude : -cfg->amplitude;
+        break;
+    case BSP_NAFE_SIM_WAVE_RAMP:
+        value += (int64_t)(cfg->amplitude * (2.0f * ch->phase - 1.0f));
+        break;
+    case BSP_NAFE_SIM_WAVE_NOISE: {
+        uint32_t span = 2U * (uint32_t)abs(cfg->amplitude) + 1U;
+        value += (int64_t)(xorshift32(&ch->noise_state) % span) - abs(cfg->amplitude);
+        break;
+    }
+    default:
+        break;
+    }
+
+    ch->phase += (float)cfg->freq_mhz / 1000.0f / (float)cfg->rate_hz;
+    if (ch->phase >= 1.0f) {
+        ch->phase -= floorf(ch->phase);
+    }
+
+    return code_clamp(value);
+}
+
+/*****************************************************************************/
+static void block_push(uint8_t channel, struct sim_channel *ch, int32_t code, bool flush)
+{
+    ch->block[ch->fill++] = code;
+    ch->samples++;
+
+    if (ch->fill == BLOCK_MAX || flush) {
+        if (block_cb) {
+            block_cb(channel, bsp_ts_now(), ch->block, ch->fill, block_cb_user_data);
+        }
+        ch->fill = 0;
+    }
+}
+
+/*****************************************************************************/
+static uint32_t samples_due(uint32_t rate_hz, uint32_t *acc)
+{
+    uint32_t due = rate_hz * TICK_MS + *acc;
+
+    *acc = due % 1000;
+
+    return due / 1000;
+}
+
+/*****************************************************************************/
+static void replay_tick(const struct bsp_nafe_sim_channel_cfg cfg[], uint32_t rate_hz)
+{
+    int32_t frame[REPLAY_COLUMNS_MAX];
+    uint32_t frames = samples_due(rate_hz, &replay_acc);
+
+    for (uint32_t f = 0; f < frames; f++) {
+        int columns = bsp_nafe_sim_replay_read_bottom(frame, ARRAY_SIZE(frame));
+
+        if (columns <= 0) {
+            return;
+        }
+
+        for (uint8_t i = 0; i < BSP_NAFE_SIM_CHANNELS_COUNT; i++) {
+            if (cfg[i].wave != BSP_NAFE_SIM_WAVE_REPLAY || cfg[i].column >= columns) {
+                continue;
+            }
+
+            block_push(i, &channels[i], code_clamp(frame[cfg[i].column]), f == frames - 1);
+        }
+    }
+}
+
+/*****************************************************************************/
+static void generator_tick(void)
+{
+    struct bsp_nafe_sim_channel_cfg cfg[BSP_NAFE_SIM_CHANNELS_COUNT];
+    bool replay = false;
+
+    k_spinlock_key_t key = k_spin_lock(&sim_lock);
+    uint32_t replay_rate = replay_rate_hz;
+    for (uint8_t i = 0; i < BSP_NAFE_SIM_CHANNELS_COUNT; i++) {
+        struct sim_channel *ch = &channels[i];
+
+        if (ch->restart) {
+            ch->restart = false;
+            ch->sample_acc = 0;
+            ch->phase = 0.0f;
+            ch->fill = 0;
+        }
+        cfg[i] = ch->cfg;
+        replay |= (cfg[i].wave == BSP_NAFE_SIM_WAVE_REPLAY);
+    }
+    k_spin_unlock(&sim_lock, key);
+
+    for (uint8_t i = 0; i < BSP_NAFE_SIM_CHANNELS_COUNT; i++) {
+        struct sim_channel *ch = &channels[i];
+
+        if (cfg[i].wave == BSP_NAFE_SIM_WAVE_OFF || cfg[i].wave == BSP_NAFE_SIM_WAVE_REPLAY ||
+            cfg[i].rate_hz == 0) {
+            continue;
+        }
+
+        uint32_t due = samples_due(cfg[i].rate_hz, &ch->sample_acc);
+
+        for (uint32_t n = 0; n < due; n++) {
+            block_push(i, ch, wave_sample(ch, &cfg[i]), n == due - 1);
+        }
+    }
+
+    if (replay && replay_rate > 0) {
+        replay_tick(cfg, replay_rate);
+    }
+}
+
+/*****************************************************************************/
+// Generates one tick worth of samples per channel, paced against absolute
+// deadlines so a slow consumer does not make the signal drift. Each deadline
+// is computed from the start, rounding does not add up over the ticks.
+static void generator_thread(void *p1, void *p2, void *p3)
+{
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    int64_t start = k_uptime_ticks();
+    uint64_t ticks = 0;
+    uint32_t speed = sim_speed;
+
+    for (;;) {
+        generator_tick();
+
+        if (sim_speed != speed) {
+            // Start over from now at the new speed
+            speed = sim_speed;
+            start = k_uptime_ticks();
+            ticks = 0;
+        }
+        ticks++;
+
+        int64_t deadline =
+            start + (int64_t)k_us_to_ticks_ceil64(ticks * TICK_MS * USEC_PER_MSEC / speed);
+        k_sleep(K_TIMEOUT_ABS_TICKS(deadline));
+    }
+}
+
+K_THREAD_DEFINE(nafe_sim_thread, CONFIG_BSP_NAFE_SIM_THREAD_STACK_SIZE, generator_thread, NULL,
+                NULL, NULL, CONFIG_BSP_NAFE_SIM_THREAD_PRIORITY, 0, 0);
+
+/*****************************************************************************/
+int bsp_nafe_sim_channel_set(uint8_t channel, const struct bsp_nafe_sim_channel_cfg *cfg)
+{
+    if (channel >= BSP_NAFE_SIM_CHANNELS_COUNT || cfg == NULL ||
+        cfg->wave >= BSP_NAFE_SIM_WAVE_MAX) {
+        return -EINVAL;
+    }
+
+    if (cfg->wave != BSP_NAFE_SIM_WAVE_OFF && cfg->wave != BSP_NAFE_SIM_WAVE_REPLAY &&
+        cfg->rate_hz == 0) {
+        return -EINVAL;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&sim_lock);
+    channels[channel].cfg = *cfg;
+    channels[channel].restart = true;
+    channels[channel].noise_state = 0x9E3779B9U ^ channel;
+    k_spin_unlock(&sim_lock, key);
+
+    return 0;
+}
+
+/*****************************************************************************/
+int bsp_nafe_sim_callback_set(bsp_nafe_sim_block_cb_t cb, void *user_data)
+{
+    k_spinlock_key_t key = k_spin_lock(&sim_lock);
+    block_cb = cb;
+    block_cb_user_data = user_data;
+    k_spin_unlock(&sim_lock, key);
+
+    return 0;
+}
+
+/*****************************************************************************/
+int bsp_nafe_sim_speed_set(uint32_t speed)
+{
+    if (speed == 0 || speed > SPEED_MAX) {
+        return -EINVAL;
+    }
+
+    sim_speed = speed;
+
+    return 0;
+}
+
+/*****************************************************************************/
+int bsp_nafe_sim_replay_open(const char *path, uint32_t rate_hz)
+{
+    if (path == NULL || rate_hz == 0) {
+        return -EINVAL;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&sim_lock);
+    replay_rate_hz = 0;
+    k_spin_unlock(&sim_lock, key);
+
+    if (bsp_nafe_sim_replay_open_bottom(path)) {
+        LOG_ERR("Cannot open replay file %s", path);
+        return -ENOENT;
+    }
+
+    key = k_spin_lock(&sim_lock);
+    replay_rate_hz = rate_hz;
+    replay_acc = 0;
+    k_spin_unlock(&sim_lock, key);
+
+    LOG_INF("Replaying %s at %u Hz", path, rate_hz);
+
+    return 0;
+}
+
+/*****************************************************************************/
+uint64_t bsp_nafe_sim_samples_get(uint8_t channel)
+{
+    if (channel >= BSP_NAFE_SIM_CHANNELS_COUNT) {
+        return 0;
+    }
+
+    return channels[channel].samples;
+}
+
+/*****************************************************************************/
+/* Command line */
+static void nafe_sim_options(void)
+{
+    static struct args_struct_t options[] = {
+        {.option = "nafe-replay",
+         .name = "path",
+         .type = 's',
+         .dest = (void *)&opt_replay_path,
+         .descript = "Replay NAFE samples from a capture file (one frame per line)"},
+        {.option = "nafe-replay-rate",
+         .name = "hz",
+         .type = 'u',
+         .dest = (void *)&opt_replay_rate_hz,
+         .descript = "Frame rate of the NAFE capture file, 1000 by default"},
+        {.option = "nafe-speed",
+         .name = "factor",
+         .type = 'u',
+         .dest = (void *)&opt_speed,
+         .descript = "NAFE signal pacing relative to real time, 1 by default"},
+        ARG_TABLE_ENDMARKER,
+    };
+
+    native_add_command_line_opts(options);
+}
+
+NATIVE_TASK(nafe_sim_options, PRE_BOOT_1, 10);
+
+/*****************************************************************************/
+static int bsp_nafe_sim_init(void)
+{
+    if (bsp_nafe_sim_speed_set(opt_speed)) {
+        LOG_WRN("Invalid --nafe-speed %u, using real time", opt_speed);
+    }
+
+    if (opt_replay_path == NULL) {
+        return 0;
+    }
+
+    int err = bsp_nafe_sim_replay_open(opt_replay_path, opt_replay_rate_hz);
+    if (err) {
+        return 0;
+    }
+
+    // Map file columns one-to-one onto channels
+    for (uint8_t i = 0; i < BSP_NAFE_SIM_CHANNELS_COUNT; i++) {
+        struct bsp_nafe_sim_channel_cfg cfg = {.wave = BSP_NAFE_SIM_WAVE_REPLAY, .column = i};
+
+        bsp_nafe_sim_channel_set(i, &cfg);
+    }
+
+    return 0;
+}
+
+SYS_INIT(bsp_nafe_sim_init, APPLICATION, 40);
+
+/*****************************************************************************/
+/* Shell */
+#ifdef CONFIG_SHELL
+static const char *const wave_names[BSP_NAFE_SIM_WAVE_MAX] = {
+    [BSP_NAFE_SIM_WAVE_OFF] = "off",     [BSP_NAFE_SIM_WAVE_SINE] = "sine",
+    [BSP_NAFE_SIM_WAVE_STEP] = "step",   [BSP_NAFE_SIM_WAVE_NOISE] = "noise",
+    [BSP_NAFE_SIM_WAVE_RAMP] = "ramp",   [BSP_NAFE_SIM_WAVE_REPLAY] = "replay",
+};
+
+static int cmd_wave(const struct shell *sh, size_t argc, char **argv)
+{
+    struct bsp_nafe_sim_channel_cfg cfg = {
+        .rate_hz = 1000,
+        .freq_mhz = 1000,
+        .amplitude = BSP_NAFE_SIM_CODE_MAX / 2,
+    };
+    uint8_t channel = strtoul(argv[1], NULL, 0);
+
+    cfg.wave = BSP_NAFE_SIM_WAVE_MAX;
+    for (int i = 0; i < BSP_NAFE_SIM_WAVE_MAX; i++) {
+        if (strcmp(argv[2], wave_names[i]) == 0) {
+            cfg.wave = i;
+        }
+    }
+
+    if (argc > 3) {
+        cfg.rate_hz = strtoul(argv[3], NULL, 0);
+    }
+    if (argc > 4) {
+        cfg.freq_mhz = strtoul(argv[4], NULL, 0);
+    }
+    if (argc > 5) {
+        cfg.amplitude = strtol(argv[5], NULL, 0);
+    }
+    if (argc > 6) {
+        cfg.offset = strtol(argv[6], NULL, 0);
+    }
+    cfg.column = channel;
+
+    int err = bsp_nafe_sim_channel_set(channel, &cfg);
+    if (err) {
+        shell_error(sh, "Invalid channel or waveform");
+    }
+
+    return err;
+}
+
+static int cmd_replay(const struct shell *sh, size_t argc, char **argv)
+{
+    uint32_t rate_hz = (argc > 2) ? strtoul(argv[2], NULL, 0) : opt_replay_rate_hz;
+
+    int err = bsp_nafe_sim_replay_open(argv[1], rate_hz);
+    if (err) {
+        shell_error(sh, "Cannot replay %s (err %d)", argv[1], err);
+    }
+
+    return err;
+}
+
+static int cmd_speed(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+
+    int err = bsp_nafe_sim_speed_set(strtoul(argv[1], NULL, 0));
+    if (err) {
+        shell_error(sh, "Speed must be 1..%u", SPEED_MAX);
+    }
+
+    return err;
+}
+
+static int cmd_stats(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    shell_print(sh, "speed x%u, replay %u Hz", sim_speed, replay_rate_hz);
+    for (uint8_t i = 0; i < BSP_NAFE_SIM_CHANNELS_COUNT; i++) {
+        shell_print(sh, "ch%u: %-6s %6u Hz %llu samples", i, wave_names[channels[i].cfg.wave],
+                    channels[i].cfg.rate_hz, (unsigned long long)channels[i].samples);
+    }
+
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(
+    sub_nafe_sim,
+    SHELL_CMD_ARG(wave, NULL,
+                  "<ch> <off|sine|step|noise|ramp|replay> [rate_hz] [freq_mhz] [amplitude] [offset]",
+                  cmd_wave, 3, 4),
+    SHELL_CMD_ARG(replay, NULL, "<host path> [rate_hz]", cmd_replay, 2, 1),
+    SHELL_CMD_ARG(speed, NULL, "<factor>", cmd_speed, 2, 0),
+    SHELL_CMD_ARG(stats, NULL, "Show generator state", cmd_stats, 1, 0), SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(nafe_sim, &sub_nafe_sim, "NAFE emulator signal source", NULL);
+#endif /* CONFIG_SHELL */
@@ -0,0 +1,71 @@
+#ifndef BSP_NAFE_SIM_H_
+#define BSP_NAFE_SIM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bsp_ts.h"
+
+#define BSP_NAFE_SIM_CHANNELS_COUNT CONFIG_BSP_NAFE_SIM_CHANNELS
+
+/// @brief Full scale of the generated conversion codes (signed 24-bit)
+#define BSP_NAFE_SIM_CODE_MAX 0x7FFFFF
+#define BSP_NAFE_SIM_CODE_MIN (-0x800000)
+
+typedef enum {
+    BSP_NAFE_SIM_WAVE_OFF,
+    BSP_NAFE_SIM_WAVE_SINE,
+    BSP_NAFE_SIM_WAVE_STEP,
+    BSP_NAFE_SIM_WAVE_NOISE,
+    BSP_NAFE_SIM_WAVE_RAMP,
+    BSP_NAFE_SIM_WAVE_REPLAY,
+    BSP_NAFE_SIM_WAVE_MAX
+} bsp_nafe_sim_wave_t;
+
+struct bsp_nafe_sim_channel_cfg {
+    bsp_nafe_sim_wave_t wave;
+    uint32_t rate_hz;  // Sample rate
+    uint32_t freq_mhz; // Signal frequency in mHz (sine, step, ramp)
+    int32_t amplitude; // Peak amplitude in codes
+    int32_t offset;    // DC offset in codes
+    uint8_t column;    // Replay file column, BSP_NAFE_SIM_WAVE_REPLAY only
+};
+
+/// @brief Receives a block of generated sign-extended 24-bit codes, ts is the
+/// time of the last code. Invoked from the generator thread.
+typedef void (*bsp_nafe_sim_block_cb_t)(uint8_t channel, bsp_ts_t ts, const int32_t *codes,
+                                        size_t count, void *user_data);
+
+/*****************************************************************************/
+
+/// @brief Configures the signal generated on a channel
+/// @param channel
+/// @param cfg
+/// @return 0 on success
+int bsp_nafe_sim_channel_set(uint8_t channel, const struct bsp_nafe_sim_channel_cfg *cfg);
+
+/// @brief Sets the callback receiving generated sample blocks
+/// @param cb
+/// @param user_data
+/// @return 0 on success
+int bsp_nafe_sim_callback_set(bsp_nafe_sim_block_cb_t cb, void *user_data);
+
+/// @brief Sets the pacing speed relative to real time
+/// @param speed 1 for real time, N for N times faster, up to 1000
+/// @return 0 on success, -EINVAL if out of range
+int bsp_nafe_sim_speed_set(uint32_t speed);
+
+/// @brief Opens a capture file on the host for replay. The file holds one
+/// frame per line with comma or whitespace separated codes, one column per
+/// channel; lines starting with '#' are skipped. Replay loops at end of file.
+/// @param path Host path
+/// @param rate_hz Frame rate of the capture
+/// @return 0 on success
+int bsp_nafe_sim_replay_open(const char *path, uint32_t rate_hz);
+
+/// @brief Returns the number of samples generated on a channel since boot
+/// @param channel
+/// @return
+uint64_t bsp_nafe_sim_samples_get(uint8_t channel);
+
+#endif // BSP_NAFE_SIM_H_
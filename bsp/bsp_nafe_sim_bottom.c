@@ -0,0 +1,87 @@
+/*
+ * Host side of the NAFE replay source, built into the native simulator runner
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "bsp_nafe_sim_bottom.h"
+
+#define REPLAY_LINE_MAX 512
+
+static FILE *replay_file;
+
+/*****************************************************************************/
+int bsp_nafe_sim_replay_open_bottom(const char *path)
+{
+    bsp_nafe_sim_replay_close_bottom();
+
+    replay_file = fopen(path, "r");
+    return (replay_file != NULL) ? 0 : -1;
+}
+
+/*****************************************************************************/
+void bsp_nafe_sim_replay_close_bottom(void)
+{
+    if (replay_file != NULL) {
+        fclose(replay_file);
+        replay_file = NULL;
+    }
+}
+
+/*****************************************************************************/
+static int parse_line(char *line, int32_t *frame, int max_columns)
+{
+    int columns = 0;
+    char *p = line;
+
+    while (columns < max_columns) {
+        char *end;
+        long value = strtol(p, &end, 0);
+
+        if (end == p) {
+            break;
+        }
+
+        frame[columns++] = (int32_t)value;
+
+        p = end;
+        while (*p == ',' || *p == ' ' || *p == '\t') {
+            p++;
+        }
+    }
+
+    return columns;
+}
+
+/*****************************************************************************/
+// Returns the number of columns read into frame, rewinding at end of file.
+// Returns -1 when no file is open or it holds no data.
+int bsp_nafe_sim_replay_read_bottom(int32_t *frame, int max_columns)
+{
+    char line[REPLAY_LINE_MAX];
+    int rewound = 0;
+
+    if (replay_file == NULL) {
+        return -1;
+    }
+
+    for (;;) {
+        if (fgets(line, sizeof(line), replay_file) == NULL) {
+            if (rewound) {
+                return -1;
+            }
+            rewind(replay_file);
+            rewound = 1;
+            continue;
+        }
+
+        if (line[0] == '#') {
+            continue;
+        }
+
+        int columns = parse_line(line, frame, max_columns);
+        if (columns > 0) {
+            return columns;
+        }
+    }
+}
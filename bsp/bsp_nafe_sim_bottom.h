@@ -0,0 +1,23 @@
+/*
+ * Host side of the NAFE replay source. Only standard C types may cross this
+ * interface, as the implementation is built into the native simulator runner.
+ * Functions return -1 on failure; host errno values are not meaningful here.
+ */
+#ifndef BSP_NAFE_SIM_BOTTOM_H_
+#define BSP_NAFE_SIM_BOTTOM_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+int bsp_nafe_sim_replay_open_bottom(const char *path);
+void bsp_nafe_sim_replay_close_bottom(void);
+int bsp_nafe_sim_replay_read_bottom(int32_t *frame, int max_columns);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BSP_NAFE_SIM_BOTTOM_H_
@@ -0,0 +1,123 @@
+#include <errno.h>
+#include <string.h>
+
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/util.h>
+
+#include "bsp.h"
+#include "bsp_pi.h"
+
+/*****************************************************************************/
+/* Private objects */
+struct bsp_pi bsp_pi;
+struct k_spinlock bsp_pi_lock;
+
+// Back buffer of the inputs produced outside the update cycle
+static int32_t analog_back[BSP_PI_ANALOG_COUNT];
+
+static uint8_t applied_dout;
+static uint8_t applied_enable;
+static bool applied_valid;
+
+/*****************************************************************************/
+void bsp_pi_inputs_update(void)
+{
+    struct digital_inputs inputs = bsp_digital_inputs_get();
+    const digital_input_state_t states[BOARD_DIGITAL_INPUTS_COUNT] = {
+        inputs.digital_in_1, inputs.digital_in_2, inputs.digital_in_3, inputs.digital_in_4};
+    uint8_t din = 0;
+    uint8_t valid = 0;
+
+    for (int i = 0; i < BOARD_DIGITAL_INPUTS_COUNT; i++) {
+        if (states[i] == DIGITAL_IN_LOGIC_HIGH) {
+            din |= BIT(i);
+        }
+        if (states[i] == DIGITAL_IN_LOGIC_HIGH || states[i] == DIGITAL_IN_LOGIC_LOW) {
+            valid |= BIT(i);
+        }
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&bsp_pi_lock);
+    bsp_pi.din = din;
+    bsp_pi.din_valid = valid;
+    memcpy(bsp_pi.analog, analog_back, sizeof(bsp_pi.analog));
+    k_spin_unlock(&bsp_pi_lock, key);
+}
+
+/*****************************************************************************/
+int bsp_pi_outputs_apply(void)
+{
+    static const digital_output_t outputs[BOARD_DIGITAL_OUTPUTS_COUNT] = {
+        DIGITAL_OUT_1, DIGITAL_OUT_2, DIGITAL_OUT_3, DIGITAL_OUT_4};
+    int err = 0;
+
+    k_spinlock_key_t key = k_spin_lock(&bsp_pi_lock);
+    uint8_t dout = bsp_pi.dout;
+    uint8_t enable = bsp_pi.dout_enable;
+    k_spin_unlock(&bsp_pi_lock, key);
+
+    for (int i = 0; i < BOARD_DIGITAL_OUTPUTS_COUNT; i++) {
+        bool init = !applied_valid;
+
+        if (init || ((enable ^ applied_enable) & BIT(i))) {
+            err |= (enable & BIT(i)) ? bsp_digital_out_enable(outputs[i])
+                                     : bsp_digital_out_disable(outputs[i]);
+        }
+
+        if (init || ((dout ^ applied_dout) & BIT(i))) {
+            err |= (dout & BIT(i)) ? bsp_digital_out_set(outputs[i])
+                                   : bsp_digital_out_reset(outputs[i]);
+        }
+    }
+
+    applied_dout = dout;
+    applied_enable = enable;
+    applied_valid = true;
+
+    return err ? -EIO : 0;
+}
+
+/*****************************************************************************/
+#ifdef CONFIG_BSP_DSP
+void bsp_pi_analog_publish(uint8_t channel, const struct bsp_dsp_result *result,
+                           void *user_data)
+{
+    ARG_UNUSED(user_data);
+
+    if (channel < BSP_PI_ANALOG_COUNT) {
+        analog_back[channel] = result->last;
+    }
+}
+#endif
+
+/*****************************************************************************/
+#if CONFIG_BSP_PI_CYCLE_MS > 0
+static void cycle_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(cycle_work, cycle_handler);
+
+static void cycle_handler(struct k_work *work)
+{
+    ARG_UNUSED(work);
+
+    bsp_pi_outputs_apply();
+    bsp_pi_inputs_update();
+
+    k_work_schedule(&cycle_work, K_MSEC(CONFIG_BSP_PI_CYCLE_MS));
+}
+#endif
+
+/*****************************************************************************/
+static int bsp_pi_init(void)
+{
+#ifdef CONFIG_BSP_DSP
+    bsp_dsp_publish_hook_set(bsp_pi_analog_publish, NULL);
+#endif
+#if CONFIG_BSP_PI_CYCLE_MS > 0
+    k_work_schedule(&cycle_work, K_NO_WAIT);
+#endif
+    return 0;
+}
+
+// After bsp_init() configured the I/O
+SYS_INIT(bsp_pi_init, APPLICATION, 35);
@@ -0,0 +1,52 @@
+#ifndef BSP_PI_H_
+#define BSP_PI_H_
+
+#include <stdint.h>
+
+#include <zephyr/spinlock.h>
+
+#ifdef CONFIG_BSP_DSP
+#include "bsp_dsp.h"
+#endif
+
+#define BSP_PI_ANALOG_COUNT 8
+
+/// @brief I/O process variables shared by the fieldbus services. Bit n of
+/// the digital members is input/output n+1.
+///
+/// bsp_pi is the image the fieldbus services read and write. Inputs are
+/// collected in a back buffer (digital inputs, NAFE channels as their
+/// windows complete) and committed to bsp_pi together by
+/// bsp_pi_inputs_update(), so the image only changes at cycle boundaries.
+/// Accesses spanning several members take bsp_pi_lock for a consistent view.
+struct bsp_pi {
+    uint8_t din;        // Digital inputs at logic high
+    uint8_t din_valid;  // Digital inputs in a defined state
+    uint8_t dout;       // Digital outputs requested high
+    uint8_t dout_enable; // DRV8844 half-bridges requested enabled
+    int32_t analog[BSP_PI_ANALOG_COUNT]; // NAFE channels, q31
+};
+
+extern struct bsp_pi bsp_pi;
+extern struct k_spinlock bsp_pi_lock;
+
+/*****************************************************************************/
+
+/// @brief Samples the digital inputs and commits them and the NAFE values
+/// received since the last call into bsp_pi
+void bsp_pi_inputs_update(void);
+
+/// @brief Drives the DRV8844 outputs from bsp_pi.dout and bsp_pi.dout_enable.
+/// Only outputs whose requested state changed since the last call are written.
+/// @return 0 on success
+int bsp_pi_outputs_apply(void);
+
+#ifdef CONFIG_BSP_DSP
+/// @brief bsp_dsp publish callback storing the last filtered value of a
+/// window for bsp_pi.analog[channel], committed by the next input update.
+/// Registered as the bsp_dsp publish hook at init.
+void bsp_pi_analog_publish(uint8_t channel, const struct bsp_dsp_result *result,
+                           void *user_data);
+#endif
+
+#endif // BSP_PI_H_
@@ -0,0 +1,219 @@
+#include <errno.h>
+#include <stdlib.h>
+
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/drivers/ptp_clock.h>
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/util.h>
+
+#include "bsp_ptp.h"
+
+LOG_MODULE_REGISTER(bsp_ptp, CONFIG_LOG_DEFAULT_LEVEL);
+
+/*****************************************************************************/
+#define PTP_CLOCK DT_NODELABEL(enet_ptp_clock)
+#define MAP_PERIOD_MS CONFIG_BSP_PTP_MAP_PERIOD_MS
+#define RATE_SHIFT 24          // Rate in ns per tick, q24
+#define READ_TRIES 4
+#define READ_WINDOW_NS 2000    // Longest accepted PTP clock read
+#define STEP_PPM 1000          // Larger rate deviations are clock steps
+#define RATE_FILTER_SHIFT 3
+#define HOLDOVER_MS (CONFIG_BSP_PTP_HOLDOVER_S * MSEC_PER_SEC)
+
+// Mapping from the timestamp counter to PTP time: ns = ns0 + (ts - ts0) * rate
+struct ptp_map {
+    bsp_ts_t ts0;
+    uint64_t ns0;
+    uint64_t rate;
+    bool valid;  // Mapped, bsp_ptp_ts_to_ns() converts to PTP time
+    bool synced; // PTP time synchronised to the grandmaster, or in holdover
+};
+
+/*****************************************************************************/
+/* Private objects */
+static const struct device *const ptp_clk = DEVICE_DT_GET(PTP_CLOCK);
+
+static struct ptp_map map;
+static struct k_spinlock map_lock;
+static uint64_t rate_nominal;
+static uint32_t read_ns_max;
+static uint32_t steps;
+static atomic_t port_synced; // Reported by bsp_ptp_sync_set()
+static int64_t sync_ms;      // Uptime of the last pass with a synchronised port
+static bool sync_seen;
+
+static void map_update(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(map_work, map_update);
+
+/*****************************************************************************/
+// Reads the PTP clock between two timestamp counter reads and returns the
+// timestamp in the middle. Reads disturbed by an interrupt are repeated.
+static int clock_sample(bsp_ts_t *ts, uint64_t *ns)
+{
+    bsp_ts_t window_max = bsp_ts_from_ns(READ_WINDOW_NS);
+
+    for (int i = 0; i < READ_TRIES; i++) {
+        struct net_ptp_time t;
+        bsp_ts_t t0 = bsp_ts_now();
+        int err = ptp_clock_get(ptp_clk, &t);
+        bsp_ts_t t1 = bsp_ts_now();
+
+        if (err) {
+            return err;
+        }
+
+        read_ns_max = MAX(read_ns_max, (uint32_t)bsp_ts_to_ns(t1 - t0));
+
+        if (t1 - t0 <= window_max) {
+            *ts = t0 + (t1 - t0) / 2;
+            *ns = t.second * NSEC_PER_SEC + t.nanosecond;
+            return 0;
+        }
+    }
+
+    return -EAGAIN;
+}
+
+/*****************************************************************************/
+static void map_update(struct k_work *work)
+{
+    ARG_UNUSED(work);
+
+    bsp_ts_t ts;
+    uint64_t ns;
+    int64_t now_ms = k_uptime_get();
+
+    if (atomic_get(&port_synced)) {
+        sync_ms = now_ms;
+        sync_seen = true;
+    }
+
+    bool synced = sync_seen && now_ms - sync_ms <= HOLDOVER_MS;
+
+    if (clock_sample(&ts, &ns) == 0) {
+        struct ptp_map m = map;
+        uint64_t dc = ts - m.ts0;
+        int64_t dns = ns - m.ns0;
+        uint64_t rate = rate_nominal;
+
+        if (m.valid) {
+            uint64_t measured = (dc > 0 && dns > 0) ? ((uint64_t)dns << RATE_SHIFT) / dc : 0;
+            uint64_t dev_ppm = (uint64_t)llabs((int64_t)(measured - rate_nominal)) * 1000000U /
+                               rate_nominal;
+
+            if (dev_ppm < STEP_PPM) {
+                rate = m.rate + ((int64_t)(measured - m.rate) >> RATE_FILTER_SHIFT);
+            } else {
+                // The PTP stack stepped the clock, start over from the nominal rate
+                steps++;
+            }
+        }
+
+        k_spinlock_key_t key = k_spin_lock(&map_lock);
+        map = (struct ptp_map){
+            .ts0 = ts, .ns0 = ns, .rate = rate, .valid = true, .synced = synced};
+        k_spin_unlock(&map_lock, key);
+    } else {
+        k_spinlock_key_t key = k_spin_lock(&map_lock);
+        map.synced = synced && map.valid;
+        k_spin_unlock(&map_lock, key);
+    }
+
+    k_work_schedule(&map_work, K_MSEC(MAP_PERIOD_MS));
+}
+
+/*****************************************************************************/
+uint64_t bsp_ptp_ts_to_ns(bsp_ts_t ts)
+{
+    k_spinlock_key_t key = k_spin_lock(&map_lock);
+    struct ptp_map m = map;
+    k_spin_unlock(&map_lock, key);
+
+    if (!m.valid) {
+        return bsp_ts_to_ns(ts);
+    }
+
+    // Signed, so events stamped just before the mapping convert as well
+    int64_t dc = ts - m.ts0;
+
+    return m.ns0 + (((int64_t)dc * (int64_t)m.rate) >> RATE_SHIFT);
+}
+
+/*****************************************************************************/
+uint64_t bsp_ptp_now_ns(void)
+{
+    return bsp_ptp_ts_to_ns(bsp_ts_now());
+}
+
+/*****************************************************************************/
+void bsp_ptp_sync_set(bool synced)
+{
+    atomic_set(&port_synced, synced);
+}
+
+/*****************************************************************************/
+bool bsp_ptp_valid(void)
+{
+    k_spinlock_key_t key = k_spin_lock(&map_lock);
+    bool synced = map.synced;
+    k_spin_unlock(&map_lock, key);
+
+    return synced;
+}
+
+/*****************************************************************************/
+static int bsp_ptp_init(void)
+{
+    if (!device_is_ready(ptp_clk)) {
+        LOG_ERR("PTP clock not ready");
+        return 0;
+    }
+
+    rate_nominal = ((uint64_t)NSEC_PER_SEC << RATE_SHIFT) / bsp_ts_hz();
+    k_work_schedule(&map_work, K_NO_WAIT);
+
+    return 0;
+}
+
+SYS_INIT(bsp_ptp_init, APPLICATION, 30);
+
+/*****************************************************************************/
+/* Shell */
+#ifdef CONFIG_SHELL
+static int cmd_ptp_status(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    k_spinlock_key_t key = k_spin_lock(&map_lock);
+    struct ptp_map m = map;
+    k_spin_unlock(&map_lock, key);
+
+    uint64_t now = bsp_ptp_now_ns();
+    int32_t ppb = m.valid ? (int64_t)(m.rate - rate_nominal) * 1000000000 / (int64_t)rate_nominal
+                          : 0;
+
+    const char *sync = !m.synced                 ? "not synchronised"
+                       : atomic_get(&port_synced) ? "synchronised"
+                                                  : "holdover";
+
+    shell_print(sh, "PTP time %llu.%09llu, %s, %s", now / NSEC_PER_SEC, now % NSEC_PER_SEC,
+                m.valid ? "mapped" : "not mapped", sync);
+    shell_print(sh, "Timestamp counter %+d ppb against PTP, clock steps %u, read max %u ns", ppb,
+                steps, read_ns_max);
+
+    return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_ptp,
+                               SHELL_CMD_ARG(status, NULL, "Show PTP timebase mapping",
+                                             cmd_ptp_status, 1, 0),
+                               SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(ptp, &sub_ptp, "PTP timebase", NULL);
+#endif /* CONFIG_SHELL */
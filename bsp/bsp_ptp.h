@@ -0,0 +1,34 @@
+#ifndef BSP_PTP_H_
+#define BSP_PTP_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "bsp_ts.h"
+
+/*****************************************************************************/
+
+/// @brief Converts a bsp_ts_now() timestamp to PTP time. Events are stamped
+/// with the timestamp counter, which is cheap in interrupts, and converted
+/// with the last mapping of the counter to the ENET PTP clock, so no PTP clock
+/// register access is needed. ISR safe.
+/// @param ts
+/// @return Nanoseconds in the PTP timebase, or bsp_ts_to_ns() until the first
+/// mapping is taken
+uint64_t bsp_ptp_ts_to_ns(bsp_ts_t ts);
+
+/// @brief Returns the current time in the PTP timebase. ISR safe.
+uint64_t bsp_ptp_now_ns(void);
+
+/// @brief Reports the synchronisation state of the PTP stack, typically from
+/// the application's port state handling: true while a port is a time
+/// receiver locked to the time transmitter. ISR safe.
+/// @param synced
+void bsp_ptp_sync_set(bool synced);
+
+/// @brief Returns true while time stamps are in synchronised PTP time: the
+/// timestamp counter is mapped to the PTP clock and bsp_ptp_sync_set() reports
+/// synchronisation, or did less than CONFIG_BSP_PTP_HOLDOVER_S ago. ISR safe.
+bool bsp_ptp_valid(void);
+
+#endif // BSP_PTP_H_
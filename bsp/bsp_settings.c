@@ -0,0 +1,798 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/storage/flash_map.h>
+#include <zephyr/sys/crc.h>
+#include <zephyr/sys/util.h>
+
+#include "bsp_flash.h"
+#include "bsp_settings.h"
+#include "bsp_ts.h"
+
+LOG_MODULE_REGISTER(bsp_settings, CONFIG_LOG_DEFAULT_LEVEL);
+
+/*****************************************************************************/
+#define SETTINGS_OFFSET CONFIG_BSP_SETTINGS_OFFSET
+#define SETTINGS_SIZE CONFIG_BSP_SETTINGS_SIZE
+#define SECTOR_SIZE CONFIG_BSP_SETTINGS_SECTOR_SIZE
+#define SECTORS_COUNT (SETTINGS_SIZE / SECTOR_SIZE)
+#define MAX_ENTRIES CONFIG_BSP_SETTINGS_MAX_ENTRIES
+#define KEY_MAX BSP_SETTINGS_KEY_MAX
+#define VALUE_MAX BSP_SETTINGS_VALUE_MAX
+#define FLUSH_MS CONFIG_BSP_SETTINGS_FLUSH_MS
+#define SETTINGS_ALIGN 8
+
+// Open addressing with at most half of the slots in use
+#define INDEX_SIZE (1U << (LOG2CEIL(MAX_ENTRIES) + 1))
+
+#define STORAGE_PARTITION storage_partition
+
+BUILD_ASSERT(SETTINGS_SIZE % SECTOR_SIZE == 0);
+BUILD_ASSERT(SECTORS_COUNT >= 2, "The settings area needs at least two sectors");
+BUILD_ASSERT(KEY_MAX <= UINT8_MAX);
+
+/*****************************************************************************/
+/* Flash layout. The settings area is a ring of sectors, the valid sector with
+ * the highest sequence number is active. A sector starts with a snapshot of
+ * all keys followed by records of the changes flushed since, each record is a
+ * header, the key and the value. A full sector is compacted into the next
+ * one: it is erased, the snapshot is programmed from RAM and the sector
+ * header last, so the previous sector stays active until the new one is
+ * complete. Erase counts travel in the sector headers. */
+#define SECTOR_MAGIC 0x47545353 // "SSTG"
+#define SECTOR_FORMAT_VERSION 1
+#define RECORD_FLAG_DELETED BIT(0)
+
+struct sector_header {
+    uint32_t magic;
+    uint8_t format_version;
+    uint8_t header_size;
+    uint16_t reserved;
+    uint32_t seq;
+    uint32_t erase_count;
+    uint32_t reserved2;
+    uint32_t header_crc; // Must be the last member
+};
+
+struct record_header {
+    uint8_t key_len;
+    uint8_t flags;
+    uint16_t value_len;
+    uint32_t crc; // Header up to here, key and value
+};
+
+BUILD_ASSERT(sizeof(struct sector_header) % SETTINGS_ALIGN == 0);
+BUILD_ASSERT(sizeof(struct record_header) % SETTINGS_ALIGN == 0);
+
+#define RECORD_MAX ROUND_UP(sizeof(struct record_header) + KEY_MAX + VALUE_MAX, SETTINGS_ALIGN)
+
+// Compaction writes all keys into one sector
+BUILD_ASSERT(sizeof(struct sector_header) + MAX_ENTRIES * RECORD_MAX <= SECTOR_SIZE,
+             "Settings sector too small for the maximum number of entries");
+
+struct setting {
+    uint32_t hash;
+    uint16_t value_len;
+    uint16_t gen; // Incremented on every change
+    uint8_t key_len;
+    bool deleted;
+    bool dirty; // Changed since the last write
+    char key[KEY_MAX];
+    uint8_t value[VALUE_MAX] __aligned(4);
+};
+
+/*****************************************************************************/
+/* Private objects */
+
+// RAM index, under settings_lock
+static struct setting entries[MAX_ENTRIES];
+static uint16_t entries_count;
+static uint16_t index_tbl[INDEX_SIZE]; // Entry index + 1, 0 for a free slot
+static bool pending;                   // Changes not yet on flash
+static bsp_ts_t pending_since;
+static struct bsp_settings_stats stats;
+static struct k_spinlock settings_lock;
+
+// Writer side, under flash_lock
+static struct {
+    const struct flash_area *fa;
+    int active;       // Active sector, -1 if none
+    uint32_t seq;     // Sequence number of the active sector
+    size_t write_off; // Next record in the active sector
+    bool compact;     // Next flush starts a new sector
+    uint32_t erase_count[SECTORS_COUNT];
+} wr = {.active = -1};
+
+static uint8_t record_buf[RECORD_MAX] __aligned(SETTINGS_ALIGN);
+static uint16_t snapshot_gen[MAX_ENTRIES];
+static K_MUTEX_DEFINE(flash_lock);
+
+static void flush_handler(struct k_work *work);
+static K_WORK_DELAYABLE_DEFINE(flush_work, flush_handler);
+
+/*****************************************************************************/
+static off_t sector_offset(int sector)
+{
+    return SETTINGS_OFFSET + (off_t)sector * SECTOR_SIZE;
+}
+
+/*****************************************************************************/
+// FNV-1a
+static uint32_t key_hash(const char *key, size_t len)
+{
+    uint32_t hash = 2166136261U;
+
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ (uint8_t)key[i]) * 16777619U;
+    }
+
+    return hash;
+}
+
+/*****************************************************************************/
+static void index_insert(uint16_t i)
+{
+    for (uint32_t n = 0;; n++) {
+        uint16_t *slot = &index_tbl[(entries[i].hash + n) & (INDEX_SIZE - 1)];
+
+        if (*slot == 0) {
+            *slot = i + 1;
+            return;
+        }
+    }
+}
+
+/*****************************************************************************/
+// Returns the entry of a key, or a new entry if insert is set. Called with
+// settings_lock held.
+static struct setting *index_find(const char *key, size_t len, uint32_t hash, bool insert)
+{
+    for (uint32_t i = 0; i < INDEX_SIZE; i++) {
+        uint16_t *slot = &index_tbl[(hash + i) & (INDEX_SIZE - 1)];
+
+        if (*slot == 0) {
+            if (!insert || entries_count == MAX_ENTRIES) {
+                return NULL;
+            }
+
+            struct setting *e = &entries[entries_count];
+
+            memset(e, 0, sizeof(*e));
+            e->hash = hash;
+            e->key_len = len;
+            e->deleted = true;
+            memcpy(e->key, key, len);
+            *slot = ++entries_count;
+
+            return e;
+        }
+
+        struct setting *e = &entries[*slot - 1];
+
+        if (e->hash == hash && e->key_len == len && memcmp(e->key, key, len) == 0) {
+            return e;
+        }
+    }
+
+    return NULL;
+}
+
+/*****************************************************************************/
+// Marks an entry changed and starts the flush deadline with the first unsaved
+// change. Called with settings_lock held.
+static void entry_changed(struct setting *e)
+{
+    e->gen++;
+    stats.sets++;
+
+    if (e->dirty) {
+        stats.coalesced++;
+    }
+    e->dirty = true;
+
+    if (!pending) {
+        pending = true;
+        pending_since = bsp_ts_now();
+    }
+}
+
+/*****************************************************************************/
+static int key_check(const char *key)
+{
+    size_t len = key ? strnlen(key, KEY_MAX) : 0;
+
+    return (len == 0 || len == KEY_MAX) ? -EINVAL : (int)len;
+}
+
+/*****************************************************************************/
+int bsp_settings_get(const char *key, void *value, size_t size)
+{
+    int len = key_check(key);
+
+    if (len < 0) {
+        return len;
+    }
+
+    uint32_t hash = key_hash(key, len);
+    k_spinlock_key_t lock = k_spin_lock(&settings_lock);
+    struct setting *e = index_find(key, len, hash, false);
+    int ret;
+
+    if (e == NULL || e->deleted) {
+        ret = -ENOENT;
+    } else if (e->value_len > size) {
+        ret = -ENOMEM;
+    } else {
+        memcpy(value, e->value, e->value_len);
+        ret = e->value_len;
+    }
+
+    k_spin_unlock(&settings_lock, lock);
+
+    return ret;
+}
+
+/*****************************************************************************/
+int bsp_settings_set(const char *key, const void *value, size_t len)
+{
+    int key_len = key_check(key);
+
+    if (key_len < 0 || len > VALUE_MAX || (value == NULL && len > 0)) {
+        return -EINVAL;
+    }
+
+    uint32_t hash = key_hash(key, key_len);
+    k_spinlock_key_t lock = k_spin_lock(&settings_lock);
+    struct setting *e = index_find(key, key_len, hash, true);
+
+    if (e == NULL) {
+        k_spin_unlock(&settings_lock, lock);
+        return -ENOSPC;
+    }
+
+    // An unchanged value costs no flash write
+    bool changed = e->deleted || e->value_len != len || memcmp(e->value, value, len) != 0;
+
+    if (changed) {
+        memcpy(e->value, value, len);
+        e->value_len = len;
+        e->deleted = false;
+        entry_changed(e);
+    }
+
+    k_spin_unlock(&settings_lock, lock);
+
+    if (changed) {
+        // The deadline is kept, so the delay counts from the first change
+        bsp_flash_work_schedule(&flush_work, K_MSEC(FLUSH_MS));
+    }
+
+    return 0;
+}
+
+/*****************************************************************************/
+int bsp_settings_delete(const char *key)
+{
+    int len = key_check(key);
+
+    if (len < 0) {
+        return len;
+    }
+
+    uint32_t hash = key_hash(key, len);
+    k_spinlock_key_t lock = k_spin_lock(&settings_lock);
+    struct setting *e = index_find(key, len, hash, false);
+
+    if (e == NULL || e->deleted) {
+        k_spin_unlock(&settings_lock, lock);
+        return -ENOENT;
+    }
+
+    e->deleted = true;
+    e->value_len = 0;
+    entry_changed(e);
+
+    k_spin_unlock(&settings_lock, lock);
+
+    bsp_flash_work_schedule(&flush_work, K_MSEC(FLUSH_MS));
+
+    return 0;
+}
+
+/*****************************************************************************/
+// Builds the record of an entry in record_buf. Returns its length, 0 if the
+// entry is skipped: clean entries unless all is set, deleted ones if all is set.
+static size_t record_build(int i, bool all, uint16_t *gen)
+{
+    struct record_header *hdr = (struct record_header *)record_buf;
+    k_spinlock_key_t lock = k_spin_lock(&settings_lock);
+    const struct setting *e = &entries[i];
+    size_t len = 0;
+
+    *gen = e->gen;
+
+    if (all ? !e->deleted : e->dirty) {
+        hdr->key_len = e->key_len;
+        hdr->flags = e->deleted ? RECORD_FLAG_DELETED : 0;
+        hdr->value_len = e->value_len;
+        memcpy(record_buf + sizeof(*hdr), e->key, e->key_len);
+        memcpy(record_buf + sizeof(*hdr) + e->key_len, e->value, e->value_len);
+        len = sizeof(*hdr) + e->key_len + e->value_len;
+    }
+
+    k_spin_unlock(&settings_lock, lock);
+
+    if (len == 0) {
+        return 0;
+    }
+
+    hdr->crc = crc32_ieee(hdr, offsetof(struct record_header, crc));
+    hdr->crc = crc32_ieee_update(hdr->crc, record_buf + sizeof(*hdr), len - sizeof(*hdr));
+
+    size_t padded = ROUND_UP(len, SETTINGS_ALIGN);
+    memset(record_buf + len, 0xFF, padded - len);
+
+    return padded;
+}
+
+/*****************************************************************************/
+// Clears the dirty flag unless the entry changed again since gen was taken
+static void record_saved(int i, uint16_t gen)
+{
+    k_spinlock_key_t lock = k_spin_lock(&settings_lock);
+
+    if (entries[i].gen == gen) {
+        entries[i].dirty = false;
+    }
+
+    k_spin_unlock(&settings_lock, lock);
+}
+
+/*****************************************************************************/
+// Writes a snapshot of all keys into the next sector. Called with flash_lock
+// held.
+static int compact(void)
+{
+    int sector = (wr.active + 1) % SECTORS_COUNT;
+    off_t base = sector_offset(sector);
+    size_t off = sizeof(struct sector_header);
+    int count = entries_count;
+    int err = flash_area_erase(wr.fa, base, SECTOR_SIZE);
+
+    wr.erase_count[sector]++;
+    stats.compactions++;
+
+    for (int i = 0; err == 0 && i < count; i++) {
+        size_t len = record_build(i, true, &snapshot_gen[i]);
+
+        if (len > 0) {
+            err = bsp_flash_write(wr.fa, base + off, record_buf, len);
+            off += len;
+            stats.records++;
+            stats.bytes += len;
+        }
+    }
+
+    struct sector_header hdr = {
+        .magic = SECTOR_MAGIC,
+        .format_version = SECTOR_FORMAT_VERSION,
+        .header_size = sizeof(hdr),
+        .seq = wr.seq + 1,
+        .erase_count = wr.erase_count[sector],
+    };
+
+    hdr.header_crc = crc32_ieee(&hdr, offsetof(struct sector_header, header_crc));
+
+    if (err == 0) {
+        err = flash_area_write(wr.fa, base, &hdr, sizeof(hdr));
+        stats.bytes += sizeof(hdr);
+    }
+
+    if (err) {
+        return err;
+    }
+
+    // Deleted keys are dropped by leaving them out of the snapshot
+    for (int i = 0; i < count; i++) {
+        record_saved(i, snapshot_gen[i]);
+    }
+
+    wr.active = sector;
+    wr.seq = hdr.seq;
+    wr.write_off = off;
+    wr.compact = false;
+
+    LOG_DBG("Settings compacted into sector %d, seq %u", sector, wr.seq);
+
+    return 0;
+}
+
+/*****************************************************************************/
+// Appends the records of the changed keys, or compacts when the active sector
+// is full. Called with flash_lock held.
+static int flush(void)
+{
+    int err = 0;
+
+    for (int i = 0; !wr.compact && i < entries_count; i++) {
+        uint16_t gen;
+        size_t len = record_build(i, false, &gen);
+
+        if (len == 0) {
+            continue;
+        }
+
+        if (wr.write_off + len > SECTOR_SIZE) {
+            wr.compact = true;
+            break;
+        }
+
+        err = bsp_flash_write(wr.fa, sector_offset(wr.active) + wr.write_off, record_buf, len);
+        if (err) {
+            // The record may be torn, a new sector leaves it behind
+            wr.compact = true;
+            break;
+        }
+
+        record_saved(i, gen);
+        wr.write_off += len;
+        stats.records++;
+        stats.bytes += len;
+    }
+
+    if (wr.compact) {
+        err = compact();
+    }
+
+    return err;
+}
+
+/*****************************************************************************/
+static int settings_flush(void)
+{
+    if (wr.fa == NULL) {
+        return -ENODEV;
+    }
+
+    k_mutex_lock(&flash_lock, K_FOREVER);
+
+    bsp_ts_t t0 = bsp_ts_now();
+    int err = flush();
+    uint32_t us = bsp_ts_to_us(bsp_ts_now() - t0);
+
+    k_mutex_unlock(&flash_lock);
+
+    k_spinlock_key_t lock = k_spin_lock(&settings_lock);
+    bool dirty = false;
+
+    for (int i = 0; !dirty && i < entries_count; i++) {
+        dirty = entries[i].dirty;
+    }
+
+    stats.flushes++;
+    stats.flush_us_max = MAX(stats.flush_us_max, us);
+    if (err) {
+        stats.flash_errors++;
+    }
+
+    if (pending && !dirty) {
+        uint32_t ms = bsp_ts_to_us(bsp_ts_now() - pending_since) / 1000;
+
+        stats.latency_ms_max = MAX(stats.latency_ms_max, ms);
+        pending = false;
+    }
+
+    k_spin_unlock(&settings_lock, lock);
+
+    if (err) {
+        LOG_ERR("Settings flush failed (err %d)", err);
+    }
+
+    // Changed during the flush or failed, retry with a fresh deadline
+    if (dirty) {
+        bsp_flash_work_schedule(&flush_work, K_MSEC(FLUSH_MS));
+    }
+
+    return err;
+}
+
+/*****************************************************************************/
+static void flush_handler(struct k_work *work)
+{
+    ARG_UNUSED(work);
+
+    (void)settings_flush();
+}
+
+/*****************************************************************************/
+int bsp_settings_flush(void)
+{
+    return settings_flush();
+}
+
+/*****************************************************************************/
+void bsp_settings_stats_get(struct bsp_settings_stats *s)
+{
+    k_spinlock_key_t lock = k_spin_lock(&settings_lock);
+
+    *s = stats;
+    s->entries = entries_count;
+
+    k_spin_unlock(&settings_lock, lock);
+
+    s->erase_min = UINT32_MAX;
+    s->erase_max = 0;
+    for (int i = 0; i < SECTORS_COUNT; i++) {
+        s->erase_min = MIN(s->erase_min, wr.erase_count[i]);
+        s->erase_max = MAX(s->erase_max, wr.erase_count[i]);
+    }
+}
+
+/*****************************************************************************/
+static bool read_erased(const void *data, size_t len)
+{
+    const uint8_t *p = data;
+    uint8_t erased = flash_area_erased_val(wr.fa);
+
+    for (size_t i = 0; i < len; i++) {
+        if (p[i] != erased) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/*****************************************************************************/
+// Finds the active sector and the erase counts of all sectors
+static void sectors_scan(void)
+{
+    uint32_t erase_max = 0;
+    bool valid[SECTORS_COUNT];
+
+    for (int s = 0; s < SECTORS_COUNT; s++) {
+        struct sector_header hdr;
+
+        valid[s] = flash_area_read(wr.fa, sector_offset(s), &hdr, sizeof(hdr)) == 0 &&
+                   hdr.magic == SECTOR_MAGIC && hdr.format_version == SECTOR_FORMAT_VERSION &&
+                   hdr.header_size == sizeof(hdr) &&
+                   crc32_ieee(&hdr, offsetof(struct sector_header, header_crc)) ==
+                       hdr.header_crc;
+
+        if (!valid[s]) {
+            continue;
+        }
+
+        wr.erase_count[s] = hdr.erase_count;
+        erase_max = MAX(erase_max, hdr.erase_count);
+
+        // Sequence numbers are compared with wrap-around
+        if (wr.active < 0 || (int32_t)(hdr.seq - wr.seq) > 0) {
+            wr.active = s;
+            wr.seq = hdr.seq;
+        }
+    }
+
+    // A sector without a header lost its count, the ring wears evenly
+    for (int s = 0; s < SECTORS_COUNT; s++) {
+        if (!valid[s]) {
+            wr.erase_count[s] = erase_max;
+        }
+    }
+}
+
+/*****************************************************************************/
+// Replays the records of the active sector into the RAM index
+static void records_load(void)
+{
+    off_t base = sector_offset(wr.active);
+    size_t off = sizeof(struct sector_header);
+
+    while (off + sizeof(struct record_header) <= SECTOR_SIZE) {
+        struct record_header *hdr = (struct record_header *)record_buf;
+
+        if (flash_area_read(wr.fa, base + off, hdr, sizeof(*hdr))) {
+            wr.compact = true;
+            break;
+        }
+
+        if (read_erased(hdr, sizeof(*hdr))) {
+            break;
+        }
+
+        size_t len = sizeof(*hdr) + hdr->key_len + hdr->value_len;
+
+        // A torn record ends the sector, the next flush starts a new one
+        if (hdr->key_len == 0 || hdr->key_len >= KEY_MAX || hdr->value_len > VALUE_MAX ||
+            off + len > SECTOR_SIZE ||
+            flash_area_read(wr.fa, base + off + sizeof(*hdr), record_buf + sizeof(*hdr),
+                            len - sizeof(*hdr)) ||
+            crc32_ieee_update(crc32_ieee(hdr, offsetof(struct record_header, crc)),
+                              record_buf + sizeof(*hdr), len - sizeof(*hdr)) != hdr->crc) {
+            LOG_WRN("Settings record at 0x%x torn", (unsigned)off);
+            wr.compact = true;
+            break;
+        }
+
+        const char *key = (const char *)record_buf + sizeof(*hdr);
+        struct setting *e = index_find(key, hdr->key_len, key_hash(key, hdr->key_len), true);
+
+        if (e == NULL) {
+            LOG_WRN("Settings index full, key dropped");
+        } else {
+            e->deleted = (hdr->flags & RECORD_FLAG_DELETED) != 0;
+            e->value_len = e->deleted ? 0 : hdr->value_len;
+            memcpy(e->value, key + hdr->key_len, e->value_len);
+        }
+
+        off += ROUND_UP(len, SETTINGS_ALIGN);
+    }
+
+    wr.write_off = off;
+
+    // Rebuild the index without the deleted keys
+    int count = entries_count;
+
+    entries_count = 0;
+    memset(index_tbl, 0, sizeof(index_tbl));
+
+    for (int i = 0; i < count; i++) {
+        if (!entries[i].deleted) {
+            entries[entries_count] = entries[i];
+            index_insert(entries_count++);
+        }
+    }
+}
+
+/*****************************************************************************/
+static int bsp_settings_init(void)
+{
+    int err = flash_area_open(FIXED_PARTITION_ID(STORAGE_PARTITION), &wr.fa);
+
+    if (err) {
+        LOG_ERR("Failed to open storage partition (err %d)", err);
+        wr.fa = NULL;
+        return 0;
+    }
+
+    if (SETTINGS_OFFSET + SETTINGS_SIZE > wr.fa->fa_size) {
+        LOG_ERR("Settings area exceeds the storage partition");
+        flash_area_close(wr.fa);
+        wr.fa = NULL;
+        return 0;
+    }
+
+    bsp_ts_t t0 = bsp_ts_now();
+
+    sectors_scan();
+
+    if (wr.active < 0) {
+        // Blank area, the first flush writes sector 0
+        wr.compact = true;
+        wr.active = SECTORS_COUNT - 1;
+        wr.seq = 0;
+    } else {
+        records_load();
+    }
+
+    LOG_INF("Settings: %u keys from sector %d in %u us", entries_count, wr.active,
+            (uint32_t)bsp_ts_to_us(bsp_ts_now() - t0));
+
+    return 0;
+}
+
+// Before bsp_init() and the services, so they start with their settings
+SYS_INIT(bsp_settings_init, APPLICATION, 31);
+
+/*****************************************************************************/
+/* Shell */
+#ifdef CONFIG_SHELL
+static int cmd_settings_status(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    struct bsp_settings_stats s;
+
+    bsp_settings_stats_get(&s);
+
+    shell_print(sh, "Keys %u of %d, sector %d of %d, %u of %d bytes used", s.entries,
+                MAX_ENTRIES, wr.active, SECTORS_COUNT, (unsigned)wr.write_off, SECTOR_SIZE);
+    shell_print(sh, "Sets %u, coalesced %u, flushes %u, records %u, %u bytes written", s.sets,
+                s.coalesced, s.flushes, s.records, s.bytes);
+    shell_print(sh, "Compactions %u, sector erases %u..%u, flash errors %u", s.compactions,
+                s.erase_min, s.erase_max, s.flash_errors);
+    shell_print(sh, "Flush max %u us, change to flash max %u ms (limit %d ms)", s.flush_us_max,
+                s.latency_ms_max, FLUSH_MS);
+
+    return 0;
+}
+
+/*****************************************************************************/
+static int cmd_settings_list(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    for (int i = 0; i < entries_count; i++) {
+        char key[KEY_MAX];
+        uint8_t value[VALUE_MAX];
+        k_spinlock_key_t lock = k_spin_lock(&settings_lock);
+        const struct setting *e = &entries[i];
+        bool deleted = e->deleted;
+        bool dirty = e->dirty;
+        size_t len = e->value_len;
+
+        memcpy(key, e->key, e->key_len);
+        key[e->key_len] = '\0';
+        memcpy(value, e->value, len);
+
+        k_spin_unlock(&settings_lock, lock);
+
+        if (deleted) {
+            continue;
+        }
+
+        shell_print(sh, "%s%s (%u bytes)", key, dirty ? " *" : "", (unsigned)len);
+        shell_hexdump(sh, value, len);
+    }
+
+    return 0;
+}
+
+/*****************************************************************************/
+// Stores the value as text, without the terminating NUL
+static int cmd_settings_set(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+
+    int err = bsp_settings_set(argv[1], argv[2], strlen(argv[2]));
+    if (err) {
+        shell_error(sh, "Not set (err %d)", err);
+    }
+
+    return err;
+}
+
+/*****************************************************************************/
+static int cmd_settings_delete(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+
+    int err = bsp_settings_delete(argv[1]);
+    if (err) {
+        shell_error(sh, "Not deleted (err %d)", err);
+    }
+
+    return err;
+}
+
+/*****************************************************************************/
+static int cmd_settings_flush(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    int err = bsp_settings_flush();
+    if (err) {
+        shell_error(sh, "Flush failed (err %d)", err);
+    }
+
+    return err;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(
+    sub_settings, SHELL_CMD_ARG(status, NULL, "Show store status", cmd_settings_status, 1, 0),
+    SHELL_CMD_ARG(list, NULL, "Print all keys", cmd_settings_list, 1, 0),
+    SHELL_CMD_ARG(set, NULL, "<key> <text> Set a key", cmd_settings_set, 3, 0),
+    SHELL_CMD_ARG(delete, NULL, "<key> Delete a key", cmd_settings_delete, 2, 0),
+    SHELL_CMD_ARG(flush, NULL, "Write pending changes now", cmd_settings_flush, 1, 0),
+    SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(settings, &sub_settings, "Settings store", NULL);
+#endif /* CONFIG_SHELL */
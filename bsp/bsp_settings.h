@@ -0,0 +1,59 @@
+#ifndef BSP_SETTINGS_H_
+#define BSP_SETTINGS_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define BSP_SETTINGS_KEY_MAX CONFIG_BSP_SETTINGS_KEY_MAX
+#define BSP_SETTINGS_VALUE_MAX CONFIG_BSP_SETTINGS_VALUE_MAX
+
+struct bsp_settings_stats {
+    uint32_t entries;          // Keys in the RAM index, deleted ones included
+    uint32_t sets;             // Changes accepted
+    uint32_t coalesced;        // Changes folded into a write still pending
+    uint32_t flushes;
+    uint32_t records;          // Records programmed
+    uint32_t bytes;            // Bytes programmed, compactions included
+    uint32_t compactions;      // Sector changes, one erase each
+    uint32_t erase_min;        // Lowest and highest erase count of a sector
+    uint32_t erase_max;
+    uint32_t flash_errors;
+    uint32_t flush_us_max;     // Longest flush, compaction included
+    uint32_t latency_ms_max;   // Longest time from a change until it was on flash
+};
+
+/*****************************************************************************/
+
+/// @brief Copies the value of a key. Served from the RAM index, never waits
+/// for flash. ISR safe.
+/// @param key NUL terminated, shorter than BSP_SETTINGS_KEY_MAX
+/// @param value
+/// @param size Size of the value buffer
+/// @return Length of the value, -ENOENT if not set, -ENOMEM if the buffer is
+/// too small
+int bsp_settings_get(const char *key, void *value, size_t size);
+
+/// @brief Sets a key in RAM and schedules the write. Changes within
+/// CONFIG_BSP_SETTINGS_FLUSH_MS of the first unsaved one are written
+/// together, a value changed several times is written once and an unchanged
+/// value not at all. ISR safe.
+/// @param key NUL terminated, shorter than BSP_SETTINGS_KEY_MAX
+/// @param value
+/// @param len At most BSP_SETTINGS_VALUE_MAX
+/// @return 0 on success, -ENOSPC if the index is full
+int bsp_settings_set(const char *key, const void *value, size_t len);
+
+/// @brief Deletes a key, the deletion is written like a change
+/// @param key
+/// @return 0 on success, -ENOENT if not set
+int bsp_settings_delete(const char *key);
+
+/// @brief Writes pending changes now and waits for the flash
+/// @return 0 on success, -ENODEV without a settings area
+int bsp_settings_flush(void);
+
+/// @brief Returns the settings statistics
+/// @param stats
+void bsp_settings_stats_get(struct bsp_settings_stats *stats);
+
+#endif // BSP_SETTINGS_H_
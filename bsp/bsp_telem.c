@@ -0,0 +1,531 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <zephyr/device.h>
+#include <zephyr/devicetree.h>
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/logging/log.h>
+#include <zephyr/net/socket.h>
+#include <zephyr/shell/shell.h>
+#include <zephyr/sys/atomic.h>
+#include <zephyr/sys/util.h>
+
+#include "bsp_telem.h"
+
+#ifdef CONFIG_BSP_CAN_STATS
+#include "bsp_can_stats.h"
+#endif
+
+#ifdef CONFIG_BSP_NAFE_SIM
+#include "bsp_nafe_sim.h"
+#endif
+
+#ifdef CONFIG_BSP_PTP
+#include "bsp_ptp.h"
+#endif
+
+LOG_MODULE_REGISTER(bsp_telem, CONFIG_LOG_DEFAULT_LEVEL);
+
+/*****************************************************************************/
+/* Datagram layout, little endian. A datagram is a header followed by records,
+ * each a record header and a payload padded to 4 bytes. */
+#define TELEM_MAGIC 0x5456 // "VT"
+#define TELEM_FORMAT_VERSION 3
+#define TELEM_FLAG_PTP BIT(0) // Times are PTP time, otherwise bsp_ts time since boot
+
+struct telem_header {
+    uint16_t magic;
+    uint8_t format_version;
+    uint8_t header_size;
+    uint32_t seq;      // Incremented per datagram, gaps are lost datagrams
+    uint64_t time_ns;  // Time of the first record
+    uint16_t records;
+    uint16_t dropped;  // Records dropped since the previous datagram, saturated
+    uint8_t flags;
+    uint8_t reserved[3];
+};
+
+struct telem_record {
+    uint8_t type;
+    uint8_t source;
+    uint16_t len;   // Payload bytes without padding
+    int32_t dt_ns;  // Event time relative to telem_header.time_ns, saturated
+};
+
+BUILD_ASSERT(sizeof(struct telem_header) == 24);
+BUILD_ASSERT(sizeof(struct telem_record) == 8);
+
+#define DATAGRAM_SIZE CONFIG_BSP_TELEM_DATAGRAM_SIZE
+#define BUFFERS_COUNT CONFIG_BSP_TELEM_BUFFERS
+#define FLUSH_MS CONFIG_BSP_TELEM_FLUSH_MS
+#define PAYLOAD_MAX (DATAGRAM_SIZE - sizeof(struct telem_header) - sizeof(struct telem_record))
+
+BUILD_ASSERT(DATAGRAM_SIZE % 4 == 0);
+
+/*****************************************************************************/
+/* Private objects */
+
+// The datagram buffers form a ring: producers fill the buffer at fill_idx,
+// the sender sends sealed buffers from send_idx on. A buffer is sealed when
+// the next record does not fit or its oldest record reached FLUSH_MS.
+struct telem_buf {
+    uint8_t data[DATAGRAM_SIZE] __aligned(4);
+    size_t len;
+    uint16_t records;
+    uint8_t writers; // Reservations not committed yet
+    bool sealed;
+    int64_t first_ms;
+};
+
+static struct telem_buf bufs[BUFFERS_COUNT];
+static uint8_t fill_idx;
+static uint8_t send_idx;
+static uint32_t dropped_pending;
+static struct k_spinlock telem_lock;
+
+static K_SEM_DEFINE(start_sem, 0, 1);
+static K_SEM_DEFINE(send_sem, 0, 1);
+static atomic_t started;
+static struct sockaddr_in dest;
+static uint32_t seq;
+static struct bsp_telem_stats stats;
+
+#if defined(CONFIG_BSP_CAN_STATS) && CONFIG_BSP_TELEM_CAN_STATS_MS > 0 &&                          \
+    DT_HAS_CHOSEN(zephyr_canbus)
+#define TELEM_CAN_STATS
+static const struct device *const can_dev = DEVICE_DT_GET(DT_CHOSEN(zephyr_canbus));
+#endif
+
+/*****************************************************************************/
+static uint64_t ts_to_ns(bsp_ts_t ts)
+{
+#ifdef CONFIG_BSP_PTP
+    return bsp_ptp_ts_to_ns(ts);
+#else
+    return bsp_ts_to_ns(ts);
+#endif
+}
+
+/*****************************************************************************/
+static void buf_reset(struct telem_buf *b)
+{
+    b->len = sizeof(struct telem_header);
+    b->records = 0;
+    b->sealed = false;
+}
+
+/*****************************************************************************/
+// Returns the buffer taking a record of need bytes, sealing the current one
+// if the record does not fit. Called with telem_lock held.
+static struct telem_buf *fill_buf(size_t need)
+{
+    struct telem_buf *b = &bufs[fill_idx];
+
+    if (!b->sealed && b->len + need <= DATAGRAM_SIZE) {
+        return b;
+    }
+
+    if (!b->sealed) {
+        b->sealed = true;
+        k_sem_give(&send_sem);
+    }
+
+    uint8_t next = (fill_idx + 1) % BUFFERS_COUNT;
+    if (next == send_idx) {
+        return NULL; // All other buffers wait for the sender
+    }
+
+    fill_idx = next;
+    b = &bufs[next];
+    buf_reset(b);
+
+    return b;
+}
+
+/*****************************************************************************/
+void *bsp_telem_reserve(uint8_t type, uint8_t source, bsp_ts_t ts, size_t len,
+                        struct bsp_telem_slot *slot)
+{
+    size_t need = sizeof(struct telem_record) + ROUND_UP(len, 4);
+
+    if (len > PAYLOAD_MAX) {
+        return NULL;
+    }
+
+    uint64_t t = ts_to_ns(ts);
+    k_spinlock_key_t key = k_spin_lock(&telem_lock);
+    struct telem_buf *b = fill_buf(need);
+
+    if (b == NULL) {
+        dropped_pending++;
+        stats.dropped++;
+        k_spin_unlock(&telem_lock, key);
+        return NULL;
+    }
+
+    struct telem_header *h = (struct telem_header *)b->data;
+
+    if (b->records == 0) {
+        h->time_ns = t;
+#ifdef CONFIG_BSP_PTP
+        h->flags = bsp_ptp_valid() ? TELEM_FLAG_PTP : 0;
+#else
+        h->flags = 0;
+#endif
+        b->first_ms = k_uptime_get();
+    }
+
+    struct telem_record *r = (struct telem_record *)&b->data[b->len];
+
+    r->type = type;
+    r->source = source;
+    r->len = len;
+    // Events may be stamped before the first record of the datagram
+    r->dt_ns = CLAMP((int64_t)(t - h->time_ns), INT32_MIN, INT32_MAX);
+
+    b->len += need;
+    b->records++;
+    b->writers++;
+    slot->buf = b - bufs;
+    stats.records++;
+
+    k_spin_unlock(&telem_lock, key);
+
+    return r + 1;
+}
+
+/*****************************************************************************/
+void bsp_telem_commit(const struct bsp_telem_slot *slot)
+{
+    k_spinlock_key_t key = k_spin_lock(&telem_lock);
+    struct telem_buf *b = &bufs[slot->buf];
+
+    b->writers--;
+    if (b->sealed && b->writers == 0) {
+        k_sem_give(&send_sem);
+    }
+
+    k_spin_unlock(&telem_lock, key);
+}
+
+/*****************************************************************************/
+int bsp_telem_samples(uint8_t channel, bsp_ts_t ts, const int32_t *codes, size_t count)
+{
+    const size_t chunk_max = PAYLOAD_MAX / sizeof(int32_t);
+
+    while (count > 0) {
+        struct bsp_telem_slot slot;
+        size_t n = MIN(count, chunk_max);
+        int32_t *p = bsp_telem_reserve(BSP_TELEM_NAFE, channel, ts, n * sizeof(int32_t), &slot);
+
+        if (p == NULL) {
+            return -ENOBUFS;
+        }
+
+        memcpy(p, codes, n * sizeof(int32_t));
+        bsp_telem_commit(&slot);
+
+        codes += n;
+        count -= n;
+    }
+
+    return 0;
+}
+
+/*****************************************************************************/
+int bsp_telem_din(bsp_ts_t ts, uint8_t din, uint8_t din_valid)
+{
+    struct bsp_telem_slot slot;
+    struct bsp_telem_din *p = bsp_telem_reserve(BSP_TELEM_DIN, 0, ts, sizeof(*p), &slot);
+
+    if (p == NULL) {
+        return -ENOBUFS;
+    }
+
+    *p = (struct bsp_telem_din){.din = din, .din_valid = din_valid};
+    bsp_telem_commit(&slot);
+
+    return 0;
+}
+
+/*****************************************************************************/
+#ifdef TELEM_CAN_STATS
+static void can_stats_add(void)
+{
+    struct bsp_can_stats s;
+    struct bsp_telem_slot slot;
+
+    if (bsp_can_stats_get(can_dev, &s)) {
+        return;
+    }
+
+    struct bsp_telem_can_stats *p =
+        bsp_telem_reserve(BSP_TELEM_CAN_STATS, 0, bsp_ts_now(), sizeof(*p), &slot);
+    if (p == NULL) {
+        return;
+    }
+
+    *p = (struct bsp_telem_can_stats){
+        .load_permille = s.load_permille,
+        .state = s.state,
+        .rx_frames = s.rx_frames,
+        .tx_frames = s.tx_frames,
+        .tx_errors = s.tx_errors,
+        .rx_overruns = s.rx_overruns,
+        .bus_off = s.bus_off,
+    };
+    bsp_telem_commit(&slot);
+}
+#endif
+
+/*****************************************************************************/
+// Returns the sealed buffer to send next, or NULL and the milliseconds until
+// the fill buffer is due, -1 if it is empty
+static struct telem_buf *send_buf_get(int64_t *wait_ms)
+{
+    k_spinlock_key_t key = k_spin_lock(&telem_lock);
+    struct telem_buf *b = &bufs[send_idx];
+    int64_t age = k_uptime_get() - b->first_ms;
+
+    *wait_ms = -1;
+
+    if (!b->sealed && b->records > 0) {
+        if (age >= FLUSH_MS) {
+            b->sealed = true;
+        } else {
+            *wait_ms = FLUSH_MS - age;
+        }
+    }
+
+    if (!b->sealed || b->writers > 0) {
+        b = NULL;
+    } else {
+        struct telem_header *h = (struct telem_header *)b->data;
+
+        h->dropped = MIN(dropped_pending, UINT16_MAX);
+        dropped_pending = 0;
+    }
+
+    k_spin_unlock(&telem_lock, key);
+
+    return b;
+}
+
+/*****************************************************************************/
+static void send_buf_release(struct telem_buf *b, bool sent)
+{
+    k_spinlock_key_t key = k_spin_lock(&telem_lock);
+
+    if (sent) {
+        stats.datagrams++;
+        stats.bytes += b->len;
+    } else {
+        stats.send_errors++;
+    }
+
+    buf_reset(b);
+
+    // A buffer sealed on age is still the fill buffer and is refilled in place
+    if (send_idx != fill_idx) {
+        send_idx = (send_idx + 1) % BUFFERS_COUNT;
+    }
+
+    k_spin_unlock(&telem_lock, key);
+}
+
+/*****************************************************************************/
+static void sender_thread(void *p1, void *p2, void *p3)
+{
+    ARG_UNUSED(p1);
+    ARG_UNUSED(p2);
+    ARG_UNUSED(p3);
+
+    k_sem_take(&start_sem, K_FOREVER);
+
+    int fd = zsock_socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (fd < 0) {
+        LOG_ERR("Telemetry socket not opened (err %d)", -errno);
+        return;
+    }
+
+#ifdef TELEM_CAN_STATS
+    int64_t can_next = k_uptime_get();
+#endif
+
+    for (;;) {
+        int64_t wait_ms;
+        struct telem_buf *b = send_buf_get(&wait_ms);
+
+#ifdef TELEM_CAN_STATS
+        int64_t now = k_uptime_get();
+
+        if (now >= can_next) {
+            can_stats_add();
+            can_next = now + CONFIG_BSP_TELEM_CAN_STATS_MS;
+        }
+        if (wait_ms < 0 || can_next - now < wait_ms) {
+            wait_ms = can_next - now;
+        }
+#endif
+
+        if (b == NULL) {
+            k_sem_take(&send_sem, wait_ms < 0 ? K_FOREVER : K_MSEC(wait_ms));
+            continue;
+        }
+
+        struct telem_header *h = (struct telem_header *)b->data;
+
+        h->magic = TELEM_MAGIC;
+        h->format_version = TELEM_FORMAT_VERSION;
+        h->header_size = sizeof(*h);
+        h->seq = seq++;
+        h->records = b->records;
+
+        k_spinlock_key_t key = k_spin_lock(&telem_lock);
+        struct sockaddr_in to = dest;
+        k_spin_unlock(&telem_lock, key);
+
+        // Sent from the buffer the records were written to
+        ssize_t ret = zsock_sendto(fd, b->data, b->len, 0, (struct sockaddr *)&to, sizeof(to));
+
+        send_buf_release(b, ret >= 0);
+    }
+}
+
+K_THREAD_DEFINE(telem_thread, CONFIG_BSP_TELEM_THREAD_STACK_SIZE, sender_thread, NULL, NULL, NULL,
+                CONFIG_BSP_TELEM_THREAD_PRIORITY, 0, 0);
+
+/*****************************************************************************/
+int bsp_telem_dest_set(const char *addr, uint16_t port)
+{
+    struct sockaddr_in to = {.sin_family = AF_INET, .sin_port = htons(port)};
+
+    if (zsock_inet_pton(AF_INET, addr, &to.sin_addr) != 1) {
+        return -EINVAL;
+    }
+
+    k_spinlock_key_t key = k_spin_lock(&telem_lock);
+    dest = to;
+    k_spin_unlock(&telem_lock, key);
+
+    return 0;
+}
+
+/*****************************************************************************/
+int bsp_telem_start(void)
+{
+    if (!atomic_cas(&started, 0, 1)) {
+        return -EALREADY;
+    }
+
+    for (size_t i = 0; i < ARRAY_SIZE(bufs); i++) {
+        buf_reset(&bufs[i]);
+    }
+
+    if (dest.sin_family != AF_INET &&
+        bsp_telem_dest_set(CONFIG_BSP_TELEM_DEST_ADDR, CONFIG_BSP_TELEM_DEST_PORT)) {
+        LOG_ERR("Invalid telemetry destination %s", CONFIG_BSP_TELEM_DEST_ADDR);
+    }
+
+    k_sem_give(&start_sem);
+    return 0;
+}
+
+/*****************************************************************************/
+void bsp_telem_stats_get(struct bsp_telem_stats *s)
+{
+    k_spinlock_key_t key = k_spin_lock(&telem_lock);
+    *s = stats;
+    k_spin_unlock(&telem_lock, key);
+}
+
+/*****************************************************************************/
+#ifdef CONFIG_BSP_TELEM_AUTO_START
+static int telem_init(void)
+{
+    bsp_telem_start();
+    return 0;
+}
+
+SYS_INIT(telem_init, APPLICATION, 35);
+#endif
+
+/*****************************************************************************/
+/* Shell */
+#ifdef CONFIG_SHELL
+static int cmd_telem_status(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+    ARG_UNUSED(argv);
+
+    static struct bsp_telem_stats last;
+    static int64_t last_ms;
+    struct bsp_telem_stats s;
+    char addr[NET_IPV4_ADDR_LEN];
+
+    bsp_telem_stats_get(&s);
+    int64_t now = k_uptime_get();
+    int64_t dt = MAX(now - last_ms, 1);
+
+    zsock_inet_ntop(AF_INET, &dest.sin_addr, addr, sizeof(addr));
+    shell_print(sh, "To %s:%u, %u byte datagrams, %u buffers, flush %u ms", addr,
+                ntohs(dest.sin_port), DATAGRAM_SIZE, BUFFERS_COUNT, FLUSH_MS);
+    shell_print(sh, "Datagrams %u, bytes %llu, records %u, dropped %u, send errors %u",
+                s.datagrams, s.bytes, s.records, s.dropped, s.send_errors);
+    shell_print(sh, "Since last status: %u datagrams/s, %llu kB/s",
+                (uint32_t)((s.datagrams - last.datagrams) * 1000LL / dt),
+                (s.bytes - last.bytes) / dt);
+
+    last = s;
+    last_ms = now;
+
+    return 0;
+}
+
+/*****************************************************************************/
+static int cmd_telem_dest(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(argc);
+
+    if (bsp_telem_dest_set(argv[1], strtoul(argv[2], NULL, 0))) {
+        shell_error(sh, "Invalid address %s", argv[1]);
+        return -EINVAL;
+    }
+
+    return 0;
+}
+
+/*****************************************************************************/
+#ifdef CONFIG_BSP_NAFE_SIM
+static void sim_block(uint8_t channel, bsp_ts_t ts, const int32_t *codes, size_t count,
+                      void *user_data)
+{
+    ARG_UNUSED(user_data);
+
+    bsp_telem_samples(channel, ts, codes, count);
+}
+
+static int cmd_telem_sim(const struct shell *sh, size_t argc, char **argv)
+{
+    ARG_UNUSED(sh);
+    ARG_UNUSED(argc);
+
+    return bsp_nafe_sim_callback_set(strcmp(argv[1], "on") == 0 ? sim_block : NULL, NULL);
+}
+#endif
+
+SHELL_STATIC_SUBCMD_SET_CREATE(sub_telem,
+                               SHELL_CMD_ARG(status, NULL, "Show sender statistics and rate",
+                                             cmd_telem_status, 1, 0),
+                               SHELL_CMD_ARG(dest, NULL, "<ipv4 address> <port>", cmd_telem_dest,
+                                             3, 0),
+#ifdef CONFIG_BSP_NAFE_SIM
+                               SHELL_CMD_ARG(sim, NULL, "<on|off> Stream the NAFE simulator",
+                                             cmd_telem_sim, 2, 0),
+#endif
+                               SHELL_SUBCMD_SET_END);
+
+SHELL_CMD_REGISTER(telem, &sub_telem, "UDP telemetry", NULL);
+#endif /* CONFIG_SHELL */
@@ -0,0 +1,88 @@
+#ifndef BSP_TELEM_H_
+#define BSP_TELEM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "bsp_ts.h"
+
+/// Record types, see bsp_telem.c for the datagram layout and
+/// scripts/telem_rx.py for a receiver
+enum bsp_telem_type {
+    BSP_TELEM_NAFE = 1,      // int32_t codes of one channel, source is the channel
+    BSP_TELEM_DIN = 2,       // Digital input edge, struct bsp_telem_din
+    BSP_TELEM_CAN_STATS = 3, // struct bsp_telem_can_stats, source is the bus
+};
+
+struct bsp_telem_din {
+    uint8_t din;       // Inputs at logic high, bit n is input n+1
+    uint8_t din_valid; // Inputs in a defined state
+    uint8_t reserved[2];
+};
+
+struct bsp_telem_can_stats {
+    uint16_t load_permille;
+    uint8_t state;     // enum can_state
+    uint8_t reserved;
+    uint32_t rx_frames;
+    uint32_t tx_frames;
+    uint32_t tx_errors;
+    uint32_t rx_overruns;
+    uint32_t bus_off;
+};
+
+/// Reservation of a record in the datagram being filled
+struct bsp_telem_slot {
+    uint8_t buf;
+};
+
+struct bsp_telem_stats {
+    uint32_t datagrams;
+    uint64_t bytes;
+    uint32_t records;
+    uint32_t dropped;     // Records lost with all datagram buffers in use
+    uint32_t send_errors;
+};
+
+/*****************************************************************************/
+
+/// @brief Opens the socket and starts sending to the configured destination
+/// @return 0 on success, -EALREADY if started
+int bsp_telem_start(void);
+
+/// @brief Sets the destination of the datagrams
+/// @param addr IPv4 address
+/// @param port
+/// @return 0 on success, -EINVAL for an invalid address
+int bsp_telem_dest_set(const char *addr, uint16_t port);
+
+/// @brief Reserves a record in the datagram being filled. The producer writes
+/// the payload in place and hands it over with bsp_telem_commit(); the
+/// datagram is sent from the same buffer. ISR safe.
+/// @param type enum bsp_telem_type
+/// @param source Channel or bus
+/// @param ts Time of the event, bsp_ts_now() if it has none
+/// @param len Payload bytes, at most CONFIG_BSP_TELEM_DATAGRAM_SIZE - 32
+/// @param slot Filled with the reservation
+/// @return Payload, 4 byte aligned, NULL if no buffer is free
+void *bsp_telem_reserve(uint8_t type, uint8_t source, bsp_ts_t ts, size_t len,
+                        struct bsp_telem_slot *slot);
+
+/// @brief Completes a record reserved with bsp_telem_reserve(). ISR safe.
+void bsp_telem_commit(const struct bsp_telem_slot *slot);
+
+/// @brief Adds NAFE codes of a channel, split into several records when they
+/// do not fit one datagram. ISR safe.
+/// @param ts Time of the block
+/// @return 0 on success, -ENOBUFS if codes were dropped
+int bsp_telem_samples(uint8_t channel, bsp_ts_t ts, const int32_t *codes, size_t count);
+
+/// @brief Adds a digital input edge. ISR safe.
+/// @param ts Interrupt time of the edge
+/// @return 0 on success, -ENOBUFS if dropped
+int bsp_telem_din(bsp_ts_t ts, uint8_t din, uint8_t din_valid);
+
+/// @brief Returns the sender statistics
+void bsp_telem_stats_get(struct bsp_telem_stats *stats);
+
+#endif // BSP_TELEM_H_
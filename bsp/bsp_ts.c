@@ -0,0 +1,142 @@
+#include <zephyr/init.h>
+#include <zephyr/kernel.h>
+#include <zephyr/sys/time_units.h>
+#include <zephyr/sys/util.h>
+
+#if defined(CONFIG_ARCH_POSIX)
+#include "bsp_ts_bottom.h"
+#elif defined(CONFIG_CPU_CORTEX_M_HAS_DWT)
+#include <cmsis_core.h>
+#endif
+
+#include "bsp_ts.h"
+
+/*****************************************************************************/
+#if defined(CONFIG_ARCH_POSIX)
+#define TS_HZ NSEC_PER_SEC
+#else
+#ifdef CONFIG_CPU_CORTEX_M_HAS_DWT
+#define TS_HZ SystemCoreClock // DWT counts core clock cycles
+#else
+#define TS_HZ sys_clock_hw_cycles_per_sec()
+#endif
+#define TS_EXTEND
+
+// The 32-bit counter wraps after 2^32 cycles, about 4.3 s at the 1 GHz core
+// clock of the M7. It is read more often than that, so every wrap is seen.
+#define KEEPALIVE_MS 1000
+#endif
+
+/*****************************************************************************/
+/* Private objects */
+#ifdef TS_EXTEND
+static struct k_spinlock ts_lock;
+static uint32_t last;
+static uint32_t high;
+#endif
+
+/*****************************************************************************/
+#ifdef TS_EXTEND
+static inline uint32_t counter_read(void)
+{
+#ifdef CONFIG_CPU_CORTEX_M_HAS_DWT
+    return DWT->CYCCNT;
+#else
+    return k_cycle_get_32();
+#endif
+}
+#endif
+
+/*****************************************************************************/
+bsp_ts_t bsp_ts_now(void)
+{
+#ifdef TS_EXTEND
+    k_spinlock_key_t key = k_spin_lock(&ts_lock);
+    uint32_t now = counter_read();
+
+    if (now < last) {
+        high++;
+    }
+    last = now;
+
+    bsp_ts_t ts = ((uint64_t)high << 32) | now;
+
+    k_spin_unlock(&ts_lock, key);
+
+    return ts;
+#else
+    return bsp_ts_host_ns_bottom();
+#endif
+}
+
+/*****************************************************************************/
+uint32_t bsp_ts_hz(void)
+{
+    return TS_HZ;
+}
+
+/*****************************************************************************/
+uint64_t bsp_ts_to_ns(bsp_ts_t ts)
+{
+    uint32_t hz = TS_HZ;
+
+    // Split, so the multiplication does not overflow for large timestamps
+    return (ts / hz) * NSEC_PER_SEC + (ts % hz) * NSEC_PER_SEC / hz;
+}
+
+/*****************************************************************************/
+uint64_t bsp_ts_to_us(bsp_ts_t ts)
+{
+    uint32_t hz = TS_HZ;
+
+    return (ts / hz) * USEC_PER_SEC + (ts % hz) * USEC_PER_SEC / hz;
+}
+
+/*****************************************************************************/
+bsp_ts_t bsp_ts_from_ns(uint64_t ns)
+{
+    uint32_t hz = TS_HZ;
+
+    return (ns / NSEC_PER_SEC) * hz + DIV_ROUND_UP((ns % NSEC_PER_SEC) * hz, NSEC_PER_SEC);
+}
+
+/*****************************************************************************/
+#ifdef TS_EXTEND
+static void keepalive(struct k_timer *timer)
+{
+    ARG_UNUSED(timer);
+
+    (void)bsp_ts_now();
+}
+
+static K_TIMER_DEFINE(keepalive_timer, keepalive, NULL);
+
+/*****************************************************************************/
+static int bsp_ts_init(void)
+{
+#ifdef CONFIG_CPU_CORTEX_M_HAS_DWT
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+#ifdef CONFIG_CPU_CORTEX_M7
+    // The DWT of the M7 ignores writes until unlocked
+    DWT->LAR = 0xC5ACCE55;
+#endif
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+#endif
+
+    return 0;
+}
+
+// Before the drivers, so their interrupts can stamp events
+SYS_INIT(bsp_ts_init, PRE_KERNEL_1, 0);
+
+/*****************************************************************************/
+static int bsp_ts_keepalive_init(void)
+{
+    k_timer_start(&keepalive_timer, K_MSEC(KEEPALIVE_MS), K_MSEC(KEEPALIVE_MS));
+
+    return 0;
+}
+
+SYS_INIT(bsp_ts_keepalive_init, POST_KERNEL, 0);
+#endif
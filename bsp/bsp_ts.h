@@ -0,0 +1,36 @@
+#ifndef BSP_TS_H_
+#define BSP_TS_H_
+
+#include <stdint.h>
+
+/// @brief Monotonic timestamp in ticks of a free-running hardware counter:
+/// the DWT cycle counter on Cortex-M, the host monotonic clock on native_sim.
+/// 64 bits, so it does not wrap during the lifetime of the device.
+typedef uint64_t bsp_ts_t;
+
+/*****************************************************************************/
+
+/// @brief Returns the current timestamp. ISR safe, a few counter reads.
+bsp_ts_t bsp_ts_now(void);
+
+/// @brief Returns the tick rate of the timestamps
+uint32_t bsp_ts_hz(void);
+
+/// @brief Converts a timestamp or a difference of timestamps to nanoseconds
+uint64_t bsp_ts_to_ns(bsp_ts_t ts);
+
+/// @brief Converts a timestamp or a difference of timestamps to microseconds
+uint64_t bsp_ts_to_us(bsp_ts_t ts);
+
+/// @brief Converts nanoseconds to ticks, rounded up
+bsp_ts_t bsp_ts_from_ns(uint64_t ns);
+
+/// @brief Returns the nanoseconds from earlier to later, negative if later is
+/// before earlier
+static inline int64_t bsp_ts_diff_ns(bsp_ts_t later, bsp_ts_t earlier)
+{
+    return (later >= earlier) ? (int64_t)bsp_ts_to_ns(later - earlier)
+                              : -(int64_t)bsp_ts_to_ns(earlier - later);
+}
+
+#endif // BSP_TS_H_
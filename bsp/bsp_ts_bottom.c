@@ -0,0 +1,31 @@
+/*
+ * Host side of the timestamp counter, built into the native simulator runner
+ */
+#include <time.h>
+
+#include "bsp_ts_bottom.h"
+
+static uint64_t start_ns;
+
+/*****************************************************************************/
+static uint64_t host_ns(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000000U + ts.tv_nsec;
+}
+
+/*****************************************************************************/
+// Counts from the first read, close to the simulated boot
+uint64_t bsp_ts_host_ns_bottom(void)
+{
+    uint64_t now = host_ns();
+
+    if (start_ns == 0) {
+        start_ns = now;
+    }
+
+    return now - start_ns;
+}
@@ -0,0 +1,20 @@
+/*
+ * Host side of the timestamp counter. Only standard C types may cross this
+ * interface, as the implementation is built into the native simulator runner.
+ */
+#ifndef BSP_TS_BOTTOM_H_
+#define BSP_TS_BOTTOM_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint64_t bsp_ts_host_ns_bottom(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // BSP_TS_BOTTOM_H_
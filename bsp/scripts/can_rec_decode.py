@@ -0,0 +1,224 @@
+#!/usr/bin/env python3
+#
+# Decodes CAN recorder blocks (bsp_can_rec.c) into candump log format.
+#
+# Input is either the output of the "can_rec dump" shell command, where block
+# data is on ":<offset> <hex>" lines and anything else is ignored, or a raw
+# image of the recording area (--image, e.g. the native_sim flash.bin with
+# --offset set to the storage partition plus CONFIG_BSP_CAN_REC_OFFSET).
+#
+# Usage: can_rec_decode.py [--image --offset N --size N] input [-o out.log]
+
+import argparse
+import struct
+import sys
+import zlib
+
+BLOCK_MAGIC = 0x43455243
+BLOCK_FORMAT_VERSION = 1
+HEADER = struct.Struct('<IBBHIIIIQII')
+FLAG_CAPTURE_START = 0x01
+FLAG_HW_TIMESTAMP = 0x02
+
+TAG_MARKER = 0x03
+TAG_CACHED = 0x04
+TAG_EXT = 0x10
+TAG_FD = 0x20
+TAG_BRS = 0x40
+TAG_RTR = 0x80
+
+ID_CACHE_SIZE = 32
+DLC_TO_LEN = [0, 1, 2, 3, 4, 5, 6, 7, 8, 12, 16, 20, 24, 32, 48, 64]
+
+
+class Reader:
+    def __init__(self, data):
+        self.data = data
+        self.pos = 0
+
+    def byte(self):
+        b = self.data[self.pos]
+        self.pos += 1
+        return b
+
+    def varint(self):
+        value = 0
+        shift = 0
+        while True:
+            b = self.byte()
+            value |= (b & 0x7F) << shift
+            shift += 7
+            if not b & 0x80:
+                return value
+
+    def le16(self):
+        value = self.data[self.pos] | (self.data[self.pos + 1] << 8)
+        self.pos += 2
+        return value
+
+    def done(self):
+        return self.pos >= len(self.data)
+
+
+def parse_header(data):
+    if len(data) < HEADER.size:
+        return None
+    fields = HEADER.unpack_from(data)
+    (magic, version, flags, header_size, seq, capture, records, payload_len, base_ts,
+     payload_crc, header_crc) = fields
+    if magic != BLOCK_MAGIC or version != BLOCK_FORMAT_VERSION or header_size != HEADER.size:
+        return None
+    if zlib.crc32(data[:HEADER.size - 4]) != header_crc:
+        return None
+    payload = data[HEADER.size:HEADER.size + payload_len]
+    if len(payload) != payload_len or zlib.crc32(payload) != payload_crc:
+        return None
+    return {'flags': flags, 'seq': seq, 'capture': capture, 'records': records,
+            'base_ts': base_ts, 'payload': payload}
+
+
+def decode_block(block):
+    """Yields (ts_us, kind, fields) tuples, mirroring the encoder state."""
+    r = Reader(block['payload'])
+    hw_ts = block['flags'] & FLAG_HW_TIMESTAMP
+    ts = block['base_ts']
+    cache = [None] * ID_CACHE_SIZE
+    cache_next = 0
+
+    for _ in range(block['records']):
+        tag = r.byte()
+        ts += r.varint()
+
+        if tag & TAG_MARKER == TAG_MARKER:
+            if tag & TAG_CACHED:
+                yield ts, 'drops', {'count': r.varint()}
+            else:
+                yield ts, 'trigger', {}
+            continue
+
+        hw = r.le16() if hw_ts else None
+        if tag & TAG_CACHED:
+            idx = r.byte()
+            can_id = cache[idx][0]
+        else:
+            can_id = r.varint()
+            idx = cache_next
+            cache[idx] = [can_id, bytearray(64)]
+            cache_next = (cache_next + 1) % ID_CACHE_SIZE
+        dlc = r.byte()
+        length = 0 if tag & TAG_RTR else DLC_TO_LEN[dlc & 0x0F]
+
+        data = bytearray(length)
+        for group in range(0, length, 8):
+            mask = r.byte()
+            for i in range(group, min(group + 8, length)):
+                if mask & (1 << (i - group)):
+                    data[i] = r.byte()
+
+        prev = cache[idx][1]
+        if tag & TAG_CACHED:
+            for i in range(length):
+                data[i] ^= prev[i]
+        prev[:length] = data
+
+        yield ts, 'frame', {'bus': tag & 0x03, 'id': can_id, 'ext': bool(tag & TAG_EXT),
+                            'fd': bool(tag & TAG_FD), 'brs': bool(tag & TAG_BRS),
+                            'rtr': bool(tag & TAG_RTR), 'dlc': dlc, 'data': bytes(data),
+                            'hw_ts': hw}
+
+
+def blocks_from_dump(lines):
+    chunks = {}
+    for line in lines:
+        line = line.strip()
+        if not line.startswith(':'):
+            continue
+        try:
+            offset, hexdata = line[1:].split()
+            chunks[int(offset, 16)] = bytes.fromhex(hexdata)
+        except ValueError:
+            continue
+
+    # Reassemble contiguous runs, each block starts with a header
+    data = bytearray()
+    start = None
+    for offset in sorted(chunks):
+        if start is None or offset != start + len(data):
+            if start is not None:
+                yield from blocks_from_image(bytes(data), start)
+            start = offset
+            data = bytearray()
+        data += chunks[offset]
+    if start is not None:
+        yield from blocks_from_image(bytes(data), start)
+
+
+def blocks_from_image(image, base=0, block_size=None):
+    pos = 0
+    while pos + HEADER.size <= len(image):
+        block = parse_header(image[pos:])
+        if block is None:
+            if block_size is None:
+                break
+            pos += block_size
+            continue
+        yield block
+        if block_size is None:
+            pos += (HEADER.size + len(block['payload']) + 7) & ~7
+        else:
+            pos += block_size
+
+
+def format_frame(ts, f):
+    can_id = f'{f["id"]:08X}' if f['ext'] else f'{f["id"]:03X}'
+    if f['rtr']:
+        body = f'{can_id}#R'
+    elif f['fd']:
+        body = f'{can_id}##{1 if f["brs"] else 0}{f["data"].hex().upper()}'
+    else:
+        body = f'{can_id}#{f["data"].hex().upper()}'
+    return f'({ts // 1000000}.{ts % 1000000:06d}) can{f["bus"]} {body}'
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Decode CAN recorder blocks to candump log')
+    parser.add_argument('input')
+    parser.add_argument('-o', '--output')
+    parser.add_argument('--image', action='store_true', help='input is a raw flash image')
+    parser.add_argument('--offset', type=lambda x: int(x, 0), default=0)
+    parser.add_argument('--size', type=lambda x: int(x, 0))
+    parser.add_argument('--block-size', type=lambda x: int(x, 0), default=4096)
+    args = parser.parse_args()
+
+    if args.image:
+        with open(args.input, 'rb') as f:
+            f.seek(args.offset)
+            image = f.read(args.size) if args.size else f.read()
+        blocks = list(blocks_from_image(image, block_size=args.block_size))
+    else:
+        with open(args.input, encoding='utf-8', errors='replace') as f:
+            blocks = list(blocks_from_dump(f))
+
+    if not blocks:
+        sys.exit(f'{args.input}: no recorder blocks')
+
+    # Flash order is circular, sequence order is time order
+    blocks.sort(key=lambda b: b['seq'])
+
+    out = open(args.output, 'w', encoding='utf-8') if args.output else sys.stdout
+    for block in blocks:
+        if block['flags'] & FLAG_CAPTURE_START:
+            out.write(f'# capture {block["capture"]}\n')
+        for ts, kind, fields in decode_block(block):
+            if kind == 'frame':
+                out.write(format_frame(ts, fields) + '\n')
+            elif kind == 'trigger':
+                out.write(f'# ({ts // 1000000}.{ts % 1000000:06d}) trigger\n')
+            else:
+                out.write(f'# ({ts // 1000000}.{ts % 1000000:06d}) {fields["count"]} frames lost\n')
+    if out is not sys.stdout:
+        out.close()
+
+
+if __name__ == '__main__':
+    main()
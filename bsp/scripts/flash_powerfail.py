@@ -0,0 +1,68 @@
+#!/usr/bin/env python3
+#
+# Power failure stress test of the flash users (settings, data logger, CAN
+# recorder, firmware update) on native_sim. Runs the simulator again and again
+# on the same flash file; each run is cut by bsp_flash_sim.c after a random
+# number of program or erase operations and the next boot has to recover from
+# what the cut left behind. A run fails on a crash or on an error log line.
+#
+# Flash waits are shortened with --flash-speed, so many cuts fit in a minute:
+#   flash_powerfail.py build/zephyr/zephyr.exe --runs 200 --max-ops 2000
+# Arguments after -- go to the simulator, e.g. to start a workload.
+#
+# Usage: flash_powerfail.py EXE [--flash FILE] [--runs N] [--max-ops N]
+#        [--speed N] [--seconds N] [--seed N] [--erase] [-- ARGS...]
+
+import argparse
+import random
+import subprocess
+import sys
+
+POWERFAIL_EXIT = 3  # BSP_FLASH_SIM_POWERFAIL_EXIT
+
+
+def run_once(args, ops, extra):
+    cmd = [args.exe, f'--flash={args.flash}', f'--flash-speed={args.speed}',
+           f'--flash-powerfail={ops}', f'-stop_at={args.seconds}'] + extra
+    proc = subprocess.run(cmd, stdin=subprocess.DEVNULL, stdout=subprocess.PIPE,
+                          stderr=subprocess.STDOUT, text=True, errors='replace',
+                          timeout=args.seconds * 10 + 30)
+    errors = [line for line in proc.stdout.splitlines() if '<err>' in line]
+    return proc.returncode, errors
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument('exe')
+    parser.add_argument('--flash', default='flash.bin')
+    parser.add_argument('--runs', type=int, default=100)
+    parser.add_argument('--max-ops', type=int, default=1000,
+                        help='cut within this many program or erase operations')
+    parser.add_argument('--speed', type=int, default=100)
+    parser.add_argument('--seconds', type=int, default=30,
+                        help='simulated run time when the cut is not reached')
+    parser.add_argument('--seed', type=int)
+    parser.add_argument('--erase', action='store_true', help='start from an erased flash')
+    args, extra = parser.parse_known_args()
+    extra = [a for a in extra if a != '--']
+
+    rng = random.Random(args.seed)
+    cuts = failures = 0
+    for run in range(args.runs):
+        ops = rng.randint(1, args.max_ops)
+        erase = ['--flash-erase'] if args.erase and run == 0 else []
+        code, errors = run_once(args, ops, erase + extra)
+        if code == POWERFAIL_EXIT:
+            cuts += 1
+        if code not in (0, POWERFAIL_EXIT) or errors:
+            failures += 1
+            print(f'run {run}: cut after {ops} ops, exit {code}')
+            for line in errors:
+                print(f'  {line}')
+
+    print(f'{args.runs} runs, {cuts} power failures, {failures} failed')
+    return 1 if failures else 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
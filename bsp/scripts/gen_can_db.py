@@ -0,0 +1,395 @@
+#!/usr/bin/env python3
+#
+# Generates straight-line CAN signal decoders and encoders from a DBC file.
+#
+# Supported subset: BO_ and SG_ lines with Intel (@1) and Motorola (@0) byte
+# order, signed and unsigned raw values, factor and offset scaling. Every
+# message gets a decode and encode function where each signal is extracted
+# with constant byte indexes, shifts and masks, and a bsp_can receive table
+# entry that decodes the frame and calls a weak per-message handler.
+#
+# Usage: gen_can_db.py --dbc file.dbc --header can_db.h --source can_db.c
+
+import argparse
+import os
+import re
+import sys
+
+BO_RE = re.compile(r'^BO_\s+(\d+)\s+(\w+)\s*:\s*(\d+)\s+(\w+)')
+SG_RE = re.compile(
+    r'^SG_\s+(\w+)\s*(\w*)\s*:\s*(\d+)\|(\d+)@([01])([+-])\s*'
+    r'\(\s*([-+0-9.eE]+)\s*,\s*([-+0-9.eE]+)\s*\)\s*'
+    r'\[\s*([-+0-9.eE]+)\s*\|\s*([-+0-9.eE]+)\s*\]\s*"([^"]*)"')
+
+CAN_EFF_FLAG = 0x80000000
+
+
+class Signal:
+    def __init__(self, name, start, length, intel, signed, factor, offset, unit):
+        self.name = name
+        self.start = start
+        self.length = length
+        self.intel = intel
+        self.signed = signed
+        self.factor = factor
+        self.offset = offset
+        self.unit = unit
+
+    @property
+    def c_name(self):
+        return snake(self.name)
+
+    @property
+    def is_integer(self):
+        return self.factor == 1.0 and self.offset == 0.0
+
+    @property
+    def raw_bits(self):
+        return 32 if self.length <= 32 else 64
+
+    @property
+    def c_type(self):
+        if not self.is_integer:
+            return 'float'
+        return ('int' if self.signed else 'uint') + f'{self.raw_bits}_t'
+
+    def bit_positions(self):
+        """Yields (frame bit position, value bit index) for every bit"""
+        if self.intel:
+            for k in range(self.length):
+                yield self.start + k, k
+        else:
+            # Motorola: start is the MSB in the DBC sawtooth numbering
+            pos = self.start
+            for j in range(self.length):
+                yield pos, self.length - 1 - j
+                pos = pos + 15 if pos % 8 == 0 else pos - 1
+
+    def segments(self):
+        """Groups the bits per byte into (byte, low bit, width, value low bit)"""
+        per_byte = {}
+        for pos, vbit in self.bit_positions():
+            per_byte.setdefault(pos // 8, []).append((pos % 8, vbit))
+
+        segs = []
+        for byte, bits in sorted(per_byte.items()):
+            bits.sort()
+            lo, vlo = bits[0]
+            segs.append((byte, lo, len(bits), vlo))
+        return segs
+
+
+class Message:
+    def __init__(self, can_id, name, dlc):
+        self.extended = bool(can_id & CAN_EFF_FLAG)
+        self.can_id = can_id & 0x1FFFFFFF
+        self.name = name
+        self.dlc = dlc
+        self.signals = []
+
+    @property
+    def c_name(self):
+        return snake(self.name)
+
+
+def snake(name):
+    name = re.sub(r'([a-z0-9])([A-Z])', r'\1_\2', name)
+    return name.lower()
+
+
+def c_float(value):
+    text = repr(float(value))
+    if 'e' not in text and '.' not in text:
+        text += '.0'
+    return text + 'f'
+
+
+def parse_dbc(path):
+    messages = []
+    current = None
+
+    with open(path, encoding='utf-8', errors='replace') as f:
+        for lineno, line in enumerate(f, 1):
+            line = line.strip()
+
+            m = BO_RE.match(line)
+            if m:
+                current = Message(int(m.group(1)), m.group(2), int(m.group(3)))
+                messages.append(current)
+                continue
+
+            if not line.startswith('SG_'):
+                # Anything else ends the signal list of the current message
+                if line:
+                    current = None
+                continue
+
+            m = SG_RE.match(line)
+            if m is None or current is None:
+                sys.exit(f'{path}:{lineno}: unsupported signal definition')
+            if m.group(2):
+                sys.exit(f'{path}:{lineno}: multiplexed signals are not supported')
+
+            sig = Signal(m.group(1), int(m.group(3)), int(m.group(4)), m.group(5) == '1',
+                         m.group(6) == '-', float(m.group(7)), float(m.group(8)), m.group(11))
+
+            if sig.length < 1 or sig.length > 64 or sig.factor == 0.0:
+                sys.exit(f'{path}:{lineno}: invalid signal {sig.name}')
+            for pos, _ in sig.bit_positions():
+                if pos < 0 or pos >= current.dlc * 8:
+                    sys.exit(f'{path}:{lineno}: signal {sig.name} exceeds DLC {current.dlc}')
+
+            current.signals.append(sig)
+
+    return messages
+
+
+def extract_expr(sig):
+    raw_t = f'uint{sig.raw_bits}_t'
+    terms = []
+
+    for byte, lo, width, vlo in sig.segments():
+        term = f'd[{byte}]'
+        if lo:
+            term = f'({term} >> {lo})'
+        if width < 8 - lo:
+            term = f'({term} & 0x{(1 << width) - 1:X}U)'
+        term = f'(({raw_t}){term}'
+        term += f' << {vlo})' if vlo else ')'
+        terms.append(term)
+
+    return ' | '.join(terms)
+
+
+def decode_stmt(prefix, sig):
+    raw_t = f'uint{sig.raw_bits}_t'
+    expr = extract_expr(sig)
+
+    if sig.signed and sig.length < sig.raw_bits:
+        sign = f'0x{1 << (sig.length - 1):X}U' + ('LL' if sig.raw_bits == 64 else '')
+        value = f'(int{sig.raw_bits}_t)((({raw_t})({expr}) ^ {sign}) - {sign})'
+    elif sig.signed:
+        value = f'(int{sig.raw_bits}_t)({expr})'
+    else:
+        value = f'({raw_t})({expr})'
+
+    if sig.is_integer:
+        return f'    m->{sig.c_name} = {value};'
+
+    scaled = f'(float){value}'
+    if sig.factor != 1.0:
+        scaled += f' * {c_float(sig.factor)}'
+    if sig.offset:
+        scaled += f' {"-" if sig.offset < 0 else "+"} {c_float(abs(sig.offset))}'
+    return f'    m->{sig.c_name} = {scaled};'
+
+
+def encode_stmts(prefix, sig):
+    raw_t = f'uint{sig.raw_bits}_t'
+    lines = ['    {']
+
+    if sig.is_integer:
+        lines.append(f'        {raw_t} raw = ({raw_t})m->{sig.c_name};')
+    else:
+        phys = f'm->{sig.c_name}'
+        if sig.offset:
+            phys = f'({phys} {"+" if sig.offset < 0 else "-"} {c_float(abs(sig.offset))})'
+        if sig.factor != 1.0:
+            phys += f' * {c_float(1.0 / sig.factor)}'
+        lines.append(f'        {raw_t} raw = ({raw_t}){prefix}_round({phys});')
+
+    for byte, lo, width, vlo in sig.segments():
+        value = f'(raw >> {vlo})' if vlo else 'raw'
+        if width < 8:
+            value = f'({value} & 0x{(1 << width) - 1:X}U)'
+        if lo:
+            value = f'({value} << {lo})'
+        lines.append(f'        d[{byte}] |= (uint8_t){value};')
+
+    lines.append('    }')
+    return lines
+
+
+def generate_header(messages, prefix, source_name):
+    guard = f'{prefix.upper()}_H_'
+    P = prefix.upper()
+    out = [
+        f'/* Generated by gen_can_db.py from {source_name}, do not edit */',
+        f'#ifndef {guard}',
+        f'#define {guard}',
+        '',
+        '#include <stddef.h>',
+        '#include <stdint.h>',
+        '#include <string.h>',
+        '',
+        '#include "bsp_can.h"',
+        '',
+        f'static inline int64_t {prefix}_round(float x)',
+        '{',
+        '    return (int64_t)(x >= 0.0f ? x + 0.5f : x - 0.5f);',
+        '}',
+    ]
+
+    for msg in messages:
+        name = f'{prefix}_{msg.c_name}'
+        N = name.upper()
+        out += [
+            '',
+            '/*****************************************************************************/',
+            f'/* {msg.name} */',
+            f'#define {N}_ID 0x{msg.can_id:X}',
+            f'#define {N}_EXTENDED {int(msg.extended)}',
+            f'#define {N}_DLC {msg.dlc}',
+            '',
+            f'struct {name} {{',
+        ]
+        for sig in msg.signals:
+            unit = f' // [{sig.unit}]' if sig.unit else ''
+            out.append(f'    {sig.c_type} {sig.c_name};{unit}')
+        out += [
+            '};',
+            '',
+            f'static inline void {name}_decode(const uint8_t *d, struct {name} *m)',
+            '{',
+        ]
+        out += [decode_stmt(prefix, sig) for sig in msg.signals]
+        out += [
+            '}',
+            '',
+            f'static inline void {name}_encode(const struct {name} *m, uint8_t *d)',
+            '{',
+            f'    memset(d, 0, {N}_DLC);',
+        ]
+        for sig in msg.signals:
+            out += encode_stmts(prefix, sig)
+        out += [
+            '}',
+            '',
+            f'/// @brief Called from the CAN dispatch thread with every decoded {msg.name}.',
+            '/// The default implementation is weak and does nothing.',
+            f'void {name}_rx(const struct {name} *msg);',
+        ]
+
+    out += [
+        '',
+        '/*****************************************************************************/',
+        f'/// @brief Receive table for bsp_can_attach(), one entry per message',
+        f'extern const struct bsp_can_rx_entry {prefix}_rx_table[];',
+        f'#define {P}_RX_TABLE_SIZE {len(messages)}',
+        '',
+        f'#endif // {guard}',
+        '',
+    ]
+    return '\n'.join(out)
+
+
+def generate_source(messages, prefix, header_name, source_name):
+    out = [
+        f'/* Generated by gen_can_db.py from {source_name}, do not edit */',
+        '#include <errno.h>',
+        '',
+        '#include <zephyr/device.h>',
+        '#include <zephyr/devicetree.h>',
+        '#include <zephyr/drivers/can.h>',
+        '#include <zephyr/init.h>',
+        '#include <zephyr/sys/util.h>',
+        '#include <zephyr/toolchain.h>',
+        '',
+        f'#include "{header_name}"',
+    ]
+
+    for msg in messages:
+        name = f'{prefix}_{msg.c_name}'
+        N = name.upper()
+        out += [
+            '',
+            '/*****************************************************************************/',
+            f'__weak void {name}_rx(const struct {name} *msg)',
+            '{',
+            '    ARG_UNUSED(msg);',
+            '}',
+            '',
+            '/*****************************************************************************/',
+            f'static void rx_{msg.c_name}(const struct device *dev, const struct can_frame *frame,',
+            f'{" " * (len(msg.c_name) + 16)}void *user_data)',
+            '{',
+            '    ARG_UNUSED(dev);',
+            '    ARG_UNUSED(user_data);',
+            '',
+            f'    if (can_dlc_to_bytes(frame->dlc) < {N}_DLC) {{',
+            '        return;',
+            '    }',
+            '',
+            f'    struct {name} msg;',
+            '',
+            f'    {name}_decode(frame->data, &msg);',
+            f'    {name}_rx(&msg);',
+            '}',
+        ]
+
+    out += [
+        '',
+        '/*****************************************************************************/',
+        f'const struct bsp_can_rx_entry {prefix}_rx_table[] = {{',
+    ]
+    for msg in messages:
+        N = f'{prefix}_{msg.c_name}'.upper()
+        if msg.extended:
+            filt = f'.id = {N}_ID, .mask = CAN_EXT_ID_MASK, .flags = CAN_FILTER_IDE'
+        else:
+            filt = f'.id = {N}_ID, .mask = CAN_STD_ID_MASK'
+        out += [
+            '    {',
+            f'        .filter = {{{filt}}},',
+            f'        .handler = rx_{msg.c_name},',
+            '    },',
+        ]
+    out += [
+        '};',
+        '',
+        '#ifdef CONFIG_BSP_CAN_DB_AUTO_ATTACH',
+        '/*****************************************************************************/',
+        f'static int {prefix}_attach(void)',
+        '{',
+        '    const struct device *dev = DEVICE_DT_GET(DT_CHOSEN(zephyr_canbus));',
+        f'    int err = bsp_can_attach(dev, {prefix}_rx_table, {prefix.upper()}_RX_TABLE_SIZE);',
+        '',
+        '    if (err == 0) {',
+        '        err = can_start(dev);',
+        '    }',
+        '',
+        '    return (err == -EALREADY) ? 0 : err;',
+        '}',
+        '',
+        f'SYS_INIT({prefix}_attach, APPLICATION, 34);',
+        '#endif /* CONFIG_BSP_CAN_DB_AUTO_ATTACH */',
+        '',
+    ]
+
+    return '\n'.join(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('--dbc', required=True)
+    parser.add_argument('--header', required=True)
+    parser.add_argument('--source', required=True)
+    parser.add_argument('--prefix', default='can_db')
+    args = parser.parse_args()
+
+    messages = parse_dbc(args.dbc)
+    if not messages:
+        sys.exit(f'{args.dbc}: no messages')
+
+    source_name = os.path.basename(args.dbc)
+    header = generate_header(messages, args.prefix, source_name)
+    source = generate_source(messages, args.prefix, os.path.basename(args.header), source_name)
+
+    for path, text in ((args.header, header), (args.source, source)):
+        os.makedirs(os.path.dirname(os.path.abspath(path)), exist_ok=True)
+        with open(path, 'w', encoding='utf-8') as f:
+            f.write(text)
+
+
+if __name__ == '__main__':
+    main()
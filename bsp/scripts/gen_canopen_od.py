@@ -0,0 +1,442 @@
+#!/usr/bin/env python3
+#
+# Generates a CANopen object dictionary for bsp_canopen from an EDS file.
+#
+# Supported subset: [XXXX] and [XXXXsubN] sections with ObjectType 0x7
+# (VAR), 0x8 (ARRAY) and 0x9 (RECORD), the basic numeric data types and
+# VISIBLE_STRING, AccessType ro/wo/rw/rww/rwr/const, PDOMapping and
+# DefaultValue, including $NODEID+offset in the communication area.
+#
+# Two extensions bind the dictionary to the BSP:
+#   Variable=bsp_pi.din    in an object or sub-object section stores the
+#                          object in a C variable instead of generated
+#                          storage; the size is checked at build time.
+#   [CodeGen] Includes=    comma separated headers declaring those variables.
+#
+# The default mapping of every PDO is resolved into a constant copy list
+# (storage address, frame offset, size), so PDO processing at run time is a
+# fixed sequence of memcpy() without dictionary lookups.
+#
+# Usage: gen_canopen_od.py --eds file.eds --header co_od.h --source co_od.c
+
+import argparse
+import configparser
+import os
+import re
+import sys
+
+OBJ_RE = re.compile(r'^([0-9A-Fa-f]{4})$')
+SUB_RE = re.compile(r'^([0-9A-Fa-f]{4})sub([0-9A-Fa-f]{1,2})$')
+
+VAR, ARRAY, RECORD = 0x7, 0x8, 0x9
+
+# DataType: (C type, size in bytes)
+DATA_TYPES = {
+    0x0001: ('uint8_t', 1),   # BOOLEAN
+    0x0002: ('int8_t', 1),
+    0x0003: ('int16_t', 2),
+    0x0004: ('int32_t', 4),
+    0x0005: ('uint8_t', 1),
+    0x0006: ('uint16_t', 2),
+    0x0007: ('uint32_t', 4),
+    0x0008: ('float', 4),     # REAL32
+    0x0009: ('char', None),   # VISIBLE_STRING
+    0x0015: ('int64_t', 8),
+    0x001B: ('uint64_t', 8),
+}
+UNSIGNED8, UNSIGNED32, VISIBLE_STRING = 0x0005, 0x0007, 0x0009
+
+ACCESS = {
+    'ro': ['READ'],
+    'const': ['READ'],
+    'wo': ['WRITE'],
+    'rw': ['READ', 'WRITE'],
+    'rww': ['READ', 'WRITE'],
+    'rwr': ['READ', 'WRITE'],
+}
+
+PDO_MAP_MAX = 8
+PDO_LEN_MAX = 8
+RPDO_COMM, RPDO_MAP, TPDO_COMM, TPDO_MAP = 0x1400, 0x1600, 0x1800, 0x1A00
+
+
+class Sub:
+    def __init__(self, index, sub, name, data_type, access, default, pdo, variable):
+        self.index = index
+        self.sub = sub
+        self.name = name
+        self.data_type = data_type
+        self.access = access
+        self.default = default
+        self.pdo = pdo
+        self.variable = variable
+        self.storage = f'od_{index:04x}_{sub:02x}'
+
+    @property
+    def c_type(self):
+        return DATA_TYPES[self.data_type][0]
+
+    @property
+    def is_string(self):
+        return self.data_type == VISIBLE_STRING
+
+    @property
+    def size(self):
+        if self.is_string:
+            return max(len(self.default), 1)
+        return DATA_TYPES[self.data_type][1]
+
+    @property
+    def lvalue(self):
+        return f'({self.variable})' if self.variable else self.storage
+
+    @property
+    def address(self):
+        return self.lvalue if self.is_string else f'&{self.lvalue}'
+
+    @property
+    def label(self):
+        return f'0x{self.index:04X} sub {self.sub}'
+
+
+class Pdo:
+    def __init__(self, comm, mapping):
+        self.comm = comm
+        self.mapping = mapping
+        self.copies = []  # (Sub, frame offset)
+        self.len = 0
+
+
+def parse_int(text, where):
+    try:
+        return int(text.strip(), 0)
+    except ValueError:
+        sys.exit(f'{where}: invalid number "{text}"')
+
+
+def parse_sub(path, section, values, index, sub, parent):
+    where = f'{path}: [{section}]'
+
+    data_type = parse_int(values.get('datatype', ''), where)
+    if data_type not in DATA_TYPES:
+        sys.exit(f'{where}: unsupported DataType 0x{data_type:04X}')
+
+    access = values.get('accesstype', 'ro').strip().lower()
+    if access not in ACCESS:
+        sys.exit(f'{where}: unsupported AccessType {access}')
+
+    variable = values.get('variable', '').strip()
+    if not variable and parent is not None:
+        # Array elements may bind to consecutive elements of a C array
+        base = parent.get('variable', '').strip()
+        if base:
+            variable = f'{base}[{sub - 1}]'
+
+    return Sub(index, sub, values.get('parametername', '').strip(), data_type, access,
+               values.get('defaultvalue', '').strip(),
+               parse_int(values.get('pdomapping', '0'), where) != 0, variable)
+
+
+def parse_eds(path):
+    eds = configparser.ConfigParser(interpolation=None, strict=False)
+    with open(path, encoding='utf-8', errors='replace') as f:
+        eds.read_file(f)
+
+    objects = {}
+    for section in eds.sections():
+        m = OBJ_RE.match(section)
+        if not m:
+            continue
+
+        index = int(m.group(1), 16)
+        values = eds[section]
+        object_type = parse_int(values.get('objecttype', '0x7'), f'{path}: [{section}]')
+
+        if object_type == VAR:
+            objects[index] = {0: parse_sub(path, section, values, index, 0, None)}
+        elif object_type in (ARRAY, RECORD):
+            objects[index] = {}
+            for sub_section in eds.sections():
+                s = SUB_RE.match(sub_section)
+                if s and int(s.group(1), 16) == index:
+                    sub = int(s.group(2), 16)
+                    parent = values if object_type == ARRAY and sub else None
+                    objects[index][sub] = parse_sub(path, sub_section, eds[sub_section], index,
+                                                    sub, parent)
+            if 0 not in objects[index]:
+                sys.exit(f'{path}: [{section}] has no sub-index 0')
+        else:
+            sys.exit(f'{path}: [{section}] unsupported ObjectType 0x{object_type:X}')
+
+    includes = []
+    if eds.has_section('CodeGen'):
+        includes = [h.strip() for h in eds['CodeGen'].get('includes', '').split(',') if h.strip()]
+
+    return objects, includes
+
+
+def default_expr(sub, comm_area):
+    text = sub.default
+    if sub.is_string:
+        return '"' + text.replace('\\', '\\\\').replace('"', '\\"') + '"'
+    if not text:
+        return '0'
+    if '$NODEID' in text.upper():
+        if not comm_area:
+            sys.exit(f'{sub.label}: $NODEID is only supported in 0x1000-0x1FFF')
+        return '(' + re.sub(r'\$NODEID', 'node_id', text, flags=re.IGNORECASE) + ')'
+    if sub.data_type == 0x0008:
+        return repr(float(text)) + 'f'
+    value = parse_int(text, sub.label)
+    suffix = 'U' if sub.c_type.startswith('u') else ''
+    if sub.size == 8:
+        suffix += 'LL'
+    return f'0x{value:X}{suffix}' if value >= 0 else f'{value}{suffix}'
+
+
+def pdo_list(objects, comm_base, map_base, tx):
+    pdos = []
+
+    while comm_base + len(pdos) in objects:
+        n = len(pdos)
+        comm = objects[comm_base + n]
+        mapping = objects.get(map_base + n)
+        what = f'{"TPDO" if tx else "RPDO"}{n + 1}'
+
+        if mapping is None:
+            sys.exit(f'{what}: mapping object 0x{map_base + n:04X} missing')
+        for sub, data_type in ((1, UNSIGNED32), (2, UNSIGNED8)):
+            if sub not in comm or comm[sub].data_type != data_type or comm[sub].variable:
+                sys.exit(f'{what}: 0x{comm_base + n:04X} sub {sub} missing or not a plain '
+                         f'{"UNSIGNED32" if sub == 1 else "UNSIGNED8"}')
+        if mapping[0].data_type != UNSIGNED8 or mapping[0].variable:
+            sys.exit(f'{what}: 0x{map_base + n:04X} sub 0 is not a plain UNSIGNED8')
+
+        # All mapping entries exist so a configuration tool can remap the PDO
+        for sub in range(1, PDO_MAP_MAX + 1):
+            entry = mapping.get(sub)
+            if entry is None:
+                mapping[sub] = Sub(map_base + n, sub, f'Mapping entry {sub}', UNSIGNED32, 'rw',
+                                   '', False, '')
+            elif entry.data_type != UNSIGNED32 or entry.variable:
+                sys.exit(f'{what}: 0x{map_base + n:04X} sub {sub} is not a plain UNSIGNED32')
+            mapping[sub].storage = f'od_{map_base + n:04x}_map[{sub - 1}]'
+
+        pdo = Pdo(comm, mapping)
+        count = parse_int(mapping[0].default or '0', f'{what} mapping count')
+        if count > PDO_MAP_MAX:
+            sys.exit(f'{what}: {count} mapped objects, at most {PDO_MAP_MAX}')
+
+        for sub in range(1, count + 1):
+            value = parse_int(mapping[sub].default or '0', f'{what} mapping {sub}')
+            index, obj_sub, bits = value >> 16, (value >> 8) & 0xFF, value & 0xFF
+            target = objects.get(index, {}).get(obj_sub)
+            label = f'{what}: mapped 0x{index:04X} sub {obj_sub}'
+
+            if target is None:
+                sys.exit(f'{label} does not exist')
+            if not target.pdo:
+                sys.exit(f'{label} is not PDO mappable')
+            if ('READ' if tx else 'WRITE') not in ACCESS[target.access]:
+                sys.exit(f'{label} is not {"readable" if tx else "writable"}')
+            if target.is_string or bits != target.size * 8:
+                sys.exit(f'{label} is {target.size * 8} bits, mapped as {bits}')
+            if pdo.len + target.size > PDO_LEN_MAX:
+                sys.exit(f'{what}: mapping exceeds {PDO_LEN_MAX} bytes')
+
+            pdo.copies.append((target, pdo.len))
+            pdo.len += target.size
+
+        pdos.append(pdo)
+
+    return pdos
+
+
+def access_expr(sub):
+    flags = [f'BSP_CANOPEN_ACCESS_{a}' for a in ACCESS[sub.access]]
+    if sub.pdo:
+        flags.append('BSP_CANOPEN_ACCESS_PDO')
+    if sub.is_string:
+        flags.append('BSP_CANOPEN_ACCESS_STRING')
+    return ' | '.join(flags)
+
+
+def generate_header(prefix, rpdos, tpdos, source_name):
+    guard = f'{prefix.upper()}_H_'
+    P = prefix.upper()
+    return '\n'.join([
+        f'/* Generated by gen_canopen_od.py from {source_name}, do not edit */',
+        f'#ifndef {guard}',
+        f'#define {guard}',
+        '',
+        '#include "bsp_canopen.h"',
+        '',
+        f'#define {P}_RPDO_COUNT {len(rpdos)}',
+        f'#define {P}_TPDO_COUNT {len(tpdos)}',
+        '',
+        '/// @brief Object dictionary for bsp_canopen_start()',
+        f'extern const struct bsp_canopen_od {prefix};',
+        '',
+        f'#endif // {guard}',
+        '',
+    ])
+
+
+def generate_source(objects, includes, rpdos, tpdos, prefix, header_name, source_name):
+    subs = [sub for index in sorted(objects) for _, sub in sorted(objects[index].items())]
+    maps = sorted({sub.index for sub in subs if sub.storage.endswith(']')})
+
+    out = [
+        f'/* Generated by gen_canopen_od.py from {source_name}, do not edit */',
+        '#include <string.h>',
+        '',
+        '#include <zephyr/init.h>',
+        '#include <zephyr/sys/util.h>',
+        '#include <zephyr/toolchain.h>',
+        '',
+        f'#include "{header_name}"',
+    ]
+    out += [f'#include "{h}"' for h in includes]
+    out += [
+        '',
+        '/*****************************************************************************/',
+        '/* Object storage */',
+    ]
+
+    for sub in subs:
+        if sub.variable or sub.storage.endswith(']'):
+            continue
+        size = f'[{sub.size}]' if sub.is_string else ''
+        out.append(f'static {sub.c_type} {sub.storage}{size}; // {sub.label} {sub.name}')
+    for index in maps:
+        out.append(f'static uint32_t od_{index:04x}_map[{PDO_MAP_MAX}];')
+
+    asserts = [sub for sub in subs if sub.variable]
+    if asserts:
+        out.append('')
+    for sub in asserts:
+        out.append(f'BUILD_ASSERT(sizeof({sub.variable}) == {sub.size}, '
+                   f'"{sub.label}: {sub.variable} has the wrong size");')
+
+    out += [
+        '',
+        '/*****************************************************************************/',
+        f'static const struct bsp_canopen_od_entry {prefix}_entries[] = {{',
+    ]
+    for sub in subs:
+        out.append(f'    {{0x{sub.index:04X}, 0x{sub.sub:02X}, {access_expr(sub)}, {sub.size}, '
+                   f'{sub.address}}},')
+    out.append('};')
+
+    for kind, pdos in (('rpdo', rpdos), ('tpdo', tpdos)):
+        for n, pdo in enumerate(pdos):
+            out += [
+                '',
+                f'static const struct bsp_canopen_copy {prefix}_{kind}{n + 1}_copies[] = {{',
+            ]
+            for target, offset in pdo.copies:
+                out.append(f'    {{{target.address}, {offset}, {target.size}}}, '
+                           f'// {target.label} {target.name}')
+            if not pdo.copies:
+                out.append('    {0},')
+            out.append('};')
+
+    for kind, pdos in (('rpdo', rpdos), ('tpdo', tpdos)):
+        out += [
+            '',
+            f'static const struct bsp_canopen_pdo {prefix}_{kind}[] = {{',
+        ]
+        for n, pdo in enumerate(pdos):
+            out += [
+                '    {',
+                f'        .cob_id = &{pdo.comm[1].storage},',
+                f'        .trans_type = &{pdo.comm[2].storage},',
+                f'        .map_count = &{pdo.mapping[0].storage},',
+                f'        .map = od_{pdo.mapping[0].index:04x}_map,',
+                f'        .copies = {prefix}_{kind}{n + 1}_copies,',
+                f'        .copies_count = {len(pdo.copies)},',
+                f'        .len = {pdo.len},',
+                '    },',
+            ]
+        if not pdos:
+            out.append('    {0},')
+        out.append('};')
+
+    for name, comm_area in (('reset_comm', True), ('reset_app', False)):
+        arg = 'uint8_t node_id' if comm_area else 'void'
+        out += [
+            '',
+            '/*****************************************************************************/',
+            f'static void {prefix}_{name}({arg})',
+            '{',
+        ]
+        if comm_area and not any('$NODEID' in sub.default.upper() for sub in subs):
+            out.append('    ARG_UNUSED(node_id);')
+        for sub in subs:
+            if (sub.index < 0x2000) != comm_area or (sub.variable and not sub.default):
+                continue
+            value = default_expr(sub, comm_area)
+            if sub.is_string:
+                out.append(f'    memcpy({sub.lvalue}, {value}, {sub.size});')
+            else:
+                out.append(f'    {sub.lvalue} = {value};')
+        out.append('}')
+
+    P = prefix.upper()
+    out += [
+        '',
+        '/*****************************************************************************/',
+        f'const struct bsp_canopen_od {prefix} = {{',
+        f'    .entries = {prefix}_entries,',
+        f'    .count = ARRAY_SIZE({prefix}_entries),',
+        f'    .rpdo = {prefix}_rpdo,',
+        f'    .rpdo_count = {P}_RPDO_COUNT,',
+        f'    .tpdo = {prefix}_tpdo,',
+        f'    .tpdo_count = {P}_TPDO_COUNT,',
+        f'    .reset_comm = {prefix}_reset_comm,',
+        f'    .reset_app = {prefix}_reset_app,',
+        '};',
+        '',
+        '#ifdef CONFIG_BSP_CANOPEN_AUTO_START',
+        '/*****************************************************************************/',
+        f'static int {prefix}_start(void)',
+        '{',
+        f'    return bsp_canopen_start(&{prefix}, CONFIG_BSP_CANOPEN_NODE_ID);',
+        '}',
+        '',
+        f'SYS_INIT({prefix}_start, APPLICATION, 34);',
+        '#endif /* CONFIG_BSP_CANOPEN_AUTO_START */',
+        '',
+    ]
+
+    return '\n'.join(out)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('--eds', required=True)
+    parser.add_argument('--header', required=True)
+    parser.add_argument('--source', required=True)
+    parser.add_argument('--prefix', default='co_od')
+    args = parser.parse_args()
+
+    objects, includes = parse_eds(args.eds)
+    if not objects:
+        sys.exit(f'{args.eds}: no objects')
+
+    rpdos = pdo_list(objects, RPDO_COMM, RPDO_MAP, False)
+    tpdos = pdo_list(objects, TPDO_COMM, TPDO_MAP, True)
+
+    source_name = os.path.basename(args.eds)
+    header = generate_header(args.prefix, rpdos, tpdos, source_name)
+    source = generate_source(objects, includes, rpdos, tpdos, args.prefix,
+                             os.path.basename(args.header), source_name)
+
+    for path, text in ((args.header, header), (args.source, source)):
+        os.makedirs(os.path.dirname(os.path.abspath(path)), exist_ok=True)
+        with open(path, 'w', encoding='utf-8') as f:
+            f.write(text)
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,115 @@
+#!/usr/bin/env python3
+#
+# Receives the UDP telemetry stream of bsp_telem.c, checks the sequence
+# numbers and prints the rate once per second.
+#
+# On native_sim with offloaded sockets the stream reaches the host directly:
+#   telem dest 127.0.0.1 5600
+#   nafe_sim ... ; telem sim on
+#   telem_rx.py --port 5600
+#
+# Usage: telem_rx.py [--port N] [--print]
+
+import argparse
+import socket
+import struct
+import sys
+import time
+
+TELEM_MAGIC = 0x5456
+TELEM_FORMAT_VERSION = 3
+TELEM_FLAG_PTP = 0x01
+HEADER = struct.Struct('<HBBIQHHB3x')
+RECORD = struct.Struct('<BBHi')
+
+TYPE_NAFE = 1
+TYPE_DIN = 2
+TYPE_CAN_STATS = 3
+
+DIN = struct.Struct('<BBxx')
+CAN_STATS = struct.Struct('<HBxIIIII')
+
+
+def records(data, header_size):
+    pos = header_size
+    while pos + RECORD.size <= len(data):
+        rtype, source, length, dt_ns = RECORD.unpack_from(data, pos)
+        pos += RECORD.size
+        yield rtype, source, dt_ns, data[pos:pos + length]
+        pos += (length + 3) & ~3
+
+
+def describe(rtype, source, payload):
+    if rtype == TYPE_NAFE:
+        codes = struct.unpack('<%di' % (len(payload) // 4), payload)
+        return 'nafe ch%u %u codes, first %d' % (source, len(codes), codes[0])
+    if rtype == TYPE_DIN:
+        din, valid = DIN.unpack(payload)
+        return 'din 0x%02x valid 0x%02x' % (din, valid)
+    if rtype == TYPE_CAN_STATS:
+        load, state, rx, tx, tx_err, overruns, bus_off = CAN_STATS.unpack(payload)
+        return 'can%u load %u.%u%% state %u rx %u tx %u tx errors %u overruns %u bus off %u' % (
+            source, load // 10, load % 10, state, rx, tx, tx_err, overruns, bus_off)
+    return 'type %u source %u, %u bytes' % (rtype, source, len(payload))
+
+
+def main():
+    parser = argparse.ArgumentParser(description='bsp_telem UDP receiver')
+    parser.add_argument('--port', type=int, default=5600)
+    parser.add_argument('--print', action='store_true', help='print every record')
+    args = parser.parse_args()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 4 << 20)
+    sock.bind(('', args.port))
+    sock.settimeout(1.0)
+
+    expected = None
+    lost = dropped = 0
+    window = {'datagrams': 0, 'bytes': 0, 'samples': 0}
+    last = time.monotonic()
+
+    while True:
+        try:
+            data = sock.recv(65536)
+        except socket.timeout:
+            data = None
+
+        if data:
+            (magic, version, header_size, seq, time_ns, count, drop,
+             flags) = HEADER.unpack_from(data)
+            if magic != TELEM_MAGIC or version != TELEM_FORMAT_VERSION:
+                print('Unknown datagram, %u bytes' % len(data), file=sys.stderr)
+                continue
+
+            if expected is not None and seq != expected:
+                lost += (seq - expected) & 0xFFFFFFFF
+            expected = (seq + 1) & 0xFFFFFFFF
+            dropped += drop
+
+            window['datagrams'] += 1
+            window['bytes'] += len(data)
+            for rtype, source, dt_ns, payload in records(data, header_size):
+                if rtype == TYPE_NAFE:
+                    window['samples'] += len(payload) // 4
+                if args.print:
+                    t = time_ns + dt_ns
+                    print('%s %u.%09u %s' % ('ptp' if flags & TELEM_FLAG_PTP else 'up ',
+                                            t // 1000000000, t % 1000000000,
+                                            describe(rtype, source, payload)))
+
+        now = time.monotonic()
+        if now - last >= 1.0:
+            dt = now - last
+            print('%7.0f datagrams/s %9.1f kB/s %9.0f samples/s, lost %u datagrams, '
+                  'dropped %u records' % (window['datagrams'] / dt, window['bytes'] / dt / 1000,
+                                          window['samples'] / dt, lost, dropped))
+            window = dict.fromkeys(window, 0)
+            last = now
+
+
+if __name__ == '__main__':
+    try:
+        main()
+    except KeyboardInterrupt:
+        pass